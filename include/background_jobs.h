@@ -0,0 +1,130 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * background_jobs.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef DFW_FIELD_TRIAL_SERVICE_BACKGROUND_JOBS_H_
+#define DFW_FIELD_TRIAL_SERVICE_BACKGROUND_JOBS_H_
+
+#include "dfw_field_trial_service_data.h"
+#include "dfw_field_trial_service_library.h"
+#include "service_job.h"
+#include "typedefs.h"
+
+#include "jansson.h"
+
+
+/**
+ * The default maximum number of heavy jobs that can run at the same
+ * time. Any others wait in a queue until a worker is free.
+ */
+#define BJ_DEFAULT_MAX_NUM_JOBS (2)
+
+
+/**
+ * A job that is running on the pool of background workers.
+ */
+typedef struct BackgroundJob BackgroundJob;
+
+
+/**
+ * The function that does the work of a background job.
+ *
+ * @param job_p The ServiceJob to report the results, errors and status to.
+ * When the job is running in the background, this is the worker's own
+ * ServiceJob with the same service, id and name as the one that was
+ * submitted and its output is copied across when the job finishes.
+ * @param params_p The JSON object of the values that the job needs. The
+ * ParameterSet that the job was submitted with will have been freed by
+ * the time the job runs so these must have been copied out of it.
+ * @param data_p The configuration data for the service. When the job is
+ * running in the background, this has its own MongoTool and DocumentCache.
+ * @return <code>true</code> if the job ran successfully, <code>false</code> otherwise.
+ */
+typedef bool (*BackgroundJobFn) (ServiceJob *job_p, const json_t *params_p, FieldTrialServiceData *data_p);
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Queue a job to run on the pool of background workers. The ServiceJob's
+ * status is set to OS_PENDING and it is given an update function so that
+ * polling it reports whether the job is queued or running along with its
+ * progress. When the job has finished, the next poll copies its status,
+ * results, errors and metadata into the ServiceJob.
+ *
+ * The number of jobs that run at once is set by the "max_background_jobs"
+ * configuration value and defaults to BJ_DEFAULT_MAX_NUM_JOBS. If this is 0,
+ * or the job can't be queued, the job is run straight away in the calling
+ * thread instead.
+ *
+ * The Service that the ServiceJob belongs to must stay alive until the job has
+ * finished, so it should be SY_ASYNCHRONOUS_DETACHED. If the job's output
+ * isn't collected within the time set by the "background_job_expiry"
+ * configuration value, which defaults to a day, it is discarded.
+ *
+ * @param job_p The ServiceJob to run.
+ * @param run_fn The function that does the work.
+ * @param params_p The values for run_fn. This will be incremented rather than
+ * copied so it must not be altered afterwards.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the job was queued or, if it was run straight
+ * away, it ran successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool RunBackgroundServiceJob (ServiceJob *job_p, BackgroundJobFn run_fn, json_t *params_p, FieldTrialServiceData *data_p);
+
+
+/**
+ * Get the BackgroundJob that a BackgroundJobFn is running as so that
+ * its progress can be set. This should be called once, before the job
+ * starts its work, rather than for each row.
+ *
+ * @param job_p The ServiceJob that was passed to the BackgroundJobFn.
+ * @return The BackgroundJob or <code>NULL</code> if the job isn't running
+ * in the background.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL BackgroundJob *GetBackgroundJob (ServiceJob *job_p);
+
+
+/**
+ * Record how far through its rows a job is. This is cheap to call for
+ * every row as the progress that polling sees is only updated every
+ * second or so and when the last row is reached.
+ *
+ * @param bg_job_p The BackgroundJob from GetBackgroundJob(). If this is
+ * <code>NULL</code>, this does nothing so it is safe to call from code
+ * that runs both in the background and straight away.
+ * @param num_rows_processed The number of rows that have been processed.
+ * @param num_rows The total number of rows or 0 if this isn't known.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void SetBackgroundJobProgress (BackgroundJob *bg_job_p, const size_t num_rows_processed, const size_t num_rows);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DFW_FIELD_TRIAL_SERVICE_BACKGROUND_JOBS_H_ */
@@ -0,0 +1,156 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * change_tracking.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef DFW_FIELD_TRIAL_SERVICE_CHANGE_TRACKING_H_
+#define DFW_FIELD_TRIAL_SERVICE_CHANGE_TRACKING_H_
+
+#include "dfw_field_trial_service_data.h"
+#include "dfw_field_trial_service_library.h"
+#include "typedefs.h"
+
+#include <time.h>
+
+#include "jansson.h"
+
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#ifdef ALLOCATE_CHANGE_TRACKING_TAGS
+	#define CHANGE_TRACKING_PREFIX DFW_FIELD_TRIAL_SERVICE_LOCAL
+	#define CHANGE_TRACKING_VAL(x)	= x
+#else
+	#define CHANGE_TRACKING_PREFIX extern
+	#define CHANGE_TRACKING_VAL(x)
+#endif
+
+#endif 		/* #ifndef DOXYGEN_SHOULD_SKIP_THIS */
+
+
+/**
+ * The key for the modification marker that is added to each
+ * document when it is saved.
+ */
+CHANGE_TRACKING_PREFIX const char *CT_MODIFICATION_S CHANGE_TRACKING_VAL ("modification");
+
+
+/**
+ * The key for the time, in seconds since the epoch, at which a
+ * document was last stamped with a modification marker.
+ */
+CHANGE_TRACKING_PREFIX const char *CT_MODIFIED_AT_S CHANGE_TRACKING_VAL ("modified_at");
+
+
+/**
+ * The collection used to store the modification counter and
+ * the incremental indexing checkpoints.
+ */
+CHANGE_TRACKING_PREFIX const char *CT_INDEXING_STATE_S CHANGE_TRACKING_VAL ("IndexingState");
+
+
+/**
+ * The key for the ids of the documents that were in the index
+ * when a checkpoint was stored.
+ */
+CHANGE_TRACKING_PREFIX const char *CT_INDEXED_IDS_S CHANGE_TRACKING_VAL ("indexed_ids");
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Add the next modification marker to a document that is about to
+ * be saved. The markers come from a counter stored in the database
+ * so they increase monotonically across all of the datatypes. The
+ * current time is added too so that the document can be compared
+ * with things that only have a timestamp such as cache files.
+ *
+ * @param doc_p The document to stamp.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the document was stamped successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool StampModification (json_t *doc_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Get the most recent modification marker without changing it.
+ *
+ * @param modification_p Where the marker will be stored. If nothing
+ * has been stamped yet, this will be 0.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the marker was read successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool GetCurrentModification (int64 *modification_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Get the incremental indexing checkpoint for an index.
+ *
+ * @param name_s The name of the index, e.g. "index_studies".
+ * @param modification_p Where the modification marker of the checkpoint
+ * will be stored. If there is no checkpoint, this will be -1.
+ * @param time_p Where the time at which the checkpoint's marker was read
+ * will be stored. If the checkpoint doesn't have one, this will be 0.
+ * @param indexed_ids_pp Where the JSON array of the ids that were indexed at the
+ * checkpoint will be stored. If there is no checkpoint, this will be <code>NULL</code>.
+ * The caller must json_decref() this.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the checkpoint was read successfully or there isn't
+ * one, <code>false</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool GetIndexingCheckpoint (const char *name_s, int64 *modification_p, time_t *time_p, json_t **indexed_ids_pp, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Store the incremental indexing checkpoint for an index, replacing
+ * any previous one.
+ *
+ * @param name_s The name of the index, e.g. "index_studies".
+ * @param modification The modification marker that the index is up to date with.
+ * @param checkpoint_time The time at which the modification marker was read.
+ * @param indexed_ids_p The JSON array of the ids that are now in the index.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the checkpoint was stored successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool SetIndexingCheckpoint (const char *name_s, const int64 modification, const time_t checkpoint_time, const json_t *indexed_ids_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Create the indexes on the modification markers and times of each of
+ * the change-tracked collections so that the changed documents can be
+ * found without scanning the whole collection.
+ *
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if all of the indexes exist, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddModificationIndexes (const FieldTrialServiceData *data_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DFW_FIELD_TRIAL_SERVICE_CHANGE_TRACKING_H_ */
@@ -0,0 +1,284 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * delimited_table.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef DFW_FIELD_TRIAL_SERVICE_DELIMITED_TABLE_H_
+#define DFW_FIELD_TRIAL_SERVICE_DELIMITED_TABLE_H_
+
+#include "dfw_field_trial_service_library.h"
+#include "typedefs.h"
+
+#include "jansson.h"
+
+
+/**
+ * A cell in a row of a delimited table. The value points into the
+ * table's text rather than being a copy of it so it is not
+ * <code>NUL</code>-terminated.
+ */
+typedef struct DelimitedTableCell
+{
+	/** The start of the cell's value. */
+	const char *dtc_value_s;
+
+	/** The length of the cell's value. */
+	size_t dtc_length;
+
+	/**
+	 * If this is <code>true</code>, the value was quoted and contains
+	 * doubled quotes that need unescaping before it can be used.
+	 */
+	bool dtc_escaped_flag;
+} DelimitedTableCell;
+
+
+/**
+ * A reader that tokenises CSV or TSV text one row at a time.
+ * Quoted cells may contain delimiters, newlines and doubled quotes.
+ */
+typedef struct DelimitedTableReader
+{
+	/** Where the next row starts. */
+	const char *dtr_next_s;
+
+	/** Where the current row starts. */
+	const char *dtr_row_s;
+
+	/** The character between the cells in a row. */
+	char dtr_delimiter;
+
+	/** The cells of the current row. */
+	DelimitedTableCell *dtr_cells_p;
+
+	/** The number of cells in the current row. */
+	size_t dtr_num_cells;
+
+	/** The number of cells that dtr_cells_p has room for. */
+	size_t dtr_max_num_cells;
+
+	/** The number of rows that have been read including the header. */
+	size_t dtr_num_rows_read;
+
+	/**
+	 * The buffer that the cells of the current row are copied into
+	 * when they are needed as <code>NUL</code>-terminated strings. It
+	 * is reused for every row and only grows for longer rows.
+	 */
+	char *dtr_buffer_s;
+
+	/** The size of dtr_buffer_s. */
+	size_t dtr_buffer_size;
+
+	/** This is set to <code>true</code> if the text couldn't be read. */
+	bool dtr_error_flag;
+} DelimitedTableReader;
+
+
+/**
+ * A point in a delimited table that a DelimitedTableReader can
+ * go back to so that some rows can be read more than once.
+ */
+typedef struct DelimitedTablePosition
+{
+	/** Where the next row starts. */
+	const char *dtp_next_s;
+
+	/** The number of rows that had been read. */
+	size_t dtp_num_rows_read;
+} DelimitedTablePosition;
+
+
+/**
+ * The column headings from the first row of a delimited table.
+ */
+typedef struct DelimitedTableHeader
+{
+	/** The headings in column order. */
+	char **dth_headings_ss;
+
+	/** The number of headings. */
+	size_t dth_num_headings;
+} DelimitedTableHeader;
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Initialise a DelimitedTableReader.
+ *
+ * @param reader_p The DelimitedTableReader to initialise.
+ * @param data_s The text to read. This must stay valid for as long as
+ * the reader and any of its cells are used.
+ * @param delimiter The character between the cells in a row.
+ * @return <code>true</code> if the reader was initialised successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool InitDelimitedTableReader (DelimitedTableReader *reader_p, const char *data_s, const char delimiter);
+
+
+/**
+ * Free the memory used by a DelimitedTableReader.
+ *
+ * @param reader_p The DelimitedTableReader to clear.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void ClearDelimitedTableReader (DelimitedTableReader *reader_p);
+
+
+/**
+ * Read the next row of a delimited table. The cells of the row are
+ * available in the reader until the next call.
+ *
+ * @param reader_p The DelimitedTableReader to use.
+ * @return <code>true</code> if a row was read, <code>false</code> if
+ * there are no more rows or upon error, in which case dtr_error_flag
+ * will be set.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool ReadDelimitedTableRow (DelimitedTableReader *reader_p);
+
+
+/**
+ * Check whether the current row of a DelimitedTableReader has any
+ * non-empty cells.
+ *
+ * @param reader_p The DelimitedTableReader to check.
+ * @return <code>true</code> if every cell is empty, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool IsDelimitedTableRowEmpty (const DelimitedTableReader *reader_p);
+
+
+/**
+ * Get an upper bound for the number of rows in some delimited text
+ * without tokenising it.
+ *
+ * @param data_s The text.
+ * @return The maximum number of rows, including the header, that
+ * the text can hold.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL size_t GetMaximumNumberOfDelimitedTableRows (const char *data_s);
+
+
+/**
+ * Read the first row of a delimited table as its column headings.
+ *
+ * @param reader_p The DelimitedTableReader to use.
+ * @param header_p The DelimitedTableHeader to fill in. This should be
+ * freed with ClearDelimitedTableHeader().
+ * @return <code>true</code> if the headings were read successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool ReadDelimitedTableHeader (DelimitedTableReader *reader_p, DelimitedTableHeader *header_p);
+
+
+/**
+ * Free the memory used by a DelimitedTableHeader.
+ *
+ * @param header_p The DelimitedTableHeader to clear.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void ClearDelimitedTableHeader (DelimitedTableHeader *header_p);
+
+
+/**
+ * Get the position of a column in a delimited table.
+ *
+ * @param header_p The DelimitedTableHeader to search.
+ * @param heading_s The heading of the column.
+ * @return The index of the column or -1 if the table doesn't have it.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL int32 GetDelimitedTableColumnIndex (const DelimitedTableHeader *header_p, const char *heading_s);
+
+
+/**
+ * Get the position of the next row that a DelimitedTableReader will read.
+ *
+ * @param reader_p The DelimitedTableReader.
+ * @param position_p The DelimitedTablePosition to fill in.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void GetDelimitedTablePosition (const DelimitedTableReader *reader_p, DelimitedTablePosition *position_p);
+
+
+/**
+ * Move a DelimitedTableReader back to a position from GetDelimitedTablePosition()
+ * so that the next call to ReadDelimitedTableRow() reads the row there again.
+ * Any read error is cleared as the rows before it can still be read.
+ *
+ * @param reader_p The DelimitedTableReader.
+ * @param position_p The DelimitedTablePosition to go back to.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void SetDelimitedTablePosition (DelimitedTableReader *reader_p, const DelimitedTablePosition *position_p);
+
+
+/**
+ * Get the value of a cell in the current row of a DelimitedTableReader
+ * as a <code>NUL</code>-terminated string. The value is copied into
+ * the reader's row buffer rather than being allocated.
+ *
+ * @param reader_p The DelimitedTableReader.
+ * @param column_index The index of the cell's column.
+ * @return The value which is valid until the next row is read or
+ * <code>NULL</code> if the cell is missing or empty.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL const char *GetDelimitedTableCellValue (DelimitedTableReader *reader_p, const int32 column_index);
+
+
+/**
+ * Get the value of a cell in the current row of a DelimitedTableReader
+ * as an integer.
+ *
+ * @param reader_p The DelimitedTableReader.
+ * @param column_index The index of the cell's column.
+ * @param value_p Where the value will be stored.
+ * @return <code>true</code> if the cell holds a valid integer,
+ * <code>false</code> if it is missing, empty or invalid.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool GetDelimitedTableCellAsInteger (DelimitedTableReader *reader_p, const int32 column_index, int32 *value_p);
+
+
+/**
+ * Get a copy of the value of a cell.
+ *
+ * @param cell_p The DelimitedTableCell.
+ * @return The newly-allocated value which should be freed with
+ * FreeCopiedString() or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL char *CopyDelimitedTableCell (const DelimitedTableCell *cell_p);
+
+
+/**
+ * Get the current row of a DelimitedTableReader as a JSON object
+ * in the same form as a row of a JSON table parameter. Only the
+ * non-empty cells are added.
+ *
+ * @param reader_p The DelimitedTableReader.
+ * @param header_p The column headings for the table.
+ * @return The JSON object or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetDelimitedTableRowAsJSON (const DelimitedTableReader *reader_p, const DelimitedTableHeader *header_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DFW_FIELD_TRIAL_SERVICE_DELIMITED_TABLE_H_ */
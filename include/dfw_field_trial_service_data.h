@@ -35,6 +35,10 @@
 #include "mongodb_tool.h"
 #include "sqlite_tool.h"
 
+
+struct DocumentCache;
+struct ReferenceCache;
+
 typedef enum
 {
 	DFTD_PROGRAM,
@@ -141,6 +145,25 @@ typedef struct /*DFW_FIELD_TRIAL_SERVICE_LOCAL*/ FieldTrialServiceData
 	const char *dftsd_study_cache_path_s;
 
 
+	/**
+	 * @private
+	 *
+	 * Should the cached studies be saved in the compressed
+	 * format rather than as plain JSON files?
+	 */
+	bool dftsd_study_cache_compression_flag;
+
+
+	/**
+	 * @private
+	 *
+	 * Should each Observation also be written to its own document
+	 * in the Observations collection so that it can be queried
+	 * without loading the Plot that it belongs to?
+	 */
+	bool dftsd_observations_collection_flag;
+
+
 	/**
 	 * @private
 	 *
@@ -160,6 +183,25 @@ typedef struct /*DFW_FIELD_TRIAL_SERVICE_LOCAL*/ FieldTrialServiceData
 	const char *dftsd_fd_url_s;
 
 
+	/**
+	 * @private
+	 *
+	 * The raw documents that have been prefetched in bulk
+	 * so that references to them can be resolved without
+	 * a separate query for each one.
+	 */
+	struct DocumentCache *dftsd_document_cache_p;
+
+
+	/**
+	 * @private
+	 *
+	 * The process-wide cache of the slowly-changing datatypes
+	 * such as MeasuredVariables, Crops and Locations.
+	 */
+	struct ReferenceCache *dftsd_reference_cache_p;
+
+
 } FieldTrialServiceData;
 
 
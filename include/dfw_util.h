@@ -77,6 +77,70 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetCachedStudy (const char *id_s, const Fi
 DFW_FIELD_TRIAL_SERVICE_LOCAL bool ClearCachedStudy (const char *id_s, const FieldTrialServiceData *data_p);
 
 
+/**
+ * Check whether a Study is cached either in memory or on disk
+ * without loading it.
+ *
+ * @param id_s The id of the Study.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the Study is cached, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool IsStudyCached (const char *id_s, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Get the time at which a Study's cache file was written.
+ *
+ * @param id_s The id of the Study.
+ * @param time_p Where the modification time of the file will be stored.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the Study has a cache file, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool GetCachedStudyTime (const char *id_s, time_t *time_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Register the calling thread as the one rebuilding a cached Study.
+ * If another thread is already rebuilding it, then this blocks until
+ * that thread has finished.
+ *
+ * @param id_s The id of the Study.
+ * @return <code>true</code> if the caller should build the Study and
+ * then call EndStudyCacheBuild(), <code>false</code> if another thread
+ * has just finished building it and the caller should check the
+ * cache again.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool BeginStudyCacheBuild (const char *id_s);
+
+
+/**
+ * Mark the rebuild of a cached Study started by BeginStudyCacheBuild()
+ * as finished and wake up any threads that are waiting for it.
+ *
+ * @param id_s The id of the Study.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void EndStudyCacheBuild (const char *id_s);
+
+
+/**
+ * Splice updated Plots into a cached Study rather than clearing the
+ * whole Study from the cache. Any Plot that is already in the cached
+ * Study, matched by its id or its row and column, is replaced and any
+ * others are inserted in row and column order. If the Study isn't
+ * cached, this does nothing. If the patch can't be applied, the cached
+ * Study is cleared instead.
+ *
+ * @param study_id_s The id of the Study.
+ * @param plots_p A JSON object whose keys are Plot ids and whose values
+ * are the VF_CLIENT_FULL JSON for those Plots.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the cached Study was patched or cleared
+ * successfully, <code>false</code> otherwise.
+ * @see AddPlotToCachedStudyPatch
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool PatchCachedStudyPlots (const char *study_id_s, const json_t *plots_p, const FieldTrialServiceData *data_p);
+
+
 DFW_FIELD_TRIAL_SERVICE_LOCAL bool FindAndAddResultToServiceJob (const char *id_s, const ViewFormat format, ServiceJob *job_p, JSONProcessor *processor_p,
 																																 json_t *(get_json_fn) (const char *id_s, const ViewFormat format, JSONProcessor *processor_p, char **name_ss, const FieldTrialServiceData *data_p),
 																																 const DFWFieldTrialData datatype, const FieldTrialServiceData *data_p);
@@ -99,6 +163,38 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL char *GetFrictionlessDataFilename (const char * co
 DFW_FIELD_TRIAL_SERVICE_LOCAL char *GetFrictionlessDataURL (const char *const name_s, const FieldTrialServiceData *data_p);
 
 
+/**
+ * Get the ids of all of the documents of a given datatype.
+ *
+ * @param datatype The datatype to get the ids for.
+ * @param data_p The configuration data for the service.
+ * @return A JSON array of the id strings or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetAllIdsAsJSON (const DFWFieldTrialData datatype, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Make a copy of the service's configuration data for use on another
+ * thread. The MongoTool and DocumentCache aren't thread-safe so the copy
+ * gets its own ones of these, and everything else is shared.
+ *
+ * @param data_p The configuration data for the service.
+ * @param grassroots_p The GrassrootsServer to get the MongoDB connection from.
+ * @return The new copy which should be freed with FreeWorkerServiceData()
+ * or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL FieldTrialServiceData *AllocateWorkerServiceData (const FieldTrialServiceData *data_p, GrassrootsServer *grassroots_p);
+
+
+/**
+ * Free a copy of the service's configuration data made by
+ * AllocateWorkerServiceData().
+ *
+ * @param worker_data_p The copy to free.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void FreeWorkerServiceData (FieldTrialServiceData *worker_data_p);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,175 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * document_cache.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef DFW_FIELD_TRIAL_SERVICE_DOCUMENT_CACHE_H_
+#define DFW_FIELD_TRIAL_SERVICE_DOCUMENT_CACHE_H_
+
+#include "dfw_field_trial_service_data.h"
+
+#include "jansson.h"
+
+
+/**
+ * A set of raw Mongo documents, grouped by datatype and
+ * keyed by their ids. This lets us resolve the references
+ * from a batch of documents, e.g. the materials and measured
+ * variables used by all of the plots in a Study, with a single
+ * query per collection rather than a query per reference.
+ */
+typedef struct DocumentCache
+{
+	/**
+	 * @private
+	 *
+	 * For each datatype, a JSON object whose keys are the
+	 * document ids and whose values are the documents.
+	 */
+	json_t *dc_docs_pp [DFTD_NUM_TYPES];
+
+	/**
+	 * @private
+	 *
+	 * The number of currently open scopes. Whilst this is greater
+	 * than zero, every document fetched by id is kept so that
+	 * subsequent lookups of it within the same request don't
+	 * need to go back to the database.
+	 */
+	uint32 dc_scope_depth;
+} DocumentCache;
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+DFW_FIELD_TRIAL_SERVICE_LOCAL DocumentCache *AllocateDocumentCache (void);
+
+
+DFW_FIELD_TRIAL_SERVICE_LOCAL void FreeDocumentCache (DocumentCache *cache_p);
+
+
+DFW_FIELD_TRIAL_SERVICE_LOCAL void ClearDocumentCache (DocumentCache *cache_p);
+
+
+/**
+ * Start a scope, e.g. for the lifetime of a ServiceJob, during which
+ * the cache will act as an identity map for all documents fetched by id.
+ * Scopes can be nested and the cache is only cleared when the outermost
+ * one is ended.
+ *
+ * @param cache_p The DocumentCache to use.
+ * @see EndDocumentCacheScope
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void BeginDocumentCacheScope (DocumentCache *cache_p);
+
+
+/**
+ * End a scope started with BeginDocumentCacheScope(). If this is the
+ * outermost scope then all of the cached documents are released.
+ *
+ * @param cache_p The DocumentCache to use.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void EndDocumentCacheScope (DocumentCache *cache_p);
+
+
+/**
+ * Keep a document that has just been fetched from the database if there is
+ * a currently open scope, otherwise do nothing.
+ *
+ * @param cache_p The DocumentCache to use.
+ * @param datatype The type of the document.
+ * @param doc_p The document. The cache will take a new reference to this.
+ * @return <code>false</code> if there was an open scope and the document
+ * could not be added, <code>true</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddDocumentToDocumentCacheScope (DocumentCache *cache_p, const DFWFieldTrialData datatype, json_t *doc_p);
+
+
+/**
+ * Get a previously cached document.
+ *
+ * @param cache_p The DocumentCache to search.
+ * @param datatype The type of the document.
+ * @param id_p The id of the document.
+ * @return The cached document or <code>NULL</code> if it is not in the cache.
+ * This belongs to the cache so should not be altered or freed.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL const json_t *GetDocumentFromDocumentCache (const DocumentCache *cache_p, const DFWFieldTrialData datatype, const bson_oid_t *id_p);
+
+
+/**
+ * Add a document to the cache using its "_id" value as its key.
+ *
+ * @param cache_p The DocumentCache to add the document to.
+ * @param datatype The type of the document.
+ * @param doc_p The document to add. The cache will take a new reference to this.
+ * @return <code>true</code> if the document was added successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddDocumentToDocumentCache (DocumentCache *cache_p, const DFWFieldTrialData datatype, json_t *doc_p);
+
+
+/**
+ * Add the id stored under the given key of a JSON object to a set of
+ * ids that will be fetched by PrefetchDocumentsIntoDocumentCache().
+ *
+ * @param ids_p The JSON object used as the set of ids.
+ * @param json_p The JSON object containing the reference.
+ * @param key_s The key for the reference within json_p.
+ * @return <code>true</code> if the id was added or json_p has no value
+ * for key_s, <code>false</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddReferencedIdToSet (json_t *ids_p, const json_t *json_p, const char *key_s);
+
+
+/**
+ * Fetch all of the given documents that are not already cached with a single
+ * query and add them to the cache.
+ *
+ * @param cache_p The DocumentCache to add the documents to.
+ * @param datatype The type of the documents.
+ * @param ids_p The JSON object whose keys are the ids to fetch.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the query ran successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool PrefetchDocumentsIntoDocumentCache (DocumentCache *cache_p, const DFWFieldTrialData datatype, const json_t *ids_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Create a query that matches all documents whose value for the given key
+ * is one of a set of ids.
+ *
+ * @param key_s The key to match against, e.g. "_id".
+ * @param ids_p The JSON object whose keys are the ids to match.
+ * @return The query which the caller must bson_destroy() or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bson_t *GetIdsInQuery (const char *key_s, const json_t *ids_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DFW_FIELD_TRIAL_SERVICE_DOCUMENT_CACHE_H_ */
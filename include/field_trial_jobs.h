@@ -81,6 +81,17 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL bool SetUpFieldTrialsListParameter (const FieldTri
 DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetFieldTrialIndexingData (Service *service_p);
 
 
+/**
+ * Convert a batch of raw Field Trials documents, in place, into the form
+ * used for indexing.
+ *
+ * @param trials_p The JSON array of documents to convert.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if all of the documents were converted successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool PrepareFieldTrialsForIndexing (json_t *trials_p, const FieldTrialServiceData *data_p);
+
+
 DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetAllFieldTrialsAsJSON (const FieldTrialServiceData *data_p, bson_t *opts_p);
 
 
@@ -44,6 +44,18 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL	OperationStatus IndexData (ServiceJob *job_p, cons
 DFW_FIELD_TRIAL_SERVICE_LOCAL OperationStatus ReindexAllData (ServiceJob *job_p, const bool update_flag, const FieldTrialServiceData *service_data_p);
 
 
+/**
+ * Reindex only the documents that have been saved since the last
+ * successful run of this and remove the index entries for any
+ * documents that have since been deleted.
+ *
+ * @param job_p The ServiceJob to update with the result.
+ * @param service_data_p The configuration data for the service.
+ * @return The status of the reindexing.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL OperationStatus ReindexChangedData (ServiceJob *job_p, const FieldTrialServiceData *service_data_p);
+
+
 DFW_FIELD_TRIAL_SERVICE_LOCAL OperationStatus ReindexStudies (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p);
 
 
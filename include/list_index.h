@@ -0,0 +1,145 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * list_index.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef DFW_FIELD_TRIAL_SERVICE_LIST_INDEX_H_
+#define DFW_FIELD_TRIAL_SERVICE_LIST_INDEX_H_
+
+#include "dfw_field_trial_service_library.h"
+#include "linked_list.h"
+#include "typedefs.h"
+
+
+/**
+ * The value to start a hash with before calling HashListIndexBytes().
+ */
+#define LI_HASH_SEED (2166136261u)
+
+
+/**
+ * An entry in a bucket of a ListIndex.
+ */
+typedef struct ListIndexEntry
+{
+	/** The ListItem that this entry points to. This is not owned by the entry. */
+	ListItem *lie_item_p;
+
+	/** The full hash of the ListItem's key. */
+	uint32 lie_hash;
+
+	/** The next entry in the same bucket. */
+	struct ListIndexEntry *lie_next_p;
+} ListIndexEntry;
+
+
+/**
+ * A hash index over the ListItems of a LinkedList so that an item
+ * with a given key can be found without walking the list. The
+ * LinkedList keeps ownership of its items and their order, the index
+ * just points to them.
+ */
+typedef struct ListIndex
+{
+	/** The buckets. This is NULL until the first item is added. */
+	ListIndexEntry **li_buckets_pp;
+
+	/** The number of buckets. This is always a power of 2. */
+	uint32 li_num_buckets;
+
+	/** The number of ListItems in the index. */
+	uint32 li_num_entries;
+} ListIndex;
+
+
+/**
+ * The function used to check whether a ListItem whose hash is the same as a
+ * value's is actually a match for that value.
+ *
+ * @param item_p The ListItem in the index.
+ * @param value_p The value being searched for.
+ * @return <code>true</code> if they match, <code>false</code> otherwise.
+ */
+typedef bool (*ListIndexMatchFn) (const ListItem *item_p, const void *value_p);
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Allocate an empty ListIndex.
+ *
+ * @return The new ListIndex or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL ListIndex *AllocateListIndex (void);
+
+
+/**
+ * Free a ListIndex. The ListItems that it points to are not freed.
+ *
+ * @param index_p The ListIndex to free.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void FreeListIndex (ListIndex *index_p);
+
+
+/**
+ * Add a ListItem to a ListIndex.
+ *
+ * @param index_p The ListIndex to add to.
+ * @param item_p The ListItem to add.
+ * @param hash The hash of the ListItem's key.
+ * @return <code>true</code> if the ListItem was added successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddListIndexItem (ListIndex *index_p, ListItem *item_p, const uint32 hash);
+
+
+/**
+ * Find the ListItem in a ListIndex that matches a value.
+ *
+ * @param index_p The ListIndex to search.
+ * @param hash The hash of the value's key.
+ * @param match_fn The function used to compare the ListItems that have the same hash against the value.
+ * @param value_p The value to search for.
+ * @return The matching ListItem or <code>NULL</code> if there isn't one.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL ListItem *FindListIndexItem (const ListIndex *index_p, const uint32 hash, ListIndexMatchFn match_fn, const void *value_p);
+
+
+/**
+ * Add some bytes to a hash.
+ *
+ * @param hash The hash so far. For the first call this should be LI_HASH_SEED.
+ * @param data_p The bytes to add.
+ * @param size The number of bytes to add.
+ * @return The updated hash.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL uint32 HashListIndexBytes (uint32 hash, const void *data_p, const size_t size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DFW_FIELD_TRIAL_SERVICE_LIST_INDEX_H_ */
@@ -115,6 +115,17 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL Location *GetLocationFromResource (Resource *resou
 
 DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetLocationIndexingData (Service *service_p);
 
+
+/**
+ * Convert a batch of raw Locations documents, in place, into the form
+ * used for indexing.
+ *
+ * @param locations_p The JSON array of documents to convert.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if all of the documents were converted successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool PrepareLocationsForIndexing (json_t *locations_p, const FieldTrialServiceData *data_p);
+
 #ifdef __cplusplus
 }
 #endif
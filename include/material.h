@@ -136,6 +136,13 @@ MATERIAL_PREFIX const char *MA_PEDIGREE_S MATERIAL_VAL ("pedigree");
 
 MATERIAL_PREFIX const char *MA_GENE_BANK_ID_S MATERIAL_VAL ("gene_bank_id");
 
+/**
+ * The key for the trimmed, lower-case copy of the accession that is
+ * used for case-insensitive lookups. It is indexed along with
+ * MA_GENE_BANK_ID_S.
+ */
+MATERIAL_PREFIX const char *MA_NORMALISED_ACCESSION_S MATERIAL_VAL ("normalised_accession");
+
 MATERIAL_PREFIX const char *MA_GENE_BANK_S MATERIAL_VAL ("gene_bank");
 
 MATERIAL_PREFIX const char *MA_EXPERIMENTAL_AREA_ID_S MATERIAL_VAL ("area_id");
@@ -206,6 +213,34 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL Material*GetOrCreateMaterialByInternalName (const
 DFW_FIELD_TRIAL_SERVICE_LOCAL Material *GetOrCreateMaterialByAccession (const char *accession_s, GeneBank *gene_bank_p, const FieldTrialServiceData *data_p);
 
 
+/**
+ * Get the existing Materials for a set of accessions within a GeneBank
+ * using a single query.
+ *
+ * @param materials_p A JSON object whose keys are the accessions and whose values
+ * are JSON nulls. Upon success, the value for each accession that exists will be
+ * replaced by the JSON for its Material. The values for any others are left as nulls.
+ * @param gene_bank_p The GeneBank that the accessions are from.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the query ran successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool GetMaterialsByAccession (json_t *materials_p, GeneBank *gene_bank_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Get or create the Materials for a set of accessions within a GeneBank
+ * using a single query for all of the existing ones.
+ *
+ * @param materials_p A JSON object whose keys are the accessions and whose values
+ * are JSON nulls. Upon success, each value will be replaced by the JSON for the Material.
+ * @param gene_bank_p The GeneBank that the accessions are from.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if all of the Materials were resolved successfully,
+ * <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool GetOrCreateMaterialsByAccession (json_t *materials_p, GeneBank *gene_bank_p, const FieldTrialServiceData *data_p);
+
+
 DFW_FIELD_TRIAL_SERVICE_LOCAL Material *GetMaterialByGermplasmID (const char *material_s, Study *area_p, const FieldTrialServiceData *data_p);
 
 DFW_FIELD_TRIAL_SERVICE_LOCAL Material *GetMaterialById (const bson_oid_t *material_id_p, const FieldTrialServiceData *data_p);
@@ -217,6 +252,18 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL Material *GetMaterialByAccession (const char *acce
 DFW_FIELD_TRIAL_SERVICE_LOCAL bool IsMaterialComplete (const Material * const material_p);
 
 
+/**
+ * Get the normalised form of an accession, i.e. with any leading and
+ * trailing whitespace removed and converted to lower case, which is what
+ * case-insensitive searches match against.
+ *
+ * @param accession_s The accession to normalise.
+ * @return The newly-allocated normalised accession which should be freed
+ * with FreeCopiedString() or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL char *GetNormalisedAccession (const char *accession_s);
+
+
 #ifdef __cplusplus
 }
 #endif
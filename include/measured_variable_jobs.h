@@ -86,6 +86,17 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL bool DoesMeasuredVariableExist (MeasuredVariable *
 DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetMeasuredVariableIndexingData (Service *service_p);
 
 
+/**
+ * Convert a batch of raw Measured Variables documents, in place, into the form
+ * used for indexing.
+ *
+ * @param measured_variables_p The JSON array of documents to convert.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if all of the documents were converted successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool PrepareMeasuredVariablesForIndexing (json_t *measured_variables_p, const FieldTrialServiceData *data_p);
+
+
 #ifdef __cplusplus
 }
 #endif
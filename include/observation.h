@@ -139,6 +139,42 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL bool SetObservationValue (Observation *observation
 DFW_FIELD_TRIAL_SERVICE_LOCAL bool AreObservationsMatching (const Observation *observation_0_p, const Observation *observation_1_p);
 
 
+/**
+ * Get the hash of the fields that AreObservationsMatching() compares: the
+ * phenotype id and the start and end dates.
+ *
+ * @param observation_p The Observation to hash.
+ * @param hash_p Where the hash will be stored.
+ * @return <code>true</code> if the hash was calculated, <code>false</code> if the Observation
+ * doesn't have both dates and so can't match any others.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool GetObservationMatchHash (const Observation *observation_p, uint32 *hash_p);
+
+
+/**
+ * Take the raw and/or corrected value from a matching Observation for each
+ * of those that an Observation doesn't have, so that a raw and a corrected
+ * value for the same phenotype and dates are kept together.
+ *
+ * @param observation_p The Observation to fill in.
+ * @param existing_observation_p The matching Observation that it is replacing.
+ * Any values that are taken are removed from it.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void MergeObservationValues (Observation *observation_p, Observation *existing_observation_p);
+
+
+/**
+ * Get the corrected value of an Observation, or its raw value if it doesn't
+ * have a corrected one, as a number.
+ *
+ * @param observation_p The Observation to get the value of.
+ * @param value_p Where the value will be stored.
+ * @return <code>true</code> if the whole of the value, apart from any trailing
+ * whitespace, is a finite number, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool GetObservationValueAsReal (const Observation *observation_p, double64 *value_p);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,180 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * observation_jobs.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef DFW_FIELD_TRIAL_SERVICE_OBSERVATION_JOBS_H_
+#define DFW_FIELD_TRIAL_SERVICE_OBSERVATION_JOBS_H_
+
+#include <time.h>
+
+#include "dfw_field_trial_service_data.h"
+#include "dfw_field_trial_service_library.h"
+#include "plot.h"
+#include "row.h"
+#include "service_job.h"
+
+#include "jansson.h"
+
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#ifdef ALLOCATE_OBSERVATION_JOBS_TAGS
+	#define OBSERVATION_JOBS_PREFIX DFW_FIELD_TRIAL_SERVICE_LOCAL
+	#define OBSERVATION_JOBS_VAL(x)	= x
+#else
+	#define OBSERVATION_JOBS_PREFIX extern
+	#define OBSERVATION_JOBS_VAL(x)
+#endif
+
+#endif 		/* #ifndef DOXYGEN_SHOULD_SKIP_THIS */
+
+
+/**
+ * The key for the id of the Row that a document in the
+ * Observations collection belongs to. The Study, Plot and
+ * Material ids use RO_STUDY_ID_S, RO_PLOT_ID_S and
+ * RO_MATERIAL_ID_S.
+ */
+OBSERVATION_JOBS_PREFIX const char *OJ_ROW_ID_S OBSERVATION_JOBS_VAL ("row_id");
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Create the indexes on the Observations collection. This does nothing
+ * unless the "observations_collection" configuration value is set.
+ *
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the indexes exist, or aren't needed,
+ * <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddObservationsCollectionIndexes (const FieldTrialServiceData *data_p);
+
+
+/**
+ * Replace the documents in the Observations collection for the Rows of
+ * some Plots that have just been saved. This does nothing unless the
+ * "observations_collection" configuration value is set. If the documents
+ * can't be written, then any existing ones for the Plots are removed.
+ *
+ * @param plots_pp The Plots.
+ * @param saved_flags_p For each Plot, whether it was saved. Only the
+ * Plots that were saved are written.
+ * @param num_plots The number of Plots.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the Observations collection was updated
+ * successfully, or isn't used, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool SavePlotsToObservationsCollection (Plot **plots_pp, const bool *saved_flags_p, const size_t num_plots, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Replace the documents in the Observations collection for some Rows whose
+ * values have just been saved. This does nothing unless the
+ * "observations_collection" configuration value is set. If the documents
+ * can't be written, then any existing ones for the Rows are removed.
+ *
+ * @param rows_pp The Rows.
+ * @param saved_flags_p For each Row, whether it was saved. Only the
+ * Rows that were saved are written.
+ * @param num_rows The number of Rows.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the Observations collection was updated
+ * successfully, or isn't used, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool SaveRowsToObservationsCollection (Row **rows_pp, const bool *saved_flags_p, const size_t num_rows, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Remove all of a Study's documents from the Observations collection. This
+ * does nothing unless the "observations_collection" configuration value is set.
+ *
+ * @param study_id_p The id of the Study.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the documents were removed successfully, or
+ * the Observations collection isn't used, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool RemoveStudyFromObservationsCollection (const bson_oid_t *study_id_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Get all of the values of a MeasuredVariable across a Study, sorted by date,
+ * from the Observations collection.
+ *
+ * @param study_id_p The id of the Study.
+ * @param variable_id_p The id of the MeasuredVariable.
+ * @param from_p If this is not <code>NULL</code>, only Observations that start
+ * on or after this day are returned.
+ * @param to_p If this is not <code>NULL</code>, only Observations that start
+ * on or before this day are returned.
+ * @param data_p The configuration data for the service.
+ * @return A JSON array of the Observation documents, which may be empty, or
+ * <code>NULL</code> upon error or if the Observations collection isn't used.
+ * The caller must json_decref() this.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetStudyVariableObservations (const bson_oid_t *study_id_p, const bson_oid_t *variable_id_p, struct tm *from_p, struct tm *to_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Get all of the values of a MeasuredVariable for a Material, across every
+ * Study, sorted by date, from the Observations collection.
+ *
+ * @param material_id_p The id of the Material.
+ * @param variable_id_p The id of the MeasuredVariable.
+ * @param data_p The configuration data for the service.
+ * @return A JSON array of the Observation documents, which may be empty, or
+ * <code>NULL</code> upon error or if the Observations collection isn't used.
+ * The caller must json_decref() this.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetMaterialVariableObservations (const bson_oid_t *material_id_p, const bson_oid_t *variable_id_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Add the values of a MeasuredVariable from the Observations collection as
+ * a result of a ServiceJob. If a Material is given, its values across every
+ * Study are used with GetMaterialVariableObservations(), otherwise the
+ * values across the Study are used with GetStudyVariableObservations().
+ *
+ * @param study_id_s The id of the Study. This is ignored if material_id_s is set.
+ * @param material_id_s The id of the Material, or <code>NULL</code>.
+ * @param variable_id_s The id of the MeasuredVariable.
+ * @param from_s If this is set, only the values of a Study's Observations
+ * that start on or after this date are used.
+ * @param to_s If this is set, only the values of a Study's Observations
+ * that start on or before this date are used.
+ * @param job_p The ServiceJob to add the result or any errors to.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the values were added successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddVariableObservationsToServiceJob (const char *study_id_s, const char *material_id_s, const char *variable_id_s, const char *from_s, const char *to_s, ServiceJob *job_p, const FieldTrialServiceData *data_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DFW_FIELD_TRIAL_SERVICE_OBSERVATION_JOBS_H_ */
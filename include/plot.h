@@ -179,6 +179,19 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL void FreePlotNode (ListItem *node_p);
 DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetPlotAsJSON (Plot *plot_p, const ViewFormat format, JSONProcessor *processor_p, const FieldTrialServiceData *data_p);
 
 
+/**
+ * Add the VF_CLIENT_FULL JSON for a Plot that has just been saved to the
+ * set of Plots that will be spliced into its cached Study by
+ * PatchCachedStudyPlots().
+ *
+ * @param plots_p The JSON object holding the Plots to patch.
+ * @param plot_p The Plot to add.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the Plot was added successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddPlotToCachedStudyPatch (json_t *plots_p, Plot *plot_p, const FieldTrialServiceData *data_p);
+
+
 DFW_FIELD_TRIAL_SERVICE_LOCAL Plot *GetPlotFromJSON (const json_t *plot_json_p, Study *parent_area_p, const FieldTrialServiceData *data_p);
 
 
@@ -75,6 +75,24 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL Plot *GetPlotByRowAndColumn (const uint32 row, con
 DFW_FIELD_TRIAL_SERVICE_LOCAL Plot *GetPlotById (bson_oid_t *id_p, Study *study_p, const FieldTrialServiceData *data_p);
 
 
+/**
+ * Save a number of Plots using one unordered bulk upsert per batch rather
+ * than a database round trip each. The number of Plots in each batch is
+ * set by the "plot_import_batch_size" configuration value.
+ *
+ * @param plots_pp The Plots to save.
+ * @param saved_flags_p An array of num_plots values that will be set to
+ * whether the Plot at the same index was saved successfully.
+ * @param num_plots The number of Plots to save.
+ * @param observations_flag_p This will be set to <code>false</code> if the
+ * Observations collection is used and the Observations of any saved Plots
+ * couldn't be written to it, <code>true</code> otherwise.
+ * @param data_p The configuration data for the service.
+ * @return The number of Plots that were saved successfully.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL size_t SavePlots (Plot **plots_pp, bool *saved_flags_p, const size_t num_plots, bool *observations_flag_p, const FieldTrialServiceData *data_p);
+
+
 /**
  * Get the plots as a Frictionless Data Table
  *
@@ -88,6 +88,17 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL Programme *GetProgrammeFromResource (Resource *res
 DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetProgrammeIndexingData (Service *service_p);
 
 
+/**
+ * Convert a batch of raw Programmes documents, in place, into the form
+ * used for indexing.
+ *
+ * @param programmes_p The JSON array of documents to convert.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if all of the documents were converted successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool PrepareProgrammesForIndexing (json_t *programmes_p, const FieldTrialServiceData *data_p);
+
+
 DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetProgrammeAsFrictionlessDataResource (const Programme *programme_p, const FieldTrialServiceData *data_p);
 
 DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetProgrammeAsFrictionlessDataPackage (const Programme *programme_p, const FieldTrialServiceData *data_p);
@@ -0,0 +1,307 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * reference_cache.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef DFW_FIELD_TRIAL_SERVICE_REFERENCE_CACHE_H_
+#define DFW_FIELD_TRIAL_SERVICE_REFERENCE_CACHE_H_
+
+#include <pthread.h>
+#include <time.h>
+
+#include "dfw_field_trial_service_data.h"
+
+#include "jansson.h"
+
+
+/**
+ * The number of hash buckets used by each ReferenceCacheTier.
+ */
+#define RC_NUM_BUCKETS (512)
+
+
+/**
+ * A single cached document.
+ */
+typedef struct ReferenceCacheEntry
+{
+	/** The key for this entry, e.g. the document's id. */
+	char *rce_key_s;
+
+	/** The cached document. */
+	json_t *rce_doc_p;
+
+	/** The approximate number of bytes used by this entry. */
+	size_t rce_num_bytes;
+
+	/**
+	 * The time after which this entry is stale and will be dropped
+	 * rather than returned.
+	 */
+	time_t rce_expiry;
+
+	/**
+	 * The revision of the source that this entry was made from, e.g. the
+	 * modification time of a file, or 0 if it isn't tracked.
+	 */
+	int64 rce_revision;
+
+	/** The next entry in the same hash bucket. */
+	struct ReferenceCacheEntry *rce_bucket_next_p;
+
+	/** The more recently used neighbour of this entry. */
+	struct ReferenceCacheEntry *rce_newer_p;
+
+	/** The less recently used neighbour of this entry. */
+	struct ReferenceCacheEntry *rce_older_p;
+} ReferenceCacheEntry;
+
+
+/**
+ * A bounded least-recently-used cache for a single datatype.
+ */
+typedef struct ReferenceCacheTier
+{
+	/** The hash buckets for looking up entries by key. */
+	ReferenceCacheEntry *rct_buckets_pp [RC_NUM_BUCKETS];
+
+	/** The most recently used entry. */
+	ReferenceCacheEntry *rct_newest_p;
+
+	/** The least recently used entry, which will be the next to be evicted. */
+	ReferenceCacheEntry *rct_oldest_p;
+
+	/** The number of bytes used by all of the entries. */
+	size_t rct_num_bytes;
+
+	/**
+	 * The maximum number of bytes that the entries can use. If this is 0,
+	 * then caching is disabled for this datatype.
+	 */
+	size_t rct_max_bytes;
+
+	/** The number of entries. */
+	uint32 rct_num_entries;
+
+	/** The number of lookups that found an entry. */
+	uint64 rct_hits;
+
+	/** The number of lookups that didn't find an entry. */
+	uint64 rct_misses;
+
+	/** The number of entries removed to make space for new ones. */
+	uint64 rct_evictions;
+
+	/** The number of entries dropped because they had gone stale. */
+	uint64 rct_expirations;
+} ReferenceCacheTier;
+
+
+/**
+ * A process-wide cache of the documents for the slowly-changing
+ * datatypes such as MeasuredVariables, Crops and Locations. It also
+ * holds the serialised JSON of the most recently used cached Studies.
+ * This is shared by all of the services and is safe to use from
+ * multiple threads.
+ */
+typedef struct ReferenceCache
+{
+	/**
+	 * @private
+	 *
+	 * The cache for each datatype.
+	 */
+	ReferenceCacheTier rc_tiers [DFTD_NUM_TYPES];
+
+	/**
+	 * @private
+	 *
+	 * The number of seconds that an entry stays valid for. Documents can
+	 * be changed by other processes, or by code paths that never call
+	 * InvalidateCachedReference(), so this bounds how stale a cached
+	 * copy can get. If this is 0, entries never expire.
+	 */
+	time_t rc_ttl;
+
+	/**
+	 * @private
+	 *
+	 * The lock guarding all access to the tiers.
+	 */
+	pthread_mutex_t rc_lock;
+} ReferenceCache;
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Get the process-wide ReferenceCache.
+ *
+ * @return The ReferenceCache.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL ReferenceCache *GetReferenceCache (void);
+
+
+/**
+ * Set the maximum number of bytes that each cached datatype can use.
+ *
+ * @param cache_p The ReferenceCache to configure.
+ * @param max_bytes The maximum size for each datatype. Use 0 to disable the cache.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void SetReferenceCacheSize (ReferenceCache *cache_p, const size_t max_bytes);
+
+
+/**
+ * Set the maximum number of bytes that a single cached datatype can use.
+ *
+ * @param cache_p The ReferenceCache to configure.
+ * @param datatype The datatype to set the limit for.
+ * @param max_bytes The maximum size for the datatype. Use 0 to disable caching it.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void SetReferenceCacheTierSize (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const size_t max_bytes);
+
+
+/**
+ * Set the number of seconds that each cached document stays valid for.
+ * This applies to documents cached after the call.
+ *
+ * @param cache_p The ReferenceCache to configure.
+ * @param ttl The lifetime of each entry in seconds. Use 0 to keep entries
+ * until they are evicted or invalidated.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void SetReferenceCacheTimeToLive (ReferenceCache *cache_p, const time_t ttl);
+
+
+/**
+ * Get a cached document.
+ *
+ * @param cache_p The ReferenceCache to search.
+ * @param datatype The type of the document.
+ * @param key_s The key for the document.
+ * @return A new reference to the document which the caller must
+ * json_decref() or <code>NULL</code> if it isn't cached or its entry
+ * has expired.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetCachedReference (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const char *key_s);
+
+
+/**
+ * Get a cached document, but only if it was made from a given revision
+ * of its source. An entry for any other revision is removed.
+ *
+ * @param cache_p The ReferenceCache to search.
+ * @param datatype The type of the document.
+ * @param key_s The key for the document.
+ * @param revision The current revision of the document's source.
+ * @return A new reference to the document which the caller must
+ * json_decref() or <code>NULL</code> if it isn't cached, its entry
+ * has expired or it was made from a different revision.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetCachedReferenceAtRevision (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const char *key_s, const int64 revision);
+
+
+/**
+ * Get a cached raw Mongo document by its id. This only applies to the
+ * slowly-changing reference datatypes, for any other datatype it will
+ * always return <code>NULL</code>.
+ *
+ * @param cache_p The ReferenceCache to search.
+ * @param datatype The type of the document.
+ * @param id_p The id of the document.
+ * @return A new reference to the document which the caller must
+ * json_decref() or <code>NULL</code> if it isn't cached.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetCachedReferenceById (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const bson_oid_t *id_p);
+
+
+/**
+ * Add a document to the cache, evicting the least recently used ones
+ * if needed. This does nothing if caching is disabled for the datatype.
+ *
+ * @param cache_p The ReferenceCache to add the document to.
+ * @param datatype The type of the document.
+ * @param key_s The key for the document.
+ * @param doc_p The document. The cache will take a new reference to this.
+ * @return <code>true</code> if the document was cached or caching is disabled
+ * for the datatype, <code>false</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool CacheReference (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const char *key_s, json_t *doc_p);
+
+
+/**
+ * Add a document to the cache along with the revision of the source
+ * that it was made from.
+ *
+ * @see CacheReference
+ * @see GetCachedReferenceAtRevision
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool CacheReferenceAtRevision (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const char *key_s, json_t *doc_p, const int64 revision);
+
+
+/**
+ * Add a raw Mongo document to the cache using its "_id" value as its key.
+ * As with GetCachedReferenceById(), this does nothing for datatypes other
+ * than the slowly-changing reference ones.
+ *
+ * @see CacheReference
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool CacheReferenceById (ReferenceCache *cache_p, const DFWFieldTrialData datatype, json_t *doc_p);
+
+
+/**
+ * Remove a document from the cache. This should be called whenever
+ * the stored document is changed.
+ *
+ * @param cache_p The ReferenceCache to remove the document from.
+ * @param datatype The type of the document.
+ * @param key_s The key for the document.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void InvalidateCachedReference (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const char *key_s);
+
+
+/**
+ * Remove a document from the cache by its id.
+ *
+ * @see InvalidateCachedReference
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void InvalidateCachedReferenceById (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const bson_oid_t *id_p);
+
+
+/**
+ * Get the sizes and the hit, miss, eviction and expiry counts for each of
+ * the cached datatypes.
+ *
+ * @param cache_p The ReferenceCache to get the statistics for.
+ * @return The statistics as a JSON array or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetReferenceCacheStatisticsAsJSON (ReferenceCache *cache_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DFW_FIELD_TRIAL_SERVICE_REFERENCE_CACHE_H_ */
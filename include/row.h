@@ -24,6 +24,7 @@
 #define SERVICES_FIELD_TRIALS_INCLUDE_ROW_H_
 
 
+#include "list_index.h"
 #include "material.h"
 #include "plot.h"
 #include "observation.h"
@@ -64,6 +65,19 @@ typedef struct Row
 
 	LinkedList *ro_treatment_factor_values_p;
 
+	/**
+	 * The ObservationNodes in ro_observations_p hashed by
+	 * GetObservationMatchHash() so that an Observation can be
+	 * replaced without walking the list.
+	 */
+	ListIndex *ro_observations_index_p;
+
+	/**
+	 * The TreatmentFactorValueNodes in ro_treatment_factor_values_p
+	 * hashed by GetTreatmentFactorValueMatchHash().
+	 */
+	ListIndex *ro_treatment_factor_values_index_p;
+
 	uint32 ro_replicate_index;
 
 	bool ro_replicate_control_flag;
@@ -151,6 +165,8 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL Row *GetRowFromJSON (const json_t *json_p, Plot *p
 
 DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddObservationToRow (Row *row_p, Observation *observation_p);
 
+DFW_FIELD_TRIAL_SERVICE_LOCAL const Observation *GetMatchingObservationFromRow (const Row *row_p, const Observation *observation_p);
+
 DFW_FIELD_TRIAL_SERVICE_LOCAL void SetRowGenotypeControl (Row *row_p, bool control_flag);
 
 
@@ -162,6 +178,19 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL void UpdateRow (Row *row_p, const uint32 rack_plot
 
 DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddTreatmentFactorValueToRow (Row *row_p, TreatmentFactorValue *tf_value_p);
 
+
+/**
+ * Get the fields to $set so that a Row's observations and treatment factor values
+ * are replaced within its Plot's stored document without rewriting the rest of
+ * the Plot. The fields use the positional operator "rows.$[<filter_id_s>]" so the
+ * update must have an array filter that matches the Row's study index.
+ *
+ * @param row_p The Row to get the values of.
+ * @param filter_id_s The identifier used in the update's array filter.
+ * @return The JSON object of fields to $set or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetRowValuesUpdateAsJSON (const Row *row_p, const char *filter_id_s);
+
 #ifdef __cplusplus
 }
 #endif
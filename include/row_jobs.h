@@ -29,6 +29,22 @@
 #include "row.h"
 #include "plot.h"
 #include "treatment_factor_value.h"
+#include "delimited_table.h"
+
+
+/**
+ * What the values in a column of a delimited table are added to a Row as.
+ * This is worked out once from the column's heading rather than for
+ * every row of the table. If neither member is set, the column is ignored.
+ */
+typedef struct RowValueColumn
+{
+	/** If the column holds the values of one of the Study's treatment factors, this is it. */
+	TreatmentFactor *rvc_treatment_factor_p;
+
+	/** If the column holds phenotype values, these are its parsed details. */
+	const struct PhenotypeColumnNode *rvc_phenotype_column_p;
+} RowValueColumn;
 
 
 
@@ -57,10 +73,87 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL Row *GetRowByStudyIndex (const int32 by_study_inde
 DFW_FIELD_TRIAL_SERVICE_LOCAL LinkedList *GetAllRowsContainingMaterial (Material *material_p, const FieldTrialServiceData *data_p);
 
 
-DFW_FIELD_TRIAL_SERVICE_LOCAL OperationStatus AddObservationValuesToRow (Row *row_p, json_t *observations_json_p, Study *study_p, const FieldTrialServiceData *data_p);
+/**
+ * Allocate the list used to hold the parsed column headings of a
+ * phenotype table so that each heading is only parsed once per upload.
+ *
+ * @return The new list or <code>NULL</code> upon error. The caller must
+ * free this with FreeLinkedList().
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL LinkedList *AllocatePhenotypeColumnsList (void);
+
+
+/**
+ * Add the phenotype values in a table row to a Row.
+ *
+ * @param row_p The Row to add the Observations to.
+ * @param observations_json_p The table row with the phenotype values keyed by column heading.
+ * @param phenotype_columns_p The list from AllocatePhenotypeColumnsList() shared by
+ * every row of the table. Any headings that haven't been seen before are parsed and
+ * added to it.
+ * @param trait_statistics_p If this is not <code>NULL</code>, the list from
+ * AllocateTraitStatisticsList() that the added and replaced values are recorded in.
+ * @param study_p The Study that the Row belongs to.
+ * @param data_p The configuration data for the service.
+ * @return The status of adding the values.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL OperationStatus AddObservationValuesToRow (Row *row_p, json_t *observations_json_p, LinkedList *phenotype_columns_p, LinkedList *trait_statistics_p, Study *study_p, const FieldTrialServiceData *data_p);
+
+/**
+ * Work out what the values in a column of a delimited table are.
+ *
+ * @param column_p The RowValueColumn to fill in.
+ * @param heading_s The heading of the column.
+ * @param treatments_flag If this is <code>true</code>, the column may hold the
+ * values of one of the Study's treatment factors.
+ * @param phenotype_columns_p The list from AllocatePhenotypeColumnsList() that the
+ * parsed heading is added to if it is a phenotype.
+ * @param study_p The Study that the table is being imported into.
+ * @param data_p The configuration data for the service.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void SetRowValueColumn (RowValueColumn *column_p, const char *heading_s, const bool treatments_flag, LinkedList *phenotype_columns_p, Study *study_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Add the treatment factor and phenotype values in the current row of a
+ * DelimitedTableReader to a Row.
+ *
+ * @param row_p The Row to add the values to.
+ * @param reader_p The DelimitedTableReader with the current row of the table.
+ * @param columns_p The RowValueColumns for the table's columns in order.
+ * @param num_columns The number of RowValueColumns.
+ * @param trait_statistics_p If this is not <code>NULL</code>, the list from
+ * AllocateTraitStatisticsList() that the added and replaced values are recorded in.
+ * @param data_p The configuration data for the service.
+ * @return The status of adding the values.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL OperationStatus AddDelimitedTableValuesToRow (Row *row_p, DelimitedTableReader *reader_p, const RowValueColumn *columns_p, const size_t num_columns, LinkedList *trait_statistics_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Save the observations and treatment factor values of a number of Rows
+ * without rewriting the rest of their Plots. Each Row is written with a
+ * positional $set on its entry in its Plot's rows array and the Rows are
+ * sent in unordered batches whose size is set by the "row_update_batch_size"
+ * configuration value.
+ *
+ * @param rows_pp The Rows to save. Their Plots must already have been saved.
+ * @param saved_flags_p An array of num_rows values that will be set to
+ * whether the Row at the same index was saved successfully.
+ * @param num_rows The number of Rows to save.
+ * @param observations_flag_p This will be set to <code>false</code> if the
+ * Observations collection is used and the Observations of any saved Rows
+ * couldn't be written to it, <code>true</code> otherwise.
+ * @param data_p The configuration data for the service.
+ * @return The number of Rows that were saved successfully.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL size_t SaveRowValues (Row **rows_pp, bool *saved_flags_p, const size_t num_rows, bool *observations_flag_p, const FieldTrialServiceData *data_p);
+
 
 DFW_FIELD_TRIAL_SERVICE_LOCAL OperationStatus AddTreatmentFactorValuesToRow (Row *row_p, json_t *plot_json_p, Study *study_p, const FieldTrialServiceData *data_p);
 
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool IsKnownRowColumnHeading (const char *key_s, const FieldTrialServiceData *data_p);
+
 DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddTreatmentFactorValueToRowByParts (Row *row_p, TreatmentFactor *tf_p, const char *value_s);
 
 DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetRowAsFrictionlessData (const Row *row_p, const Study * const study_p, const FieldTrialServiceData *service_data_p, const char * const null_sequence_s);
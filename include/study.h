@@ -231,6 +231,12 @@ typedef struct Study
 
 	uint32 *st_predicted_harvest_year_p;
 
+	/**
+	 * The number of Plots in this Study if they have already
+	 * been counted, e.g. in bulk when indexing, or -1 if not.
+	 */
+	int32 st_num_plots;
+
 } Study;
 
 
@@ -0,0 +1,162 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * study_cache_file.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef DFW_FIELD_TRIAL_SERVICE_STUDY_CACHE_FILE_H_
+#define DFW_FIELD_TRIAL_SERVICE_STUDY_CACHE_FILE_H_
+
+#include <stdio.h>
+
+#include "dfw_field_trial_service_library.h"
+#include "typedefs.h"
+
+#include "jansson.h"
+
+
+/**
+ * The suffix used for uncompressed cached Studies.
+ */
+#define SCF_PLAIN_SUFFIX_S ".json"
+
+
+/**
+ * The suffix used for compressed cached Studies.
+ */
+#define SCF_COMPRESSED_SUFFIX_S ".jsonz"
+
+
+/**
+ * The current version of the compressed cache file format.
+ */
+#define SCF_FORMAT_VERSION (1)
+
+
+/**
+ * The header at the start of each compressed cached Study. This
+ * is followed by the zlib-compressed serialised JSON of the Study.
+ */
+typedef struct StudyCacheFileHeader
+{
+	/** The version of the file format. */
+	uint32 scfh_format_version;
+
+	/**
+	 * The revision of the cached Study. Studies do not keep a revision
+	 * counter, so this is the time, in seconds since the epoch, that
+	 * the Study was cached.
+	 */
+	uint64 scfh_revision;
+
+	/** The length of the serialised Study once it has been uncompressed. */
+	uint64 scfh_uncompressed_size;
+
+	/** The CRC-32 checksum of the uncompressed serialised Study. */
+	uint32 scfh_checksum;
+} StudyCacheFileHeader;
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Write a serialised Study to a plain JSON cache file. The data is
+ * written to a temporary file which is then renamed so that readers
+ * never see a partially-written file.
+ *
+ * @param filename_s The file to write.
+ * @param study_s The serialised JSON of the Study.
+ * @param study_length The length of study_s.
+ * @return <code>true</code> if the file was written successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool WritePlainStudyCacheFile (const char *filename_s, const char *study_s, const size_t study_length);
+
+
+/**
+ * Write a serialised Study to a compressed cache file. As with
+ * WritePlainStudyCacheFile(), the file is replaced atomically.
+ *
+ * @param filename_s The file to write.
+ * @param study_s The serialised JSON of the Study.
+ * @param study_length The length of study_s.
+ * @return <code>true</code> if the file was written successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool WriteCompressedStudyCacheFile (const char *filename_s, const char *study_s, const size_t study_length);
+
+
+/**
+ * Load a Study from a compressed cache file. The data is decompressed
+ * and parsed in chunks rather than being uncompressed into memory
+ * first. If the size or checksum of the uncompressed data doesn't
+ * match those in the header, the Study is rejected.
+ *
+ * @param filename_s The file to read.
+ * @return The Study's JSON or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *ReadCompressedStudyCacheFile (const char *filename_s);
+
+
+/**
+ * Read the header of a compressed cache file.
+ *
+ * @param filename_s The file to read.
+ * @param header_p The StudyCacheFileHeader to fill in.
+ * @return <code>true</code> if the header was read successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool ReadStudyCacheFileHeader (const char *filename_s, StudyCacheFileHeader *header_p);
+
+
+/**
+ * Open a uniquely-named file alongside a file that is to be replaced
+ * atomically with ReplaceWithTemporaryFile().
+ *
+ * @param filename_s The file that will be replaced.
+ * @param temp_filename_ss Where the name of the temporary file will be stored.
+ * ReplaceWithTemporaryFile() frees this.
+ * @return The temporary file, opened for writing, or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL FILE *OpenTemporaryFile (const char *filename_s, char **temp_filename_ss);
+
+
+/**
+ * Close a file from OpenTemporaryFile() and, if everything was written
+ * successfully, move it over the top of the file that it is replacing.
+ * Otherwise the temporary file is removed. Either way, temp_filename_s
+ * is freed.
+ *
+ * @param temp_f The temporary file.
+ * @param temp_filename_s The name of the temporary file.
+ * @param success_flag Whether everything was written to temp_f successfully.
+ * @param filename_s The file to replace.
+ * @return <code>true</code> if the file was replaced successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool ReplaceWithTemporaryFile (FILE *temp_f, char *temp_filename_s, const bool success_flag, const char *filename_s);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DFW_FIELD_TRIAL_SERVICE_STUDY_CACHE_FILE_H_ */
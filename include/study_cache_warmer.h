@@ -0,0 +1,78 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * study_cache_warmer.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef DFW_FIELD_TRIAL_SERVICE_STUDY_CACHE_WARMER_H_
+#define DFW_FIELD_TRIAL_SERVICE_STUDY_CACHE_WARMER_H_
+
+#include "dfw_field_trial_service_data.h"
+#include "grassroots_server.h"
+#include "service_job.h"
+
+#include "jansson.h"
+
+
+/**
+ * The default number of threads used to warm the study cache.
+ */
+#define SCW_DEFAULT_NUM_THREADS (4)
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Get the ids of all of the Studies.
+ *
+ * @param data_p The configuration data for the service.
+ * @return A JSON array of the id strings or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetAllStudyIdsAsJSON (const FieldTrialServiceData *data_p);
+
+
+/**
+ * Build and cache the VF_CLIENT_FULL JSON for a set of Studies using a pool
+ * of worker threads. Each worker has its own connection to the database.
+ * Any Study whose cache file is newer than its last modification is skipped
+ * and any other cached copy is rebuilt.
+ *
+ * @param study_ids_p A JSON array of the ids of the Studies to warm.
+ * @param num_threads The number of worker threads to use.
+ * @param job_p The ServiceJob that the progress is reported to after each Study.
+ * @param data_p The configuration data for the service.
+ * @param grassroots_p The GrassrootsServer used to get the database connections.
+ * @return A JSON object with the numbers of Studies that were built, rebuilt
+ * because they were stale, skipped and failed along with the ids of any
+ * failures or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *WarmStudyCache (const json_t *study_ids_p, uint32 num_threads, ServiceJob *job_p, const FieldTrialServiceData *data_p, GrassrootsServer *grassroots_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DFW_FIELD_TRIAL_SERVICE_STUDY_CACHE_WARMER_H_ */
@@ -57,6 +57,15 @@ STUDY_JOB_PREFIX NamedParameterType STUDY_SLOPE STUDY_JOB_STRUCT_VAL("ST Slope",
 
 STUDY_JOB_PREFIX NamedParameterType STUDY_GET_ALL_PLOTS STUDY_JOB_STRUCT_VAL("Get all Plots for Study", PT_BOOLEAN);
 
+STUDY_JOB_PREFIX NamedParameterType STUDY_GET_TRAIT_MATRIX STUDY_JOB_STRUCT_VAL("Get trait matrix for Study", PT_BOOLEAN);
+
+STUDY_JOB_PREFIX NamedParameterType STUDY_GET_TRAIT_STATISTICS STUDY_JOB_STRUCT_VAL("Get trait statistics for Study", PT_BOOLEAN);
+
+STUDY_JOB_PREFIX NamedParameterType STUDY_VARIABLE_OBSERVATIONS STUDY_JOB_STRUCT_VAL("Get observations of Measured Variable", PT_STRING);
+STUDY_JOB_PREFIX NamedParameterType STUDY_OBSERVATIONS_MATERIAL STUDY_JOB_STRUCT_VAL("Observations for Material", PT_STRING);
+STUDY_JOB_PREFIX NamedParameterType STUDY_OBSERVATIONS_FROM STUDY_JOB_STRUCT_VAL("Observations from", PT_STRING);
+STUDY_JOB_PREFIX NamedParameterType STUDY_OBSERVATIONS_TO STUDY_JOB_STRUCT_VAL("Observations to", PT_STRING);
+
 
 STUDY_JOB_PREFIX NamedParameterType STUDY_ADD_STUDY STUDY_JOB_STRUCT_VAL("Add Study", PT_BOOLEAN);
 
@@ -176,6 +185,17 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL OperationStatus RemovePlotsForStudyById (const cha
 DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetStudyIndexingData (Service *service_p);
 
 
+/**
+ * Convert a batch of raw Studies documents, in place, into the form
+ * used for indexing. Each raw document is replaced by the minimal view of its Study.
+ *
+ * @param studies_p The JSON array of documents to convert.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if all of the documents were converted successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool PrepareStudiesForIndexing (json_t *studies_p, const FieldTrialServiceData *data_p);
+
+
 DFW_FIELD_TRIAL_SERVICE_LOCAL struct TreatmentFactor *GetOrCreateTreatmentFactorForStudy (Study *study_p, const bson_oid_t *treatment_id_p, const FieldTrialServiceData *data_p);
 
 
@@ -0,0 +1,107 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * trait_matrix.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef DFW_FIELD_TRIAL_SERVICE_TRAIT_MATRIX_H_
+#define DFW_FIELD_TRIAL_SERVICE_TRAIT_MATRIX_H_
+
+#include "dfw_field_trial_service_data.h"
+#include "dfw_field_trial_service_library.h"
+#include "service_job.h"
+#include "study.h"
+#include "typedefs.h"
+
+
+/**
+ * The version of the trait matrix format written by GetStudyTraitMatrix().
+ */
+#define TM_FORMAT_VERSION (1)
+
+
+/*
+ * A trait matrix holds one row for each Row of a Study and one column for
+ * each MeasuredVariable that any of them has an Observation for. It is
+ * stored as:
+ *
+ * 	4 bytes: magic, "DFWT"
+ * 	4 bytes: format version
+ * 	4 bytes: the number of rows, R
+ * 	4 bytes: the number of variables, V
+ * 	V variable names, each as a 4-byte length followed by that many bytes
+ * 	R x 4 bytes: the study index of each row
+ * 	R x 4 bytes: the replicate of each row
+ * 	R x 4 bytes: the row of each row's plot
+ * 	R x 4 bytes: the column of each row's plot
+ * 	(R + 1) x 4 bytes: the offsets of each row's accession into the following bytes
+ * 	the accessions
+ * 	V columns, each as a null bitmap of (R + 7) / 8 bytes followed by
+ * 	R x 8-byte IEEE 754 doubles
+ *
+ * with all of the numbers being little-endian. Each of the blocks from the
+ * study indexes onwards starts on an 8-byte boundary, padded with zeros.
+ * Bit (i % 8) of byte (i / 8) of a null bitmap is set if row i has a value
+ * and the doubles for rows without a value are NaN.
+ */
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Get a Study's phenotype values as a trait matrix.
+ *
+ * If a Row has more than one Observation of a MeasuredVariable, the one
+ * with the latest start date is used, preferring a corrected value over
+ * a raw value from the same day. Values that aren't numbers are left
+ * empty.
+ *
+ * @param study_p The Study, with its Plots already loaded.
+ * @param length_p Where the length of the trait matrix will be stored.
+ * @param num_rows_p Where the number of rows will be stored.
+ * @param num_variables_p Where the number of variables will be stored.
+ * @return The trait matrix or <code>NULL</code> upon error. This should be
+ * freed with FreeMemory().
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL unsigned char *GetStudyTraitMatrix (const Study *study_p, size_t *length_p, uint32 *num_rows_p, uint32 *num_variables_p);
+
+
+/**
+ * Write a Study's trait matrix to the directory given by the "fd_path"
+ * configuration value and add a result with its "fd_url" address to a
+ * ServiceJob.
+ *
+ * @param id_s The id of the Study.
+ * @param job_p The ServiceJob to add the result or any errors to.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the trait matrix was added successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddStudyTraitMatrixToServiceJob (const char *id_s, ServiceJob *job_p, const FieldTrialServiceData *data_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DFW_FIELD_TRIAL_SERVICE_TRAIT_MATRIX_H_ */
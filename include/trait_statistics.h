@@ -0,0 +1,321 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * trait_statistics.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef DFW_FIELD_TRIAL_SERVICE_TRAIT_STATISTICS_H_
+#define DFW_FIELD_TRIAL_SERVICE_TRAIT_STATISTICS_H_
+
+#include "dfw_field_trial_service_data.h"
+#include "dfw_field_trial_service_library.h"
+#include "linked_list.h"
+#include "observation.h"
+#include "service_job.h"
+#include "typedefs.h"
+
+#include "jansson.h"
+
+
+/**
+ * The number of bins in each TraitStatistics histogram.
+ */
+#define TS_NUM_HISTOGRAM_BINS (32)
+
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#ifdef ALLOCATE_TRAIT_STATISTICS_TAGS
+	#define TRAIT_STATISTICS_PREFIX DFW_FIELD_TRIAL_SERVICE_LOCAL
+	#define TRAIT_STATISTICS_VAL(x)	= x
+#else
+	#define TRAIT_STATISTICS_PREFIX extern
+	#define TRAIT_STATISTICS_VAL(x)
+#endif
+
+#endif 		/* #ifndef DOXYGEN_SHOULD_SKIP_THIS */
+
+
+/**
+ * The collection holding a TraitStatistics document for each
+ * MeasuredVariable of each Study.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_COLLECTION_S TRAIT_STATISTICS_VAL ("TraitStatistics");
+
+/**
+ * The key for the name of the MeasuredVariable.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_NAME_S TRAIT_STATISTICS_VAL ("name");
+
+/**
+ * The key for the number of values.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_COUNT_S TRAIT_STATISTICS_VAL ("count");
+
+/**
+ * The key for the mean of the values.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_MEAN_S TRAIT_STATISTICS_VAL ("mean");
+
+/**
+ * The key for the sum of the squared differences from the mean.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_M2_S TRAIT_STATISTICS_VAL ("m2");
+
+/**
+ * The key for the sample standard deviation of the values.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_SD_S TRAIT_STATISTICS_VAL ("sd");
+
+/**
+ * The key for the smallest value.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_MIN_S TRAIT_STATISTICS_VAL ("min");
+
+/**
+ * The key for the largest value.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_MAX_S TRAIT_STATISTICS_VAL ("max");
+
+/**
+ * The key for the histogram.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_HISTOGRAM_S TRAIT_STATISTICS_VAL ("histogram");
+
+/**
+ * The key for the power of two that gives the width of the histogram's bins.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_BIN_EXPONENT_S TRAIT_STATISTICS_VAL ("bin_exponent");
+
+/**
+ * The key for the index of the histogram's first bin.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_FIRST_BIN_S TRAIT_STATISTICS_VAL ("first_bin");
+
+/**
+ * The key for the width of the histogram's bins.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_BIN_WIDTH_S TRAIT_STATISTICS_VAL ("bin_width");
+
+/**
+ * The key for the lower bound of the histogram's first bin.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_START_S TRAIT_STATISTICS_VAL ("start");
+
+/**
+ * The key for the number of values in each of the histogram's bins.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_BINS_S TRAIT_STATISTICS_VAL ("bins");
+
+/**
+ * The key for the revision of a stored TraitStatistics document which
+ * is used to detect concurrent updates.
+ */
+TRAIT_STATISTICS_PREFIX const char *TS_REVISION_S TRAIT_STATISTICS_VAL ("revision");
+
+
+/**
+ * The summary statistics for a set of values of a MeasuredVariable.
+ *
+ * The moments are kept using Welford's method so that sets of values can be
+ * merged without going back to the values themselves. The histogram has
+ * a fixed number of bins, each of them 2^ts_bin_exponent wide, with bin i
+ * covering [(ts_first_bin + i) * width, (ts_first_bin + i + 1) * width).
+ * When a value falls outside of the bins, the width is doubled and adjacent
+ * bins are merged, so any two histograms can be combined exactly.
+ */
+typedef struct TraitStatistics
+{
+	int64 ts_count;
+
+	double64 ts_mean;
+
+	/** The sum of the squared differences from the mean */
+	double64 ts_m2;
+
+	double64 ts_min;
+
+	double64 ts_max;
+
+	int32 ts_bin_exponent;
+
+	int64 ts_first_bin;
+
+	int64 ts_bins [TS_NUM_HISTOGRAM_BINS];
+} TraitStatistics;
+
+
+/**
+ * The changes to the TraitStatistics of a MeasuredVariable made during
+ * a phenotype upload.
+ */
+typedef struct TraitStatisticsNode
+{
+	ListItem tsn_node;
+
+	bson_oid_t tsn_variable_id;
+
+	char *tsn_variable_name_s;
+
+	/** The values that have been added */
+	TraitStatistics tsn_added;
+
+	/** The values that have been replaced */
+	TraitStatistics tsn_removed;
+
+	/**
+	 * The revision of the stored statistics from before the upload's
+	 * values were saved, 0 if there weren't any or -1 if it isn't known.
+	 */
+	int64 tsn_revision;
+} TraitStatisticsNode;
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Create the index on the trait statistics collection that the study summaries use.
+ *
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the index exists, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddTraitStatisticsIndexes (const FieldTrialServiceData *data_p);
+
+
+/**
+ * Allocate a list to collect the TraitStatisticsNodes for an upload.
+ *
+ * @return The new list or <code>NULL</code> upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL LinkedList *AllocateTraitStatisticsList (void);
+
+
+/**
+ * Add the value of an Observation to the changes for its MeasuredVariable.
+ * Observations whose values aren't numbers are ignored.
+ *
+ * @param stats_p The list of TraitStatisticsNodes.
+ * @param observation_p The Observation that has been added to a Row.
+ * @return <code>true</code> if the value was added or ignored, <code>false</code>
+ * upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddObservationToTraitStatistics (LinkedList *stats_p, const Observation *observation_p);
+
+
+/**
+ * Record that the value of an Observation is being replaced so that it is
+ * taken out of the stored statistics for its MeasuredVariable. Observations
+ * whose values aren't numbers are ignored.
+ *
+ * @param stats_p The list of TraitStatisticsNodes.
+ * @param observation_p The Observation that is about to be replaced.
+ * @return <code>true</code> if the value was recorded or ignored, <code>false</code>
+ * upon error.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool RemoveObservationFromTraitStatistics (LinkedList *stats_p, const Observation *observation_p);
+
+
+/**
+ * Record the revision of the stored statistics for each of the MeasuredVariables
+ * that an upload has changed. This must be called before the upload's values
+ * are saved so that SaveStudyTraitStatistics() can tell whether the stored
+ * statistics may already include them.
+ *
+ * @param study_id_p The id of the Study.
+ * @param stats_p The list of TraitStatisticsNodes.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if all of the revisions were read successfully,
+ * <code>false</code> otherwise in which case the statistics of any unknown
+ * revisions will be rebuilt rather than merged.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool GetStudyTraitStatisticsRevisions (const bson_oid_t *study_id_p, LinkedList *stats_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Merge the changes made during an upload into the stored statistics
+ * for each of a Study's MeasuredVariables.
+ *
+ * The smallest and largest values are only ever widened, so after values
+ * have been replaced they are bounds rather than the exact extremes.
+ *
+ * The changes for a MeasuredVariable are only merged if its stored statistics
+ * are still at the revision recorded by GetStudyTraitStatisticsRevisions().
+ * If they have changed since, don't exist yet or its replaced values can't
+ * have been merged into them, its statistics are rebuilt from all of the
+ * Study's stored Plots instead.
+ *
+ * @param study_id_p The id of the Study.
+ * @param stats_p The list of TraitStatisticsNodes.
+ * @param recompute_flag If this is <code>true</code>, then stats_p includes
+ * changes that weren't saved, so all of the statistics are rebuilt from the
+ * Study's stored Plots rather than merged.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if all of the statistics were saved successfully,
+ * <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool SaveStudyTraitStatistics (const bson_oid_t *study_id_p, LinkedList *stats_p, const bool recompute_flag, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Remove all of the stored statistics for a Study.
+ *
+ * @param study_id_p The id of the Study.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the statistics were removed successfully,
+ * <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool RemoveStudyTraitStatistics (const bson_oid_t *study_id_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Get the stored statistics for each of a Study's MeasuredVariables. Only
+ * the trait statistics collection is queried, not the Study's Plots.
+ *
+ * @param study_id_p The id of the Study.
+ * @param data_p The configuration data for the service.
+ * @return A JSON array with an object for each MeasuredVariable holding
+ * its count, mean, sample standard deviation, smallest and largest values
+ * and histogram, or <code>NULL</code> upon error. The caller must
+ * json_decref() this.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetStudyTraitStatisticsAsJSON (const bson_oid_t *study_id_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Add the stored statistics for a Study as a result of a ServiceJob.
+ *
+ * @param id_s The id of the Study.
+ * @param job_p The ServiceJob to add the result or any errors to.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the statistics were added successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddStudyTraitStatisticsToServiceJob (const char *id_s, ServiceJob *job_p, const FieldTrialServiceData *data_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DFW_FIELD_TRIAL_SERVICE_TRAIT_STATISTICS_H_ */
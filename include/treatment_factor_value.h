@@ -68,6 +68,16 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL const char *GetTreatmentFactorLabelValue (const Tr
 
 DFW_FIELD_TRIAL_SERVICE_LOCAL bool AreTreatmentFactorValuesMatching (const TreatmentFactorValue *tfv_0_p, const TreatmentFactorValue *tfv_1_p);
 
+/**
+ * Get the hash of the treatment id that AreTreatmentFactorValuesMatching() compares.
+ *
+ * @param tfv_p The TreatmentFactorValue to hash.
+ * @param hash_p Where the hash will be stored.
+ * @return <code>true</code> if the hash was calculated, <code>false</code> if the
+ * TreatmentFactorValue has no treatment and so can't match any others.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool GetTreatmentFactorValueMatchHash (const TreatmentFactorValue *tfv_p, uint32 *hash_p);
+
 DFW_FIELD_TRIAL_SERVICE_LOCAL const bson_oid_t *GetTreatmentIdForTreatmentFactorValue (const TreatmentFactorValue *tfv_p);
 
 DFW_FIELD_TRIAL_SERVICE_LOCAL TreatmentFactorValue *GetTreatmentFactorValueFromJSON (const json_t *tf_value_json_p, const struct Study *study_p, const FieldTrialServiceData *data_p);
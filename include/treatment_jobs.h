@@ -45,6 +45,17 @@ DFW_FIELD_TRIAL_SERVICE_LOCAL bool GetSubmissionTreatmentParameterTypeForNamedPa
 DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetTreatmentIndexingData (Service *service_p);
 
 
+/**
+ * Convert a batch of raw Treatments documents, in place, into the form
+ * used for indexing.
+ *
+ * @param treatments_p The JSON array of documents to convert.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if all of the documents were converted successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool PrepareTreatmentsForIndexing (json_t *treatments_p, const FieldTrialServiceData *data_p);
+
+
 DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetAllTreatmentsAsJSON (const FieldTrialServiceData *data_p, bson_t *opts_p);
 
 
@@ -0,0 +1,228 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * upload_session.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef DFW_FIELD_TRIAL_SERVICE_UPLOAD_SESSION_H_
+#define DFW_FIELD_TRIAL_SERVICE_UPLOAD_SESSION_H_
+
+#include "dfw_field_trial_service_data.h"
+#include "dfw_field_trial_service_library.h"
+#include "parameter.h"
+#include "service_job.h"
+#include "typedefs.h"
+
+#include "jansson.h"
+
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+#ifdef ALLOCATE_UPLOAD_SESSION_TAGS
+	#define UPLOAD_SESSION_PREFIX DFW_FIELD_TRIAL_SERVICE_LOCAL
+	#define UPLOAD_SESSION_VAL(x)	= x
+#else
+	#define UPLOAD_SESSION_PREFIX extern
+	#define UPLOAD_SESSION_VAL(x)
+#endif
+
+#endif 		/* #ifndef DOXYGEN_SHOULD_SKIP_THIS */
+
+
+/**
+ * The collection used to store the checkpoint for each upload session.
+ */
+UPLOAD_SESSION_PREFIX const char *US_UPLOAD_SESSIONS_S UPLOAD_SESSION_VAL ("UploadSessions");
+
+
+/**
+ * The key for the number of rows of a table that an upload session
+ * has committed. Any chunk starting before this has already been
+ * applied, either in full or in part.
+ */
+UPLOAD_SESSION_PREFIX const char *US_COMMITTED_ROWS_S UPLOAD_SESSION_VAL ("committed_rows");
+
+
+/**
+ * The key for the id of the request that has claimed the rows after
+ * an upload session's checkpoint and is applying them.
+ */
+UPLOAD_SESSION_PREFIX const char *US_PENDING_ID_S UPLOAD_SESSION_VAL ("pending_id");
+
+
+/**
+ * The key for the time at which the rows after an upload session's
+ * checkpoint were claimed.
+ */
+UPLOAD_SESSION_PREFIX const char *US_PENDING_SINCE_S UPLOAD_SESSION_VAL ("pending_since");
+
+
+/**
+ * The default number of seconds after which a claim on the rows of an
+ * upload session is treated as abandoned and the rows can be claimed by
+ * another request. This can be changed with the "upload_session_claim_timeout"
+ * config key.
+ */
+#define US_DEFAULT_CLAIM_TIMEOUT (60 * 60)
+
+
+/**
+ * The type of upload session used for plot tables.
+ */
+UPLOAD_SESSION_PREFIX const char *US_PLOTS_TYPE_S UPLOAD_SESSION_VAL ("plots");
+
+
+/**
+ * The type of upload session used for phenotype tables.
+ */
+UPLOAD_SESSION_PREFIX const char *US_PHENOTYPES_TYPE_S UPLOAD_SESSION_VAL ("phenotypes");
+
+
+
+/**
+ * A chunk of rows of a large table that is being uploaded over
+ * several requests as part of an upload session.
+ */
+typedef struct UploadChunk
+{
+	/** The id of the upload session. This is not copied. */
+	const char *uc_session_id_s;
+
+	/** The index, in the whole table, of the first row in this chunk. */
+	int64 uc_start_row;
+
+	/**
+	 * The number of rows of the whole table that had been committed
+	 * before this chunk.
+	 */
+	int64 uc_committed_rows;
+
+	/** The index, in the whole table, of the row after the end of this chunk. */
+	int64 uc_end_row;
+
+	/** The id that this chunk's claim on the session's rows was made with. */
+	bson_oid_t uc_claim_id;
+
+	/** Does this chunk hold the claim on the session's rows? */
+	bool uc_claimed_flag;
+} UploadChunk;
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Start applying a chunk of an upload session by getting its checkpoint.
+ * If this is the first chunk of the session, the session doesn't need to
+ * exist yet. A chunk may start at or before the checkpoint but a chunk that
+ * starts after it would leave a gap in the table so it is rejected.
+ *
+ * A session only has a single checkpoint, so its chunks are applied one
+ * after another rather than in parallel. A client must wait for each chunk
+ * to finish before sending the next one.
+ *
+ * If the chunk has any rows after the checkpoint, they are claimed before
+ * anything is written so that no other request can apply them at the same
+ * time. If another request already holds the claim, the chunk is rejected.
+ * Once the rows have been applied, the claim is given up by either
+ * CommitUploadChunk() or ReleaseUploadChunk().
+ *
+ * @param chunk_p The UploadChunk to fill in.
+ * @param session_id_s The id of the upload session chosen by the client.
+ * @param type_s The type of table being uploaded, e.g. US_PLOTS_TYPE_S.
+ * @param study_id_s The id of the Study that the table is for.
+ * @param start_row The index, in the whole table, of the first row in this chunk.
+ * @param num_rows The number of rows in the chunk.
+ * @param job_p The ServiceJob to add any errors to.
+ * @param session_param_p The parameter that held the session id, used for the errors.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the chunk can be applied, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool BeginUploadChunk (UploadChunk *chunk_p, const char *session_id_s, const char *type_s, const char *study_id_s, const int64 start_row, const size_t num_rows, ServiceJob *job_p, const NamedParameterType *session_param_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Get the rows of a chunk that haven't been committed yet. When a chunk is
+ * retried, the rows that were applied the first time are skipped.
+ *
+ * @param chunk_p The UploadChunk.
+ * @param rows_p The JSON array of the rows of the chunk.
+ * @return A new JSON array of the rows to apply, which may be empty, or
+ * <code>NULL</code> upon error. The caller must json_decref() this.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL json_t *GetUploadChunkRowsToApply (const UploadChunk *chunk_p, const json_t *rows_p);
+
+
+/**
+ * Get the index, in the whole table, of the first row returned by
+ * GetUploadChunkRowsToApply().
+ *
+ * @param chunk_p The UploadChunk.
+ * @return The index of the row.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL int64 GetUploadChunkFirstRowToApply (const UploadChunk *chunk_p);
+
+
+/**
+ * Move an upload session's checkpoint to the end of a chunk once all of
+ * its rows have been saved and give up the chunk's claim on them. If any
+ * of the rows failed, ReleaseUploadChunk() should be used instead so that
+ * they can be sent again. The checkpoint is only moved if this chunk still
+ * holds the claim that BeginUploadChunk() made.
+ *
+ * @param chunk_p The UploadChunk. On success its uc_committed_rows is updated.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the checkpoint was stored successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool CommitUploadChunk (UploadChunk *chunk_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Give up a chunk's claim on the rows of its upload session without
+ * moving the checkpoint, so that the rows can be sent again. This does
+ * nothing if the chunk doesn't hold a claim, for instance because it
+ * has been committed, so it can always be called once a chunk is done.
+ *
+ * @param chunk_p The UploadChunk.
+ * @param data_p The configuration data for the service.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL void ReleaseUploadChunk (UploadChunk *chunk_p, const FieldTrialServiceData *data_p);
+
+
+/**
+ * Add an upload session's id and checkpoint to a ServiceJob's metadata so
+ * that the client knows which row to send next.
+ *
+ * @param chunk_p The UploadChunk.
+ * @param job_p The ServiceJob to update.
+ * @return <code>true</code> if the metadata was added successfully, <code>false</code> otherwise.
+ */
+DFW_FIELD_TRIAL_SERVICE_LOCAL bool AddUploadChunkToServiceJob (const UploadChunk *chunk_p, ServiceJob *job_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* DFW_FIELD_TRIAL_SERVICE_UPLOAD_SESSION_H_ */
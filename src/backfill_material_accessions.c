@@ -0,0 +1,208 @@
+/*
+ ** Copyright 2014-2016 The Earlham Institute
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+/*
+ *
+ * backfill_material_accessions.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <stdio.h>
+
+#include "jansson.h"
+
+#include "dfw_field_trial_service_data.h"
+#include "mongodb_util.h"
+#include "mongo_client_manager.h"
+#include "mongodb_tool.h"
+
+#include "material.h"
+#include "bson/bson.h"
+
+
+static bool AddNormalisedAccessionIndex (MongoTool *mongo_p);
+
+
+/**
+ * A program to add the normalised accession to each document in the
+ * Materials collection that doesn't have one and then index it along
+ * with the gene bank id.
+ */
+int main (void)
+{
+	int ret = 0;
+	const char *uri_s = "mongodb://localhost:27017";
+
+	if (InitMongoDB ())
+		{
+			struct MongoClientManager *mongo_clients_p = AllocateMongoClientManager (uri_s);
+
+			if (mongo_clients_p)
+				{
+					MongoTool *mongo_p = AllocateMongoTool (NULL, mongo_clients_p);
+
+					if (mongo_p)
+						{
+							if (SetMongoToolDatabaseAndCollection (mongo_p, "dfw_field_trial", DFT_MATERIAL_S))
+								{
+									bson_t *query_p = BCON_NEW (MA_NORMALISED_ACCESSION_S, "{", "$exists", BCON_BOOL (false), "}");
+
+									if (query_p)
+										{
+											bson_t *opts_p = BCON_NEW ("projection", "{", MA_ACCESSION_S, BCON_INT32 (1), "}");
+
+											if (opts_p)
+												{
+													json_t *materials_p = GetAllMongoResultsAsJSON (mongo_p, query_p, opts_p);
+
+													if (materials_p)
+														{
+															bson_oid_t *material_id_p = GetNewUnitialisedBSONOid ();
+
+															if (material_id_p)
+																{
+																	json_t *update_p = json_object ();
+
+																	if (update_p)
+																		{
+																			size_t i;
+																			json_t *material_json_p;
+																			size_t num_successes = 0;
+																			const size_t num_materials = json_array_size (materials_p);
+
+																			json_array_foreach (materials_p, i, material_json_p)
+																				{
+																					const char *accession_s = GetJSONString (material_json_p, MA_ACCESSION_S);
+
+																					if (accession_s)
+																						{
+																							if (GetMongoIdFromJSON (material_json_p, material_id_p))
+																								{
+																									char *normalised_accession_s = GetNormalisedAccession (accession_s);
+
+																									if (normalised_accession_s)
+																										{
+																											if (SetJSONString (update_p, MA_NORMALISED_ACCESSION_S, normalised_accession_s))
+																												{
+																													if (UpdateMongoDocument (mongo_p, material_id_p, update_p))
+																														{
+																															++ num_successes;
+																														}
+																													else
+																														{
+																															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, update_p, "Failed to update document");
+																														}
+																												}
+
+																											FreeCopiedString (normalised_accession_s);
+																										}		/* if (normalised_accession_s) */
+
+																								}		/* if (GetMongoIdFromJSON (material_json_p, material_id_p)) */
+																							else
+																								{
+																									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, material_json_p, "Failed to get \"%s\"", MONGO_ID_S);
+																								}
+
+																						}		/* if (accession_s) */
+																					else
+																						{
+																							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, material_json_p, "Failed to get \"%s\"", MA_ACCESSION_S);
+																						}
+
+																				}		/* json_array_foreach (materials_p, i, material_json_p) */
+
+																			printf ("updated %lu out of %lu materials successfully\n", num_successes, num_materials);
+
+																			if (num_successes != num_materials)
+																				{
+																					ret = 1;
+																				}
+
+																			json_decref (update_p);
+																		}		/* if (update_p) */
+
+																	FreeBSONOid (material_id_p);
+																}		/* if (material_id_p) */
+
+															json_decref (materials_p);
+														}		/* if (materials_p) */
+
+													bson_destroy (opts_p);
+												}		/* if (opts_p) */
+
+											bson_destroy (query_p);
+										}		/* if (query_p) */
+
+									/*
+									 * The index is needed whether or not there
+									 * was anything left to backfill.
+									 */
+									if (!AddNormalisedAccessionIndex (mongo_p))
+										{
+											ret = 1;
+										}
+
+								}		/* if (SetMongoToolDatabaseAndCollection (mongo_p, "dfw_field_trial", DFT_MATERIAL_S)) */
+
+							FreeMongoTool (mongo_p);
+						}		/* if (mongo_p) */
+
+					FreeMongoClientManager (mongo_clients_p);
+				}		/* if (mongo_clients_p) */
+
+			ExitMongoDB ();
+		}
+
+	return ret;
+}
+
+
+static bool AddNormalisedAccessionIndex (MongoTool *mongo_p)
+{
+	bool success_flag = false;
+	bson_t *command_p = BCON_NEW ("createIndexes", BCON_UTF8 (DFT_MATERIAL_S),
+																"indexes", "[",
+																	"{",
+																		"key", "{", MA_NORMALISED_ACCESSION_S, BCON_INT32 (1), MA_GENE_BANK_ID_S, BCON_INT32 (1), "}",
+																		"name", BCON_UTF8 ("normalised_accession_gene_bank_id"),
+																	"}",
+																"]");
+
+	if (command_p)
+		{
+			bson_t *reply_p = NULL;
+
+			if (RunMongoCommand (mongo_p, command_p, &reply_p))
+				{
+					printf ("added index on \"%s\" and \"%s\"\n", MA_NORMALISED_ACCESSION_S, MA_GENE_BANK_ID_S);
+					success_flag = true;
+
+					if (reply_p)
+						{
+							bson_destroy (reply_p);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add index on \"%s\" and \"%s\" to \"%s\"", MA_NORMALISED_ACCESSION_S, MA_GENE_BANK_ID_S, DFT_MATERIAL_S);
+				}
+
+			bson_destroy (command_p);
+		}		/* if (command_p) */
+
+	return success_flag;
+}
@@ -0,0 +1,475 @@
+/*
+ ** Copyright 2014-2016 The Earlham Institute
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+/*
+ *
+ * backfill_observations.c
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: billy
+ */
+
+#include <stdio.h>
+
+#include "jansson.h"
+
+#include "dfw_field_trial_service_data.h"
+#include "mongodb_util.h"
+#include "mongo_client_manager.h"
+#include "mongodb_tool.h"
+
+#include "observation_jobs.h"
+#include "plot.h"
+#include "row.h"
+#include "bson/bson.h"
+
+
+static bool BackfillStudyObservations (MongoTool *mongo_p, const bson_oid_t *study_id_p, size_t *num_plots_p, size_t *num_successes_p);
+
+static bool BackfillPlotObservations (MongoTool *mongo_p, const json_t *plot_json_p);
+
+static bool AddRowObservationUpserts (const json_t *row_json_p, bson_t *updates_p, uint32 *num_updates_p, bson_t *written_ids_p);
+
+static bool CopyRowId (json_t *doc_json_p, const char *doc_key_s, const json_t *row_json_p, const char *row_key_s);
+
+static bool RemoveOtherPlotObservations (MongoTool *mongo_p, const bson_oid_t *plot_id_p, const bson_t *written_ids_p);
+
+
+/**
+ * A program to write the document for each Observation of every Plot
+ * into the Observations collection, so that the data that was saved
+ * before the "observations_collection" configuration value was set can
+ * be queried. Any other documents for each Plot are removed, so this can
+ * be run again at any time.
+ */
+int main (void)
+{
+	int ret = 0;
+	const char *uri_s = "mongodb://localhost:27017";
+
+	if (InitMongoDB ())
+		{
+			struct MongoClientManager *mongo_clients_p = AllocateMongoClientManager (uri_s);
+
+			if (mongo_clients_p)
+				{
+					MongoTool *mongo_p = AllocateMongoTool (NULL, mongo_clients_p);
+
+					if (mongo_p)
+						{
+							if (SetMongoToolDatabaseAndCollection (mongo_p, "dfw_field_trial", DFT_STUDIES_S))
+								{
+									bson_t *query_p = bson_new ();
+
+									if (query_p)
+										{
+											bson_t *opts_p = BCON_NEW ("projection", "{", MONGO_ID_S, BCON_INT32 (1), "}");
+
+											if (opts_p)
+												{
+													json_t *studies_p = GetAllMongoResultsAsJSON (mongo_p, query_p, opts_p);
+
+													if (studies_p)
+														{
+															size_t i;
+															json_t *study_json_p;
+															size_t num_plots = 0;
+															size_t num_successes = 0;
+
+															/*
+															 * Each Study's Plots are fetched in turn rather
+															 * than loading the whole Plots collection at once.
+															 */
+															json_array_foreach (studies_p, i, study_json_p)
+																{
+																	bson_oid_t study_id;
+
+																	if (GetMongoIdFromJSON (study_json_p, &study_id))
+																		{
+																			if (!BackfillStudyObservations (mongo_p, &study_id, &num_plots, &num_successes))
+																				{
+																					ret = 1;
+																				}
+																		}
+																	else
+																		{
+																			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, study_json_p, "Failed to get \"%s\"", MONGO_ID_S);
+																			ret = 1;
+																		}
+
+																}		/* json_array_foreach (studies_p, i, study_json_p) */
+
+															printf ("backfilled the observations of %lu out of %lu plots successfully\n", num_successes, num_plots);
+
+															if (num_successes != num_plots)
+																{
+																	ret = 1;
+																}
+
+															json_decref (studies_p);
+														}		/* if (studies_p) */
+													else
+														{
+															ret = 1;
+														}
+
+													bson_destroy (opts_p);
+												}		/* if (opts_p) */
+
+											bson_destroy (query_p);
+										}		/* if (query_p) */
+
+								}		/* if (SetMongoToolDatabaseAndCollection (mongo_p, "dfw_field_trial", DFT_STUDIES_S)) */
+
+							FreeMongoTool (mongo_p);
+						}		/* if (mongo_p) */
+
+					FreeMongoClientManager (mongo_clients_p);
+				}		/* if (mongo_clients_p) */
+
+			ExitMongoDB ();
+		}
+
+	return ret;
+}
+
+
+static bool BackfillStudyObservations (MongoTool *mongo_p, const bson_oid_t *study_id_p, size_t *num_plots_p, size_t *num_successes_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (mongo_p, DFT_PLOT_S))
+		{
+			bson_t *query_p = BCON_NEW (PL_PARENT_STUDY_S, BCON_OID (study_id_p));
+
+			if (query_p)
+				{
+					bson_t *opts_p = BCON_NEW ("projection", "{", PL_ROWS_S, BCON_INT32 (1), "}");
+
+					if (opts_p)
+						{
+							json_t *plots_p = GetAllMongoResultsAsJSON (mongo_p, query_p, opts_p);
+
+							if (plots_p)
+								{
+									size_t i;
+									json_t *plot_json_p;
+
+									success_flag = true;
+
+									json_array_foreach (plots_p, i, plot_json_p)
+										{
+											++ (*num_plots_p);
+
+											if (BackfillPlotObservations (mongo_p, plot_json_p))
+												{
+													++ (*num_successes_p);
+												}
+											else
+												{
+													success_flag = false;
+												}
+										}
+
+									json_decref (plots_p);
+								}		/* if (plots_p) */
+
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (mongo_p, DFT_PLOT_S)) */
+
+	if (!success_flag)
+		{
+			char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+			bson_oid_to_string (study_id_p, id_s);
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to backfill the observations for study \"%s\"", id_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Upsert the documents for all of a Plot's Observations with a single
+ * unordered update command and then remove any others for the Plot.
+ */
+static bool BackfillPlotObservations (MongoTool *mongo_p, const json_t *plot_json_p)
+{
+	bool success_flag = false;
+	bson_oid_t plot_id;
+
+	if (GetMongoIdFromJSON (plot_json_p, &plot_id))
+		{
+			bson_t *command_p = bson_new ();
+			bson_t *written_ids_p = bson_new ();
+
+			if (command_p && written_ids_p)
+				{
+					bson_t updates;
+
+					if ((BSON_APPEND_UTF8 (command_p, "update", DFT_OBSERVATION_S)) && (BSON_APPEND_ARRAY_BEGIN (command_p, "updates", &updates)))
+						{
+							const json_t *rows_p = json_object_get (plot_json_p, PL_ROWS_S);
+							uint32 num_updates = 0;
+							size_t i;
+							const json_t *row_json_p;
+
+							success_flag = true;
+
+							json_array_foreach (rows_p, i, row_json_p)
+								{
+									if (!AddRowObservationUpserts (row_json_p, &updates, &num_updates, written_ids_p))
+										{
+											success_flag = false;
+										}
+								}
+
+							if (!bson_append_array_end (command_p, &updates))
+								{
+									success_flag = false;
+								}
+
+							if (success_flag && (num_updates > 0))
+								{
+									bson_t *reply_p = NULL;
+
+									success_flag = false;
+
+									if ((BSON_APPEND_BOOL (command_p, "ordered", false)) && (RunMongoCommand (mongo_p, command_p, &reply_p)))
+										{
+											success_flag = true;
+
+											if (reply_p)
+												{
+													json_t *reply_json_p = ConvertBSONToJSON (reply_p);
+
+													if (reply_json_p)
+														{
+															const json_t *write_errors_p = json_object_get (reply_json_p, "writeErrors");
+
+															if (json_array_size (write_errors_p) > 0)
+																{
+																	PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, write_errors_p, "Failed to write " SIZET_FMT " observations", json_array_size (write_errors_p));
+																	success_flag = false;
+																}
+
+															json_decref (reply_json_p);
+														}		/* if (reply_json_p) */
+
+													bson_destroy (reply_p);
+												}		/* if (reply_p) */
+										}
+								}
+
+							/*
+							 * Only remove the old documents once the new ones are all there
+							 */
+							if (success_flag)
+								{
+									success_flag = RemoveOtherPlotObservations (mongo_p, &plot_id, written_ids_p);
+								}
+						}
+				}
+
+			if (written_ids_p)
+				{
+					bson_destroy (written_ids_p);
+				}
+
+			if (command_p)
+				{
+					bson_destroy (command_p);
+				}
+
+			if (!success_flag)
+				{
+					char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+					bson_oid_to_string (&plot_id, id_s);
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to backfill the observations for plot \"%s\"", id_s);
+				}
+
+		}		/* if (GetMongoIdFromJSON (plot_json_p, &plot_id)) */
+	else
+		{
+			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, plot_json_p, "Failed to get \"%s\"", MONGO_ID_S);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Each document is the stored Observation along with the ids from its Row,
+ * the same as the service writes them.
+ */
+static bool AddRowObservationUpserts (const json_t *row_json_p, bson_t *updates_p, uint32 *num_updates_p, bson_t *written_ids_p)
+{
+	bool success_flag = true;
+	const json_t *observations_p = json_object_get (row_json_p, RO_OBSERVATIONS_S);
+	size_t i;
+	const json_t *observation_json_p;
+
+	json_array_foreach (observations_p, i, observation_json_p)
+		{
+			json_t *doc_json_p = json_copy ((json_t *) observation_json_p);
+
+			if (doc_json_p)
+				{
+					bson_t *doc_p = NULL;
+
+					if ((CopyRowId (doc_json_p, OJ_ROW_ID_S, row_json_p, MONGO_ID_S)) && (CopyRowId (doc_json_p, RO_PLOT_ID_S, row_json_p, RO_PLOT_ID_S)) &&
+							(CopyRowId (doc_json_p, RO_STUDY_ID_S, row_json_p, RO_STUDY_ID_S)) && (CopyRowId (doc_json_p, RO_MATERIAL_ID_S, row_json_p, RO_MATERIAL_ID_S)))
+						{
+							doc_p = ConvertJSONToBSON (doc_json_p);
+						}
+
+					if (doc_p)
+						{
+							bson_iter_t iter;
+
+							if ((bson_iter_init_find (&iter, doc_p, MONGO_ID_S)) && (BSON_ITER_HOLDS_OID (&iter)))
+								{
+									const bson_oid_t *id_p = bson_iter_oid (&iter);
+									char index_buffer [16];
+									const char *index_s;
+									bson_t update;
+
+									bson_uint32_to_string (*num_updates_p, &index_s, index_buffer, sizeof (index_buffer));
+
+									if (BSON_APPEND_DOCUMENT_BEGIN (updates_p, index_s, &update))
+										{
+											bson_t q;
+
+											if (BSON_APPEND_DOCUMENT_BEGIN (&update, "q", &q))
+												{
+													if (!BSON_APPEND_OID (&q, MONGO_ID_S, id_p))
+														{
+															success_flag = false;
+														}
+
+													if (!bson_append_document_end (&update, &q))
+														{
+															success_flag = false;
+														}
+												}
+											else
+												{
+													success_flag = false;
+												}
+
+											if (! ((BSON_APPEND_DOCUMENT (&update, "u", doc_p)) && (BSON_APPEND_BOOL (&update, "upsert", true))))
+												{
+													success_flag = false;
+												}
+
+											if (!bson_append_document_end (updates_p, &update))
+												{
+													success_flag = false;
+												}
+
+											if (!BSON_APPEND_OID (written_ids_p, index_s, id_p))
+												{
+													success_flag = false;
+												}
+
+											++ (*num_updates_p);
+										}
+									else
+										{
+											success_flag = false;
+										}
+								}
+							else
+								{
+									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, observation_json_p, "Failed to get \"%s\"", MONGO_ID_S);
+									success_flag = false;
+								}
+
+							bson_destroy (doc_p);
+						}		/* if (doc_p) */
+					else
+						{
+							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_json_p, "Failed to convert observation to BSON");
+							success_flag = false;
+						}
+
+					json_decref (doc_json_p);
+				}		/* if (doc_json_p) */
+			else
+				{
+					success_flag = false;
+				}
+
+		}		/* json_array_foreach (observations_p, i, observation_json_p) */
+
+	return success_flag;
+}
+
+
+/*
+ * Rows without a Material, such as discarded ones, don't store its id
+ * so any missing ids are left out.
+ */
+static bool CopyRowId (json_t *doc_json_p, const char *doc_key_s, const json_t *row_json_p, const char *row_key_s)
+{
+	json_t *id_p = json_object_get (row_json_p, row_key_s);
+
+	return ((!id_p) || (json_object_set (doc_json_p, doc_key_s, id_p) == 0));
+}
+
+
+static bool RemoveOtherPlotObservations (MongoTool *mongo_p, const bson_oid_t *plot_id_p, const bson_t *written_ids_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (mongo_p, DFT_OBSERVATION_S))
+		{
+			bson_t *query_p = BCON_NEW (RO_PLOT_ID_S, BCON_OID (plot_id_p));
+
+			if (query_p)
+				{
+					bson_t written;
+
+					if (BSON_APPEND_DOCUMENT_BEGIN (query_p, MONGO_ID_S, &written))
+						{
+							if (BSON_APPEND_ARRAY (&written, "$nin", written_ids_p))
+								{
+									success_flag = true;
+								}
+
+							if (!bson_append_document_end (query_p, &written))
+								{
+									success_flag = false;
+								}
+						}
+
+					if (success_flag)
+						{
+							success_flag = RemoveMongoDocumentsByBSON (mongo_p, query_p, false);
+						}
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (mongo_p, DFT_OBSERVATION_S)) */
+
+	return success_flag;
+}
@@ -0,0 +1,766 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * background_jobs.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "background_jobs.h"
+#include "dfw_util.h"
+#include "grassroots_server.h"
+#include "json_util.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define BACKGROUND_JOBS_DEBUG	(STM_LEVEL_FINE)
+#else
+	#define BACKGROUND_JOBS_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+typedef enum BackgroundJobState
+{
+	BJS_QUEUED,
+	BJS_RUNNING,
+	BJS_FINISHED
+} BackgroundJobState;
+
+
+/*
+ * The default number of seconds that the output of a finished job is kept
+ * for if the ServiceJob that was submitted is never polled again. This can
+ * be changed with the "background_job_expiry" config key.
+ */
+#define S_DEFAULT_JOB_EXPIRY (24 * 60 * 60)
+
+
+/*
+ * The minimum number of seconds between the updates of a job's progress.
+ */
+#define S_PROGRESS_INTERVAL (1)
+
+
+struct BackgroundJob
+{
+	/*
+	 * The worker's own ServiceJob that it reports the job's output to.
+	 * This only has the service, id and name of the submitted ServiceJob,
+	 * and its own copy of the name, so nothing is shared between them.
+	 * The submitted ServiceJob is matched to this by its id.
+	 */
+	ServiceJob bj_worker_job;
+
+	BackgroundJobFn bj_run_fn;
+
+	json_t *bj_params_p;
+
+	const FieldTrialServiceData *bj_data_p;
+
+	GrassrootsServer *bj_grassroots_p;
+
+	BackgroundJobState bj_state;
+
+	size_t bj_num_rows_processed;
+
+	size_t bj_num_rows;
+
+	size_t bj_num_errors;
+
+	/* Only the worker uses this so it isn't guarded by the lock */
+	time_t bj_last_progress_time;
+
+	time_t bj_finished_time;
+
+	struct BackgroundJob *bj_next_p;
+};
+
+
+/*
+ * The shared state for all of the worker threads.
+ */
+typedef struct BackgroundJobs
+{
+	/* The queued, running and uncollected jobs in submission order */
+	BackgroundJob *bjs_first_p;
+
+	BackgroundJob *bjs_last_p;
+
+	uint32 bjs_num_workers;
+
+	/* How long finished jobs are kept for, in seconds */
+	time_t bjs_expiry;
+
+	pthread_mutex_t bjs_lock;
+} BackgroundJobs;
+
+
+static BackgroundJobs s_background_jobs;
+
+static pthread_once_t s_background_jobs_once = PTHREAD_ONCE_INIT;
+
+static const char * const S_PROGRESS_S = "progress";
+
+
+static BackgroundJobs *GetBackgroundJobs (void);
+
+static void InitBackgroundJobs (void);
+
+static BackgroundJob *AllocateBackgroundJob (ServiceJob *job_p, BackgroundJobFn run_fn, json_t *params_p, const FieldTrialServiceData *data_p, GrassrootsServer *grassroots_p);
+
+static void FreeBackgroundJob (BackgroundJob *bg_job_p);
+
+static bool IsBackgroundJobFor (const BackgroundJob *bg_job_p, const ServiceJob *job_p);
+
+static void RemoveExpiredBackgroundJobs (BackgroundJobs *jobs_p, const time_t now);
+
+static void *RunBackgroundJobsWorker (void *jobs_p);
+
+static void RunBackgroundJob (BackgroundJob *bg_job_p);
+
+static bool UpdateBackgroundServiceJob (ServiceJob *job_p);
+
+static bool AddBackgroundJobProgressToServiceJob (ServiceJob *job_p, const BackgroundJob *bg_job_p);
+
+static void MoveBackgroundJobOutput (json_t **dest_pp, json_t **src_pp);
+
+static size_t GetNumberOfErrors (const json_t *errors_p);
+
+
+
+bool RunBackgroundServiceJob (ServiceJob *job_p, BackgroundJobFn run_fn, json_t *params_p, FieldTrialServiceData *data_p)
+{
+	bool queued_flag = false;
+	int max_num_jobs = BJ_DEFAULT_MAX_NUM_JOBS;
+
+	int expiry = S_DEFAULT_JOB_EXPIRY;
+
+	if (!GetJSONInteger (data_p -> dftsd_base_data.sd_config_p, "max_background_jobs", &max_num_jobs))
+		{
+			max_num_jobs = BJ_DEFAULT_MAX_NUM_JOBS;
+		}
+
+	if ((!GetJSONInteger (data_p -> dftsd_base_data.sd_config_p, "background_job_expiry", &expiry)) || (expiry < 0))
+		{
+			expiry = S_DEFAULT_JOB_EXPIRY;
+		}
+
+	if (max_num_jobs > 0)
+		{
+			GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (job_p -> sj_service_p);
+
+			if (grassroots_p)
+				{
+					BackgroundJob *bg_job_p = AllocateBackgroundJob (job_p, run_fn, params_p, data_p, grassroots_p);
+
+					if (bg_job_p)
+						{
+							BackgroundJobs *jobs_p = GetBackgroundJobs ();
+
+							pthread_mutex_lock (& (jobs_p -> bjs_lock));
+
+							jobs_p -> bjs_expiry = (time_t) expiry;
+							RemoveExpiredBackgroundJobs (jobs_p, time (NULL));
+
+							if (jobs_p -> bjs_num_workers < (uint32) max_num_jobs)
+								{
+									pthread_t thread;
+
+									if (pthread_create (&thread, NULL, RunBackgroundJobsWorker, jobs_p) == 0)
+										{
+											pthread_detach (thread);
+											++ (jobs_p -> bjs_num_workers);
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to start background job worker thread");
+										}
+								}
+
+							/*
+							 * Only queue the job if there is a worker to run it
+							 */
+							if (jobs_p -> bjs_num_workers > 0)
+								{
+									if (jobs_p -> bjs_last_p)
+										{
+											jobs_p -> bjs_last_p -> bj_next_p = bg_job_p;
+										}
+									else
+										{
+											jobs_p -> bjs_first_p = bg_job_p;
+										}
+
+									jobs_p -> bjs_last_p = bg_job_p;
+
+									SetServiceJobStatus (job_p, OS_PENDING);
+									SetServiceJobUpdateFunction (job_p, UpdateBackgroundServiceJob);
+
+									queued_flag = true;
+								}
+
+							pthread_mutex_unlock (& (jobs_p -> bjs_lock));
+
+							if (!queued_flag)
+								{
+									FreeBackgroundJob (bg_job_p);
+								}
+
+						}		/* if (bg_job_p) */
+
+				}		/* if (grassroots_p) */
+
+			if (!queued_flag)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to queue background job, running it now instead");
+				}
+
+		}		/* if (max_num_jobs > 0) */
+
+	if (queued_flag)
+		{
+			return true;
+		}
+
+	return run_fn (job_p, params_p, data_p);
+}
+
+
+BackgroundJob *GetBackgroundJob (ServiceJob *job_p)
+{
+	BackgroundJobs *jobs_p = GetBackgroundJobs ();
+	BackgroundJob *bg_job_p;
+
+	pthread_mutex_lock (& (jobs_p -> bjs_lock));
+
+	for (bg_job_p = jobs_p -> bjs_first_p; bg_job_p != NULL; bg_job_p = bg_job_p -> bj_next_p)
+		{
+			if (& (bg_job_p -> bj_worker_job) == job_p)
+				{
+					break;
+				}
+		}
+
+	pthread_mutex_unlock (& (jobs_p -> bjs_lock));
+
+	return bg_job_p;
+}
+
+
+void SetBackgroundJobProgress (BackgroundJob *bg_job_p, const size_t num_rows_processed, const size_t num_rows)
+{
+	if (bg_job_p)
+		{
+			const time_t now = time (NULL);
+
+			/*
+			 * Publishing the progress takes the shared lock so only
+			 * do it every so often and when the job gets to the end.
+			 */
+			if ((now - (bg_job_p -> bj_last_progress_time) >= S_PROGRESS_INTERVAL) || (num_rows_processed == num_rows))
+				{
+					BackgroundJobs *jobs_p = GetBackgroundJobs ();
+
+					/*
+					 * Only the worker alters its copy of the job's errors
+					 * and this is being called from that worker.
+					 */
+					const size_t num_errors = GetNumberOfErrors (bg_job_p -> bj_worker_job.sj_errors_p);
+
+					pthread_mutex_lock (& (jobs_p -> bjs_lock));
+					bg_job_p -> bj_num_rows_processed = num_rows_processed;
+					bg_job_p -> bj_num_rows = num_rows;
+					bg_job_p -> bj_num_errors = num_errors;
+					pthread_mutex_unlock (& (jobs_p -> bjs_lock));
+
+					bg_job_p -> bj_last_progress_time = now;
+				}
+		}
+}
+
+
+/*
+ * static definitions
+ */
+
+static BackgroundJobs *GetBackgroundJobs (void)
+{
+	pthread_once (&s_background_jobs_once, InitBackgroundJobs);
+
+	return &s_background_jobs;
+}
+
+
+static void InitBackgroundJobs (void)
+{
+	s_background_jobs.bjs_first_p = NULL;
+	s_background_jobs.bjs_last_p = NULL;
+	s_background_jobs.bjs_num_workers = 0;
+	s_background_jobs.bjs_expiry = S_DEFAULT_JOB_EXPIRY;
+
+	pthread_mutex_init (& (s_background_jobs.bjs_lock), NULL);
+}
+
+
+static BackgroundJob *AllocateBackgroundJob (ServiceJob *job_p, BackgroundJobFn run_fn, json_t *params_p, const FieldTrialServiceData *data_p, GrassrootsServer *grassroots_p)
+{
+	BackgroundJob *bg_job_p = (BackgroundJob *) AllocMemory (sizeof (BackgroundJob));
+
+	if (bg_job_p)
+		{
+			/*
+			 * The worker starts with empty output which is added
+			 * to whatever the submitted job already has when it
+			 * is collected.
+			 */
+			memset (& (bg_job_p -> bj_worker_job), 0, sizeof (ServiceJob));
+			bg_job_p -> bj_worker_job.sj_service_p = job_p -> sj_service_p;
+			memcpy (& (bg_job_p -> bj_worker_job.sj_id), & (job_p -> sj_id), sizeof (job_p -> sj_id));
+
+			if ((! (job_p -> sj_name_s)) || ((bg_job_p -> bj_worker_job.sj_name_s = EasyCopyToNewString (job_p -> sj_name_s)) != NULL))
+				{
+					bg_job_p -> bj_run_fn = run_fn;
+					bg_job_p -> bj_params_p = json_incref (params_p);
+					bg_job_p -> bj_data_p = data_p;
+					bg_job_p -> bj_grassroots_p = grassroots_p;
+					bg_job_p -> bj_state = BJS_QUEUED;
+					bg_job_p -> bj_num_rows_processed = 0;
+					bg_job_p -> bj_num_rows = 0;
+					bg_job_p -> bj_num_errors = 0;
+					bg_job_p -> bj_last_progress_time = 0;
+					bg_job_p -> bj_finished_time = 0;
+					bg_job_p -> bj_next_p = NULL;
+
+					return bg_job_p;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to copy background job name \"%s\"", job_p -> sj_name_s);
+				}
+
+			FreeMemory (bg_job_p);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate background job");
+		}
+
+	return NULL;
+}
+
+
+static void FreeBackgroundJob (BackgroundJob *bg_job_p)
+{
+	if (bg_job_p -> bj_params_p)
+		{
+			json_decref (bg_job_p -> bj_params_p);
+		}
+
+	if (bg_job_p -> bj_worker_job.sj_result_p)
+		{
+			json_decref (bg_job_p -> bj_worker_job.sj_result_p);
+		}
+
+	if (bg_job_p -> bj_worker_job.sj_errors_p)
+		{
+			json_decref (bg_job_p -> bj_worker_job.sj_errors_p);
+		}
+
+	if (bg_job_p -> bj_worker_job.sj_metadata_p)
+		{
+			json_decref (bg_job_p -> bj_worker_job.sj_metadata_p);
+		}
+
+	if (bg_job_p -> bj_worker_job.sj_name_s)
+		{
+			FreeCopiedString (bg_job_p -> bj_worker_job.sj_name_s);
+		}
+
+	FreeMemory (bg_job_p);
+}
+
+
+static bool IsBackgroundJobFor (const BackgroundJob *bg_job_p, const ServiceJob *job_p)
+{
+	return (memcmp (& (bg_job_p -> bj_worker_job.sj_id), & (job_p -> sj_id), sizeof (job_p -> sj_id)) == 0);
+}
+
+
+/*
+ * Free any finished jobs whose output hasn't been collected within
+ * the expiry time. This must be called with the lock held.
+ */
+static void RemoveExpiredBackgroundJobs (BackgroundJobs *jobs_p, const time_t now)
+{
+	BackgroundJob *bg_job_p = jobs_p -> bjs_first_p;
+	BackgroundJob *prev_p = NULL;
+
+	while (bg_job_p)
+		{
+			BackgroundJob *next_p = bg_job_p -> bj_next_p;
+
+			if ((bg_job_p -> bj_state == BJS_FINISHED) && (now - (bg_job_p -> bj_finished_time) > jobs_p -> bjs_expiry))
+				{
+					if (prev_p)
+						{
+							prev_p -> bj_next_p = next_p;
+						}
+					else
+						{
+							jobs_p -> bjs_first_p = next_p;
+						}
+
+					if (jobs_p -> bjs_last_p == bg_job_p)
+						{
+							jobs_p -> bjs_last_p = prev_p;
+						}
+
+					PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Removing the uncollected output of background job \"%s\"", bg_job_p -> bj_worker_job.sj_name_s ? bg_job_p -> bj_worker_job.sj_name_s : "");
+
+					FreeBackgroundJob (bg_job_p);
+				}
+			else
+				{
+					prev_p = bg_job_p;
+				}
+
+			bg_job_p = next_p;
+		}
+}
+
+
+static void *RunBackgroundJobsWorker (void *data_p)
+{
+	BackgroundJobs *jobs_p = (BackgroundJobs *) data_p;
+	bool loop_flag = true;
+
+	while (loop_flag)
+		{
+			BackgroundJob *bg_job_p;
+
+			pthread_mutex_lock (& (jobs_p -> bjs_lock));
+
+			for (bg_job_p = jobs_p -> bjs_first_p; bg_job_p != NULL; bg_job_p = bg_job_p -> bj_next_p)
+				{
+					if (bg_job_p -> bj_state == BJS_QUEUED)
+						{
+							bg_job_p -> bj_state = BJS_RUNNING;
+							break;
+						}
+				}
+
+			/*
+			 * If there's nothing left to do, this worker stops. This is done while
+			 * holding the lock so any job queued afterwards will start a new worker.
+			 */
+			if (!bg_job_p)
+				{
+					-- (jobs_p -> bjs_num_workers);
+					loop_flag = false;
+				}
+
+			pthread_mutex_unlock (& (jobs_p -> bjs_lock));
+
+			if (bg_job_p)
+				{
+					RunBackgroundJob (bg_job_p);
+
+					pthread_mutex_lock (& (jobs_p -> bjs_lock));
+					bg_job_p -> bj_state = BJS_FINISHED;
+					bg_job_p -> bj_finished_time = time (NULL);
+					bg_job_p -> bj_num_errors = GetNumberOfErrors (bg_job_p -> bj_worker_job.sj_errors_p);
+					pthread_mutex_unlock (& (jobs_p -> bjs_lock));
+				}
+
+		}		/* while (loop_flag) */
+
+	return NULL;
+}
+
+
+static void RunBackgroundJob (BackgroundJob *bg_job_p)
+{
+	ServiceJob *job_p = & (bg_job_p -> bj_worker_job);
+	FieldTrialServiceData *data_p = AllocateWorkerServiceData (bg_job_p -> bj_data_p, bg_job_p -> bj_grassroots_p);
+
+	SetServiceJobStatus (job_p, OS_FAILED_TO_START);
+
+	if (data_p)
+		{
+			bool success_flag;
+			OperationStatus status;
+
+			SetServiceJobStatus (job_p, OS_STARTED);
+
+			success_flag = bg_job_p -> bj_run_fn (job_p, bg_job_p -> bj_params_p, data_p);
+
+			/*
+			 * Make sure that the job doesn't look like it's still running. The
+			 * status is read directly as this copy of the job is never polled.
+			 */
+			status = job_p -> sj_status;
+
+			if ((status == OS_STARTED) || (status == OS_PENDING))
+				{
+					SetServiceJobStatus (job_p, success_flag ? OS_SUCCEEDED : OS_FAILED);
+				}
+
+			#if BACKGROUND_JOBS_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Background job \"%s\" finished with status %d", job_p -> sj_name_s ? job_p -> sj_name_s : "", job_p -> sj_status);
+			#endif
+
+			FreeWorkerServiceData (data_p);
+		}		/* if (data_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set up the service data for background job");
+		}
+
+	json_decref (bg_job_p -> bj_params_p);
+	bg_job_p -> bj_params_p = NULL;
+}
+
+
+/*
+ * This is called on the thread that is polling the job.
+ */
+static bool UpdateBackgroundServiceJob (ServiceJob *job_p)
+{
+	bool success_flag = true;
+	BackgroundJobs *jobs_p = GetBackgroundJobs ();
+	BackgroundJob *bg_job_p;
+	BackgroundJob *prev_p = NULL;
+	BackgroundJob *finished_job_p = NULL;
+	bool found_flag = false;
+
+	pthread_mutex_lock (& (jobs_p -> bjs_lock));
+
+	RemoveExpiredBackgroundJobs (jobs_p, time (NULL));
+
+	for (bg_job_p = jobs_p -> bjs_first_p; bg_job_p != NULL; bg_job_p = bg_job_p -> bj_next_p)
+		{
+			if (IsBackgroundJobFor (bg_job_p, job_p))
+				{
+					found_flag = true;
+
+					success_flag = AddBackgroundJobProgressToServiceJob (job_p, bg_job_p);
+
+					switch (bg_job_p -> bj_state)
+						{
+							case BJS_QUEUED:
+								SetServiceJobStatus (job_p, OS_PENDING);
+								break;
+
+							case BJS_RUNNING:
+								SetServiceJobStatus (job_p, OS_STARTED);
+								break;
+
+							case BJS_FINISHED:
+								/*
+								 * The worker has finished with it so it can be
+								 * taken off of the list and collected.
+								 */
+								if (prev_p)
+									{
+										prev_p -> bj_next_p = bg_job_p -> bj_next_p;
+									}
+								else
+									{
+										jobs_p -> bjs_first_p = bg_job_p -> bj_next_p;
+									}
+
+								if (jobs_p -> bjs_last_p == bg_job_p)
+									{
+										jobs_p -> bjs_last_p = prev_p;
+									}
+
+								finished_job_p = bg_job_p;
+								break;
+						}
+
+					break;
+				}		/* if (IsBackgroundJobFor (bg_job_p, job_p)) */
+
+			prev_p = bg_job_p;
+		}
+
+	pthread_mutex_unlock (& (jobs_p -> bjs_lock));
+
+	if (finished_job_p)
+		{
+			ServiceJob *worker_job_p = & (finished_job_p -> bj_worker_job);
+
+			MoveBackgroundJobOutput (& (job_p -> sj_result_p), & (worker_job_p -> sj_result_p));
+			MoveBackgroundJobOutput (& (job_p -> sj_errors_p), & (worker_job_p -> sj_errors_p));
+			MoveBackgroundJobOutput (& (job_p -> sj_metadata_p), & (worker_job_p -> sj_metadata_p));
+
+			SetServiceJobStatus (job_p, worker_job_p -> sj_status);
+
+			FreeBackgroundJob (finished_job_p);
+		}
+	else if (!found_flag)
+		{
+			const OperationStatus status = job_p -> sj_status;
+
+			/*
+			 * If the job hadn't been collected, its output has expired
+			 */
+			if ((status == OS_STARTED) || (status == OS_PENDING))
+				{
+					AddGeneralErrorMessageToServiceJob (job_p, "The output of this job has expired");
+					SetServiceJobStatus (job_p, OS_FAILED);
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool AddBackgroundJobProgressToServiceJob (ServiceJob *job_p, const BackgroundJob *bg_job_p)
+{
+	bool success_flag = false;
+	const char *state_s = "queued";
+	json_t *progress_p = NULL;
+
+	if (bg_job_p -> bj_state == BJS_RUNNING)
+		{
+			state_s = "running";
+		}
+	else if (bg_job_p -> bj_state == BJS_FINISHED)
+		{
+			state_s = "finished";
+		}
+
+	progress_p = json_pack ("{s:s,s:I,s:I,s:I}",
+		"state", state_s,
+		"rows_processed", (json_int_t) (bg_job_p -> bj_num_rows_processed),
+		"rows", (json_int_t) (bg_job_p -> bj_num_rows),
+		"errors", (json_int_t) (bg_job_p -> bj_num_errors));
+
+	if (progress_p)
+		{
+			if (! (job_p -> sj_metadata_p))
+				{
+					job_p -> sj_metadata_p = json_object ();
+				}
+
+			if (job_p -> sj_metadata_p)
+				{
+					if (json_object_set_new (job_p -> sj_metadata_p, S_PROGRESS_S, progress_p) == 0)
+						{
+							success_flag = true;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add background job progress");
+						}
+				}
+			else
+				{
+					json_decref (progress_p);
+				}
+		}		/* if (progress_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create background job progress");
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Add the worker's output to the submitted job's. Arrays are appended
+ * to and objects are merged, anything else is replaced.
+ */
+static void MoveBackgroundJobOutput (json_t **dest_pp, json_t **src_pp)
+{
+	json_t *src_p = *src_pp;
+
+	if (src_p)
+		{
+			json_t *dest_p = *dest_pp;
+
+			if ((json_is_array (dest_p)) && (json_is_array (src_p)))
+				{
+					if (json_array_extend (dest_p, src_p) != 0)
+						{
+							PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, src_p, "Failed to add background job output");
+						}
+
+					json_decref (src_p);
+				}
+			else if ((json_is_object (dest_p)) && (json_is_object (src_p)))
+				{
+					if (json_object_update (dest_p, src_p) != 0)
+						{
+							PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, src_p, "Failed to add background job output");
+						}
+
+					json_decref (src_p);
+				}
+			else
+				{
+					if (dest_p)
+						{
+							json_decref (dest_p);
+						}
+
+					*dest_pp = src_p;
+				}
+
+			*src_pp = NULL;
+		}		/* if (src_p) */
+}
+
+
+static size_t GetNumberOfErrors (const json_t *errors_p)
+{
+	size_t num_errors = 0;
+
+	if (json_is_array (errors_p))
+		{
+			num_errors = json_array_size (errors_p);
+		}
+	else if (json_is_object (errors_p))
+		{
+			const char *key_s;
+			json_t *value_p;
+
+			json_object_foreach ((json_t *) errors_p, key_s, value_p)
+				{
+					num_errors += GetNumberOfErrors (value_p);
+				}
+
+			/*
+			 * An object with no nested errors is a single error
+			 */
+			if ((num_errors == 0) && (json_object_size (errors_p) > 0))
+				{
+					num_errors = 1;
+				}
+		}
+
+	return num_errors;
+}
@@ -0,0 +1,414 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * change_tracking.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <time.h>
+
+#define ALLOCATE_CHANGE_TRACKING_TAGS (1)
+#include "change_tracking.h"
+
+#include "memory_allocations.h"
+#include "mongodb_tool.h"
+#include "mongodb_util.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+/*
+ * The id of the document holding the modification counter.
+ */
+static const char * const S_COUNTER_ID_S = "modification_counter";
+
+static const char * const S_COUNTER_VALUE_S = "value";
+
+static const char * const S_CHECKPOINT_PREFIX_S = "checkpoint_";
+
+static const char * const S_CHECKPOINT_TIME_S = "time";
+
+
+/*
+ * The datatypes whose documents are stamped when they are saved.
+ */
+static const DFWFieldTrialData S_TRACKED_TYPES [] =
+{
+	DFTD_STUDY,
+	DFTD_FIELD_TRIAL,
+	DFTD_LOCATION,
+	DFTD_MEASURED_VARIABLE,
+	DFTD_PROGRAM
+};
+
+
+static bool GetIndexingStateDocument (const char *id_s, json_t **doc_pp, const FieldTrialServiceData *data_p);
+
+static bool AddModificationIndexesToCollection (const char *collection_s, const FieldTrialServiceData *data_p);
+
+
+
+bool StampModification (json_t *doc_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	bson_t *command_p = BCON_NEW ("findAndModify", BCON_UTF8 (CT_INDEXING_STATE_S),
+																"query", "{", MONGO_ID_S, BCON_UTF8 (S_COUNTER_ID_S), "}",
+																"update", "{", "$inc", "{", S_COUNTER_VALUE_S, BCON_INT64 (1), "}", "}",
+																"new", BCON_BOOL (true),
+																"upsert", BCON_BOOL (true));
+
+	if (command_p)
+		{
+			bson_t *reply_p = NULL;
+
+			if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p))
+				{
+					if (reply_p)
+						{
+							json_t *reply_json_p = ConvertBSONToJSON (reply_p);
+
+							if (reply_json_p)
+								{
+									const json_t *counter_p = json_object_get (reply_json_p, "value");
+									const json_t *value_p = counter_p ? json_object_get (counter_p, S_COUNTER_VALUE_S) : NULL;
+
+									if (json_is_integer (value_p))
+										{
+											if (json_object_set_new (doc_p, CT_MODIFICATION_S, json_integer (json_integer_value (value_p))) == 0)
+												{
+													if (json_object_set_new (doc_p, CT_MODIFIED_AT_S, json_integer ((json_int_t) time (NULL))) == 0)
+														{
+															success_flag = true;
+														}
+													else
+														{
+															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Failed to set \"%s\"", CT_MODIFIED_AT_S);
+														}
+												}
+											else
+												{
+													PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Failed to set \"%s\"", CT_MODIFICATION_S);
+												}
+										}
+									else
+										{
+											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, reply_json_p, "Failed to get the next modification marker");
+										}
+
+									json_decref (reply_json_p);
+								}		/* if (reply_json_p) */
+
+							bson_destroy (reply_p);
+						}		/* if (reply_p) */
+
+				}		/* if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p)) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to increment the modification counter in \"%s\"", CT_INDEXING_STATE_S);
+				}
+
+			bson_destroy (command_p);
+		}		/* if (command_p) */
+
+	return success_flag;
+}
+
+
+bool GetCurrentModification (int64 *modification_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	json_t *counter_p = NULL;
+
+	if (GetIndexingStateDocument (S_COUNTER_ID_S, &counter_p, data_p))
+		{
+			*modification_p = 0;
+
+			if (counter_p)
+				{
+					const json_t *value_p = json_object_get (counter_p, S_COUNTER_VALUE_S);
+
+					if (json_is_integer (value_p))
+						{
+							*modification_p = json_integer_value (value_p);
+							success_flag = true;
+						}
+					else
+						{
+							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, counter_p, "Failed to get \"%s\"", S_COUNTER_VALUE_S);
+						}
+
+					json_decref (counter_p);
+				}
+			else
+				{
+					/* Nothing has been stamped yet */
+					success_flag = true;
+				}
+		}
+
+	return success_flag;
+}
+
+
+bool GetIndexingCheckpoint (const char *name_s, int64 *modification_p, time_t *time_p, json_t **indexed_ids_pp, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	char *id_s = ConcatenateStrings (S_CHECKPOINT_PREFIX_S, name_s);
+
+	if (id_s)
+		{
+			json_t *checkpoint_p = NULL;
+
+			if (GetIndexingStateDocument (id_s, &checkpoint_p, data_p))
+				{
+					*modification_p = -1;
+					*time_p = 0;
+					*indexed_ids_pp = NULL;
+
+					if (checkpoint_p)
+						{
+							const json_t *value_p = json_object_get (checkpoint_p, CT_MODIFICATION_S);
+							const json_t *time_value_p = json_object_get (checkpoint_p, S_CHECKPOINT_TIME_S);
+							json_t *ids_p = json_object_get (checkpoint_p, CT_INDEXED_IDS_S);
+
+							if ((json_is_integer (value_p)) && (json_is_array (ids_p)))
+								{
+									*modification_p = json_integer_value (value_p);
+
+									/* Checkpoints stored before the times were added don't have one */
+									if (json_is_integer (time_value_p))
+										{
+											*time_p = (time_t) json_integer_value (time_value_p);
+										}
+
+									*indexed_ids_pp = json_incref (ids_p);
+									success_flag = true;
+								}
+							else
+								{
+									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, checkpoint_p, "Invalid indexing checkpoint \"%s\"", id_s);
+								}
+
+							json_decref (checkpoint_p);
+						}
+					else
+						{
+							success_flag = true;
+						}
+				}
+
+			FreeCopiedString (id_s);
+		}		/* if (id_s) */
+
+	return success_flag;
+}
+
+
+bool SetIndexingCheckpoint (const char *name_s, const int64 modification, const time_t checkpoint_time, const json_t *indexed_ids_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	char *id_s = ConcatenateStrings (S_CHECKPOINT_PREFIX_S, name_s);
+
+	if (id_s)
+		{
+			bson_t *checkpoint_p = bson_new ();
+
+			if (checkpoint_p)
+				{
+					bson_t ids;
+
+					if ((BSON_APPEND_INT64 (checkpoint_p, CT_MODIFICATION_S, modification)) && (BSON_APPEND_INT64 (checkpoint_p, S_CHECKPOINT_TIME_S, (int64) checkpoint_time)))
+						{
+							if (BSON_APPEND_ARRAY_BEGIN (checkpoint_p, CT_INDEXED_IDS_S, &ids))
+								{
+									bool ids_flag = true;
+									size_t i;
+									const json_t *indexed_id_p;
+
+									json_array_foreach (indexed_ids_p, i, indexed_id_p)
+										{
+											const char *indexed_id_s = json_string_value (indexed_id_p);
+
+											if (indexed_id_s)
+												{
+													char key_buffer [16];
+													const char *key_s = NULL;
+
+													bson_uint32_to_string ((uint32) i, &key_s, key_buffer, sizeof (key_buffer));
+
+													if (!BSON_APPEND_UTF8 (&ids, key_s, indexed_id_s))
+														{
+															ids_flag = false;
+														}
+												}
+										}
+
+									if (bson_append_array_end (checkpoint_p, &ids) && ids_flag)
+										{
+											bson_t *command_p = BCON_NEW ("update", BCON_UTF8 (CT_INDEXING_STATE_S),
+																										"updates", "[",
+																											"{",
+																												"q", "{", MONGO_ID_S, BCON_UTF8 (id_s), "}",
+																												"u", BCON_DOCUMENT (checkpoint_p),
+																												"upsert", BCON_BOOL (true),
+																											"}",
+																										"]");
+
+											if (command_p)
+												{
+													bson_t *reply_p = NULL;
+
+													if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p))
+														{
+															success_flag = true;
+
+															if (reply_p)
+																{
+																	bson_destroy (reply_p);
+																}
+														}
+
+													bson_destroy (command_p);
+												}		/* if (command_p) */
+
+										}		/* if (bson_append_array_end (checkpoint_p, &ids) && ids_flag) */
+
+								}		/* if (BSON_APPEND_ARRAY_BEGIN (checkpoint_p, CT_INDEXED_IDS_S, &ids)) */
+
+						}		/* if ((BSON_APPEND_INT64 (checkpoint_p, CT_MODIFICATION_S, modification)) && ... */
+
+					bson_destroy (checkpoint_p);
+				}		/* if (checkpoint_p) */
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to store indexing checkpoint \"%s\"", id_s);
+				}
+
+			FreeCopiedString (id_s);
+		}		/* if (id_s) */
+
+	return success_flag;
+}
+
+
+bool AddModificationIndexes (const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+	const size_t num_types = sizeof (S_TRACKED_TYPES) / sizeof (S_TRACKED_TYPES [0]);
+	size_t i;
+
+	for (i = 0; i < num_types; ++ i)
+		{
+			if (!AddModificationIndexesToCollection (data_p -> dftsd_collection_ss [S_TRACKED_TYPES [i]], data_p))
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool AddModificationIndexesToCollection (const char *collection_s, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	bson_t *command_p = BCON_NEW ("createIndexes", BCON_UTF8 (collection_s),
+																"indexes", "[",
+																	"{",
+																		"key", "{", CT_MODIFICATION_S, BCON_INT32 (1), "}",
+																		"name", BCON_UTF8 (CT_MODIFICATION_S),
+																	"}",
+																	"{",
+																		"key", "{", CT_MODIFIED_AT_S, BCON_INT32 (1), "}",
+																		"name", BCON_UTF8 (CT_MODIFIED_AT_S),
+																	"}",
+																"]");
+
+	if (command_p)
+		{
+			bson_t *reply_p = NULL;
+
+			if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p))
+				{
+					success_flag = true;
+
+					if (reply_p)
+						{
+							bson_destroy (reply_p);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add the modification indexes to \"%s\"", collection_s);
+				}
+
+			bson_destroy (command_p);
+		}		/* if (command_p) */
+
+	return success_flag;
+}
+
+
+/*
+ * Get a document from the indexing state collection. If it doesn't
+ * exist, *doc_pp is set to NULL.
+ */
+static bool GetIndexingStateDocument (const char *id_s, json_t **doc_pp, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, CT_INDEXING_STATE_S))
+		{
+			bson_t *query_p = BCON_NEW (MONGO_ID_S, BCON_UTF8 (id_s));
+
+			if (query_p)
+				{
+					json_t *results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, NULL);
+
+					*doc_pp = NULL;
+
+					/*
+					 * No results is treated the same as a missing document, which
+					 * at worst means that everything is reindexed.
+					 */
+					if (results_p)
+						{
+							json_t *doc_p = json_array_get (results_p, 0);
+
+							if (doc_p)
+								{
+									*doc_pp = json_incref (doc_p);
+								}
+
+							json_decref (results_p);
+						}
+
+					success_flag = true;
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, CT_INDEXING_STATE_S)) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set collection to \"%s\"", CT_INDEXING_STATE_S);
+		}
+
+	return success_flag;
+}
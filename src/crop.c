@@ -23,6 +23,7 @@
 #define ALLOCATE_CROP_TAGS (1)
 #include "crop.h"
 #include "dfw_util.h"
+#include "reference_cache.h"
 
 #include "memory_allocations.h"
 #include "string_utils.h"
@@ -437,6 +438,11 @@ bool SaveCrop (Crop *crop_p, const FieldTrialServiceData *data_p)
 				{
 					success_flag = SaveMongoData (data_p -> dftsd_mongo_p, crop_json_p, data_p -> dftsd_collection_ss [DFTD_CROP], selector_p);
 
+					if (success_flag)
+						{
+							InvalidateCachedReferenceById (data_p -> dftsd_reference_cache_p, DFTD_CROP, crop_p -> cr_id_p);
+						}
+
 					json_decref (crop_json_p);
 				}		/* if (crop_json_p) */
 
@@ -448,17 +454,7 @@ bool SaveCrop (Crop *crop_p, const FieldTrialServiceData *data_p)
 
 Crop *GetCropById (const bson_oid_t *id_p, const FieldTrialServiceData *data_p)
 {
-	Crop *crop_p = NULL;
-	char *id_s = GetBSONOidAsString (id_p);
-
-	if (id_s)
-		{
-			crop_p = GetCropByIdString (id_s, data_p);
-		}
-	else
-		{
-			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "GetBSONOidAsString failed for crop");
-		}
+	Crop *crop_p = (Crop *) GetDFWObjectById (id_p, DFTD_CROP, GetCropCallback, VF_STORAGE, data_p);
 
 	return crop_p;
 }
@@ -346,22 +346,11 @@ Crop *GetStoredCropValue (const json_t *json_p, const char *key_s, const FieldTr
 				{
 					if (GetNamedIdFromJSON (json_p, key_s, crop_id_p))
 						{
-							char *id_s = GetBSONOidAsString (crop_id_p);
+							crop_p = GetCropById (crop_id_p, data_p);
 
-							if (id_s)
+							if (!crop_p)
 								{
-									crop_p = GetCropByIdString (id_s, data_p);
-
-									if (!crop_p)
-										{
-											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "GetCropByIdString failed for \"%s\"", id_s);
-										}
-
-									FreeCopiedString (id_s);
-								}		/* if (id_s) */
-							else
-								{
-									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, json_p, "GetBSONOidAsString for \"%s\"", key_s);
+									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, json_p, "GetCropById failed for \"%s\"", key_s);
 								}
 
 						}		/* if (GetNamedIdFromJSON (json_p, key_s, crop_id_p)) */
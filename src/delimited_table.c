@@ -0,0 +1,570 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * delimited_table.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <string.h>
+
+#include "delimited_table.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+/*
+ * The number of cells that a reader starts with room for.
+ */
+#define S_INITIAL_NUM_CELLS (32)
+
+
+static bool AddDelimitedTableCell (DelimitedTableReader *reader_p, const char *value_s, const size_t length, const bool escaped_flag);
+
+static json_t *GetDelimitedTableCellAsJSON (const DelimitedTableCell *cell_p);
+
+static void CopyDelimitedTableCellValue (const DelimitedTableCell *cell_p, char *dest_s);
+
+static bool ReserveDelimitedTableBuffer (DelimitedTableReader *reader_p, const size_t size);
+
+
+
+bool InitDelimitedTableReader (DelimitedTableReader *reader_p, const char *data_s, const char delimiter)
+{
+	reader_p -> dtr_delimiter = delimiter;
+	reader_p -> dtr_num_cells = 0;
+	reader_p -> dtr_num_rows_read = 0;
+	reader_p -> dtr_error_flag = false;
+
+	/* Skip any UTF-8 byte order mark that a spreadsheet has added */
+	if (strncmp (data_s, "\xEF\xBB\xBF", 3) == 0)
+		{
+			data_s += 3;
+		}
+
+	reader_p -> dtr_next_s = data_s;
+	reader_p -> dtr_row_s = data_s;
+	reader_p -> dtr_buffer_s = NULL;
+	reader_p -> dtr_buffer_size = 0;
+
+	reader_p -> dtr_cells_p = (DelimitedTableCell *) AllocMemoryArray (S_INITIAL_NUM_CELLS, sizeof (DelimitedTableCell));
+
+	if (reader_p -> dtr_cells_p)
+		{
+			reader_p -> dtr_max_num_cells = S_INITIAL_NUM_CELLS;
+			return true;
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate %d table cells", S_INITIAL_NUM_CELLS);
+			reader_p -> dtr_max_num_cells = 0;
+		}
+
+	return false;
+}
+
+
+void ClearDelimitedTableReader (DelimitedTableReader *reader_p)
+{
+	if (reader_p -> dtr_cells_p)
+		{
+			FreeMemory (reader_p -> dtr_cells_p);
+			reader_p -> dtr_cells_p = NULL;
+		}
+
+	if (reader_p -> dtr_buffer_s)
+		{
+			FreeMemory (reader_p -> dtr_buffer_s);
+			reader_p -> dtr_buffer_s = NULL;
+		}
+
+	reader_p -> dtr_num_cells = 0;
+	reader_p -> dtr_max_num_cells = 0;
+	reader_p -> dtr_buffer_size = 0;
+	reader_p -> dtr_next_s = NULL;
+	reader_p -> dtr_row_s = NULL;
+}
+
+
+bool ReadDelimitedTableRow (DelimitedTableReader *reader_p)
+{
+	const char *current_s = reader_p -> dtr_next_s;
+	const char delimiter = reader_p -> dtr_delimiter;
+	bool loop_flag = true;
+
+	reader_p -> dtr_num_cells = 0;
+
+	if ((reader_p -> dtr_error_flag) || (!current_s) || (*current_s == '\0'))
+		{
+			return false;
+		}
+
+	while (loop_flag)
+		{
+			const char *value_s = current_s;
+			size_t length = 0;
+			bool escaped_flag = false;
+
+			if (*current_s == '"')
+				{
+					bool quoted_flag = true;
+
+					value_s = ++ current_s;
+
+					/*
+					 * Find the closing quote, stepping over any doubled ones
+					 */
+					while (quoted_flag)
+						{
+							const char *quote_s = strchr (current_s, '"');
+
+							if (quote_s)
+								{
+									if (* (quote_s + 1) == '"')
+										{
+											escaped_flag = true;
+											current_s = quote_s + 2;
+										}
+									else
+										{
+											length = quote_s - value_s;
+											current_s = quote_s + 1;
+											quoted_flag = false;
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Unterminated quoted cell in row " SIZET_FMT, reader_p -> dtr_num_rows_read + 1);
+									reader_p -> dtr_error_flag = true;
+									return false;
+								}
+						}
+
+					/*
+					 * Anything between the closing quote and the end of the
+					 * cell isn't part of the value
+					 */
+					while ((*current_s != '\0') && (*current_s != delimiter) && (*current_s != '\r') && (*current_s != '\n'))
+						{
+							++ current_s;
+						}
+				}
+			else
+				{
+					while ((*current_s != '\0') && (*current_s != delimiter) && (*current_s != '\r') && (*current_s != '\n'))
+						{
+							++ current_s;
+						}
+
+					length = current_s - value_s;
+				}
+
+			if (!AddDelimitedTableCell (reader_p, value_s, length, escaped_flag))
+				{
+					reader_p -> dtr_error_flag = true;
+					return false;
+				}
+
+			if (*current_s == delimiter)
+				{
+					++ current_s;
+				}
+			else
+				{
+					if (*current_s == '\r')
+						{
+							++ current_s;
+						}
+
+					if (*current_s == '\n')
+						{
+							++ current_s;
+						}
+
+					loop_flag = false;
+				}
+
+		}		/* while (loop_flag) */
+
+	/*
+	 * Each cell's value is no longer than its place in the row so
+	 * a buffer the size of the row can hold all of them
+	 */
+	if (!ReserveDelimitedTableBuffer (reader_p, (current_s - reader_p -> dtr_next_s) + 1))
+		{
+			reader_p -> dtr_error_flag = true;
+			return false;
+		}
+
+	reader_p -> dtr_row_s = reader_p -> dtr_next_s;
+	reader_p -> dtr_next_s = current_s;
+	++ (reader_p -> dtr_num_rows_read);
+
+	return true;
+}
+
+
+bool IsDelimitedTableRowEmpty (const DelimitedTableReader *reader_p)
+{
+	size_t i;
+	const DelimitedTableCell *cell_p = reader_p -> dtr_cells_p;
+
+	for (i = reader_p -> dtr_num_cells; i > 0; -- i, ++ cell_p)
+		{
+			if (cell_p -> dtc_length > 0)
+				{
+					return false;
+				}
+		}
+
+	return true;
+}
+
+
+size_t GetMaximumNumberOfDelimitedTableRows (const char *data_s)
+{
+	size_t num_rows = 1;
+
+	while ((data_s = strchr (data_s, '\n')) != NULL)
+		{
+			++ num_rows;
+			++ data_s;
+		}
+
+	return num_rows;
+}
+
+
+bool ReadDelimitedTableHeader (DelimitedTableReader *reader_p, DelimitedTableHeader *header_p)
+{
+	header_p -> dth_headings_ss = NULL;
+	header_p -> dth_num_headings = 0;
+
+	if (ReadDelimitedTableRow (reader_p))
+		{
+			const size_t num_headings = reader_p -> dtr_num_cells;
+
+			header_p -> dth_headings_ss = (char **) AllocMemoryArray (num_headings, sizeof (char *));
+
+			if (header_p -> dth_headings_ss)
+				{
+					size_t i;
+					const DelimitedTableCell *cell_p = reader_p -> dtr_cells_p;
+
+					header_p -> dth_num_headings = num_headings;
+
+					for (i = 0; i < num_headings; ++ i, ++ cell_p)
+						{
+							char *heading_s = CopyDelimitedTableCell (cell_p);
+
+							if (heading_s)
+								{
+									* ((header_p -> dth_headings_ss) + i) = heading_s;
+								}
+							else
+								{
+									ClearDelimitedTableHeader (header_p);
+									return false;
+								}
+						}
+
+					return true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " table headings", num_headings);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to read the table headings");
+		}
+
+	return false;
+}
+
+
+void ClearDelimitedTableHeader (DelimitedTableHeader *header_p)
+{
+	if (header_p -> dth_headings_ss)
+		{
+			size_t i;
+			char **heading_ss = header_p -> dth_headings_ss;
+
+			for (i = header_p -> dth_num_headings; i > 0; -- i, ++ heading_ss)
+				{
+					if (*heading_ss)
+						{
+							FreeCopiedString (*heading_ss);
+						}
+				}
+
+			FreeMemory (header_p -> dth_headings_ss);
+			header_p -> dth_headings_ss = NULL;
+		}
+
+	header_p -> dth_num_headings = 0;
+}
+
+
+int32 GetDelimitedTableColumnIndex (const DelimitedTableHeader *header_p, const char *heading_s)
+{
+	size_t i;
+	char **heading_ss = header_p -> dth_headings_ss;
+
+	for (i = 0; i < header_p -> dth_num_headings; ++ i, ++ heading_ss)
+		{
+			if (strcmp (*heading_ss, heading_s) == 0)
+				{
+					return (int32) i;
+				}
+		}
+
+	return -1;
+}
+
+
+void GetDelimitedTablePosition (const DelimitedTableReader *reader_p, DelimitedTablePosition *position_p)
+{
+	position_p -> dtp_next_s = reader_p -> dtr_next_s;
+	position_p -> dtp_num_rows_read = reader_p -> dtr_num_rows_read;
+}
+
+
+void SetDelimitedTablePosition (DelimitedTableReader *reader_p, const DelimitedTablePosition *position_p)
+{
+	reader_p -> dtr_next_s = position_p -> dtp_next_s;
+	reader_p -> dtr_num_rows_read = position_p -> dtp_num_rows_read;
+	reader_p -> dtr_num_cells = 0;
+
+	/* Any error was in a row after the position */
+	reader_p -> dtr_error_flag = false;
+}
+
+
+const char *GetDelimitedTableCellValue (DelimitedTableReader *reader_p, const int32 column_index)
+{
+	if ((column_index >= 0) && ((size_t) column_index < reader_p -> dtr_num_cells))
+		{
+			const DelimitedTableCell *cell_p = (reader_p -> dtr_cells_p) + column_index;
+
+			if (cell_p -> dtc_length > 0)
+				{
+					/*
+					 * The value goes at the same offset in the buffer as it has
+					 * in the row so no two cells can overlap
+					 */
+					char *value_s = (reader_p -> dtr_buffer_s) + (cell_p -> dtc_value_s - reader_p -> dtr_row_s);
+
+					CopyDelimitedTableCellValue (cell_p, value_s);
+
+					return value_s;
+				}
+		}
+
+	return NULL;
+}
+
+
+bool GetDelimitedTableCellAsInteger (DelimitedTableReader *reader_p, const int32 column_index, int32 *value_p)
+{
+	const char *value_s = GetDelimitedTableCellValue (reader_p, column_index);
+
+	if (value_s)
+		{
+			return GetValidInteger (&value_s, value_p);
+		}
+
+	return false;
+}
+
+
+char *CopyDelimitedTableCell (const DelimitedTableCell *cell_p)
+{
+	char *copy_s = (char *) AllocMemory ((cell_p -> dtc_length + 1) * sizeof (char));
+
+	if (copy_s)
+		{
+			CopyDelimitedTableCellValue (cell_p, copy_s);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to copy table cell of length " SIZET_FMT, cell_p -> dtc_length);
+		}
+
+	return copy_s;
+}
+
+
+json_t *GetDelimitedTableRowAsJSON (const DelimitedTableReader *reader_p, const DelimitedTableHeader *header_p)
+{
+	json_t *row_p = json_object ();
+
+	if (row_p)
+		{
+			size_t i;
+			const DelimitedTableCell *cell_p = reader_p -> dtr_cells_p;
+			char **heading_ss = header_p -> dth_headings_ss;
+			size_t num_cells = reader_p -> dtr_num_cells;
+
+			/*
+			 * Any cells without a heading are ignored
+			 */
+			if (num_cells > header_p -> dth_num_headings)
+				{
+					num_cells = header_p -> dth_num_headings;
+				}
+
+			for (i = 0; i < num_cells; ++ i, ++ cell_p, ++ heading_ss)
+				{
+					if ((cell_p -> dtc_length > 0) && (! (IsStringEmpty (*heading_ss))))
+						{
+							json_t *value_p = GetDelimitedTableCellAsJSON (cell_p);
+
+							if ((!value_p) || (json_object_set_new (row_p, *heading_ss, value_p) != 0))
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add \"%s\" to row " SIZET_FMT, *heading_ss, reader_p -> dtr_num_rows_read);
+									json_decref (row_p);
+									return NULL;
+								}
+						}
+				}
+		}
+
+	return row_p;
+}
+
+
+static json_t *GetDelimitedTableCellAsJSON (const DelimitedTableCell *cell_p)
+{
+	json_t *value_p = NULL;
+
+	if (cell_p -> dtc_escaped_flag)
+		{
+			char *value_s = CopyDelimitedTableCell (cell_p);
+
+			if (value_s)
+				{
+					value_p = json_string (value_s);
+					FreeCopiedString (value_s);
+				}
+		}
+	else
+		{
+			value_p = json_stringn (cell_p -> dtc_value_s, cell_p -> dtc_length);
+		}
+
+	return value_p;
+}
+
+
+static void CopyDelimitedTableCellValue (const DelimitedTableCell *cell_p, char *dest_s)
+{
+	if (cell_p -> dtc_escaped_flag)
+		{
+			const char *src_s = cell_p -> dtc_value_s;
+			const char * const end_s = src_s + cell_p -> dtc_length;
+
+			/*
+			 * Each doubled quote becomes a single one
+			 */
+			while (src_s < end_s)
+				{
+					*dest_s = *src_s;
+
+					if ((*src_s == '"') && (src_s + 1 < end_s) && (* (src_s + 1) == '"'))
+						{
+							++ src_s;
+						}
+
+					++ src_s;
+					++ dest_s;
+				}
+
+			*dest_s = '\0';
+		}
+	else
+		{
+			memcpy (dest_s, cell_p -> dtc_value_s, cell_p -> dtc_length);
+			* (dest_s + cell_p -> dtc_length) = '\0';
+		}
+}
+
+
+static bool ReserveDelimitedTableBuffer (DelimitedTableReader *reader_p, const size_t size)
+{
+	if (size > reader_p -> dtr_buffer_size)
+		{
+			char *buffer_s = (char *) AllocMemory (size * sizeof (char));
+
+			if (buffer_s)
+				{
+					if (reader_p -> dtr_buffer_s)
+						{
+							FreeMemory (reader_p -> dtr_buffer_s);
+						}
+
+					reader_p -> dtr_buffer_s = buffer_s;
+					reader_p -> dtr_buffer_size = size;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " bytes for table row " SIZET_FMT, size, reader_p -> dtr_num_rows_read + 1);
+					return false;
+				}
+		}
+
+	return true;
+}
+
+
+static bool AddDelimitedTableCell (DelimitedTableReader *reader_p, const char *value_s, const size_t length, const bool escaped_flag)
+{
+	DelimitedTableCell *cell_p;
+
+	if (reader_p -> dtr_num_cells == reader_p -> dtr_max_num_cells)
+		{
+			const size_t new_max_num_cells = (reader_p -> dtr_max_num_cells) << 1;
+			DelimitedTableCell *new_cells_p = (DelimitedTableCell *) AllocMemoryArray (new_max_num_cells, sizeof (DelimitedTableCell));
+
+			if (new_cells_p)
+				{
+					memcpy (new_cells_p, reader_p -> dtr_cells_p, (reader_p -> dtr_num_cells) * sizeof (DelimitedTableCell));
+					FreeMemory (reader_p -> dtr_cells_p);
+
+					reader_p -> dtr_cells_p = new_cells_p;
+					reader_p -> dtr_max_num_cells = new_max_num_cells;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " table cells", new_max_num_cells);
+					return false;
+				}
+		}
+
+	cell_p = (reader_p -> dtr_cells_p) + (reader_p -> dtr_num_cells);
+
+	cell_p -> dtc_value_s = value_s;
+	cell_p -> dtc_length = length;
+	cell_p -> dtc_escaped_flag = escaped_flag;
+
+	++ (reader_p -> dtr_num_cells);
+
+	return true;
+}
@@ -22,6 +22,11 @@
 
 #define ALLOCATE_DFW_FIELD_TRIAL_SERVICE_TAGS (1)
 #include "dfw_field_trial_service_data.h"
+#include "change_tracking.h"
+#include "document_cache.h"
+#include "observation_jobs.h"
+#include "trait_statistics.h"
+#include "reference_cache.h"
 
 #include "streams.h"
 #include "string_utils.h"
@@ -76,10 +81,21 @@ FieldTrialServiceData *AllocateFieldTrialServiceData (void)
 			data_p -> dftsd_database_s = NULL;
 			data_p -> dftsd_facet_key_s = NULL;
 			data_p -> dftsd_study_cache_path_s = NULL;
+			data_p -> dftsd_study_cache_compression_flag = false;
+			data_p -> dftsd_observations_collection_flag = false;
+			data_p -> dftsd_fd_path_s = NULL;
+			data_p -> dftsd_fd_url_s = NULL;
 
 			memset (data_p -> dftsd_collection_ss, 0, DFTD_NUM_TYPES * sizeof (const char *));
 
-			return data_p;
+			data_p -> dftsd_reference_cache_p = GetReferenceCache ();
+
+			if ((data_p -> dftsd_document_cache_p = AllocateDocumentCache ()) != NULL)
+				{
+					return data_p;
+				}
+
+			FreeMemory (data_p);
 		}
 
 	return NULL;
@@ -93,6 +109,11 @@ void FreeFieldTrialServiceData (FieldTrialServiceData *data_p)
 			FreeMongoTool (data_p -> dftsd_mongo_p);
 		}
 
+	if (data_p -> dftsd_document_cache_p)
+		{
+			FreeDocumentCache (data_p -> dftsd_document_cache_p);
+		}
+
 	FreeMemory (data_p);
 }
 
@@ -123,6 +144,8 @@ bool ConfigureFieldTrialService (FieldTrialServiceData *data_p, GrassrootsServer
 										}
 								}
 
+							GetJSONBoolean (service_config_p, "cache_compression", & (data_p -> dftsd_study_cache_compression_flag));
+
 							data_p -> dftsd_fd_path_s = GetJSONString (service_config_p, "fd_path");
 
 							if (data_p -> dftsd_fd_path_s)
@@ -136,6 +159,48 @@ bool ConfigureFieldTrialService (FieldTrialServiceData *data_p, GrassrootsServer
 
 							data_p -> dftsd_fd_url_s = GetJSONString (service_config_p, "fd_url");
 
+							if (json_object_get (service_config_p, "reference_cache_size"))
+								{
+									int cache_size = 0;
+
+									if (GetJSONInteger (service_config_p, "reference_cache_size", &cache_size) && (cache_size >= 0))
+										{
+											SetReferenceCacheSize (data_p -> dftsd_reference_cache_p, (size_t) cache_size);
+										}
+									else
+										{
+											PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, service_config_p, "Invalid value for \"reference_cache_size\"");
+										}
+								}
+
+							if (json_object_get (service_config_p, "reference_cache_ttl"))
+								{
+									int ttl = 0;
+
+									if (GetJSONInteger (service_config_p, "reference_cache_ttl", &ttl) && (ttl >= 0))
+										{
+											SetReferenceCacheTimeToLive (data_p -> dftsd_reference_cache_p, (time_t) ttl);
+										}
+									else
+										{
+											PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, service_config_p, "Invalid value for \"reference_cache_ttl\"");
+										}
+								}
+
+							if (json_object_get (service_config_p, "study_memory_cache_size"))
+								{
+									int cache_size = 0;
+
+									if (GetJSONInteger (service_config_p, "study_memory_cache_size", &cache_size) && (cache_size >= 0))
+										{
+											SetReferenceCacheTierSize (data_p -> dftsd_reference_cache_p, DFTD_STUDY, (size_t) cache_size);
+										}
+									else
+										{
+											PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, service_config_p, "Invalid value for \"study_memory_cache_size\"");
+										}
+								}
+
 
 							* ((data_p -> dftsd_collection_ss) + DFTD_PROGRAM) = DFT_PROGRAM_S;
 							* ((data_p -> dftsd_collection_ss) + DFTD_FIELD_TRIAL) = DFT_FIELD_TRIALS_S;
@@ -151,6 +216,26 @@ bool ConfigureFieldTrialService (FieldTrialServiceData *data_p, GrassrootsServer
 							// * ((data_p -> dftsd_collection_ss) + DFTD_ROW) = DFT_ROW_S;
 							* ((data_p -> dftsd_collection_ss) + DFTD_CROP) = DFT_CROP_S;
 							* ((data_p -> dftsd_collection_ss) + DFTD_TREATMENT) = DFT_TREATMENT_S;
+
+							GetJSONBoolean (service_config_p, "observations_collection", & (data_p -> dftsd_observations_collection_flag));
+
+							if (data_p -> dftsd_observations_collection_flag)
+								{
+									if (!AddObservationsCollectionIndexes (data_p))
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add the indexes for \"%s\"", DFT_OBSERVATION_S);
+										}
+								}
+
+							if (!AddTraitStatisticsIndexes (data_p))
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add the indexes for \"%s\"", TS_COLLECTION_S);
+								}
+
+							if (!AddModificationIndexes (data_p))
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add the modification indexes");
+								}
 						}
 					else
 						{
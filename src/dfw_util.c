@@ -20,7 +20,16 @@
  *      Author: billy
  */
 
+#include <pthread.h>
+
+#include <sys/stat.h>
+
 #include "dfw_util.h"
+#include "document_cache.h"
+#include "grassroots_server.h"
+#include "reference_cache.h"
+#include "study_cache_file.h"
+#include "plot.h"
 #include "streams.h"
 #include "time_util.h"
 #include "string_utils.h"
@@ -35,7 +44,49 @@
 #endif
 
 
-static char *GetCacheFilename (const char *id_s, const FieldTrialServiceData *data_p);
+/*
+ * A Study that is currently being rebuilt for the cache.
+ */
+typedef struct StudyCacheBuild
+{
+	char *scb_id_s;
+
+	/* The number of threads waiting for this build to finish */
+	uint32 scb_num_waiters;
+
+	bool scb_done_flag;
+
+	pthread_cond_t scb_done_cond;
+
+	struct StudyCacheBuild *scb_next_p;
+} StudyCacheBuild;
+
+
+static pthread_mutex_t s_study_cache_builds_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static StudyCacheBuild *s_study_cache_builds_p = NULL;
+
+
+
+static char *GetCacheFilename (const char *id_s, const char *suffix_s, const FieldTrialServiceData *data_p);
+
+static json_t *LoadCachedStudyFile (const char *id_s, const char *suffix_s, const FieldTrialServiceData *data_p);
+
+static bool RemoveCacheFile (const char *id_s, const char *suffix_s, const FieldTrialServiceData *data_p);
+
+static bool DoesCacheFileExist (const char *id_s, const char *suffix_s, const FieldTrialServiceData *data_p);
+
+static StudyCacheBuild *AllocateStudyCacheBuild (const char *id_s);
+
+static void FreeStudyCacheBuild (StudyCacheBuild *build_p);
+
+static bool SplicePlotIntoCachedPlots (json_t *cached_plots_p, json_t *plot_json_p);
+
+static bool CacheSerialisedStudy (const char *id_s, const char *study_s, const size_t study_length, const int64 revision, const FieldTrialServiceData *data_p);
+
+static bool StatCacheFile (const char *id_s, struct stat *file_stat_p, const FieldTrialServiceData *data_p);
+
+static bool GetCacheFileRevision (const char *id_s, int64 *revision_p, const FieldTrialServiceData *data_p);
 
 
 
@@ -83,31 +134,72 @@ bool FindAndAddResultToServiceJob (const char *id_s, const ViewFormat format, Se
 bool CacheStudy (const char *id_s, const json_t *study_json_p, const FieldTrialServiceData *data_p)
 {
 	bool success_flag = false;
+	char *study_s = json_dumps (study_json_p, 0);
 
-	/*
-	 * Is the Study cached?
-	 */
-	if (data_p -> dftsd_study_cache_path_s)
+	if (study_s)
 		{
-			char *filename_s = GetCacheFilename (id_s, data_p);
+			const size_t study_length = strlen (study_s);
 
-			if (filename_s)
+			/*
+			 * Is the Study cached?
+			 */
+			if (data_p -> dftsd_study_cache_path_s)
 				{
-					int res = json_dump_file (study_json_p, filename_s, 0);
+					const bool compress_flag = data_p -> dftsd_study_cache_compression_flag;
+					char *filename_s = GetCacheFilename (id_s, compress_flag ? SCF_COMPRESSED_SUFFIX_S : SCF_PLAIN_SUFFIX_S, data_p);
 
-					if (res != 0)
+					if (filename_s)
 						{
-							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, study_json_p, "Failed to save cached study to \"%s\", error \"%s\" at [%d, %d]", filename_s);
-						}
+							if (compress_flag)
+								{
+									success_flag = WriteCompressedStudyCacheFile (filename_s, study_s, study_length);
+								}
+							else
+								{
+									success_flag = WritePlainStudyCacheFile (filename_s, study_s, study_length);
+								}
 
-					FreeCopiedString (filename_s);
-				}		/* if (filename_s) */
+							/*
+							 * Remove any copy in the other format so that
+							 * it can't be read back instead of this one.
+							 */
+							if (success_flag)
+								{
+									RemoveCacheFile (id_s, compress_flag ? SCF_PLAIN_SUFFIX_S : SCF_COMPRESSED_SUFFIX_S, data_p);
+								}
 
-		}		/* if (data_p -> dftsd_study_cache_path_s) */
+							FreeCopiedString (filename_s);
+						}		/* if (filename_s) */
+
+				}		/* if (data_p -> dftsd_study_cache_path_s) */
+			else
+				{
+					/* No cache path configured*/
+					success_flag = true;
+				}
+
+			/*
+			 * The in-memory copy is tied to the revision of the cache file that
+			 * it was loaded from, which can't be reliably read back here if
+			 * another process is writing the same file. So just drop any
+			 * older copy and let the next read load the file. Without a cache
+			 * path, memory is the only tier, so keep the Study there so that
+			 * subsequent hits don't need to rebuild it.
+			 */
+			if (data_p -> dftsd_study_cache_path_s)
+				{
+					InvalidateCachedReference (data_p -> dftsd_reference_cache_p, DFTD_STUDY, id_s);
+				}
+			else
+				{
+					CacheSerialisedStudy (id_s, study_s, study_length, 0, data_p);
+				}
+
+			free (study_s);
+		}		/* if (study_s) */
 	else
 		{
-			/* No cache path configured*/
-			success_flag = true;
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to serialise study \"%s\" for caching", id_s);
 		}
 
 	return success_flag;
@@ -117,56 +209,98 @@ bool CacheStudy (const char *id_s, const json_t *study_json_p, const FieldTrialS
 json_t *GetCachedStudy (const char *id_s, const FieldTrialServiceData *data_p)
 {
 	json_t *study_json_p = NULL;
+	json_t *serialised_study_p = NULL;
+	int64 revision = 0;
 
 	/*
-	 * Is the Study cached?
+	 * The cache files can be rewritten or removed by other processes, so
+	 * the in-memory copy is only used if it was loaded from the current
+	 * version of the file. This is checked before any file is loaded so
+	 * a file that changes whilst it is being read is never cached under
+	 * the newer revision.
 	 */
 	if (data_p -> dftsd_study_cache_path_s)
 		{
-			char *filename_s = NULL;
+			if (GetCacheFileRevision (id_s, &revision, data_p))
+				{
+					serialised_study_p = GetCachedReferenceAtRevision (data_p -> dftsd_reference_cache_p, DFTD_STUDY, id_s, revision);
+				}
+			else
+				{
+					InvalidateCachedReference (data_p -> dftsd_reference_cache_p, DFTD_STUDY, id_s);
+				}
+		}
+	else
+		{
+			serialised_study_p = GetCachedReference (data_p -> dftsd_reference_cache_p, DFTD_STUDY, id_s);
+		}
+
+	/*
+	 * Do we have the Study in memory?
+	 */
+	if (serialised_study_p)
+		{
+			json_error_t err;
 
 			#if DFW_UTIL_DEBUG >= STM_LEVEL_FINE
-			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Checking for cached study \"%s\" in \"%s\"", id_s, data_p -> dftsd_study_cache_path_s);
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Loading cached study \"%s\" from memory", id_s);
 			#endif
 
-			filename_s = GetCacheFilename (id_s, data_p);
+			study_json_p = json_loadb (json_string_value (serialised_study_p), json_string_length (serialised_study_p), 0, &err);
 
-			if (filename_s)
+			if (!study_json_p)
 				{
-					if (IsPathValid (filename_s))
-						{
-							json_error_t err;
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to load cached study \"%s\" from memory, error \"%s\" at [%d, %d]", id_s, err.text, err.line, err.column);
+				}
 
-							#if DFW_UTIL_DEBUG >= STM_LEVEL_FINE
-							PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Loading cached study \"%s\" in \"%s\"", id_s, data_p -> dftsd_study_cache_path_s);
-							#endif
+			json_decref (serialised_study_p);
+		}
 
-							study_json_p = json_load_file (filename_s, 0, &err);
+	/*
+	 * Is the Study cached on disk?
+	 */
+	if ((!study_json_p) && (data_p -> dftsd_study_cache_path_s))
+		{
+			#if DFW_UTIL_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Checking for cached study \"%s\" in \"%s\"", id_s, data_p -> dftsd_study_cache_path_s);
+			#endif
 
-							if (!study_json_p)
-								{
-									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to load cached study from \"%s\", error \"%s\" at [%d, %d]", filename_s, err.text, err.line, err.column);
-								}
-						}
-					else
+			/*
+			 * Prefer the compressed format and fall back to
+			 * any plain JSON file.
+			 */
+			study_json_p = LoadCachedStudyFile (id_s, SCF_COMPRESSED_SUFFIX_S, data_p);
+
+			if (!study_json_p)
+				{
+					study_json_p = LoadCachedStudyFile (id_s, SCF_PLAIN_SUFFIX_S, data_p);
+				}
+
+			if (study_json_p)
+				{
+					char *study_s = json_dumps (study_json_p, 0);
+
+					if (study_s)
 						{
-							#if DFW_UTIL_DEBUG >= STM_LEVEL_FINE
-							PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "No cached study \"%s\" in \"%s\"", id_s, data_p -> dftsd_study_cache_path_s);
-							#endif
+							CacheSerialisedStudy (id_s, study_s, strlen (study_s), revision, data_p);
+							free (study_s);
 						}
-
-					FreeCopiedString (filename_s);
-				}		/* if (filename_s) */
+				}
 			else
 				{
-					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "GetCacheFilename failed for \"%s\"", id_s);
+					#if DFW_UTIL_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "No cached study \"%s\" in \"%s\"", id_s, data_p -> dftsd_study_cache_path_s);
+					#endif
 				}
 
-		}		/* if (data_p -> dftsd_study_cache_path_s) */
+		}		/* if ((!study_json_p) && (data_p -> dftsd_study_cache_path_s)) */
 	else
 		{
 			#if DFW_UTIL_DEBUG >= STM_LEVEL_FINE
-			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "No cache path configured");
+			if (!study_json_p)
+				{
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "No cache path configured");
+				}
 			#endif
 		}
 
@@ -177,27 +311,234 @@ json_t *GetCachedStudy (const char *id_s, const FieldTrialServiceData *data_p)
 bool ClearCachedStudy (const char *id_s, const FieldTrialServiceData *data_p)
 {
 	bool success_flag = true;
-	char *filename_s = GetCacheFilename (id_s, data_p);
 
-	if (filename_s)
+	InvalidateCachedReference (data_p -> dftsd_reference_cache_p, DFTD_STUDY, id_s);
+
+	if (!RemoveCacheFile (id_s, SCF_PLAIN_SUFFIX_S, data_p))
 		{
-			if (IsPathValid (filename_s))
+			success_flag = false;
+		}
+
+	if (!RemoveCacheFile (id_s, SCF_COMPRESSED_SUFFIX_S, data_p))
+		{
+			success_flag = false;
+		}
+
+	return success_flag;
+}
+
+
+
+
+bool IsStudyCached (const char *id_s, const FieldTrialServiceData *data_p)
+{
+	bool cached_flag = false;
+
+	/*
+	 * When there is a cache path, the in-memory copy is only valid
+	 * whilst its file exists.
+	 */
+	if (data_p -> dftsd_study_cache_path_s)
+		{
+			cached_flag = (DoesCacheFileExist (id_s, SCF_COMPRESSED_SUFFIX_S, data_p) || DoesCacheFileExist (id_s, SCF_PLAIN_SUFFIX_S, data_p));
+		}
+	else
+		{
+			json_t *serialised_study_p = GetCachedReference (data_p -> dftsd_reference_cache_p, DFTD_STUDY, id_s);
+
+			if (serialised_study_p)
 				{
-					if (!RemoveFile (filename_s))
+					cached_flag = true;
+					json_decref (serialised_study_p);
+				}
+		}
+
+	return cached_flag;
+}
+
+
+bool GetCachedStudyTime (const char *id_s, time_t *time_p, const FieldTrialServiceData *data_p)
+{
+	struct stat file_stat;
+
+	if (StatCacheFile (id_s, &file_stat, data_p))
+		{
+			*time_p = file_stat.st_mtime;
+			return true;
+		}
+
+	return false;
+}
+
+
+bool BeginStudyCacheBuild (const char *id_s)
+{
+	bool builder_flag = true;
+	StudyCacheBuild *build_p;
+
+	pthread_mutex_lock (&s_study_cache_builds_lock);
+
+	build_p = s_study_cache_builds_p;
+
+	while ((build_p) && (strcmp (build_p -> scb_id_s, id_s) != 0))
+		{
+			build_p = build_p -> scb_next_p;
+		}
+
+	if (build_p)
+		{
+			/*
+			 * Someone else is already building this Study so
+			 * wait for them to finish.
+			 */
+			builder_flag = false;
+
+			++ (build_p -> scb_num_waiters);
+
+			while (! (build_p -> scb_done_flag))
+				{
+					pthread_cond_wait (& (build_p -> scb_done_cond), &s_study_cache_builds_lock);
+				}
+
+			-- (build_p -> scb_num_waiters);
+
+			/*
+			 * The build has already been removed from the list
+			 * by EndStudyCacheBuild () so if we're the last
+			 * waiter, free it.
+			 */
+			if (build_p -> scb_num_waiters == 0)
+				{
+					FreeStudyCacheBuild (build_p);
+				}
+		}
+	else
+		{
+			build_p = AllocateStudyCacheBuild (id_s);
+
+			if (build_p)
+				{
+					build_p -> scb_next_p = s_study_cache_builds_p;
+					s_study_cache_builds_p = build_p;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to register cache build for study \"%s\"", id_s);
+				}
+		}
+
+	pthread_mutex_unlock (&s_study_cache_builds_lock);
+
+	return builder_flag;
+}
+
+
+void EndStudyCacheBuild (const char *id_s)
+{
+	StudyCacheBuild *build_p;
+	StudyCacheBuild *prev_p = NULL;
+
+	pthread_mutex_lock (&s_study_cache_builds_lock);
+
+	build_p = s_study_cache_builds_p;
+
+	while ((build_p) && (strcmp (build_p -> scb_id_s, id_s) != 0))
+		{
+			prev_p = build_p;
+			build_p = build_p -> scb_next_p;
+		}
+
+	if (build_p)
+		{
+			if (prev_p)
+				{
+					prev_p -> scb_next_p = build_p -> scb_next_p;
+				}
+			else
+				{
+					s_study_cache_builds_p = build_p -> scb_next_p;
+				}
+
+			if (build_p -> scb_num_waiters > 0)
+				{
+					/* The last waiter to wake up will free the build */
+					build_p -> scb_done_flag = true;
+					pthread_cond_broadcast (& (build_p -> scb_done_cond));
+				}
+			else
+				{
+					FreeStudyCacheBuild (build_p);
+				}
+		}
+
+	pthread_mutex_unlock (&s_study_cache_builds_lock);
+}
+
+
+bool PatchCachedStudyPlots (const char *study_id_s, const json_t *plots_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+	json_t *study_json_p = NULL;
+
+	/*
+	 * Make sure that no one rebuilds the Study whilst we are
+	 * patching it.
+	 */
+	while (!BeginStudyCacheBuild (study_id_s))
+		{
+		}
+
+	study_json_p = GetCachedStudy (study_id_s, data_p);
+
+	if (study_json_p)
+		{
+			json_t *cached_plots_p = json_object_get (study_json_p, ST_PLOTS_S);
+
+			success_flag = false;
+
+			if (json_is_array (cached_plots_p))
+				{
+					const char *plot_id_s;
+					json_t *plot_json_p;
+
+					success_flag = true;
+
+					json_object_foreach ((json_t *) plots_p, plot_id_s, plot_json_p)
 						{
-							success_flag = false;
+							if (!SplicePlotIntoCachedPlots (cached_plots_p, plot_json_p))
+								{
+									PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, plot_json_p, "Failed to patch plot \"%s\" into cached study \"%s\"", plot_id_s, study_id_s);
+									success_flag = false;
+									break;
+								}
 						}
+
+					if (success_flag)
+						{
+							success_flag = CacheStudy (study_id_s, study_json_p, data_p);
+						}
+
+				}		/* if (json_is_array (cached_plots_p)) */
+
+			json_decref (study_json_p);
+
+			/*
+			 * If the patch failed, fall back to clearing the cached
+			 * Study so that it gets rebuilt from the database.
+			 */
+			if (!success_flag)
+				{
+					success_flag = ClearCachedStudy (study_id_s, data_p);
 				}
 
-			FreeCopiedString (filename_s);
-		}		/* if (filename_s) */
+		}		/* if (study_json_p) */
+
+	EndStudyCacheBuild (study_id_s);
 
 	return success_flag;
 }
 
 
-
-
 char *GetFrictionlessDataURL (const char *const name_s, const FieldTrialServiceData *data_p)
 {
 	char *url_s = NULL;
@@ -246,8 +587,19 @@ void *GetDFWObjectById (const bson_oid_t *id_p, DFWFieldTrialData collection_typ
 {
 	void *result_p = NULL;
 	MongoTool *tool_p = data_p -> dftsd_mongo_p;
+	const json_t *cached_doc_p = GetDocumentFromDocumentCache (data_p -> dftsd_document_cache_p, collection_type, id_p);
+	json_t *reference_doc_p = NULL;
 
-	if (SetMongoToolCollection (tool_p, data_p -> dftsd_collection_ss [collection_type]))
+	if (cached_doc_p)
+		{
+			result_p = get_obj_from_json_fn (cached_doc_p, format, data_p);
+		}
+	else if ((reference_doc_p = GetCachedReferenceById (data_p -> dftsd_reference_cache_p, collection_type, id_p)) != NULL)
+		{
+			result_p = get_obj_from_json_fn (reference_doc_p, format, data_p);
+			json_decref (reference_doc_p);
+		}
+	else if (SetMongoToolCollection (tool_p, data_p -> dftsd_collection_ss [collection_type]))
 		{
 			bson_t *query_p = bson_new ();
 			char id_s [MONGO_OID_STRING_BUFFER_SIZE];
@@ -280,7 +632,12 @@ void *GetDFWObjectById (const bson_oid_t *id_p, DFWFieldTrialData collection_typ
 
 													result_p = get_obj_from_json_fn (res_p, format, data_p);
 
-													if (!result_p)
+													if (result_p)
+														{
+															AddDocumentToDocumentCacheScope (data_p -> dftsd_document_cache_p, collection_type, res_p);
+															CacheReferenceById (data_p -> dftsd_reference_cache_p, collection_type, res_p);
+														}
+													else
 														{
 															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, res_p, "failed to create object for id \"%s\"", id_s);
 														}
@@ -904,13 +1261,277 @@ const char *GetIDDefaultValueFromJSON (const char *id_param_s, const json_t *par
 }
 
 
-static char *GetCacheFilename (const char *id_s, const FieldTrialServiceData *data_p)
+static bool CacheSerialisedStudy (const char *id_s, const char *study_s, const size_t study_length, const int64 revision, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	json_t *serialised_study_p = json_stringn_nocheck (study_s, study_length);
+
+	if (serialised_study_p)
+		{
+			success_flag = CacheReferenceAtRevision (data_p -> dftsd_reference_cache_p, DFTD_STUDY, id_s, serialised_study_p, revision);
+			json_decref (serialised_study_p);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to store serialised study \"%s\"", id_s);
+		}
+
+	return success_flag;
+}
+
+
+static json_t *LoadCachedStudyFile (const char *id_s, const char *suffix_s, const FieldTrialServiceData *data_p)
+{
+	json_t *study_json_p = NULL;
+	char *filename_s = GetCacheFilename (id_s, suffix_s, data_p);
+
+	if (filename_s)
+		{
+			if (IsPathValid (filename_s))
+				{
+					#if DFW_UTIL_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Loading cached study from \"%s\"", filename_s);
+					#endif
+
+					if (strcmp (suffix_s, SCF_COMPRESSED_SUFFIX_S) == 0)
+						{
+							study_json_p = ReadCompressedStudyCacheFile (filename_s);
+
+							/*
+							 * If the file is corrupt, remove it so that
+							 * it gets regenerated.
+							 */
+							if (!study_json_p)
+								{
+									if (!RemoveFile (filename_s))
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to remove unreadable cached study \"%s\"", filename_s);
+										}
+								}
+						}
+					else
+						{
+							json_error_t err;
+
+							study_json_p = json_load_file (filename_s, 0, &err);
+
+							if (!study_json_p)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to load cached study from \"%s\", error \"%s\" at [%d, %d]", filename_s, err.text, err.line, err.column);
+								}
+						}
+
+				}		/* if (IsPathValid (filename_s)) */
+
+			FreeCopiedString (filename_s);
+		}		/* if (filename_s) */
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "GetCacheFilename failed for \"%s\" and \"%s\"", id_s, suffix_s);
+		}
+
+	return study_json_p;
+}
+
+
+static bool RemoveCacheFile (const char *id_s, const char *suffix_s, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+	char *filename_s = GetCacheFilename (id_s, suffix_s, data_p);
+
+	if (filename_s)
+		{
+			if (IsPathValid (filename_s))
+				{
+					if (!RemoveFile (filename_s))
+						{
+							success_flag = false;
+						}
+				}
+
+			FreeCopiedString (filename_s);
+		}		/* if (filename_s) */
+
+	return success_flag;
+}
+
+
+/*
+ * The cached plots are sorted by row and then column, so either replace
+ * the matching plot or insert the new one at the correct position.
+ */
+static bool SplicePlotIntoCachedPlots (json_t *cached_plots_p, json_t *plot_json_p)
+{
+	bool success_flag = false;
+	bson_oid_t id;
+	int row;
+	int column;
+
+	if (GetMongoIdFromJSON (plot_json_p, &id))
+		{
+			if (GetJSONInteger (plot_json_p, PL_ROW_INDEX_S, &row) && GetJSONInteger (plot_json_p, PL_COLUMN_INDEX_S, &column))
+				{
+					const size_t num_plots = json_array_size (cached_plots_p);
+					size_t insert_index = num_plots;
+					size_t i = 0;
+					bool found_flag = false;
+
+					while ((i < num_plots) && (!found_flag))
+						{
+							const json_t *cached_plot_p = json_array_get (cached_plots_p, i);
+							bson_oid_t cached_id;
+							int cached_row = -1;
+							int cached_column = -1;
+
+							GetJSONInteger (cached_plot_p, PL_ROW_INDEX_S, &cached_row);
+							GetJSONInteger (cached_plot_p, PL_COLUMN_INDEX_S, &cached_column);
+
+							if (((cached_row == row) && (cached_column == column)) || (GetMongoIdFromJSON (cached_plot_p, &cached_id) && bson_oid_equal (&cached_id, &id)))
+								{
+									found_flag = true;
+								}
+							else
+								{
+									if ((insert_index == num_plots) && ((cached_row > row) || ((cached_row == row) && (cached_column > column))))
+										{
+											insert_index = i;
+										}
+
+									++ i;
+								}
+						}
+
+					if (found_flag)
+						{
+							success_flag = (json_array_set (cached_plots_p, i, plot_json_p) == 0);
+						}
+					else
+						{
+							success_flag = (json_array_insert (cached_plots_p, insert_index, plot_json_p) == 0);
+						}
+				}
+			else
+				{
+					PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, plot_json_p, "Failed to get row and column for plot");
+				}
+		}
+	else
+		{
+			PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, plot_json_p, "Failed to get id for plot");
+		}
+
+	return success_flag;
+}
+
+
+static StudyCacheBuild *AllocateStudyCacheBuild (const char *id_s)
+{
+	char *copied_id_s = EasyCopyToNewString (id_s);
+
+	if (copied_id_s)
+		{
+			StudyCacheBuild *build_p = (StudyCacheBuild *) AllocMemory (sizeof (StudyCacheBuild));
+
+			if (build_p)
+				{
+					if (pthread_cond_init (& (build_p -> scb_done_cond), NULL) == 0)
+						{
+							build_p -> scb_id_s = copied_id_s;
+							build_p -> scb_num_waiters = 0;
+							build_p -> scb_done_flag = false;
+							build_p -> scb_next_p = NULL;
+
+							return build_p;
+						}
+
+					FreeMemory (build_p);
+				}
+
+			FreeCopiedString (copied_id_s);
+		}
+
+	return NULL;
+}
+
+
+static void FreeStudyCacheBuild (StudyCacheBuild *build_p)
+{
+	pthread_cond_destroy (& (build_p -> scb_done_cond));
+	FreeCopiedString (build_p -> scb_id_s);
+	FreeMemory (build_p);
+}
+
+
+static bool DoesCacheFileExist (const char *id_s, const char *suffix_s, const FieldTrialServiceData *data_p)
+{
+	bool exists_flag = false;
+	char *filename_s = GetCacheFilename (id_s, suffix_s, data_p);
+
+	if (filename_s)
+		{
+			exists_flag = IsPathValid (filename_s);
+			FreeCopiedString (filename_s);
+		}
+
+	return exists_flag;
+}
+
+
+/*
+ * Get the details of the cache file that GetCachedStudy() would load
+ * for a Study. The compressed format is preferred in the same way.
+ */
+static bool StatCacheFile (const char *id_s, struct stat *file_stat_p, const FieldTrialServiceData *data_p)
+{
+	const char *suffixes_ss [] = { SCF_COMPRESSED_SUFFIX_S, SCF_PLAIN_SUFFIX_S, NULL };
+	const char **suffix_ss = suffixes_ss;
+	bool found_flag = false;
+
+	while ((*suffix_ss) && (!found_flag))
+		{
+			char *filename_s = GetCacheFilename (id_s, *suffix_ss, data_p);
+
+			if (filename_s)
+				{
+					if (stat (filename_s, file_stat_p) == 0)
+						{
+							found_flag = true;
+						}
+
+					FreeCopiedString (filename_s);
+				}
+
+			++ suffix_ss;
+		}
+
+	return found_flag;
+}
+
+
+/*
+ * Get the modification time, in nanoseconds, of a Study's cache file.
+ */
+static bool GetCacheFileRevision (const char *id_s, int64 *revision_p, const FieldTrialServiceData *data_p)
+{
+	struct stat file_stat;
+
+	if (StatCacheFile (id_s, &file_stat, data_p))
+		{
+			*revision_p = (((int64) file_stat.st_mtim.tv_sec) * 1000000000) + file_stat.st_mtim.tv_nsec;
+			return true;
+		}
+
+	return false;
+}
+
+
+static char *GetCacheFilename (const char *id_s, const char *suffix_s, const FieldTrialServiceData *data_p)
 {
 	char *filename_s = NULL;
 
 	if (data_p -> dftsd_study_cache_path_s)
 		{
-			char *local_filename_s = ConcatenateStrings (id_s, ".json");
+			char *local_filename_s = ConcatenateStrings (id_s, suffix_s);
 
 			if (local_filename_s)
 				{
@@ -932,3 +1553,120 @@ static char *GetCacheFilename (const char *id_s, const FieldTrialServiceData *da
 
 	return filename_s;
 }
+
+
+json_t *GetAllIdsAsJSON (const DFWFieldTrialData datatype, const FieldTrialServiceData *data_p)
+{
+	json_t *ids_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [datatype]))
+		{
+			bson_t *query_p = bson_new ();
+
+			if (query_p)
+				{
+					bson_t *opts_p = BCON_NEW ("projection", "{", MONGO_ID_S, BCON_INT32 (1), "}");
+
+					if (opts_p)
+						{
+							json_t *results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, opts_p);
+
+							if (results_p)
+								{
+									if ((ids_p = json_array ()) != NULL)
+										{
+											size_t i;
+											json_t *result_p;
+
+											json_array_foreach (results_p, i, result_p)
+												{
+													bson_oid_t id;
+
+													if (GetMongoIdFromJSON (result_p, &id))
+														{
+															char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+															bson_oid_to_string (&id, id_s);
+
+															if (json_array_append_new (ids_p, json_string (id_s)) != 0)
+																{
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add id \"%s\"", id_s);
+																}
+														}
+													else
+														{
+															PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, result_p, "Failed to get id");
+														}
+												}
+
+										}		/* if ((ids_p = json_array ()) != NULL) */
+
+									json_decref (results_p);
+								}		/* if (results_p) */
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get ids from \"%s\"", data_p -> dftsd_collection_ss [datatype]);
+								}
+
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [datatype])) */
+
+	return ids_p;
+}
+
+
+FieldTrialServiceData *AllocateWorkerServiceData (const FieldTrialServiceData *data_p, GrassrootsServer *grassroots_p)
+{
+	FieldTrialServiceData *worker_data_p = (FieldTrialServiceData *) AllocMemory (sizeof (FieldTrialServiceData));
+
+	if (worker_data_p)
+		{
+			*worker_data_p = *data_p;
+
+			if ((worker_data_p -> dftsd_mongo_p = AllocateMongoTool (NULL, grassroots_p -> gs_mongo_manager_p)) != NULL)
+				{
+					if (SetMongoToolDatabase (worker_data_p -> dftsd_mongo_p, worker_data_p -> dftsd_database_s))
+						{
+							if ((worker_data_p -> dftsd_document_cache_p = AllocateDocumentCache ()) != NULL)
+								{
+									return worker_data_p;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate DocumentCache for worker");
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set database to \"%s\" for worker", worker_data_p -> dftsd_database_s);
+						}
+
+					FreeMongoTool (worker_data_p -> dftsd_mongo_p);
+				}		/* if ((worker_data_p -> dftsd_mongo_p = AllocateMongoTool (NULL, grassroots_p -> gs_mongo_manager_p)) != NULL) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate MongoTool for worker");
+				}
+
+			FreeMemory (worker_data_p);
+		}		/* if (worker_data_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate worker service data");
+		}
+
+	return NULL;
+}
+
+
+void FreeWorkerServiceData (FieldTrialServiceData *worker_data_p)
+{
+	FreeDocumentCache (worker_data_p -> dftsd_document_cache_p);
+	FreeMongoTool (worker_data_p -> dftsd_mongo_p);
+	FreeMemory (worker_data_p);
+}
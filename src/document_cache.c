@@ -0,0 +1,363 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * document_cache.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include "document_cache.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "mongodb_util.h"
+
+
+#ifdef _DEBUG
+	#define DOCUMENT_CACHE_DEBUG	(STM_LEVEL_FINE)
+#else
+	#define DOCUMENT_CACHE_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+static bson_t *GetIdsQuery (const char *key_s, const json_t *ids_p, const DocumentCache *cache_p, const DFWFieldTrialData datatype, uint32 *num_ids_p);
+
+
+
+DocumentCache *AllocateDocumentCache (void)
+{
+	DocumentCache *cache_p = (DocumentCache *) AllocMemory (sizeof (DocumentCache));
+
+	if (cache_p)
+		{
+			memset (cache_p -> dc_docs_pp, 0, DFTD_NUM_TYPES * sizeof (json_t *));
+			cache_p -> dc_scope_depth = 0;
+		}
+
+	return cache_p;
+}
+
+
+void FreeDocumentCache (DocumentCache *cache_p)
+{
+	ClearDocumentCache (cache_p);
+	FreeMemory (cache_p);
+}
+
+
+void ClearDocumentCache (DocumentCache *cache_p)
+{
+	uint32 i;
+
+	for (i = 0; i < DFTD_NUM_TYPES; ++ i)
+		{
+			json_t *docs_p = * ((cache_p -> dc_docs_pp) + i);
+
+			if (docs_p)
+				{
+					json_decref (docs_p);
+					* ((cache_p -> dc_docs_pp) + i) = NULL;
+				}
+		}
+}
+
+
+void BeginDocumentCacheScope (DocumentCache *cache_p)
+{
+	++ (cache_p -> dc_scope_depth);
+}
+
+
+void EndDocumentCacheScope (DocumentCache *cache_p)
+{
+	if (cache_p -> dc_scope_depth > 0)
+		{
+			-- (cache_p -> dc_scope_depth);
+
+			if (cache_p -> dc_scope_depth == 0)
+				{
+					ClearDocumentCache (cache_p);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "EndDocumentCacheScope called without a matching BeginDocumentCacheScope");
+		}
+}
+
+
+bool AddDocumentToDocumentCacheScope (DocumentCache *cache_p, const DFWFieldTrialData datatype, json_t *doc_p)
+{
+	bool success_flag = true;
+
+	if ((cache_p) && (cache_p -> dc_scope_depth > 0))
+		{
+			success_flag = AddDocumentToDocumentCache (cache_p, datatype, doc_p);
+		}
+
+	return success_flag;
+}
+
+
+const json_t *GetDocumentFromDocumentCache (const DocumentCache *cache_p, const DFWFieldTrialData datatype, const bson_oid_t *id_p)
+{
+	const json_t *doc_p = NULL;
+
+	if ((cache_p) && (datatype < DFTD_NUM_TYPES))
+		{
+			const json_t *docs_p = * ((cache_p -> dc_docs_pp) + datatype);
+
+			if (docs_p)
+				{
+					char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+					bson_oid_to_string (id_p, id_s);
+					doc_p = json_object_get (docs_p, id_s);
+				}
+		}
+
+	return doc_p;
+}
+
+
+bool AddDocumentToDocumentCache (DocumentCache *cache_p, const DFWFieldTrialData datatype, json_t *doc_p)
+{
+	bool success_flag = false;
+
+	if (datatype < DFTD_NUM_TYPES)
+		{
+			json_t **docs_pp = (cache_p -> dc_docs_pp) + datatype;
+
+			if (! (*docs_pp))
+				{
+					*docs_pp = json_object ();
+				}
+
+			if (*docs_pp)
+				{
+					bson_oid_t id;
+
+					if (GetMongoIdFromJSON (doc_p, &id))
+						{
+							char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+							bson_oid_to_string (&id, id_s);
+
+							if (json_object_set (*docs_pp, id_s, doc_p) == 0)
+								{
+									success_flag = true;
+								}
+							else
+								{
+									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Failed to add \"%s\" to document cache", id_s);
+								}
+
+						}		/* if (GetMongoIdFromJSON (doc_p, &id)) */
+					else
+						{
+							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Failed to get id for document cache");
+						}
+
+				}		/* if (*docs_pp) */
+
+		}		/* if (datatype < DFTD_NUM_TYPES) */
+
+	return success_flag;
+}
+
+
+bool AddReferencedIdToSet (json_t *ids_p, const json_t *json_p, const char *key_s)
+{
+	bool success_flag = true;
+
+	if (json_object_get (json_p, key_s))
+		{
+			bson_oid_t id;
+
+			if (GetNamedIdFromJSON (json_p, key_s, &id))
+				{
+					char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+					bson_oid_to_string (&id, id_s);
+
+					if (json_object_set_new (ids_p, id_s, json_true ()) != 0)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add \"%s\" to set of ids", id_s);
+							success_flag = false;
+						}
+				}
+			else
+				{
+					PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, json_p, "Failed to get id for \"%s\"", key_s);
+				}
+		}
+
+	return success_flag;
+}
+
+
+bool PrefetchDocumentsIntoDocumentCache (DocumentCache *cache_p, const DFWFieldTrialData datatype, const json_t *ids_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	uint32 num_ids = 0;
+	bson_t *query_p = GetIdsQuery (MONGO_ID_S, ids_p, cache_p, datatype, &num_ids);
+
+	if (query_p)
+		{
+			if (num_ids > 0)
+				{
+					if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [datatype]))
+						{
+							json_t *results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, NULL);
+
+							if (results_p)
+								{
+									if (json_is_array (results_p))
+										{
+											size_t i;
+											json_t *doc_p;
+
+											success_flag = true;
+
+											json_array_foreach (results_p, i, doc_p)
+												{
+													if (!AddDocumentToDocumentCache (cache_p, datatype, doc_p))
+														{
+															success_flag = false;
+														}
+												}
+
+											#if DOCUMENT_CACHE_DEBUG >= STM_LEVEL_FINE
+											PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Prefetched " SIZET_FMT " of " UINT32_FMT " documents from \"%s\"", json_array_size (results_p), num_ids, data_p -> dftsd_collection_ss [datatype]);
+											#endif
+										}		/* if (json_is_array (results_p)) */
+									else
+										{
+											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, results_p, "Results are not an array");
+										}
+
+									json_decref (results_p);
+								}		/* if (results_p) */
+							else
+								{
+									PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, query_p, "Failed to get results from \"%s\"", data_p -> dftsd_collection_ss [datatype]);
+								}
+
+						}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [datatype])) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set collection to \"%s\"", data_p -> dftsd_collection_ss [datatype]);
+						}
+
+				}		/* if (num_ids > 0) */
+			else
+				{
+					/* Everything is already cached */
+					success_flag = true;
+				}
+
+			bson_destroy (query_p);
+		}		/* if (query_p) */
+
+	return success_flag;
+}
+
+
+bson_t *GetIdsInQuery (const char *key_s, const json_t *ids_p)
+{
+	uint32 num_ids = 0;
+
+	return GetIdsQuery (key_s, ids_p, NULL, DFTD_NUM_TYPES, &num_ids);
+}
+
+
+/*
+ * If cache_p is not NULL, any ids for documents that are already
+ * cached are left out of the query.
+ */
+static bson_t *GetIdsQuery (const char *key_s, const json_t *ids_p, const DocumentCache *cache_p, const DFWFieldTrialData datatype, uint32 *num_ids_p)
+{
+	bson_t *query_p = bson_new ();
+
+	if (query_p)
+		{
+			bson_t id_doc;
+			bool success_flag = false;
+
+			if (BSON_APPEND_DOCUMENT_BEGIN (query_p, key_s, &id_doc))
+				{
+					bson_t ids_array;
+
+					if (BSON_APPEND_ARRAY_BEGIN (&id_doc, "$in", &ids_array))
+						{
+							const char *id_s;
+							json_t *value_p;
+							uint32 i = 0;
+
+							success_flag = true;
+
+							json_object_foreach ((json_t *) ids_p, id_s, value_p)
+								{
+									bson_oid_t id;
+
+									bson_oid_init_from_string (&id, id_s);
+
+									if ((!cache_p) || (!GetDocumentFromDocumentCache (cache_p, datatype, &id)))
+										{
+											char index_buffer [16];
+											const char *index_s;
+
+											bson_uint32_to_string (i, &index_s, index_buffer, sizeof (index_buffer));
+
+											if (bson_append_oid (&ids_array, index_s, -1, &id))
+												{
+													++ i;
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add \"%s\" to query", id_s);
+													success_flag = false;
+												}
+										}
+								}
+
+							*num_ids_p = i;
+
+							if (!bson_append_array_end (&id_doc, &ids_array))
+								{
+									success_flag = false;
+								}
+
+						}		/* if (BSON_APPEND_ARRAY_BEGIN (&id_doc, "$in", &ids_array)) */
+
+					if (!bson_append_document_end (query_p, &id_doc))
+						{
+							success_flag = false;
+						}
+
+				}		/* if (BSON_APPEND_DOCUMENT_BEGIN (query_p, key_s, &id_doc)) */
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create ids query for \"%s\"", key_s);
+					bson_destroy (query_p);
+					query_p = NULL;
+				}
+
+		}		/* if (query_p) */
+
+	return query_p;
+}
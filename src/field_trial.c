@@ -30,11 +30,15 @@
 #include "memory_allocations.h"
 #include "streams.h"
 #include "dfw_util.h"
+#include "change_tracking.h"
 #include "indexing.h"
 #include "json_processor.h"
 #include "programme.h"
 
 
+static void *GetFieldTrialCallback (const json_t *json_p, const ViewFormat format, const FieldTrialServiceData *data_p);
+
+
 
 
 FieldTrial *AllocateFieldTrial (const char *name_s, const char *team_s, Programme *parent_program_p, MEM_FLAG parent_program_mem, bson_oid_t *id_p)
@@ -128,7 +132,11 @@ bool SaveFieldTrial (FieldTrial *trial_p, ServiceJob *job_p, FieldTrialServiceDa
 
 			if (field_trial_json_p)
 				{
-					if (SaveMongoData (data_p -> dftsd_mongo_p, field_trial_json_p, data_p -> dftsd_collection_ss [DFTD_FIELD_TRIAL], selector_p))
+					if (!StampModification (field_trial_json_p, data_p))
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add modification marker to FieldTrial \"%s\" so it has not been saved", trial_p -> ft_name_s);
+						}
+					else if (SaveMongoData (data_p -> dftsd_mongo_p, field_trial_json_p, data_p -> dftsd_collection_ss [DFTD_FIELD_TRIAL], selector_p))
 						{
 							status = IndexData (job_p, field_trial_json_p);
 
@@ -522,15 +530,7 @@ FieldTrial *GetUniqueFieldTrialBySearchString (const char *trial_s, const ViewFo
 
 FieldTrial *GetFieldTrialById (const bson_oid_t *id_p, const ViewFormat format, const FieldTrialServiceData *data_p)
 {
-	FieldTrial *trial_p = NULL;
-	char *id_s = GetBSONOidAsString (id_p);
-
-	if (id_s)
-		{
-			trial_p = GetFieldTrialByIdString (id_s, format, data_p);
-
-			FreeCopiedString (id_s);
-		}
+	FieldTrial *trial_p = (FieldTrial *) GetDFWObjectById (id_p, DFTD_FIELD_TRIAL, GetFieldTrialCallback, format, data_p);
 
 	return trial_p;
 }
@@ -539,85 +539,7 @@ FieldTrial *GetFieldTrialById (const bson_oid_t *id_p, const ViewFormat format,
 
 FieldTrial *GetFieldTrialByIdString (const char *field_trial_id_s, const ViewFormat format, const FieldTrialServiceData *data_p)
 {
-	FieldTrial *trial_p = NULL;
-	MongoTool *tool_p = data_p -> dftsd_mongo_p;
-
-	if (bson_oid_is_valid (field_trial_id_s, strlen (field_trial_id_s)))
-		{
-			if (SetMongoToolCollection (tool_p, data_p -> dftsd_collection_ss [DFTD_FIELD_TRIAL]))
-				{
-					bson_t *query_p = bson_new ();
-
-					if (query_p)
-						{
-							bson_oid_t oid;
-
-							bson_oid_init_from_string (&oid, field_trial_id_s);
-
-							if (BSON_APPEND_OID (query_p, MONGO_ID_S, &oid))
-								{
-									json_t *results_p = GetAllMongoResultsAsJSON (tool_p, query_p, NULL);
-
-									if (results_p)
-										{
-											if (json_is_array (results_p))
-												{
-													size_t num_results = json_array_size (results_p);
-
-													if (num_results == 1)
-														{
-															json_t *res_p = json_array_get (results_p, 0);
-
-															trial_p = GetFieldTrialFromJSON (res_p, format, data_p);
-
-															if (!trial_p)
-																{
-																	PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, res_p, "failed to create field trial for id \"%s\"", field_trial_id_s);
-																}
-
-														}		/* if (num_results == 1) */
-													else
-														{
-															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, results_p, "" SIZET_FMT " results when searching for field trial with id \"%s\"", num_results, field_trial_id_s);
-														}
-
-												}		/* if (json_is_array (results_p) */
-											else
-												{
-													PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, results_p, "Results are not an array");
-												}
-
-											json_decref (results_p);
-										}		/* if (results_p) */
-									else
-										{
-											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get results searching for field trial with id \"%s\"", field_trial_id_s);
-										}
-
-								}		/* if (BSON_APPEND_OID (query_p, MONGO_ID_S, &oid)) */
-							else
-								{
-									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create query for field trial with id \"%s\"", field_trial_id_s);
-								}
-
-							bson_destroy (query_p);
-						}		/* if (query_p) */
-					else
-						{
-							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create query for field trial with id \"%s\"", field_trial_id_s);
-						}
-
-				}		/* if (SetMongoToolCollection (tool_p, data_p -> dftsd_collection_ss [DFTD_FIELD_TRIAL])) */
-			else
-				{
-					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set collection to \"%s\"", data_p -> dftsd_collection_ss [DFTD_FIELD_TRIAL]);
-				}
-
-		}		/* if (bson_oid_is_valid (field_trial_id_s, strlen (field_trial_id_s))) */
-	else
-		{
-			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is not a valid oid", field_trial_id_s);
-		}
+	FieldTrial *trial_p = (FieldTrial *) GetDFWObjectByIdString (field_trial_id_s, DFTD_FIELD_TRIAL, GetFieldTrialCallback, format, data_p);
 
 	return trial_p;
 }
@@ -722,3 +644,8 @@ char *GetFieldTrialAsString (const FieldTrial *trial_p)
 	return trial_s;
 }
 
+
+static void *GetFieldTrialCallback (const json_t *json_p, const ViewFormat format, const FieldTrialServiceData *data_p)
+{
+	return GetFieldTrialFromJSON (json_p, format, data_p);
+}
@@ -270,39 +270,46 @@ bool RunForSubmissionFieldTrialParams (FieldTrialServiceData *data_p, ParameterS
 json_t *GetFieldTrialIndexingData (Service *service_p)
 {
 	FieldTrialServiceData *data_p = (FieldTrialServiceData *) (service_p -> se_data_p);
-	json_t *src_trials_p = GetAllFieldTrialsAsJSON (data_p, NULL);
+	json_t *trials_p = GetAllFieldTrialsAsJSON (data_p, NULL);
 
-	if (src_trials_p)
+	if (trials_p)
 		{
-			if (json_is_array (src_trials_p))
-				{
-					FieldTrialServiceData *dfw_data_p = (FieldTrialServiceData *) (service_p -> se_data_p);
-					size_t i;
-					json_t *src_trial_p;
-					size_t num_added = 0;
+			PrepareFieldTrialsForIndexing (trials_p, data_p);
 
-					json_array_foreach (src_trials_p, i, src_trial_p)
-						{
-							bson_oid_t id;
+			return trials_p;
+		}		/* if (trials_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "No field trials for \"%s\"", GetServiceName (service_p));
+		}
 
-							if (AddDatatype (src_trial_p, DFTD_FIELD_TRIAL))
-								{
+	return NULL;
+}
 
-								}
 
+bool PrepareFieldTrialsForIndexing (json_t *trials_p, const FieldTrialServiceData * UNUSED_PARAM (data_p))
+{
+	bool success_flag = false;
 
-						}		/* json_array_foreach (src_studies_p, i, src_study_p) */
+	if (json_is_array (trials_p))
+		{
+			size_t i;
+			json_t *trial_p;
+			size_t num_added = 0;
 
-				}		/* if (json_is_array (src_studies_p)) */
+			json_array_foreach (trials_p, i, trial_p)
+				{
+					if (AddDatatype (trial_p, DFTD_FIELD_TRIAL))
+						{
+							++ num_added;
+						}
 
-			return src_trials_p;
-		}		/* if (src_studies_p) */
-	else
-		{
-			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "No field trials for \"%s\"", GetServiceName (service_p));
-		}
+				}		/* json_array_foreach (trials_p, i, trial_p) */
 
-	return NULL;
+			success_flag = (num_added == json_array_size (trials_p));
+		}		/* if (json_is_array (trials_p)) */
+
+	return success_flag;
 }
 
 
@@ -23,6 +23,7 @@
 #define ALLOCATE_GENE_BANK_TAGS (1)
 #include "gene_bank.h"
 #include "dfw_util.h"
+#include "reference_cache.h"
 
 #include "memory_allocations.h"
 #include "string_utils.h"
@@ -34,7 +35,9 @@
 
 static void *GetGeneBankCallback (const json_t *json_p, const ViewFormat format, const FieldTrialServiceData *data_p);
 
-static GeneBank *SearchForGeneBank (bson_t *query_p, const FieldTrialServiceData *data_p);
+static GeneBank *SearchForGeneBank (bson_t *query_p, const char *cache_key_s, const FieldTrialServiceData *data_p);
+
+static char *GetGeneBankNameCacheKey (const char *name_s);
 
 
 /*
@@ -257,6 +260,16 @@ bool SaveGeneBank (GeneBank *gene_bank_p, FieldTrialServiceData *data_p)
 				{
 					if (SaveMongoData (data_p -> dftsd_mongo_p, gene_bank_json_p, data_p -> dftsd_collection_ss [DFTD_GENE_BANK], selector_p))
 						{
+							char *cache_key_s = GetGeneBankNameCacheKey (gene_bank_p -> gb_name_s);
+
+							InvalidateCachedReferenceById (data_p -> dftsd_reference_cache_p, DFTD_GENE_BANK, gene_bank_p -> gb_id_p);
+
+							if (cache_key_s)
+								{
+									InvalidateCachedReference (data_p -> dftsd_reference_cache_p, DFTD_GENE_BANK, cache_key_s);
+									FreeCopiedString (cache_key_s);
+								}
+
 							success_flag = true;
 						}
 					else
@@ -284,29 +297,45 @@ bool SaveGeneBank (GeneBank *gene_bank_p, FieldTrialServiceData *data_p)
 GeneBank *GetGeneBankByName (const char *name_s, const FieldTrialServiceData *data_p)
 {
 	GeneBank *gene_bank_p = NULL;
-	bson_t *query_p = BCON_NEW (GB_NAME_S, BCON_UTF8 (name_s));
+	char *cache_key_s = GetGeneBankNameCacheKey (name_s);
+	json_t *cached_doc_p = cache_key_s ? GetCachedReference (data_p -> dftsd_reference_cache_p, DFTD_GENE_BANK, cache_key_s) : NULL;
 
-	if (query_p)
+	if (cached_doc_p)
 		{
-			gene_bank_p = SearchForGeneBank (query_p, data_p);
+			gene_bank_p = GetGeneBankFromJSON (cached_doc_p);
+			json_decref (cached_doc_p);
+		}
+	else
+		{
+			bson_t *query_p = BCON_NEW (GB_NAME_S, BCON_UTF8 (name_s));
+
+			if (query_p)
+				{
+					gene_bank_p = SearchForGeneBank (query_p, cache_key_s, data_p);
 
-			if (!gene_bank_p)
+					if (!gene_bank_p)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to find GeneBank \"%s\"", name_s);
+						}
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+			else
 				{
-					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to find GeneBank \"%s\"", name_s);
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create GeneBank query to search for \"%s\"", name_s);
 				}
+		}
 
-			bson_destroy (query_p);
-		}		/* if (query_p) */
-	else
+	if (cache_key_s)
 		{
-			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create GeneBank query to search for \"%s\"", name_s);
+			FreeCopiedString (cache_key_s);
 		}
 
 	return gene_bank_p;
 }
 
 
-static GeneBank *SearchForGeneBank (bson_t *query_p, const FieldTrialServiceData *data_p)
+static GeneBank *SearchForGeneBank (bson_t *query_p, const char *cache_key_s, const FieldTrialServiceData *data_p)
 {
 	GeneBank *gene_bank_p = NULL;
 
@@ -324,7 +353,14 @@ static GeneBank *SearchForGeneBank (bson_t *query_p, const FieldTrialServiceData
 
 									gene_bank_p = GetGeneBankFromJSON (result_p);
 
-									if (!gene_bank_p)
+									if (gene_bank_p)
+										{
+											if (cache_key_s)
+												{
+													CacheReference (data_p -> dftsd_reference_cache_p, DFTD_GENE_BANK, cache_key_s, result_p);
+												}
+										}
+									else
 										{
 											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, result_p, "Failed to get GeneBank from JSON");
 										}
@@ -377,3 +413,16 @@ static void *GetGeneBankCallback (const json_t *json_p, const ViewFormat format,
 {
 	return GetGeneBankFromJSON (json_p);
 }
+
+
+static char *GetGeneBankNameCacheKey (const char *name_s)
+{
+	char *key_s = ConcatenateStrings ("name:", name_s);
+
+	if (!key_s)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create cache key for GeneBank \"%s\"", name_s);
+		}
+
+	return key_s;
+}
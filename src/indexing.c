@@ -20,12 +20,17 @@
  *      Author: billy
  */
 
+#include <pthread.h>
 #include <stddef.h>
 #include <string.h>
 #include <time.h>
 
 
 #include "indexing.h"
+#include "change_tracking.h"
+#include "dfw_util.h"
+#include "study_cache_file.h"
+#include "study_cache_warmer.h"
 #include "study_jobs.h"
 #include "location_jobs.h"
 #include "field_trial_jobs.h"
@@ -33,6 +38,7 @@
 #include "programme_jobs.h"
 #include "treatment_jobs.h"
 #include "audit.h"
+#include "background_jobs.h"
 
 #include "boolean_parameter.h"
 #include "string_utils.h"
@@ -57,6 +63,7 @@
 #include "data_resource.h"
 #include "filesystem_utils.h"
 #include "streams.h"
+#include "byte_buffer.h"
 #include "json_util.h"
 #include "memory_allocations.h"
 #include "operation.h"
@@ -64,6 +71,8 @@
 #include "typedefs.h"
 #include "user_details.h"
 #include "dfw_field_trial_service_data.h"
+#include "document_cache.h"
+#include "reference_cache.h"
 
 /*
  * Static declarations
@@ -74,6 +83,7 @@
  */
 static NamedParameterType S_CLEAR_DATA = { "SS Clear all data", PT_BOOLEAN };
 static NamedParameterType S_REINDEX_ALL_DATA = { "SS Reindex all data", PT_BOOLEAN };
+static NamedParameterType S_REINDEX_CHANGED_DATA = { "SS Reindex changed data", PT_BOOLEAN };
 static NamedParameterType S_REINDEX_TRIALS = { "SS Reindex trials", PT_BOOLEAN };
 static NamedParameterType S_REINDEX_STUDIES = { "SS Reindex studies", PT_BOOLEAN };
 static NamedParameterType S_REINDEX_LOCATIONS = { "SS Reindex locations", PT_BOOLEAN };
@@ -89,6 +99,122 @@ static NamedParameterType S_GENERATE_FD_PACAKGES = { "SS Gnerate FD Packages", P
  */
 static NamedParameterType S_CACHE_CLEAR = { "SS clear study cache", PT_LARGE_STRING };
 static NamedParameterType S_CACHE_LIST = { "SS list study cache", PT_BOOLEAN };
+static NamedParameterType S_CACHE_WARM = { "SS warm study cache", PT_LARGE_STRING };
+static NamedParameterType S_REFERENCE_CACHE_STATS = { "SS reference cache statistics", PT_BOOLEAN };
+
+
+/*
+ * The keys for the options of the jobs that run in the background
+ */
+static const char * const S_BACKGROUND_REINDEX_ALL_S = "reindex_all";
+static const char * const S_BACKGROUND_UPDATE_S = "update";
+static const char * const S_BACKGROUND_GENERATE_FD_S = "generate_fd_packages";
+static const char * const S_BACKGROUND_WARM_CACHE_S = "warm_study_cache";
+
+
+/*
+ * The default number of documents sent to Lucene at a time when reindexing.
+ * This can be changed with the "indexing_batch_size" config key.
+ */
+#define S_DEFAULT_INDEXING_BATCH_SIZE (500)
+
+
+/*
+ * The default number of seconds before the previous checkpoint from which
+ * documents are reindexed again, to pick up any that were stamped before
+ * the checkpoint but not saved until afterwards. This can be changed with
+ * the "indexing_overlap_seconds" config key.
+ */
+#define S_DEFAULT_INDEXING_OVERLAP (600)
+
+
+/*
+ * The maximum number of batches that can be waiting to be
+ * indexed when reindexing in parallel.
+ */
+#define S_INDEXING_QUEUE_SIZE (12)
+
+
+/*
+ * The number of datatypes that are read concurrently when reindexing in parallel.
+ */
+#define S_NUM_REINDEX_PRODUCERS (6)
+
+
+/*
+ * The maximum number of removed documents to delete from the
+ * index with a single query.
+ */
+#define S_MAX_IDS_PER_DELETE (64)
+
+
+/*
+ * The function used to send a batch of prepared documents to the index.
+ */
+typedef bool (*IndexBatchFn) (json_t *docs_p, const char *lucene_name_s, const bool update_flag, void *sink_p);
+
+
+struct ReindexProducer;
+
+
+typedef struct IndexingBatch
+{
+	json_t *ib_docs_p;
+
+	struct ReindexProducer *ib_producer_p;
+} IndexingBatch;
+
+
+/*
+ * The shared sink that the producer threads add their batches to
+ * when reindexing in parallel. Only the thread that owns the
+ * LuceneTool takes batches from it and writes them to the index.
+ */
+typedef struct IndexingQueue
+{
+	IndexingBatch iq_batches [S_INDEXING_QUEUE_SIZE];
+
+	/* The index of the oldest batch in iq_batches */
+	uint32 iq_head;
+
+	uint32 iq_num_batches;
+
+	uint32 iq_num_running_producers;
+
+	pthread_mutex_t iq_lock;
+
+	/* Signalled whenever a batch is added or removed or a producer finishes */
+	pthread_cond_t iq_changed;
+} IndexingQueue;
+
+
+/*
+ * The reading and preparing of a single datatype when reindexing in parallel.
+ */
+typedef struct ReindexProducer
+{
+	const char *rp_lucene_name_s;
+
+	DFWFieldTrialData rp_datatype;
+
+	const char *rp_excluded_key_s;
+
+	bool (*rp_prepare_fn) (json_t *docs_p, const FieldTrialServiceData *data_p);
+
+	IndexingQueue *rp_queue_p;
+
+	const FieldTrialServiceData *rp_data_p;
+
+	GrassrootsServer *rp_grassroots_p;
+
+	OperationStatus rp_status;
+
+	/* The number of this producer's batches that have been queued */
+	uint32 rp_num_queued;
+
+	/* The number of this producer's batches that then failed to be indexed */
+	uint32 rp_num_index_failures;
+} ReindexProducer;
 
 
 
@@ -108,10 +234,18 @@ static ParameterSet *GetFieldTrialIndexingServiceParameters (Service *service_p,
 static ServiceJobSet *RunFieldTrialIndexingService (Service *service_p, ParameterSet *param_set_p, UserDetails *user_p, ProvidersStateTable *providers_p);
 
 
-static bool RunReindexing (ParameterSet *param_set_p, ServiceJob *job_p, FieldTrialServiceData *data_p);
+static bool RunReindexing (ParameterSet *param_set_p, const bool reindex_all_flag, ServiceJob *job_p, FieldTrialServiceData *data_p);
+
+static json_t *GetBackgroundIndexingParams (ParameterSet *param_set_p, const FieldTrialServiceData *data_p);
+
+static bool RunBackgroundIndexing (ServiceJob *job_p, const json_t *params_p, FieldTrialServiceData *data_p);
 
 static bool RunCaching (ParameterSet *param_set_p, ServiceJob *job_p, FieldTrialServiceData *data_p);
 
+static OperationStatus RunStudyCacheWarming (const char *ids_s, ServiceJob *job_p, FieldTrialServiceData *data_p);
+
+static bool RunReferenceCacheStatistics (ParameterSet *param_set_p, ServiceJob *job_p, FieldTrialServiceData *data_p);
+
 
 static ParameterSet *IsResourceForFieldTrialIndexingService (Service *service_p, Resource *resource_p, Handler *handler_p);
 
@@ -127,10 +261,38 @@ static void GetCacheList (ServiceJob *job_p, const bool full_path_flag, const Fi
 
 static LinkedList *GetAllCacheFiles (const char *cache_path_s, const bool full_path_flag);
 
-static char *GetFullCacheFilename (const char *name_s, const char *cache_path_s, const size_t cache_path_length);
+static LinkedList *GetCacheFilesWithSuffix (const char *cache_path_s, const char *suffix_s, const bool full_path_flag);
+
+static char *GetCacheEntryId (const char *entry_s);
+
+static bool AddUncompressedCacheFileSize (json_t *file_p, const char *filename_s, const size_t file_size);
 
 static OperationStatus GenerateAllFrictionlessDataStudies (ServiceJob *job_p, FieldTrialServiceData *data_p);
 
+static OperationStatus IndexInBatches (IndexBatchFn index_fn, void *sink_p, const char *lucene_name_s, const DFWFieldTrialData datatype, const char *excluded_key_s, bool (*prepare_fn) (json_t *docs_p, const FieldTrialServiceData *data_p), const bson_t *filter_p, bool update_flag, const FieldTrialServiceData *data_p);
+
+static bool IndexBatchWithLucene (json_t *docs_p, const char *lucene_name_s, const bool update_flag, void *sink_p);
+
+static bool AddBatchToIndexingQueue (json_t *docs_p, const char *lucene_name_s, const bool update_flag, void *sink_p);
+
+static OperationStatus ReindexAllDataSequentially (ServiceJob *job_p, LuceneTool *lucene_p, const bool update_flag, const FieldTrialServiceData *service_data_p);
+
+static OperationStatus ReindexAllDataInParallel (LuceneTool *lucene_p, const bool update_flag, const FieldTrialServiceData *service_data_p, GrassrootsServer *grassroots_p);
+
+static void InitReindexProducer (ReindexProducer *producer_p, const char *lucene_name_s, const DFWFieldTrialData datatype, const char *excluded_key_s, bool (*prepare_fn) (json_t *docs_p, const FieldTrialServiceData *data_p), IndexingQueue *queue_p, const FieldTrialServiceData *data_p, GrassrootsServer *grassroots_p);
+
+static void *RunReindexProducer (void *producer_p);
+
+static void IndexQueuedBatches (IndexingQueue *queue_p, LuceneTool *lucene_p);
+
+static json_t *GetNextIndexingBatch (const DFWFieldTrialData datatype, const bson_oid_t *last_id_p, const uint32 batch_size, const char *excluded_key_s, const bson_t *filter_p, const FieldTrialServiceData *data_p);
+
+static OperationStatus ReindexChangedDatatype (LuceneTool *lucene_p, const char *lucene_name_s, const DFWFieldTrialData datatype, const char *excluded_key_s, bool (*prepare_fn) (json_t *docs_p, const FieldTrialServiceData *data_p), const int64 current_modification, const time_t checkpoint_time, const FieldTrialServiceData *data_p);
+
+static bool DeleteRemovedDocumentsFromLucene (LuceneTool *lucene_p, const char *lucene_name_s, const json_t *indexed_ids_p, const json_t *current_ids_p);
+
+static bool DeleteIdsFromLucene (LuceneTool *lucene_p, const json_t *ids_p, const size_t from, const size_t to);
+
 
 /*
  * API definitions
@@ -160,7 +322,7 @@ Service *GetFieldTrialIndexingService (GrassrootsServer *grassroots_p)
 																 CloseFieldTrialIndexingService,
 																 NULL,
 																 false,
-																 SY_SYNCHRONOUS,
+																 SY_ASYNCHRONOUS_DETACHED,
 																 (ServiceData *) data_p,
 																 GetFieldTrialIndexingServiceMetadata,
 																 NULL,
@@ -222,7 +384,11 @@ static bool CloseFieldTrialIndexingService (Service *service_p)
 
 
 
-static bool RunReindexing (ParameterSet *param_set_p, ServiceJob *job_p, FieldTrialServiceData *data_p)
+/*
+ * If reindex_all_flag is false, a request to reindex all of the data
+ * is left for the background job to do.
+ */
+static bool RunReindexing (ParameterSet *param_set_p, const bool reindex_all_flag, ServiceJob *job_p, FieldTrialServiceData *data_p)
 {
 	bool done_flag = false;
 	OperationStatus status = GetServiceJobStatus (job_p);
@@ -242,12 +408,28 @@ static bool RunReindexing (ParameterSet *param_set_p, ServiceJob *job_p, FieldTr
 		{
 			if ((index_flag_p != NULL) && (*index_flag_p == true))
 				{
-					ReindexAllData (job_p, update_flag, data_p);
+					if (reindex_all_flag)
+						{
+							ReindexAllData (job_p, update_flag, data_p);
+						}
 
 					done_flag = true;
 				}
 		}
 
+	if (!done_flag)
+		{
+			if (GetCurrentBooleanParameterValueFromParameterSet (param_set_p, S_REINDEX_CHANGED_DATA.npt_name_s, &index_flag_p))
+				{
+					if ((index_flag_p != NULL) && (*index_flag_p == true))
+						{
+							ReindexChangedData (job_p, data_p);
+
+							done_flag = true;
+						}
+				}
+		}
+
 	if (!done_flag)
 		{
 			GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (job_p -> sj_service_p);
@@ -382,6 +564,144 @@ static bool RunReindexing (ParameterSet *param_set_p, ServiceJob *job_p, FieldTr
 }
 
 
+/*
+ * Copy the options for reindexing all of the data, generating the
+ * Frictionless Data packages and warming the study cache out of the
+ * ParameterSet. If none of them has been requested, this returns NULL.
+ */
+static json_t *GetBackgroundIndexingParams (ParameterSet *param_set_p, const FieldTrialServiceData *data_p)
+{
+	json_t *params_p = NULL;
+	const bool *reindex_all_flag_p = NULL;
+	const bool *run_fd_packages_flag_p = NULL;
+	const char *warm_ids_s = NULL;
+
+	GetCurrentBooleanParameterValueFromParameterSet (param_set_p, S_REINDEX_ALL_DATA.npt_name_s, &reindex_all_flag_p);
+	GetCurrentBooleanParameterValueFromParameterSet (param_set_p, S_GENERATE_FD_PACAKGES.npt_name_s, &run_fd_packages_flag_p);
+
+	/* The Studies can only be warmed if there is somewhere to cache them */
+	if (data_p -> dftsd_study_cache_path_s)
+		{
+			GetCurrentStringParameterValueFromParameterSet (param_set_p, S_CACHE_WARM.npt_name_s, &warm_ids_s);
+		}
+
+	if ((reindex_all_flag_p && (*reindex_all_flag_p)) || (run_fd_packages_flag_p && (*run_fd_packages_flag_p)) || (warm_ids_s))
+		{
+			const bool *clear_flag_p = NULL;
+			bool update_flag = false;
+
+			/* This matches how RunReindexing () gets the flag */
+			if (GetCurrentBooleanParameterValueFromParameterSet (param_set_p, S_REINDEX_TRIALS.npt_name_s, &clear_flag_p))
+				{
+					if (clear_flag_p)
+						{
+							update_flag = ! (*clear_flag_p);
+						}
+				}
+
+			params_p = json_pack ("{s:b,s:b,s:b}",
+				S_BACKGROUND_REINDEX_ALL_S, (reindex_all_flag_p && (*reindex_all_flag_p)) ? 1 : 0,
+				S_BACKGROUND_UPDATE_S, update_flag ? 1 : 0,
+				S_BACKGROUND_GENERATE_FD_S, (run_fd_packages_flag_p && (*run_fd_packages_flag_p)) ? 1 : 0);
+
+			if (params_p)
+				{
+					if (warm_ids_s)
+						{
+							if (!SetJSONString (params_p, S_BACKGROUND_WARM_CACHE_S, warm_ids_s))
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add \"%s\" to the background indexing options", warm_ids_s);
+									json_decref (params_p);
+									params_p = NULL;
+								}
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create background indexing options");
+				}
+		}
+
+	return params_p;
+}
+
+
+/*
+ * Reindex all of the data, generate all of the Frictionless Data packages
+ * and/or warm the study cache. These can take a long time so they run on
+ * the background workers.
+ */
+static bool RunBackgroundIndexing (ServiceJob *job_p, const json_t *params_p, FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+	bool reindex_all_flag = false;
+	bool run_fd_packages_flag = false;
+	const char *warm_ids_s = GetJSONString (params_p, S_BACKGROUND_WARM_CACHE_S);
+
+	GetJSONBoolean (params_p, S_BACKGROUND_REINDEX_ALL_S, &reindex_all_flag);
+	GetJSONBoolean (params_p, S_BACKGROUND_GENERATE_FD_S, &run_fd_packages_flag);
+
+	/*
+	 * These only read data so each document fetched by
+	 * id only needs to be read once.
+	 */
+	BeginDocumentCacheScope (data_p -> dftsd_document_cache_p);
+
+	if (reindex_all_flag)
+		{
+			bool update_flag = false;
+
+			GetJSONBoolean (params_p, S_BACKGROUND_UPDATE_S, &update_flag);
+
+			if (ReindexAllData (job_p, update_flag, data_p) != OS_SUCCEEDED)
+				{
+					success_flag = false;
+				}
+		}
+
+	if (run_fd_packages_flag)
+		{
+			OperationStatus fd_status = GenerateAllFrictionlessDataStudies (job_p, data_p);
+
+			/*
+			 * When reindexing has been done too, the job keeps its status
+			 */
+			if ((!reindex_all_flag) && (fd_status != OS_IDLE))
+				{
+					SetServiceJobStatus (job_p, fd_status);
+				}
+
+			if ((fd_status == OS_FAILED) || (fd_status == OS_PARTIALLY_SUCCEEDED))
+				{
+					success_flag = false;
+				}
+		}
+
+	EndDocumentCacheScope (data_p -> dftsd_document_cache_p);
+
+	/*
+	 * Warming the cache writes the Studies to it so it is done
+	 * outside of the read-only scope.
+	 */
+	if (warm_ids_s)
+		{
+			OperationStatus warm_status = RunStudyCacheWarming (warm_ids_s, job_p, data_p);
+
+			if ((!reindex_all_flag) && (!run_fd_packages_flag))
+				{
+					SetServiceJobStatus (job_p, warm_status);
+				}
+
+			if (warm_status != OS_SUCCEEDED)
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
 static bool RunCaching (ParameterSet *param_set_p, ServiceJob *job_p, FieldTrialServiceData *data_p)
 {
 	bool done_flag = false;
@@ -426,30 +746,29 @@ static bool RunCaching (ParameterSet *param_set_p, ServiceJob *job_p, FieldTrial
 
 									if (entries_p)
 										{
-											const char *cache_path_s = data_p -> dftsd_study_cache_path_s;
-											const size_t cache_path_length = strlen (cache_path_s);
 											StringListNode *node_p = (StringListNode *) (entries_p -> ll_head_p);
 											size_t num_removed = 0;
 
 											while (node_p)
 												{
-													char *filename_s = GetFullCacheFilename (node_p -> sln_string_s, cache_path_s, cache_path_length);
+													char *id_s = GetCacheEntryId (node_p -> sln_string_s);
 
-													if (filename_s)
+													if (id_s)
 														{
-															if (RemoveFile (filename_s))
+															/*
+															 * Remove every copy of the Study, whichever
+															 * format it is stored in.
+															 */
+															if (ClearCachedStudy (id_s, data_p))
 																{
 																	++ num_removed;
 																}
 															else
 																{
-																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to remove file \"%s\"", node_p -> sln_string_s);
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to remove cached study \"%s\"", node_p -> sln_string_s);
 																}
 
-															if (filename_s != node_p -> sln_string_s)
-																{
-																	FreeCopiedString (filename_s);
-																}
+															FreeCopiedString (id_s);
 														}
 
 
@@ -475,6 +794,21 @@ static bool RunCaching (ParameterSet *param_set_p, ServiceJob *job_p, FieldTrial
 					SetServiceJobStatus (job_p, status);
 				}		/* if (!done_flag) */
 
+			/*
+			 * Warming the cache is queued with the other long-running tasks,
+			 * so it happens after any clearing and "clear *" followed by
+			 * "warm *" rebuilds every cached Study.
+			 */
+			if (!done_flag)
+				{
+					const char *warm_ids_s = NULL;
+
+					if (GetCurrentStringParameterValueFromParameterSet (param_set_p, S_CACHE_WARM.npt_name_s, &warm_ids_s) && (warm_ids_s))
+						{
+							done_flag = true;
+						}
+				}
+
 		}		/* if (data_p -> dftsd_study_cache_path_s) */
 	else
 		{
@@ -485,86 +819,248 @@ static bool RunCaching (ParameterSet *param_set_p, ServiceJob *job_p, FieldTrial
 }
 
 
-static char *GetFullCacheFilename (const char *name_s, const char *cache_path_s, const size_t cache_path_length)
+/*
+ * Warm the study cache for the Studies with the given space-separated
+ * ids, or all of them if this is "*".
+ */
+static OperationStatus RunStudyCacheWarming (const char *ids_s, ServiceJob *job_p, FieldTrialServiceData *data_p)
 {
-	char *filename_s = NULL;
-	const char * const suffix_s = ".json";
+	OperationStatus status = OS_FAILED;
+	json_t *ids_p = NULL;
 
-	if (!DoesStringEndWith (name_s, suffix_s))
+	if (strcmp (ids_s, "*") == 0)
 		{
-			filename_s = ConcatenateStrings (name_s, suffix_s);
-
-			if (!filename_s)
-				{
-					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "ConcatenateStrings failed for \"%s\" and \"%s\"", name_s, suffix_s);
-				}
+			ids_p = GetAllStudyIdsAsJSON (data_p);
 		}
 	else
 		{
-			filename_s = (char *) name_s;
+			LinkedList *entries_p = ParseStringToStringLinkedList (ids_s, " ", true);
+
+			if (entries_p)
+				{
+					if ((ids_p = json_array ()) != NULL)
+						{
+							StringListNode *node_p = (StringListNode *) (entries_p -> ll_head_p);
+
+							while (node_p && ids_p)
+								{
+									if (json_array_append_new (ids_p, json_string (node_p -> sln_string_s)) != 0)
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add \"%s\" to the studies to warm", node_p -> sln_string_s);
+											json_decref (ids_p);
+											ids_p = NULL;
+										}
+
+									node_p = (StringListNode *) (node_p -> sln_node.ln_next_p);
+								}
+						}
+
+					FreeLinkedList (entries_p);
+				}		/* if (entries_p) */
 		}
 
-	if (filename_s)
+	if (ids_p)
 		{
-			/*
-			 * Is it the full path?
-			 */
-			if (strncmp (cache_path_s, filename_s, cache_path_length) != 0)
+			GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (job_p -> sj_service_p);
+			int num_threads = SCW_DEFAULT_NUM_THREADS;
+			json_t *results_p = NULL;
+
+			GetJSONInteger (data_p -> dftsd_base_data.sd_config_p, "cache_warming_threads", &num_threads);
+
+			if (num_threads < 1)
+				{
+					num_threads = 1;
+				}
+
+			results_p = WarmStudyCache (ids_p, (uint32) num_threads, job_p, data_p, grassroots_p);
+
+			if (results_p)
 				{
-					char *full_filename_s = MakeFilename (cache_path_s, filename_s);
+					const json_t *failed_ids_p = json_object_get (results_p, "failed_ids");
+					json_t *dest_record_p = GetResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, "Study Cache Warming", results_p);
 
-					if (!full_filename_s)
+					if (dest_record_p)
+						{
+							if (!AddResultToServiceJob (job_p, dest_record_p))
+								{
+									json_decref (dest_record_p);
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "AddResultToServiceJob failed for study cache warming");
+								}
+						}		/* if (dest_record_p) */
+					else
 						{
-							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "MakeFilename failed for \"%s\" and \"%s\"", cache_path_s, filename_s);
+							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, results_p, "GetResourceAsJSONByParts failed for study cache warming");
 						}
 
-					if (filename_s != name_s)
+					if (json_array_size (failed_ids_p) == 0)
 						{
-							FreeCopiedString (filename_s);
+							status = OS_SUCCEEDED;
 						}
+					else
+						{
+							size_t i;
+							const json_t *failed_id_p;
 
-					filename_s = full_filename_s;
+							json_array_foreach (failed_ids_p, i, failed_id_p)
+								{
+									char *error_s = ConcatenateVarargsStrings ("Failed to warm the cached Study \"", json_string_value (failed_id_p), "\"", NULL);
+
+									if (error_s)
+										{
+											AddGeneralErrorMessageToServiceJob (job_p, error_s);
+											FreeCopiedString (error_s);
+										}
+								}
+
+							if (json_array_size (failed_ids_p) < json_array_size (ids_p))
+								{
+									status = OS_PARTIALLY_SUCCEEDED;
+								}
+						}
 
+					json_decref (results_p);
+				}		/* if (results_p) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "WarmStudyCache failed for \"%s\"", ids_s);
 				}
-		}		/* if (filename_s) */
 
-	return filename_s;
+			json_decref (ids_p);
+		}		/* if (ids_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the ids of the Studies to warm from \"%s\"", ids_s);
+		}
+
+	return status;
 }
 
-static void GetCacheList (ServiceJob *job_p, const bool full_path_flag, const FieldTrialServiceData *data_p)
+
+static bool RunReferenceCacheStatistics (ParameterSet *param_set_p, ServiceJob *job_p, FieldTrialServiceData *data_p)
 {
-	if (data_p -> dftsd_study_cache_path_s)
-		{
-			LinkedList *filenames_p = GetAllCacheFiles (data_p -> dftsd_study_cache_path_s, true);
+	bool done_flag = false;
+	const bool *stats_flag_p = NULL;
 
-			if (filenames_p)
+	if (GetCurrentBooleanParameterValueFromParameterSet (param_set_p, S_REFERENCE_CACHE_STATS.npt_name_s, &stats_flag_p))
+		{
+			if ((stats_flag_p != NULL) && (*stats_flag_p == true))
 				{
 					OperationStatus status = OS_FAILED;
-					json_t *files_array_p = json_array ();
+					json_t *stats_p = GetReferenceCacheStatisticsAsJSON (data_p -> dftsd_reference_cache_p);
 
-					if (files_array_p)
+					if (stats_p)
 						{
-							size_t array_size;
-							StringListNode *node_p = (StringListNode *) (filenames_p -> ll_head_p);
-							FileInformation info;
-							json_t *dest_record_p = NULL;
-							const char sep = GetFileSeparatorChar ();
+							json_t *dest_record_p = GetResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, "Reference Cache", stats_p);
 
-							InitFileInformation (&info);
-
-							while (node_p)
+							if (dest_record_p)
 								{
-									if (CalculateFileInformation (node_p -> sln_string_s, &info))
+									if (AddResultToServiceJob (job_p, dest_record_p))
 										{
-											const char *filename_s;
+											status = OS_SUCCEEDED;
+										}
+									else
+										{
+											json_decref (dest_record_p);
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "AddResultToServiceJob failed for reference cache statistics");
+										}
 
-											if (full_path_flag)
-												{
-													filename_s = node_p -> sln_string_s;
-												}
-											else
-												{
-													filename_s = strrchr (node_p -> sln_string_s, sep);
+								}		/* if (dest_record_p) */
+							else
+								{
+									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, stats_p, "GetResourceAsJSONByParts failed for reference cache statistics");
+								}
+
+							json_decref (stats_p);
+						}		/* if (stats_p) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "GetReferenceCacheStatisticsAsJSON failed");
+						}
+
+					SetServiceJobStatus (job_p, status);
+					done_flag = true;
+				}
+		}
+
+	return done_flag;
+}
+
+
+static char *GetCacheEntryId (const char *entry_s)
+{
+	const char *name_s = strrchr (entry_s, GetFileSeparatorChar ());
+	char *id_s = NULL;
+
+	if (name_s)
+		{
+			/* scroll past the file separator char */
+			++ name_s;
+		}
+	else
+		{
+			name_s = entry_s;
+		}
+
+	id_s = EasyCopyToNewString (name_s);
+
+	if (id_s)
+		{
+			size_t suffix_length = 0;
+
+			if (DoesStringEndWith (id_s, SCF_COMPRESSED_SUFFIX_S))
+				{
+					suffix_length = strlen (SCF_COMPRESSED_SUFFIX_S);
+				}
+			else if (DoesStringEndWith (id_s, SCF_PLAIN_SUFFIX_S))
+				{
+					suffix_length = strlen (SCF_PLAIN_SUFFIX_S);
+				}
+
+			* (id_s + strlen (id_s) - suffix_length) = '\0';
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to copy cache entry \"%s\"", entry_s);
+		}
+
+	return id_s;
+}
+
+
+static void GetCacheList (ServiceJob *job_p, const bool full_path_flag, const FieldTrialServiceData *data_p)
+{
+	if (data_p -> dftsd_study_cache_path_s)
+		{
+			LinkedList *filenames_p = GetAllCacheFiles (data_p -> dftsd_study_cache_path_s, true);
+
+			if (filenames_p)
+				{
+					OperationStatus status = OS_FAILED;
+					json_t *files_array_p = json_array ();
+
+					if (files_array_p)
+						{
+							size_t array_size;
+							StringListNode *node_p = (StringListNode *) (filenames_p -> ll_head_p);
+							FileInformation info;
+							json_t *dest_record_p = NULL;
+							const char sep = GetFileSeparatorChar ();
+
+							InitFileInformation (&info);
+
+							while (node_p)
+								{
+									if (CalculateFileInformation (node_p -> sln_string_s, &info))
+										{
+											const char *filename_s;
+
+											if (full_path_flag)
+												{
+													filename_s = node_p -> sln_string_s;
+												}
+											else
+												{
+													filename_s = strrchr (node_p -> sln_string_s, sep);
 
 													if (filename_s)
 														{
@@ -604,13 +1100,16 @@ static void GetCacheList (ServiceJob *job_p, const bool full_path_flag, const Fi
 																										{
 																											if (SetJSONString (file_p, CONTEXT_PREFIX_SCHEMA_ORG_S "fileSize", size_s))
 																												{
-																													if (json_array_append_new (files_array_p, file_p) == 0)
+																													if (AddUncompressedCacheFileSize (file_p, node_p -> sln_string_s, info.fi_size))
 																														{
-																															added_flag = true;
-																														}		/* if (json_array_append_new (files_array_p, file_p) == 0) */
-																													else
-																														{
-																															PrintJSONToErrors (STM_LEVEL_INFO, __FILE__, __LINE__, file_p, "Failed to add json item for \"%s\"", node_p -> sln_string_s);
+																															if (json_array_append_new (files_array_p, file_p) == 0)
+																																{
+																																	added_flag = true;
+																																}		/* if (json_array_append_new (files_array_p, file_p) == 0) */
+																															else
+																																{
+																																	PrintJSONToErrors (STM_LEVEL_INFO, __FILE__, __LINE__, file_p, "Failed to add json item for \"%s\"", node_p -> sln_string_s);
+																																}
 																														}
 
 																												}		/* if (SetJSONString (file_p, CONTEXT_PREFIX_SCHEMA_ORG_S "fileSize", size_s)) */
@@ -728,152 +1227,811 @@ static void GetCacheList (ServiceJob *job_p, const bool full_path_flag, const Fi
 				}		/* if (filenames_p) */
 			else
 				{
-					PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "No cached files in \"%s\"", data_p -> dftsd_study_cache_path_s);
+					PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "No cached files in \"%s\"", data_p -> dftsd_study_cache_path_s);
+				}
+
+		}		/* if (data_p -> dftsd_study_cache_path_s) */
+	else
+		{
+			PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "No studies cache path set");
+		}
+
+}
+
+
+static bool AddUncompressedCacheFileSize (json_t *file_p, const char *filename_s, const size_t file_size)
+{
+	bool success_flag = false;
+	uint64 uncompressed_size = file_size;
+	const char *format_s = "application/json";
+	bool got_size_flag = true;
+
+	if (DoesStringEndWith (filename_s, SCF_COMPRESSED_SUFFIX_S))
+		{
+			StudyCacheFileHeader header;
+
+			if (ReadStudyCacheFileHeader (filename_s, &header))
+				{
+					uncompressed_size = header.scfh_uncompressed_size;
+					format_s = "application/zlib";
+				}
+			else
+				{
+					got_size_flag = false;
+				}
+		}
+
+	if (got_size_flag)
+		{
+			char *bytes_s = ConvertLongToString ((int64) uncompressed_size);
+
+			if (bytes_s)
+				{
+					char *size_s = ConcatenateStrings (bytes_s, " B");
+
+					if (size_s)
+						{
+							if (SetJSONString (file_p, "uncompressedFileSize", size_s))
+								{
+									if (SetJSONString (file_p, CONTEXT_PREFIX_SCHEMA_ORG_S "encodingFormat", format_s))
+										{
+											success_flag = true;
+										}
+									else
+										{
+											PrintJSONToErrors (STM_LEVEL_INFO, __FILE__, __LINE__, file_p, "Failed to set \"%s\": \"%s\" for \"%s\"", CONTEXT_PREFIX_SCHEMA_ORG_S "encodingFormat", format_s, filename_s);
+										}
+								}
+							else
+								{
+									PrintJSONToErrors (STM_LEVEL_INFO, __FILE__, __LINE__, file_p, "Failed to set \"%s\": \"%s\" for \"%s\"", "uncompressedFileSize", size_s, filename_s);
+								}
+
+							FreeCopiedString (size_s);
+						}		/* if (size_s) */
+					else
+						{
+							PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "ConcatenateStrings failed for \"%s\" and \" B\" for \"%s\"", bytes_s, filename_s);
+						}
+
+					FreeCopiedString (bytes_s);
+				}		/* if (bytes_s) */
+			else
+				{
+					PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Failed to get size as string from " UINT64_FMT " for  \"%s\"", uncompressed_size, filename_s);
+				}
+
+		}		/* if (got_size_flag) */
+	else
+		{
+			PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Failed to read the cache header for \"%s\"", filename_s);
+		}
+
+	return success_flag;
+}
+
+
+static LinkedList *GetAllCacheFiles (const char *cache_path_s, const bool full_path_flag)
+{
+	LinkedList *files_p = GetCacheFilesWithSuffix (cache_path_s, SCF_PLAIN_SUFFIX_S, full_path_flag);
+	LinkedList *compressed_files_p = GetCacheFilesWithSuffix (cache_path_s, SCF_COMPRESSED_SUFFIX_S, full_path_flag);
+
+	if (compressed_files_p)
+		{
+			if (files_p)
+				{
+					ListItem *node_p;
+
+					while ((node_p = LinkedListRemHead (compressed_files_p)) != NULL)
+						{
+							LinkedListAddTail (files_p, node_p);
+						}
+
+					FreeLinkedList (compressed_files_p);
+				}
+			else
+				{
+					files_p = compressed_files_p;
+				}
+		}
+
+	return files_p;
+}
+
+
+static LinkedList *GetCacheFilesWithSuffix (const char *cache_path_s, const char *suffix_s, const bool full_path_flag)
+{
+	LinkedList *files_p = NULL;
+	char *pattern_s = ConcatenateVarargsStrings (cache_path_s, "*", suffix_s, NULL);
+
+	if (pattern_s)
+		{
+			if (! (files_p = GetMatchingFiles (pattern_s, full_path_flag)))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "GetMatchingFiles failed for pattern: \"%s\"", pattern_s);
+				}
+
+			FreeCopiedString (pattern_s);
+		}		/* if (pattern_s) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to concat strings for cache file pattern: \"%s\"", cache_path_s);
+		}
+
+	return files_p;
+}
+
+
+OperationStatus IndexData (ServiceJob *job_p, const json_t *data_to_index_p)
+{
+	OperationStatus status = OS_FAILED;
+	GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (job_p -> sj_service_p);
+	LuceneTool *lucene_p = AllocateLuceneTool (grassroots_p, job_p -> sj_id);
+
+	if (lucene_p)
+		{
+			status = IndexLucene (lucene_p, data_to_index_p, true);
+
+			FreeLuceneTool (lucene_p);
+		}		/* if (lucene_p) */
+
+	return status;
+}
+
+
+OperationStatus ReindexAllData (ServiceJob *job_p, const bool update_flag, const FieldTrialServiceData *service_data_p)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (job_p -> sj_service_p);
+	LuceneTool *lucene_p = AllocateLuceneTool (grassroots_p, job_p -> sj_id);
+
+	if (lucene_p)
+		{
+			bool parallel_flag = false;
+
+			GetJSONBoolean (service_data_p -> dftsd_base_data.sd_config_p, "parallel_reindexing", &parallel_flag);
+
+			if (parallel_flag)
+				{
+					status = ReindexAllDataInParallel (lucene_p, update_flag, service_data_p, grassroots_p);
+				}
+			else
+				{
+					status = ReindexAllDataSequentially (job_p, lucene_p, update_flag, service_data_p);
+				}
+
+			FreeLuceneTool (lucene_p);
+		}		/* if (lucene_p) */
+
+	SetServiceJobStatus (job_p, status);
+
+	return status;
+}
+
+
+static OperationStatus ReindexAllDataSequentially (ServiceJob *job_p, LuceneTool *lucene_p, const bool update_flag, const FieldTrialServiceData *service_data_p)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	OperationStatus temp_status = ReindexStudies (job_p, lucene_p, update_flag, service_data_p);
+	uint32 fully_succeeded_count = 0;
+	uint32 partially_succeeded_count = 0;
+	uint32 total_count = 0;
+
+	++ total_count;
+	if (temp_status == OS_SUCCEEDED)
+		{
+			++ fully_succeeded_count;
+		}
+	else if (temp_status == OS_PARTIALLY_SUCCEEDED)
+		{
+			++ partially_succeeded_count;
+		}
+
+
+	temp_status = ReindexTrials (job_p, lucene_p, true, service_data_p);
+	++ total_count;
+
+	if (temp_status == OS_SUCCEEDED)
+		{
+			++ fully_succeeded_count;
+		}
+	else if (temp_status == OS_PARTIALLY_SUCCEEDED)
+		{
+			++ partially_succeeded_count;
+		}
+
+	temp_status = ReindexLocations (job_p, lucene_p, true, service_data_p);
+	++ total_count;
+
+	if (temp_status == OS_SUCCEEDED)
+		{
+			++ fully_succeeded_count;
+		}
+	else if (temp_status == OS_PARTIALLY_SUCCEEDED)
+		{
+			++ partially_succeeded_count;
+		}
+
+	temp_status = ReindexMeasuredVariables (job_p, lucene_p, true, service_data_p);
+	++ total_count;
+
+	if (temp_status == OS_SUCCEEDED)
+		{
+			++ fully_succeeded_count;
+		}
+	else if (temp_status == OS_PARTIALLY_SUCCEEDED)
+		{
+			++ partially_succeeded_count;
+		}
+
+	temp_status = ReindexProgrammes (job_p, lucene_p, true, service_data_p);
+	++ total_count;
+	if (temp_status == OS_SUCCEEDED)
+		{
+			++ fully_succeeded_count;
+		}
+	else if (temp_status == OS_PARTIALLY_SUCCEEDED)
+		{
+			++ partially_succeeded_count;
+		}
+
+
+	temp_status = ReindexTreatments (job_p, lucene_p, true, service_data_p);
+	++ total_count;
+	if (temp_status == OS_SUCCEEDED)
+		{
+			++ fully_succeeded_count;
+		}
+	else if (temp_status == OS_PARTIALLY_SUCCEEDED)
+		{
+			++ partially_succeeded_count;
+		}
+
+
+	if (fully_succeeded_count == total_count)
+		{
+			status = OS_SUCCEEDED;
+		}
+	else if ((fully_succeeded_count > 0) || (partially_succeeded_count > 0))
+		{
+			status = OS_PARTIALLY_SUCCEEDED;
+		}
+
+
+	return status;
+}
+
+
+/*
+ * Read and prepare each datatype on its own thread, with its own MongoTool,
+ * while this thread writes the resulting batches to the index. Most of the
+ * time for a reindex is spent waiting on the database so this should take
+ * about as long as the slowest datatype rather than the sum of them all.
+ */
+static OperationStatus ReindexAllDataInParallel (LuceneTool *lucene_p, const bool update_flag, const FieldTrialServiceData *service_data_p, GrassrootsServer *grassroots_p)
+{
+	OperationStatus status = OS_FAILED;
+	bool cleared_flag = update_flag;
+
+	/*
+	 * If the index is being replaced, it has to be cleared before
+	 * any of the producers start adding to it.
+	 */
+	if (!cleared_flag)
+		{
+			json_t *empty_p = json_array ();
+
+			if (empty_p)
+				{
+					cleared_flag = IndexBatchWithLucene (empty_p, "index_studies", false, lucene_p);
+					json_decref (empty_p);
+				}
+
+			if (!cleared_flag)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to clear the index before reindexing in parallel");
+				}
+		}
+
+	if (cleared_flag)
+		{
+			IndexingQueue queue;
+
+			queue.iq_head = 0;
+			queue.iq_num_batches = 0;
+			queue.iq_num_running_producers = 0;
+
+			if (pthread_mutex_init (& (queue.iq_lock), NULL) == 0)
+				{
+					if (pthread_cond_init (& (queue.iq_changed), NULL) == 0)
+						{
+							ReindexProducer producers [S_NUM_REINDEX_PRODUCERS];
+							pthread_t threads [S_NUM_REINDEX_PRODUCERS];
+							bool started_flags [S_NUM_REINDEX_PRODUCERS];
+							uint32 fully_succeeded_count = 0;
+							uint32 partially_succeeded_count = 0;
+							uint32 i;
+
+							InitReindexProducer (producers, "index_studies", DFTD_STUDY, ST_SHAPE_S, PrepareStudiesForIndexing, &queue, service_data_p, grassroots_p);
+							InitReindexProducer (producers + 1, "index_trials", DFTD_FIELD_TRIAL, NULL, PrepareFieldTrialsForIndexing, &queue, service_data_p, grassroots_p);
+							InitReindexProducer (producers + 2, "index_locations", DFTD_LOCATION, NULL, PrepareLocationsForIndexing, &queue, service_data_p, grassroots_p);
+							InitReindexProducer (producers + 3, "index_measured_variables", DFTD_MEASURED_VARIABLE, NULL, PrepareMeasuredVariablesForIndexing, &queue, service_data_p, grassroots_p);
+							InitReindexProducer (producers + 4, "index_programmes", DFTD_PROGRAM, NULL, PrepareProgrammesForIndexing, &queue, service_data_p, grassroots_p);
+							InitReindexProducer (producers + 5, "index_treatments", DFTD_TREATMENT, NULL, PrepareTreatmentsForIndexing, &queue, service_data_p, grassroots_p);
+
+							/*
+							 * Count all of the producers as running before any of them
+							 * start so that the queue isn't seen as finished too early.
+							 */
+							queue.iq_num_running_producers = S_NUM_REINDEX_PRODUCERS;
+
+							for (i = 0; i < S_NUM_REINDEX_PRODUCERS; ++ i)
+								{
+									started_flags [i] = (pthread_create (threads + i, NULL, RunReindexProducer, producers + i) == 0);
+
+									if (!started_flags [i])
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to start reindexing thread for \"%s\", it will be reindexed afterwards", producers [i].rp_lucene_name_s);
+
+											pthread_mutex_lock (& (queue.iq_lock));
+											-- (queue.iq_num_running_producers);
+											pthread_mutex_unlock (& (queue.iq_lock));
+										}
+								}
+
+							IndexQueuedBatches (&queue, lucene_p);
+
+							for (i = 0; i < S_NUM_REINDEX_PRODUCERS; ++ i)
+								{
+									ReindexProducer *producer_p = producers + i;
+
+									if (started_flags [i])
+										{
+											pthread_join (threads [i], NULL);
+
+											if (producer_p -> rp_num_index_failures > 0)
+												{
+													producer_p -> rp_status = (producer_p -> rp_num_index_failures < producer_p -> rp_num_queued) ? OS_PARTIALLY_SUCCEEDED : OS_FAILED;
+												}
+										}
+									else
+										{
+											producer_p -> rp_status = IndexInBatches (IndexBatchWithLucene, lucene_p, producer_p -> rp_lucene_name_s, producer_p -> rp_datatype, producer_p -> rp_excluded_key_s, producer_p -> rp_prepare_fn, NULL, true, service_data_p);
+										}
+
+									if (producer_p -> rp_status == OS_SUCCEEDED)
+										{
+											++ fully_succeeded_count;
+										}
+									else if (producer_p -> rp_status == OS_PARTIALLY_SUCCEEDED)
+										{
+											++ partially_succeeded_count;
+										}
+								}
+
+							if (fully_succeeded_count == S_NUM_REINDEX_PRODUCERS)
+								{
+									status = OS_SUCCEEDED;
+								}
+							else if ((fully_succeeded_count > 0) || (partially_succeeded_count > 0))
+								{
+									status = OS_PARTIALLY_SUCCEEDED;
+								}
+
+							pthread_cond_destroy (& (queue.iq_changed));
+						}		/* if (pthread_cond_init (& (queue.iq_changed), NULL) == 0) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to initialise reindexing queue condition");
+						}
+
+					pthread_mutex_destroy (& (queue.iq_lock));
+				}		/* if (pthread_mutex_init (& (queue.iq_lock), NULL) == 0) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to initialise reindexing queue lock");
+				}
+
+		}		/* if (cleared_flag) */
+
+	return status;
+}
+
+
+OperationStatus ReindexStudies (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p)
+{
+	/*
+	 * The shape data can be large and only its presence is indexed
+	 */
+	return IndexInBatches (IndexBatchWithLucene, lucene_p, "index_studies", DFTD_STUDY, ST_SHAPE_S, PrepareStudiesForIndexing, NULL, update_flag, service_data_p);
+}
+
+
+
+OperationStatus ReindexTreatments (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p)
+{
+	return IndexInBatches (IndexBatchWithLucene, lucene_p, "index_treatments", DFTD_TREATMENT, NULL, PrepareTreatmentsForIndexing, NULL, update_flag, service_data_p);
+}
+
+
+OperationStatus ReindexProgrammes (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p)
+{
+	return IndexInBatches (IndexBatchWithLucene, lucene_p, "index_programmes", DFTD_PROGRAM, NULL, PrepareProgrammesForIndexing, NULL, update_flag, service_data_p);
+}
+
+
+OperationStatus ReindexLocations (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p)
+{
+	return IndexInBatches (IndexBatchWithLucene, lucene_p, "index_locations", DFTD_LOCATION, NULL, PrepareLocationsForIndexing, NULL, update_flag, service_data_p);
+}
+
+
+OperationStatus ReindexTrials (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p)
+{
+	return IndexInBatches (IndexBatchWithLucene, lucene_p, "index_trials", DFTD_FIELD_TRIAL, NULL, PrepareFieldTrialsForIndexing, NULL, update_flag, service_data_p);
+}
+
+
+OperationStatus ReindexMeasuredVariables (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p)
+{
+	return IndexInBatches (IndexBatchWithLucene, lucene_p, "index_measured_variables", DFTD_MEASURED_VARIABLE, NULL, PrepareMeasuredVariablesForIndexing, NULL, update_flag, service_data_p);
+}
+
+
+/*
+ * Rather than building the whole collection in memory before indexing it,
+ * read it in pages of batch_size documents, ordered by id, and pass each
+ * one to index_fn before reading the next. The first batch uses the given
+ * update_flag and the rest are then added to the index that it started.
+ */
+static OperationStatus IndexInBatches (IndexBatchFn index_fn, void *sink_p, const char *lucene_name_s, const DFWFieldTrialData datatype, const char *excluded_key_s, bool (*prepare_fn) (json_t *docs_p, const FieldTrialServiceData *data_p), const bson_t *filter_p, bool update_flag, const FieldTrialServiceData *data_p)
+{
+	OperationStatus status = OS_FAILED;
+	int batch_size = S_DEFAULT_INDEXING_BATCH_SIZE;
+	bson_oid_t last_id;
+	bool has_last_id_flag = false;
+	bool loop_flag = true;
+	uint32 num_batches = 0;
+	uint32 num_succeeded = 0;
+
+	if ((!GetJSONInteger (data_p -> dftsd_base_data.sd_config_p, "indexing_batch_size", &batch_size)) || (batch_size < 1))
+		{
+			batch_size = S_DEFAULT_INDEXING_BATCH_SIZE;
+		}
+
+	while (loop_flag)
+		{
+			json_t *docs_p = GetNextIndexingBatch (datatype, has_last_id_flag ? &last_id : NULL, (uint32) batch_size, excluded_key_s, filter_p, data_p);
+
+			loop_flag = false;
+
+			if (docs_p)
+				{
+					const size_t num_docs = json_array_size (docs_p);
+
+					/*
+					 * Always index the first batch, even if it is empty, so
+					 * that an existing index is cleared if needed.
+					 */
+					if ((num_docs > 0) || (num_batches == 0))
+						{
+							++ num_batches;
+
+							/*
+							 * Get the id to page from before the documents are converted
+							 */
+							if (num_docs > 0)
+								{
+									if (GetMongoIdFromJSON (json_array_get (docs_p, num_docs - 1), &last_id))
+										{
+											has_last_id_flag = true;
+											loop_flag = (num_docs == (size_t) batch_size);
+										}
+									else
+										{
+											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, json_array_get (docs_p, num_docs - 1), "Failed to get id to continue indexing \"%s\" from", lucene_name_s);
+										}
+								}
+
+							if (prepare_fn (docs_p, data_p))
+								{
+									if (index_fn (docs_p, lucene_name_s, update_flag, sink_p))
+										{
+											++ num_succeeded;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to index batch " UINT32_FMT " for \"%s\"", num_batches, lucene_name_s);
+										}
+
+									update_flag = true;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to prepare batch " UINT32_FMT " for \"%s\"", num_batches, lucene_name_s);
+								}
+						}
+
+					json_decref (docs_p);
+				}		/* if (docs_p) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get batch " UINT32_FMT " for \"%s\"", num_batches + 1, lucene_name_s);
+				}
+
+		}		/* while (loop_flag) */
+
+	if ((num_batches > 0) && (num_succeeded == num_batches))
+		{
+			status = OS_SUCCEEDED;
+		}
+	else if (num_succeeded > 0)
+		{
+			status = OS_PARTIALLY_SUCCEEDED;
+		}
+
+	return status;
+}
+
+
+static bool IndexBatchWithLucene (json_t *docs_p, const char *lucene_name_s, const bool update_flag, void *sink_p)
+{
+	bool success_flag = false;
+	LuceneTool *lucene_p = (LuceneTool *) sink_p;
+
+	if (SetLuceneToolName (lucene_p, lucene_name_s))
+		{
+			if (IndexLucene (lucene_p, docs_p, update_flag) == OS_SUCCEEDED)
+				{
+					success_flag = true;
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set LuceneTool name to \"%s\"", lucene_name_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Wait until there is space in the producer's queue and then add
+ * the batch to it. The index has already been cleared before any
+ * of the producers start, so update_flag is not needed.
+ */
+static bool AddBatchToIndexingQueue (json_t *docs_p, const char * UNUSED_PARAM (lucene_name_s), const bool UNUSED_PARAM (update_flag), void *sink_p)
+{
+	ReindexProducer *producer_p = (ReindexProducer *) sink_p;
+	IndexingQueue *queue_p = producer_p -> rp_queue_p;
+
+	if (json_array_size (docs_p) > 0)
+		{
+			IndexingBatch *batch_p;
+
+			pthread_mutex_lock (& (queue_p -> iq_lock));
+
+			while (queue_p -> iq_num_batches == S_INDEXING_QUEUE_SIZE)
+				{
+					pthread_cond_wait (& (queue_p -> iq_changed), & (queue_p -> iq_lock));
+				}
+
+			batch_p = queue_p -> iq_batches + ((queue_p -> iq_head + queue_p -> iq_num_batches) % S_INDEXING_QUEUE_SIZE);
+			batch_p -> ib_docs_p = json_incref (docs_p);
+			batch_p -> ib_producer_p = producer_p;
+
+			++ (queue_p -> iq_num_batches);
+			++ (producer_p -> rp_num_queued);
+
+			pthread_cond_broadcast (& (queue_p -> iq_changed));
+			pthread_mutex_unlock (& (queue_p -> iq_lock));
+		}
+
+	return true;
+}
+
+
+/*
+ * Write the queued batches to the index as they arrive until all
+ * of the producers have finished and the queue is empty.
+ */
+static void IndexQueuedBatches (IndexingQueue *queue_p, LuceneTool *lucene_p)
+{
+	pthread_mutex_lock (& (queue_p -> iq_lock));
+
+	while ((queue_p -> iq_num_batches > 0) || (queue_p -> iq_num_running_producers > 0))
+		{
+			if (queue_p -> iq_num_batches > 0)
+				{
+					IndexingBatch batch = * (queue_p -> iq_batches + queue_p -> iq_head);
+
+					queue_p -> iq_head = (queue_p -> iq_head + 1) % S_INDEXING_QUEUE_SIZE;
+					-- (queue_p -> iq_num_batches);
+
+					/*
+					 * Let any producers that are waiting for space carry on
+					 * while this batch is being indexed
+					 */
+					pthread_cond_broadcast (& (queue_p -> iq_changed));
+					pthread_mutex_unlock (& (queue_p -> iq_lock));
+
+					if (!IndexBatchWithLucene (batch.ib_docs_p, batch.ib_producer_p -> rp_lucene_name_s, true, lucene_p))
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to index queued batch for \"%s\"", batch.ib_producer_p -> rp_lucene_name_s);
+							++ (batch.ib_producer_p -> rp_num_index_failures);
+						}
+
+					json_decref (batch.ib_docs_p);
+
+					pthread_mutex_lock (& (queue_p -> iq_lock));
+				}
+			else
+				{
+					pthread_cond_wait (& (queue_p -> iq_changed), & (queue_p -> iq_lock));
 				}
-
-		}		/* if (data_p -> dftsd_study_cache_path_s) */
-	else
-		{
-			PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "No studies cache path set");
 		}
 
+	pthread_mutex_unlock (& (queue_p -> iq_lock));
 }
 
 
-static LinkedList *GetAllCacheFiles (const char *cache_path_s, const bool full_path_flag)
+static void InitReindexProducer (ReindexProducer *producer_p, const char *lucene_name_s, const DFWFieldTrialData datatype, const char *excluded_key_s, bool (*prepare_fn) (json_t *docs_p, const FieldTrialServiceData *data_p), IndexingQueue *queue_p, const FieldTrialServiceData *data_p, GrassrootsServer *grassroots_p)
 {
-	LinkedList *files_p = NULL;
-	char *pattern_s = ConcatenateStrings (cache_path_s, "*.json");
-
-	if (pattern_s)
-		{
-			if (! (files_p = GetMatchingFiles (pattern_s, full_path_flag)))
-				{
-					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "GetMatchingFiles failed for pattern: \"%s\"", pattern_s);
-				}
-
-			FreeCopiedString (pattern_s);
-		}		/* if (pattern_s) */
-	else
-		{
-			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to concat strings for cache file pattern: \"%s\"", cache_path_s);
-		}
-
-	return files_p;
+	producer_p -> rp_lucene_name_s = lucene_name_s;
+	producer_p -> rp_datatype = datatype;
+	producer_p -> rp_excluded_key_s = excluded_key_s;
+	producer_p -> rp_prepare_fn = prepare_fn;
+	producer_p -> rp_queue_p = queue_p;
+	producer_p -> rp_data_p = data_p;
+	producer_p -> rp_grassroots_p = grassroots_p;
+	producer_p -> rp_status = OS_FAILED_TO_START;
+	producer_p -> rp_num_queued = 0;
+	producer_p -> rp_num_index_failures = 0;
 }
 
 
-OperationStatus IndexData (ServiceJob *job_p, const json_t *data_to_index_p)
+static void *RunReindexProducer (void *data_p)
 {
-	OperationStatus status = OS_FAILED;
-	GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (job_p -> sj_service_p);
-	LuceneTool *lucene_p = AllocateLuceneTool (grassroots_p, job_p -> sj_id);
+	ReindexProducer *producer_p = (ReindexProducer *) data_p;
+	IndexingQueue *queue_p = producer_p -> rp_queue_p;
 
-	if (lucene_p)
+	FieldTrialServiceData *worker_data_p = AllocateWorkerServiceData (producer_p -> rp_data_p, producer_p -> rp_grassroots_p);
+
+	if (worker_data_p)
 		{
-			status = IndexLucene (lucene_p, data_to_index_p, true);
+			producer_p -> rp_status = IndexInBatches (AddBatchToIndexingQueue, producer_p, producer_p -> rp_lucene_name_s, producer_p -> rp_datatype, producer_p -> rp_excluded_key_s, producer_p -> rp_prepare_fn, NULL, true, worker_data_p);
 
-			FreeLuceneTool (lucene_p);
-		}		/* if (lucene_p) */
+			FreeWorkerServiceData (worker_data_p);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set up the service data for \"%s\"", producer_p -> rp_lucene_name_s);
+		}
 
-	return status;
+	pthread_mutex_lock (& (queue_p -> iq_lock));
+	-- (queue_p -> iq_num_running_producers);
+	pthread_cond_broadcast (& (queue_p -> iq_changed));
+	pthread_mutex_unlock (& (queue_p -> iq_lock));
+
+	return NULL;
 }
 
 
-OperationStatus ReindexAllData (ServiceJob *job_p, const bool update_flag, const FieldTrialServiceData *service_data_p)
+/*
+ * Get up to batch_size raw documents, ordered by id, whose ids come after last_id_p.
+ * If last_id_p is NULL, start from the beginning of the collection. If filter_p is
+ * not NULL, only the documents that also match it are returned.
+ */
+static json_t *GetNextIndexingBatch (const DFWFieldTrialData datatype, const bson_oid_t *last_id_p, const uint32 batch_size, const char *excluded_key_s, const bson_t *filter_p, const FieldTrialServiceData *data_p)
 {
-	OperationStatus status = OS_FAILED_TO_START;
-	GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (job_p -> sj_service_p);
-	LuceneTool *lucene_p = AllocateLuceneTool (grassroots_p, job_p -> sj_id);
+	json_t *docs_p = NULL;
 
-	if (lucene_p)
+	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [datatype]))
 		{
-			OperationStatus temp_status = ReindexStudies (job_p, lucene_p, update_flag, service_data_p);
-			uint32 fully_succeeded_count = 0;
-			uint32 partially_succeeded_count = 0;
-			uint32 total_count = 0;
+			bson_t *query_p = filter_p ? bson_copy (filter_p) : bson_new ();
 
-			++ total_count;
-			if (temp_status == OS_SUCCEEDED)
-				{
-					++ fully_succeeded_count;
-				}
-			else if (temp_status == OS_PARTIALLY_SUCCEEDED)
+			if (query_p)
 				{
-					++ partially_succeeded_count;
-				}
+					bson_t *opts_p;
 
+					if (last_id_p)
+						{
+							BCON_APPEND (query_p, MONGO_ID_S, "{", "$gt", BCON_OID (last_id_p), "}");
+						}
 
-			temp_status = ReindexTrials (job_p, lucene_p, true, service_data_p);
-			++ total_count;
+					opts_p = BCON_NEW ("sort", "{", MONGO_ID_S, BCON_INT32 (1), "}", "limit", BCON_INT64 (batch_size));
 
-			if (temp_status == OS_SUCCEEDED)
-				{
-					++ fully_succeeded_count;
-				}
-			else if (temp_status == OS_PARTIALLY_SUCCEEDED)
-				{
-					++ partially_succeeded_count;
-				}
+					if (opts_p)
+						{
+							if (excluded_key_s)
+								{
+									BCON_APPEND (opts_p, "projection", "{", excluded_key_s, BCON_INT32 (0), "}");
+								}
 
-			temp_status = ReindexLocations (job_p, lucene_p, true, service_data_p);
-			++ total_count;
+							docs_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, opts_p);
 
-			if (temp_status == OS_SUCCEEDED)
-				{
-					++ fully_succeeded_count;
-				}
-			else if (temp_status == OS_PARTIALLY_SUCCEEDED)
-				{
-					++ partially_succeeded_count;
-				}
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
 
-			temp_status = ReindexMeasuredVariables (job_p, lucene_p, true, service_data_p);
-			++ total_count;
+					bson_destroy (query_p);
+				}		/* if (query_p) */
 
-			if (temp_status == OS_SUCCEEDED)
-				{
-					++ fully_succeeded_count;
-				}
-			else if (temp_status == OS_PARTIALLY_SUCCEEDED)
-				{
-					++ partially_succeeded_count;
-				}
+		}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [datatype])) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set collection to \"%s\"", data_p -> dftsd_collection_ss [datatype]);
+		}
 
-			temp_status = ReindexProgrammes (job_p, lucene_p, true, service_data_p);
-			++ total_count;
-			if (temp_status == OS_SUCCEEDED)
-				{
-					++ fully_succeeded_count;
-				}
-			else if (temp_status == OS_PARTIALLY_SUCCEEDED)
-				{
-					++ partially_succeeded_count;
-				}
+	return docs_p;
+}
 
 
-			temp_status = ReindexTreatments (job_p, lucene_p, true, service_data_p);
-			++ total_count;
-			if (temp_status == OS_SUCCEEDED)
-				{
-					++ fully_succeeded_count;
-				}
-			else if (temp_status == OS_PARTIALLY_SUCCEEDED)
-				{
-					++ partially_succeeded_count;
-				}
+/*
+ * Reindex only those documents that have been saved since the last
+ * checkpoint for each index and remove any that have been deleted.
+ * Treatments are not saved by this service so they aren't tracked.
+ */
+OperationStatus ReindexChangedData (ServiceJob *job_p, const FieldTrialServiceData *service_data_p)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (job_p -> sj_service_p);
+	LuceneTool *lucene_p = AllocateLuceneTool (grassroots_p, job_p -> sj_id);
 
+	if (lucene_p)
+		{
+			int64 current_modification = 0;
+			const time_t checkpoint_time = time (NULL);
 
-			if (fully_succeeded_count == total_count)
+			/*
+			 * Get the marker before reading anything so that any documents
+			 * saved while this is running will be picked up next time.
+			 */
+			if (GetCurrentModification (&current_modification, service_data_p))
 				{
-					status = OS_SUCCEEDED;
-				}
-			else if ((fully_succeeded_count > 0) || (partially_succeeded_count > 0))
+					OperationStatus statuses [5];
+					const uint32 total_count = sizeof (statuses) / sizeof (statuses [0]);
+					uint32 fully_succeeded_count = 0;
+					uint32 partially_succeeded_count = 0;
+					uint32 i;
+
+					statuses [0] = ReindexChangedDatatype (lucene_p, "index_studies", DFTD_STUDY, ST_SHAPE_S, PrepareStudiesForIndexing, current_modification, checkpoint_time, service_data_p);
+					statuses [1] = ReindexChangedDatatype (lucene_p, "index_trials", DFTD_FIELD_TRIAL, NULL, PrepareFieldTrialsForIndexing, current_modification, checkpoint_time, service_data_p);
+					statuses [2] = ReindexChangedDatatype (lucene_p, "index_locations", DFTD_LOCATION, NULL, PrepareLocationsForIndexing, current_modification, checkpoint_time, service_data_p);
+					statuses [3] = ReindexChangedDatatype (lucene_p, "index_measured_variables", DFTD_MEASURED_VARIABLE, NULL, PrepareMeasuredVariablesForIndexing, current_modification, checkpoint_time, service_data_p);
+					statuses [4] = ReindexChangedDatatype (lucene_p, "index_programmes", DFTD_PROGRAM, NULL, PrepareProgrammesForIndexing, current_modification, checkpoint_time, service_data_p);
+
+					for (i = 0; i < total_count; ++ i)
+						{
+							if (statuses [i] == OS_SUCCEEDED)
+								{
+									++ fully_succeeded_count;
+								}
+							else if (statuses [i] == OS_PARTIALLY_SUCCEEDED)
+								{
+									++ partially_succeeded_count;
+								}
+						}
+
+					if (fully_succeeded_count == total_count)
+						{
+							status = OS_SUCCEEDED;
+						}
+					else if ((fully_succeeded_count > 0) || (partially_succeeded_count > 0))
+						{
+							status = OS_PARTIALLY_SUCCEEDED;
+						}
+					else
+						{
+							status = OS_FAILED;
+						}
+
+				}		/* if (GetCurrentModification (&current_modification, service_data_p)) */
+			else
 				{
-					status = OS_PARTIALLY_SUCCEEDED;
+					status = OS_FAILED;
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the current modification marker");
 				}
 
-
 			FreeLuceneTool (lucene_p);
 		}		/* if (lucene_p) */
 
@@ -883,118 +2041,240 @@ OperationStatus ReindexAllData (ServiceJob *job_p, const bool update_flag, const
 }
 
 
-OperationStatus ReindexStudies (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p)
+static OperationStatus ReindexChangedDatatype (LuceneTool *lucene_p, const char *lucene_name_s, const DFWFieldTrialData datatype, const char *excluded_key_s, bool (*prepare_fn) (json_t *docs_p, const FieldTrialServiceData *data_p), const int64 current_modification, const time_t checkpoint_time, const FieldTrialServiceData *data_p)
 {
 	OperationStatus status = OS_FAILED;
-	json_t *studies_p = GetStudyIndexingData (service_data_p -> dftsd_base_data.sd_service_p);
+	int64 last_modification = -1;
+	time_t last_time = 0;
+	json_t *indexed_ids_p = NULL;
 
-	if (studies_p)
+	if (GetIndexingCheckpoint (lucene_name_s, &last_modification, &last_time, &indexed_ids_p, data_p))
 		{
-			if (SetLuceneToolName (lucene_p, "index_studies"))
+			json_t *current_ids_p = GetAllIdsAsJSON (datatype, data_p);
+
+			if (current_ids_p)
 				{
-					status = IndexLucene (lucene_p, studies_p, update_flag);
-				}
+					/*
+					 * If there is no checkpoint yet, every document counts as changed
+					 */
+					if (last_modification < 0)
+						{
+							status = IndexInBatches (IndexBatchWithLucene, lucene_p, lucene_name_s, datatype, excluded_key_s, prepare_fn, NULL, true, data_p);
+						}
+					else
+						{
+							bson_t *filter_p = NULL;
+
+							/*
+							 * A document is stamped before it is saved, so one stamped before
+							 * the last checkpoint may not have been written until afterwards.
+							 * Reindexing everything modified within the overlap before the
+							 * checkpoint picks these up.
+							 */
+							if (last_time > 0)
+								{
+									int overlap = S_DEFAULT_INDEXING_OVERLAP;
 
-			json_decref (studies_p);
-		}
+									if ((!GetJSONInteger (data_p -> dftsd_base_data.sd_config_p, "indexing_overlap_seconds", &overlap)) || (overlap < 0))
+										{
+											overlap = S_DEFAULT_INDEXING_OVERLAP;
+										}
 
-	return status;
-}
+									filter_p = BCON_NEW ("$or", "[",
+																				"{", CT_MODIFICATION_S, "{", "$gt", BCON_INT64 (last_modification), "}", "}",
+																				"{", CT_MODIFIED_AT_S, "{", "$gte", BCON_INT64 ((int64) (last_time - overlap)), "}", "}",
+																			"]");
+								}
+							else
+								{
+									filter_p = BCON_NEW (CT_MODIFICATION_S, "{", "$gt", BCON_INT64 (last_modification), "}");
+								}
 
+							if (filter_p)
+								{
+									status = IndexInBatches (IndexBatchWithLucene, lucene_p, lucene_name_s, datatype, excluded_key_s, prepare_fn, filter_p, true, data_p);
+									bson_destroy (filter_p);
+								}
+						}
 
+					if ((status == OS_SUCCEEDED) && indexed_ids_p)
+						{
+							if (!DeleteRemovedDocumentsFromLucene (lucene_p, lucene_name_s, indexed_ids_p, current_ids_p))
+								{
+									status = OS_PARTIALLY_SUCCEEDED;
+								}
+						}
 
-OperationStatus ReindexTreatments (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p)
-{
-	OperationStatus status = OS_FAILED;
-	json_t *treatments_p = GetTreatmentIndexingData (service_data_p -> dftsd_base_data.sd_service_p);
+					/*
+					 * Only move the checkpoint on once everything up to it is in the index
+					 */
+					if (status == OS_SUCCEEDED)
+						{
+							if (!SetIndexingCheckpoint (lucene_name_s, current_modification, checkpoint_time, current_ids_p, data_p))
+								{
+									status = OS_PARTIALLY_SUCCEEDED;
+								}
+						}
 
-	if (treatments_p)
-		{
-			if (SetLuceneToolName (lucene_p, "index_treatments"))
+					json_decref (current_ids_p);
+				}		/* if (current_ids_p) */
+			else
 				{
-					status = IndexLucene (lucene_p, treatments_p, update_flag);
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the current ids for \"%s\"", lucene_name_s);
 				}
 
-			json_decref (treatments_p);
+			if (indexed_ids_p)
+				{
+					json_decref (indexed_ids_p);
+				}
+
+		}		/* if (GetIndexingCheckpoint (lucene_name_s, &last_modification, &last_time, &indexed_ids_p, data_p)) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the indexing checkpoint for \"%s\"", lucene_name_s);
 		}
 
 	return status;
 }
 
 
-OperationStatus ReindexProgrammes (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p)
+/*
+ * Remove the entries for any documents that were in the index at the
+ * last checkpoint but no longer exist.
+ */
+static bool DeleteRemovedDocumentsFromLucene (LuceneTool *lucene_p, const char *lucene_name_s, const json_t *indexed_ids_p, const json_t *current_ids_p)
 {
-	OperationStatus status = OS_FAILED;
-	json_t *programmes_p = GetProgrammeIndexingData (service_data_p -> dftsd_base_data.sd_service_p);
+	bool success_flag = false;
+	json_t *current_set_p = json_object ();
 
-	if (programmes_p)
+	if (current_set_p)
 		{
-			if (SetLuceneToolName (lucene_p, "index_programmes"))
+			json_t *removed_ids_p = json_array ();
+
+			if (removed_ids_p)
 				{
-					status = IndexLucene (lucene_p, programmes_p, update_flag);
-				}
+					size_t i;
+					json_t *id_p;
 
-			json_decref (programmes_p);
-		}
+					success_flag = true;
 
-	return status;
-}
+					json_array_foreach (current_ids_p, i, id_p)
+						{
+							const char *id_s = json_string_value (id_p);
 
+							if (id_s)
+								{
+									if (json_object_set (current_set_p, id_s, json_true ()) != 0)
+										{
+											success_flag = false;
+										}
+								}
+						}
 
-OperationStatus ReindexLocations (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p)
-{
-	OperationStatus status = OS_FAILED;
-	json_t *locations_p = GetLocationIndexingData (service_data_p -> dftsd_base_data.sd_service_p);
+					json_array_foreach (indexed_ids_p, i, id_p)
+						{
+							const char *id_s = json_string_value (id_p);
 
-	if (locations_p)
-		{
-			if (SetLuceneToolName (lucene_p, "index_locations"))
-				{
-					status = IndexLucene (lucene_p, locations_p, update_flag);
-				}
-			json_decref (locations_p);
-		}
+							if ((id_s) && (json_object_get (current_set_p, id_s) == NULL))
+								{
+									if (json_array_append (removed_ids_p, id_p) != 0)
+										{
+											success_flag = false;
+										}
+								}
+						}
 
-	return status;
-}
+					if (success_flag)
+						{
+							const size_t num_removed = json_array_size (removed_ids_p);
 
+							if (num_removed > 0)
+								{
+									if (SetLuceneToolName (lucene_p, lucene_name_s))
+										{
+											size_t from = 0;
 
-OperationStatus ReindexTrials (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p)
-{
-	OperationStatus status = OS_FAILED;
-	json_t *trials_p = GetFieldTrialIndexingData (service_data_p -> dftsd_base_data.sd_service_p);
+											while (from < num_removed)
+												{
+													size_t to = from + S_MAX_IDS_PER_DELETE;
 
-	if (trials_p)
-		{
-			if (SetLuceneToolName (lucene_p, "index_trials"))
-				{
-					status = IndexLucene (lucene_p, trials_p, update_flag);
-				}
+													if (to > num_removed)
+														{
+															to = num_removed;
+														}
 
-			json_decref (trials_p);
-		}
+													if (!DeleteIdsFromLucene (lucene_p, removed_ids_p, from, to))
+														{
+															success_flag = false;
+														}
 
-	return status;
+													from = to;
+												}
+										}
+									else
+										{
+											success_flag = false;
+										}
+
+									if (success_flag)
+										{
+											PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Removed " SIZET_FMT " deleted documents from \"%s\"", num_removed, lucene_name_s);
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to remove " SIZET_FMT " deleted documents from \"%s\"", num_removed, lucene_name_s);
+										}
+								}
+
+						}		/* if (success_flag) */
+
+					json_decref (removed_ids_p);
+				}		/* if (removed_ids_p) */
+
+			json_decref (current_set_p);
+		}		/* if (current_set_p) */
+
+	return success_flag;
 }
 
 
-OperationStatus ReindexMeasuredVariables (ServiceJob *job_p, LuceneTool *lucene_p, bool update_flag, const FieldTrialServiceData *service_data_p)
+/*
+ * Delete the index entries for the ids in the range [from, to) with a single query.
+ */
+static bool DeleteIdsFromLucene (LuceneTool *lucene_p, const json_t *ids_p, const size_t from, const size_t to)
 {
-	OperationStatus status = OS_FAILED;
-	json_t *variables_p = GetMeasuredVariableIndexingData (service_data_p -> dftsd_base_data.sd_service_p);
-
+	bool success_flag = false;
+	ByteBuffer *query_buffer_p = AllocateByteBuffer (1024);
 
-	if (variables_p)
+	if (query_buffer_p)
 		{
-			if (SetLuceneToolName (lucene_p, "index_measured_variables"))
+			size_t i;
+
+			success_flag = true;
+
+			for (i = from; (i < to) && success_flag; ++ i)
 				{
-					status = IndexLucene (lucene_p, variables_p, update_flag);
+					const char *id_s = json_string_value (json_array_get (ids_p, i));
+
+					if (!AppendStringsToByteBuffer (query_buffer_p, (i > from) ? " OR " : "", LUCENE_ID_S, ":", id_s, NULL))
+						{
+							success_flag = false;
+						}
 				}
 
-			json_decref (variables_p);
-		}
+			if (success_flag)
+				{
+					if (DeleteLucene (lucene_p, GetByteBufferData (query_buffer_p), NULL) != OS_SUCCEEDED)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to delete \"%s\" from the index", GetByteBufferData (query_buffer_p));
+							success_flag = false;
+						}
+				}
 
-	return status;
+			FreeByteBuffer (query_buffer_p);
+		}		/* if (query_buffer_p) */
+
+	return success_flag;
 }
 
 
@@ -1014,10 +2294,16 @@ static ServiceJobSet *RunFieldTrialIndexingService (Service *service_p, Paramete
 
 			if (param_set_p)
 				{
-					const bool *run_fd_packages_flag_p = NULL;
 					const char *id_s = NULL;
+					json_t *background_params_p = GetBackgroundIndexingParams (param_set_p, data_p);
+
+					/*
+					 * Reindexing and generating the packages only read data so
+					 * each document fetched by id only needs to be read once.
+					 */
+					BeginDocumentCacheScope (data_p -> dftsd_document_cache_p);
 
-					if (!RunReindexing (param_set_p, job_p, data_p))
+					if (!RunReindexing (param_set_p, background_params_p == NULL, job_p, data_p))
 						{
 							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "RunReindexing failed");
 						}
@@ -1027,13 +2313,9 @@ static ServiceJobSet *RunFieldTrialIndexingService (Service *service_p, Paramete
 							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "RunCaching failed");
 						}
 
+					RunReferenceCacheStatistics (param_set_p, job_p, data_p);
 
-					GetCurrentBooleanParameterValueFromParameterSet (param_set_p, S_GENERATE_FD_PACAKGES.npt_name_s, &run_fd_packages_flag_p);
-
-					if (run_fd_packages_flag_p && (*run_fd_packages_flag_p))
-						{
-							OperationStatus fd_status = GenerateAllFrictionlessDataStudies (job_p, data_p);
-						}
+					EndDocumentCacheScope (data_p -> dftsd_document_cache_p);
 
 					if (GetCurrentStringParameterValueFromParameterSet (param_set_p, S_REMOVE_STUDY_PLOTS.npt_name_s, &id_s))
 						{
@@ -1045,6 +2327,20 @@ static ServiceJobSet *RunFieldTrialIndexingService (Service *service_p, Paramete
 								}
 						}		/* if (id_s) */
 
+					/*
+					 * Reindexing all of the data, generating the packages and warming the cache are
+					 * queued last so that the job stays pending until they're done.
+					 */
+					if (background_params_p)
+						{
+							if (!RunBackgroundServiceJob (job_p, RunBackgroundIndexing, background_params_p, data_p))
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "RunBackgroundIndexing failed");
+								}
+
+							json_decref (background_params_p);
+						}
+
 				}
 		}
 
@@ -1064,6 +2360,10 @@ static bool GetIndexingParameterTypeForNamedParameter (const Service *service_p,
 		{
 			*pt_p = S_REINDEX_ALL_DATA.npt_type;
 		}
+	else if (strcmp (param_name_s, S_REINDEX_CHANGED_DATA.npt_name_s) == 0)
+		{
+			*pt_p = S_REINDEX_CHANGED_DATA.npt_type;
+		}
 	else if (strcmp (param_name_s, S_REINDEX_TRIALS.npt_name_s) == 0)
 		{
 			*pt_p = S_REINDEX_TRIALS.npt_type;
@@ -1096,6 +2396,14 @@ static bool GetIndexingParameterTypeForNamedParameter (const Service *service_p,
 		{
 			*pt_p = S_CACHE_LIST.npt_type;
 		}
+	else if (strcmp (param_name_s, S_CACHE_WARM.npt_name_s) == 0)
+		{
+			*pt_p = S_CACHE_WARM.npt_type;
+		}
+	else if (strcmp (param_name_s, S_REFERENCE_CACHE_STATS.npt_name_s) == 0)
+		{
+			*pt_p = S_REFERENCE_CACHE_STATS.npt_type;
+		}
 	else if (strcmp (param_name_s, S_REMOVE_STUDY_PLOTS.npt_name_s) == 0)
 		{
 			*pt_p = S_REMOVE_STUDY_PLOTS.npt_type;
@@ -1142,20 +2450,29 @@ static ParameterSet *GetFieldTrialIndexingServiceParameters (Service *service_p,
 																{
 																	if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, params_p, indexing_group_p, S_REINDEX_TREATMENTS.npt_name_s, "Reindex all Treatments", "Reindex all Treatments into Lucene", &b, PL_ALL)) != NULL)
 																		{
-																			ParameterGroup *caching_group_p = CreateAndAddParameterGroupToParameterSet ("Cache", false, data_p, params_p);
-
-																			if ((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, params_p, caching_group_p, S_CACHE_CLEAR.npt_type, S_CACHE_CLEAR.npt_name_s, "Clear Study cache", "Clear any cached Studies with the given Ids. Use * to clear all of them.", NULL, PL_ALL)) != NULL)
+																			if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, params_p, indexing_group_p, S_REINDEX_CHANGED_DATA.npt_name_s, "Reindex changed data", "Reindex only the data that has been saved or removed since the last time that this was run", &b, PL_ALL)) != NULL)
 																				{
-																					if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, params_p, caching_group_p, S_CACHE_LIST.npt_name_s, "List cached Studies", "Get the ids and dates of all of the cached Studies", &b, PL_ALL)) != NULL)
-																						{
-																							ParameterGroup *manager_group_p = CreateAndAddParameterGroupToParameterSet ("Studies", false, data_p, params_p);
+																					ParameterGroup *caching_group_p = CreateAndAddParameterGroupToParameterSet ("Cache", false, data_p, params_p);
 
-																							if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, params_p, manager_group_p, S_GENERATE_FD_PACAKGES.npt_name_s, "Generate all Frictionless Data Packages", "Generate FD pacakges for all Studies", &b, PL_ALL)) != NULL)
+																					if ((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, params_p, caching_group_p, S_CACHE_CLEAR.npt_type, S_CACHE_CLEAR.npt_name_s, "Clear Study cache", "Clear any cached Studies with the given Ids. Use * to clear all of them.", NULL, PL_ALL)) != NULL)
+																						{
+																							if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, params_p, caching_group_p, S_CACHE_LIST.npt_name_s, "List cached Studies", "Get the ids and dates of all of the cached Studies", &b, PL_ALL)) != NULL)
 																								{
-																									if ((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, params_p, manager_group_p, S_REMOVE_STUDY_PLOTS.npt_type, S_REMOVE_STUDY_PLOTS.npt_name_s, "Remove Plots", "Remove all of the Plots for the given Study Id", NULL, PL_ALL)) != NULL)
+																									if ((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, params_p, caching_group_p, S_CACHE_WARM.npt_type, S_CACHE_WARM.npt_name_s, "Warm Study cache", "Build the cached copies of the Studies with the given Ids in the background, using several threads. Any Study whose cached copy is newer than its last change is skipped. Use * to warm all of them.", NULL, PL_ALL)) != NULL)
 																										{
-
-																											return params_p;
+																										if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, params_p, caching_group_p, S_REFERENCE_CACHE_STATS.npt_name_s, "Reference cache statistics", "Get the sizes and the hit, miss and eviction counts of the in-memory cache for each datatype", &b, PL_ALL)) != NULL)
+																											{
+																												ParameterGroup *manager_group_p = CreateAndAddParameterGroupToParameterSet ("Studies", false, data_p, params_p);
+
+																												if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, params_p, manager_group_p, S_GENERATE_FD_PACAKGES.npt_name_s, "Generate all Frictionless Data Packages", "Generate FD pacakges for all Studies", &b, PL_ALL)) != NULL)
+																													{
+																														if ((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, params_p, manager_group_p, S_REMOVE_STUDY_PLOTS.npt_type, S_REMOVE_STUDY_PLOTS.npt_name_s, "Remove Plots", "Remove all of the Plots for the given Study Id", NULL, PL_ALL)) != NULL)
+																															{
+
+																																return params_p;
+																															}
+																													}
+																											}
 																										}
 																								}
 																						}
@@ -1380,6 +2697,7 @@ static OperationStatus GenerateAllFrictionlessDataStudies (ServiceJob *job_p, Fi
 					size_t i;
 					size_t num_saved = 0;
 					const size_t num_studies = json_array_size (all_studies_p);
+					BackgroundJob *bg_job_p = GetBackgroundJob (job_p);
 
 					json_array_foreach (all_studies_p, i, study_json_p)
 						{
@@ -1402,6 +2720,8 @@ static OperationStatus GenerateAllFrictionlessDataStudies (ServiceJob *job_p, Fi
 								{
 									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, study_json_p, "GetStudyFromJSON () failed");
 								}
+
+							SetBackgroundJobProgress (bg_job_p, i + 1, num_studies);
 						}
 
 					if (num_saved == num_studies)
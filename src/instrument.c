@@ -25,6 +25,8 @@
 #include "memory_allocations.h"
 #include "string_utils.h"
 #include "dfw_util.h"
+#include "document_cache.h"
+#include "reference_cache.h"
 
 
 
@@ -148,6 +150,11 @@ bool SaveInstrument (Instrument *instrument_p, const FieldTrialServiceData *data
 				{
 					success_flag = SaveMongoData (data_p -> dftsd_mongo_p, instrument_json_p, data_p -> dftsd_collection_ss [DFTD_INSTRUMENT], selector_p);
 
+					if (success_flag)
+						{
+							InvalidateCachedReferenceById (data_p -> dftsd_reference_cache_p, DFTD_INSTRUMENT, instrument_p -> in_id_p);
+						}
+
 					json_decref (instrument_json_p);
 				}		/* if (instrument_json_p) */
 
@@ -161,8 +168,19 @@ bool SaveInstrument (Instrument *instrument_p, const FieldTrialServiceData *data
 Instrument *GetInstrumentById (const bson_oid_t *instrument_id_p, const FieldTrialServiceData *data_p)
 {
 	Instrument *instrument_p = NULL;
+	const json_t *cached_doc_p = GetDocumentFromDocumentCache (data_p -> dftsd_document_cache_p, DFTD_INSTRUMENT, instrument_id_p);
+	json_t *reference_doc_p = NULL;
 
-	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_INSTRUMENT]))
+	if (cached_doc_p)
+		{
+			instrument_p = GetInstrumentFromJSON (cached_doc_p);
+		}
+	else if ((reference_doc_p = GetCachedReferenceById (data_p -> dftsd_reference_cache_p, DFTD_INSTRUMENT, instrument_id_p)) != NULL)
+		{
+			instrument_p = GetInstrumentFromJSON (reference_doc_p);
+			json_decref (reference_doc_p);
+		}
+	else if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_INSTRUMENT]))
 		{
 			bson_t *query_p = BCON_NEW (MONGO_ID_S, BCON_OID (instrument_id_p));
 
@@ -182,10 +200,11 @@ Instrument *GetInstrumentById (const bson_oid_t *instrument_id_p, const FieldTri
 
 											instrument_p = GetInstrumentFromJSON (entry_p);
 
-											if (!instrument_p)
+											if (instrument_p)
 												{
-
-												}		/* if (!instrument_p) */
+													AddDocumentToDocumentCacheScope (data_p -> dftsd_document_cache_p, DFTD_INSTRUMENT, entry_p);
+													CacheReferenceById (data_p -> dftsd_reference_cache_p, DFTD_INSTRUMENT, entry_p);
+												}		/* if (instrument_p) */
 
 										}		/* if (num_results == 1) */
 
@@ -0,0 +1,208 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * list_index.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include "list_index.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+
+
+static const uint32 S_INITIAL_NUM_BUCKETS = 8;
+
+static const uint32 S_HASH_PRIME = 16777619u;
+
+
+static bool ResizeListIndex (ListIndex *index_p, const uint32 num_buckets);
+
+
+
+ListIndex *AllocateListIndex (void)
+{
+	ListIndex *index_p = (ListIndex *) AllocMemory (sizeof (ListIndex));
+
+	if (index_p)
+		{
+			index_p -> li_buckets_pp = NULL;
+			index_p -> li_num_buckets = 0;
+			index_p -> li_num_entries = 0;
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate ListIndex");
+		}
+
+	return index_p;
+}
+
+
+void FreeListIndex (ListIndex *index_p)
+{
+	if (index_p -> li_buckets_pp)
+		{
+			uint32 i;
+
+			for (i = 0; i < index_p -> li_num_buckets; ++ i)
+				{
+					ListIndexEntry *entry_p = * ((index_p -> li_buckets_pp) + i);
+
+					while (entry_p)
+						{
+							ListIndexEntry *next_p = entry_p -> lie_next_p;
+
+							FreeMemory (entry_p);
+							entry_p = next_p;
+						}
+				}
+
+			FreeMemory (index_p -> li_buckets_pp);
+		}
+
+	FreeMemory (index_p);
+}
+
+
+bool AddListIndexItem (ListIndex *index_p, ListItem *item_p, const uint32 hash)
+{
+	bool success_flag = false;
+
+	/*
+	 * Keep no more than one entry per bucket on average. If the index
+	 * can't grow, it still works, just with longer chains.
+	 */
+	if (index_p -> li_num_entries >= index_p -> li_num_buckets)
+		{
+			const uint32 num_buckets = (index_p -> li_num_buckets > 0) ? (index_p -> li_num_buckets << 1) : S_INITIAL_NUM_BUCKETS;
+
+			if (!ResizeListIndex (index_p, num_buckets))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to resize ListIndex to " UINT32_FMT " buckets", num_buckets);
+				}
+		}
+
+	if (index_p -> li_buckets_pp)
+		{
+			ListIndexEntry *entry_p = (ListIndexEntry *) AllocMemory (sizeof (ListIndexEntry));
+
+			if (entry_p)
+				{
+					ListIndexEntry **bucket_pp = (index_p -> li_buckets_pp) + (hash & (index_p -> li_num_buckets - 1));
+
+					entry_p -> lie_item_p = item_p;
+					entry_p -> lie_hash = hash;
+					entry_p -> lie_next_p = *bucket_pp;
+					*bucket_pp = entry_p;
+
+					++ (index_p -> li_num_entries);
+					success_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate ListIndexEntry");
+				}
+
+		}		/* if (index_p -> li_buckets_pp) */
+
+	return success_flag;
+}
+
+
+ListItem *FindListIndexItem (const ListIndex *index_p, const uint32 hash, ListIndexMatchFn match_fn, const void *value_p)
+{
+	if (index_p -> li_buckets_pp)
+		{
+			const ListIndexEntry *entry_p = * ((index_p -> li_buckets_pp) + (hash & (index_p -> li_num_buckets - 1)));
+
+			while (entry_p)
+				{
+					if ((entry_p -> lie_hash == hash) && (match_fn (entry_p -> lie_item_p, value_p)))
+						{
+							return entry_p -> lie_item_p;
+						}
+
+					entry_p = entry_p -> lie_next_p;
+				}
+		}
+
+	return NULL;
+}
+
+
+/*
+ * FNV-1a
+ */
+uint32 HashListIndexBytes (uint32 hash, const void *data_p, const size_t size)
+{
+	const uint8 *byte_p = (const uint8 *) data_p;
+	size_t i;
+
+	for (i = 0; i < size; ++ i, ++ byte_p)
+		{
+			hash ^= *byte_p;
+			hash *= S_HASH_PRIME;
+		}
+
+	return hash;
+}
+
+
+
+/*
+ * static definitions
+ */
+
+static bool ResizeListIndex (ListIndex *index_p, const uint32 num_buckets)
+{
+	ListIndexEntry **buckets_pp = (ListIndexEntry **) AllocMemoryArray (num_buckets, sizeof (ListIndexEntry *));
+
+	if (buckets_pp)
+		{
+			if (index_p -> li_buckets_pp)
+				{
+					uint32 i;
+
+					for (i = 0; i < index_p -> li_num_buckets; ++ i)
+						{
+							ListIndexEntry *entry_p = * ((index_p -> li_buckets_pp) + i);
+
+							while (entry_p)
+								{
+									ListIndexEntry *next_p = entry_p -> lie_next_p;
+									ListIndexEntry **bucket_pp = buckets_pp + (entry_p -> lie_hash & (num_buckets - 1));
+
+									entry_p -> lie_next_p = *bucket_pp;
+									*bucket_pp = entry_p;
+
+									entry_p = next_p;
+								}
+						}
+
+					FreeMemory (index_p -> li_buckets_pp);
+				}
+
+			index_p -> li_buckets_pp = buckets_pp;
+			index_p -> li_num_buckets = num_buckets;
+
+			return true;
+		}
+
+	return false;
+}
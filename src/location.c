@@ -25,6 +25,8 @@
 #include "memory_allocations.h"
 #include "study.h"
 #include "dfw_util.h"
+#include "change_tracking.h"
+#include "reference_cache.h"
 #include "indexing.h"
 
 
@@ -318,8 +320,14 @@ OperationStatus SaveLocation (Location *location_p, ServiceJob *job_p, FieldTria
 
 			if (location_json_p)
 				{
-					if (SaveMongoData (data_p -> dftsd_mongo_p, location_json_p, data_p -> dftsd_collection_ss [DFTD_LOCATION], selector_p))
+					if (!StampModification (location_json_p, data_p))
 						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add modification marker to Location so it has not been saved");
+						}
+					else if (SaveMongoData (data_p -> dftsd_mongo_p, location_json_p, data_p -> dftsd_collection_ss [DFTD_LOCATION], selector_p))
+						{
+							InvalidateCachedReferenceById (data_p -> dftsd_reference_cache_p, DFTD_LOCATION, location_p -> lo_id_p);
+
 							status = IndexData (job_p, location_json_p);
 
 							if (status != OS_SUCCEEDED)
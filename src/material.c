@@ -20,12 +20,16 @@
  *      Author: billy
  */
 
+#include <ctype.h>
+#include <string.h>
+
 #define ALLOCATE_MATERIAL_TAGS (1)
 #include "material.h"
 #include "memory_allocations.h"
 #include "string_utils.h"
 #include "gene_bank.h"
 #include "dfw_util.h"
+#include "document_cache.h"
 
 
 static bool ReplaceMaterialField (const char *new_value_s, char **value_ss);
@@ -34,7 +38,9 @@ static Material *SearchForMaterial (bson_t *query_p, const FieldTrialServiceData
 
 static bool SetValidJSONString (json_t *material_json_p, const char *key_s, const char *value_s);
 
-static char *GetRegex (const char *accession_s);
+static bool AddNormalisedAccessionToJSON (json_t *material_json_p, const char *accession_s);
+
+static bson_t *GetAccessionsQuery (const json_t *materials_p, const GeneBank *gene_bank_p);
 
 /*
  * API FUNCTIONS
@@ -218,6 +224,11 @@ json_t *GetMaterialAsJSON (const Material *material_p, const ViewFormat format,
 											success_flag = true;
 										}
 
+									if (success_flag && (format == VF_STORAGE))
+										{
+											success_flag = AddNormalisedAccessionToJSON (material_json_p, material_p -> ma_accession_s);
+										}
+
 									if (success_flag)
 										{
 											return material_json_p;
@@ -390,6 +401,119 @@ Material *GetOrCreateMaterialByAccession (const char *accession_s, GeneBank *gen
 }
 
 
+bool GetMaterialsByAccession (json_t *materials_p, GeneBank *gene_bank_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	bson_t *query_p = GetAccessionsQuery (materials_p, gene_bank_p);
+
+	if (query_p)
+		{
+			if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_MATERIAL]))
+				{
+					json_t *results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, NULL);
+
+					success_flag = true;
+
+					if (results_p)
+						{
+							size_t i;
+							json_t *result_p;
+
+							json_array_foreach (results_p, i, result_p)
+								{
+									const char *result_accession_s = GetJSONString (result_p, MA_ACCESSION_S);
+
+									if (result_accession_s)
+										{
+											if (json_object_get (materials_p, result_accession_s))
+												{
+													if (json_object_set (materials_p, result_accession_s, result_p) != 0)
+														{
+															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, result_p, "Failed to store Material for accession \"%s\"", result_accession_s);
+															success_flag = false;
+														}
+												}
+										}
+								}
+
+							json_decref (results_p);
+						}		/* if (results_p) */
+
+				}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_MATERIAL])) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set mongo collection to \"%s\"", data_p -> dftsd_collection_ss [DFTD_MATERIAL]);
+				}
+
+			bson_destroy (query_p);
+		}		/* if (query_p) */
+
+	return success_flag;
+}
+
+
+bool GetOrCreateMaterialsByAccession (json_t *materials_p, GeneBank *gene_bank_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = GetMaterialsByAccession (materials_p, gene_bank_p, data_p);
+
+	if (success_flag)
+		{
+			const char *accession_s;
+			json_t *value_p;
+
+			/*
+			 * Create any that don't exist yet
+			 */
+			json_object_foreach (materials_p, accession_s, value_p)
+				{
+					if (json_is_null (value_p))
+						{
+							Material *material_p = AllocateMaterialByAccession (NULL, accession_s, gene_bank_p -> gb_id_p, data_p);
+
+							if (material_p)
+								{
+									if (SaveMaterial (material_p, data_p))
+										{
+											json_t *material_json_p = GetMaterialAsJSON (material_p, VF_STORAGE, data_p);
+
+											if (material_json_p)
+												{
+													if (json_object_set_new (materials_p, accession_s, material_json_p) != 0)
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to store Material for accession \"%s\"", accession_s);
+															success_flag = false;
+														}
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get Material with internal name of \"%s\" for gene bank \"%s\" as JSON", accession_s, gene_bank_p -> gb_name_s);
+													success_flag = false;
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to save Material with internal name of \"%s\" for gene bank \"%s\"", accession_s, gene_bank_p -> gb_name_s);
+											success_flag = false;
+										}
+
+									FreeMaterial (material_p);
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate Material with internal name of \"%s\" for gene bank \"%s\"", accession_s, gene_bank_p -> gb_name_s);
+									success_flag = false;
+								}
+
+						}		/* if (json_is_null (value_p)) */
+
+				}		/* json_object_foreach (materials_p, accession_s, value_p) */
+
+		}		/* if (success_flag) */
+
+	return success_flag;
+}
+
+
 
 
 Material *GetMaterialByAccession (const char *accession_s, GeneBank *gene_bank_p, const bool case_sensitive_flag, const FieldTrialServiceData *data_p)
@@ -407,13 +531,17 @@ Material *GetMaterialByAccession (const char *accession_s, GeneBank *gene_bank_p
 				}
 			else
 				{
-					char *regex_s = GetRegex (accession_s);
+					/*
+					 * Match against the indexed normalised copy rather than
+					 * using a case-insensitive regex which can't use an index.
+					 */
+					char *normalised_accession_s = GetNormalisedAccession (accession_s);
 
-					if (regex_s)
+					if (normalised_accession_s)
 						{
-							success_flag = BSON_APPEND_REGEX (query_p, MA_ACCESSION_S, regex_s, "i");
+							success_flag = BSON_APPEND_UTF8 (query_p, MA_NORMALISED_ACCESSION_S, normalised_accession_s);
 
-							FreeCopiedString (regex_s);
+							FreeCopiedString (normalised_accession_s);
 						}
 				}
 
@@ -457,9 +585,14 @@ Material *GetMaterialByAccession (const char *accession_s, GeneBank *gene_bank_p
 Material *GetMaterialById (const bson_oid_t *material_id_p, const FieldTrialServiceData *data_p)
 {
 	Material *material_p = NULL;
-	bson_t *query_p = BCON_NEW (MONGO_ID_S, BCON_OID (material_id_p));
+	const json_t *cached_doc_p = GetDocumentFromDocumentCache (data_p -> dftsd_document_cache_p, DFTD_MATERIAL, material_id_p);
+	bson_t *query_p = NULL;
 
-	if (query_p)
+	if (cached_doc_p)
+		{
+			material_p = GetMaterialFromJSON (cached_doc_p, false, data_p);
+		}
+	else if ((query_p = BCON_NEW (MONGO_ID_S, BCON_OID (material_id_p))) != NULL)
 		{
 			material_p = SearchForMaterial (query_p, data_p);
 
@@ -512,7 +645,11 @@ static Material *SearchForMaterial (bson_t *query_p, const FieldTrialServiceData
 
 									material_p = GetMaterialFromJSON (result_p, false, data_p);
 
-									if (!material_p)
+									if (material_p)
+										{
+											AddDocumentToDocumentCacheScope (data_p -> dftsd_document_cache_p, DFTD_MATERIAL, result_p);
+										}
+									else
 										{
 											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, result_p, "Failed to get Material from JSON");
 										}
@@ -551,6 +688,47 @@ bool IsMaterialComplete (const Material * const material_p)
 }
 
 
+char *GetNormalisedAccession (const char *accession_s)
+{
+	char *normalised_accession_s = NULL;
+	const char *start_p = accession_s;
+	const char *end_p = accession_s + strlen (accession_s);
+
+	while ((start_p < end_p) && (isspace ((unsigned char) *start_p)))
+		{
+			++ start_p;
+		}
+
+	while ((end_p > start_p) && (isspace ((unsigned char) * (end_p - 1))))
+		{
+			-- end_p;
+		}
+
+	normalised_accession_s = (char *) AllocMemory ((end_p - start_p) + 1);
+
+	if (normalised_accession_s)
+		{
+			char *dest_p = normalised_accession_s;
+
+			while (start_p < end_p)
+				{
+					*dest_p = (char) tolower ((unsigned char) *start_p);
+
+					++ dest_p;
+					++ start_p;
+				}
+
+			*dest_p = '\0';
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate normalised accession for \"%s\"", accession_s);
+		}
+
+	return normalised_accession_s;
+}
+
+
 bool SetMaterialAccession (Material *material_p, const char * const accession_s)
 {
 	return ReplaceMaterialField (accession_s, & (material_p -> ma_accession_s));
@@ -613,16 +791,98 @@ static bool SetValidJSONString (json_t *material_json_p, const char *key_s, cons
 }
 
 
-static char *GetRegex (const char *accession_s)
+static bool AddNormalisedAccessionToJSON (json_t *material_json_p, const char *accession_s)
 {
-	char *regex_s = NULL;
-	char *lower_case_accession_s = GetStringAsLowerCase (accession_s);
+	bool success_flag = false;
+	char *normalised_accession_s = GetNormalisedAccession (accession_s);
+
+	if (normalised_accession_s)
+		{
+			success_flag = SetJSONString (material_json_p, MA_NORMALISED_ACCESSION_S, normalised_accession_s);
+
+			FreeCopiedString (normalised_accession_s);
+		}
 
-	if (lower_case_accession_s)
+	if (!success_flag)
 		{
-			regex_s = ConcatenateVarargsStrings ("^", lower_case_accession_s, "$", NULL);
+			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, material_json_p, "Failed to add \"%s\" for \"%s\"", MA_NORMALISED_ACCESSION_S, accession_s);
 		}
 
-	return regex_s;
+	return success_flag;
 }
 
+
+
+/*
+ * Get the query for all of the accessions that are the keys of materials_p
+ * within the given GeneBank.
+ */
+static bson_t *GetAccessionsQuery (const json_t *materials_p, const GeneBank *gene_bank_p)
+{
+	bson_t *query_p = bson_new ();
+
+	if (query_p)
+		{
+			bson_t accession_doc;
+			bool success_flag = false;
+
+			if (BSON_APPEND_DOCUMENT_BEGIN (query_p, MA_ACCESSION_S, &accession_doc))
+				{
+					bson_t accessions_array;
+
+					if (BSON_APPEND_ARRAY_BEGIN (&accession_doc, "$in", &accessions_array))
+						{
+							const char *accession_s;
+							json_t *value_p;
+							uint32 i = 0;
+
+							success_flag = true;
+
+							json_object_foreach ((json_t *) materials_p, accession_s, value_p)
+								{
+									char index_buffer [16];
+									const char *index_s;
+
+									bson_uint32_to_string (i, &index_s, index_buffer, sizeof (index_buffer));
+
+									if (BSON_APPEND_UTF8 (&accessions_array, index_s, accession_s))
+										{
+											++ i;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add \"%s\" to query", accession_s);
+											success_flag = false;
+										}
+								}
+
+							if (!bson_append_array_end (&accession_doc, &accessions_array))
+								{
+									success_flag = false;
+								}
+
+						}		/* if (BSON_APPEND_ARRAY_BEGIN (&accession_doc, "$in", &accessions_array)) */
+
+					if (!bson_append_document_end (query_p, &accession_doc))
+						{
+							success_flag = false;
+						}
+
+				}		/* if (BSON_APPEND_DOCUMENT_BEGIN (query_p, MA_ACCESSION_S, &accession_doc)) */
+
+			if (success_flag)
+				{
+					success_flag = BSON_APPEND_OID (query_p, MA_GENE_BANK_ID_S, gene_bank_p -> gb_id_p);
+				}
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create accessions query for gene bank \"%s\"", gene_bank_p -> gb_name_s);
+					bson_destroy (query_p);
+					query_p = NULL;
+				}
+
+		}		/* if (query_p) */
+
+	return query_p;
+}
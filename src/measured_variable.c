@@ -26,6 +26,9 @@
 #include "memory_allocations.h"
 #include "string_utils.h"
 #include "dfw_util.h"
+#include "change_tracking.h"
+#include "document_cache.h"
+#include "reference_cache.h"
 #include "time_util.h"
 #include "indexing.h"
 
@@ -332,8 +335,14 @@ OperationStatus SaveMeasuredVariable (MeasuredVariable *treatment_p, ServiceJob
 
 			if (phenotype_json_p)
 				{
-					if (SaveMongoData (data_p -> dftsd_mongo_p, phenotype_json_p, data_p -> dftsd_collection_ss [DFTD_MEASURED_VARIABLE], selector_p))
+					if (!StampModification (phenotype_json_p, data_p))
 						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add modification marker to MeasuredVariable \"%s\" so it has not been saved", treatment_p -> mv_internal_name_s);
+						}
+					else if (SaveMongoData (data_p -> dftsd_mongo_p, phenotype_json_p, data_p -> dftsd_collection_ss [DFTD_MEASURED_VARIABLE], selector_p))
+						{
+							InvalidateCachedReferenceById (data_p -> dftsd_reference_cache_p, DFTD_MEASURED_VARIABLE, treatment_p -> mv_id_p);
+
 							status = IndexData (job_p, phenotype_json_p);
 
 							if (status != OS_SUCCEEDED)
@@ -453,8 +462,19 @@ MeasuredVariable *GetMeasuredVariableByIdString (const char *id_s, const FieldTr
 MeasuredVariable *GetMeasuredVariableById (const bson_oid_t *phenotype_id_p, const FieldTrialServiceData *data_p)
 {
 	MeasuredVariable *treatment_p = NULL;
+	const json_t *cached_doc_p = GetDocumentFromDocumentCache (data_p -> dftsd_document_cache_p, DFTD_MEASURED_VARIABLE, phenotype_id_p);
+	json_t *reference_doc_p = NULL;
 
-	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_MEASURED_VARIABLE]))
+	if (cached_doc_p)
+		{
+			treatment_p = GetMeasuredVariableFromJSON (cached_doc_p, data_p);
+		}
+	else if ((reference_doc_p = GetCachedReferenceById (data_p -> dftsd_reference_cache_p, DFTD_MEASURED_VARIABLE, phenotype_id_p)) != NULL)
+		{
+			treatment_p = GetMeasuredVariableFromJSON (reference_doc_p, data_p);
+			json_decref (reference_doc_p);
+		}
+	else if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_MEASURED_VARIABLE]))
 		{
 			bson_t *query_p = BCON_NEW (MONGO_ID_S, BCON_OID (phenotype_id_p));
 
@@ -474,10 +494,11 @@ MeasuredVariable *GetMeasuredVariableById (const bson_oid_t *phenotype_id_p, con
 
 											treatment_p = GetMeasuredVariableFromJSON (entry_p, data_p);
 
-											if (!treatment_p)
+											if (treatment_p)
 												{
-
-												}		/* if (!treatment_p) */
+													AddDocumentToDocumentCacheScope (data_p -> dftsd_document_cache_p, DFTD_MEASURED_VARIABLE, entry_p);
+													CacheReferenceById (data_p -> dftsd_reference_cache_p, DFTD_MEASURED_VARIABLE, entry_p);
+												}		/* if (treatment_p) */
 
 										}		/* if (num_results == 1) */
 
@@ -336,45 +336,55 @@ json_t *GetMeasuredVariableIndexingData (Service *service_p)
 
 	if (measured_variables_p)
 		{
-			if (json_is_array (measured_variables_p))
-				{
-					size_t i;
-					json_t *measured_variable_p;
-					size_t num_added = 0;
+			PrepareMeasuredVariablesForIndexing (measured_variables_p, data_p);
+
+			return measured_variables_p;
+		}		/* if (measured_variables_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "No measured variables for \"%s\"", GetServiceName (service_p));
+		}
+
+	return NULL;
+}
+
+
+bool PrepareMeasuredVariablesForIndexing (json_t *measured_variables_p, const FieldTrialServiceData * UNUSED_PARAM (data_p))
+{
+	bool success_flag = false;
+
+	if (json_is_array (measured_variables_p))
+		{
+			size_t i;
+			json_t *measured_variable_p;
+			size_t num_added = 0;
 
-					json_array_foreach (measured_variables_p, i, measured_variable_p)
+			json_array_foreach (measured_variables_p, i, measured_variable_p)
+				{
+					if (AddDatatype (measured_variable_p, DFTD_MEASURED_VARIABLE))
 						{
-							if (AddDatatype (measured_variable_p, DFTD_MEASURED_VARIABLE))
+							json_t *variable_p = json_object_get (measured_variable_p, MV_VARIABLE_S);
+
+							if (variable_p)
 								{
-									json_t *variable_p = json_object_get (measured_variable_p, MV_VARIABLE_S);
+									const char *name_s = GetJSONString (variable_p, SCHEMA_TERM_NAME_S);
 
-									if (variable_p)
+									if (name_s)
 										{
-											const char *name_s = GetJSONString (variable_p, SCHEMA_TERM_NAME_S);
-
-											if (name_s)
+											if (SetJSONString (measured_variable_p, MV_NAME_S, name_s))
 												{
-													if (SetJSONString (measured_variable_p, MV_NAME_S, name_s))
-														{
-															++ num_added;
-														}
+													++ num_added;
 												}
 										}
 								}
+						}
 
+				}		/* json_array_foreach (measured_variables_p, i, measured_variable_p) */
 
-						}		/* json_array_foreach (src_studies_p, i, src_study_p) */
-
-				}		/* if (json_is_array (src_studies_p)) */
-
-			return measured_variables_p;
-		}		/* if (src_studies_p) */
-	else
-		{
-			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "No measured variables for \"%s\"", GetServiceName (service_p));
-		}
+			success_flag = (num_added == json_array_size (measured_variables_p));
+		}		/* if (json_is_array (measured_variables_p)) */
 
-	return NULL;
+	return success_flag;
 }
 
 
@@ -20,6 +20,9 @@
  *      Author: billy
  */
 
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <bson.h>
@@ -41,6 +44,7 @@
 #include "memory_allocations.h"
 #include "string_utils.h"
 #include "dfw_util.h"
+#include "list_index.h"
 
 
 static const char *S_OBSERVATION_NATURES_SS [ON_NUM_PHENOTYPE_NATURES] = { "Row", "Experimental Area" };
@@ -54,6 +58,8 @@ static bool CreateInstrumentFromObservationJSON (const json_t *observation_json_
 
 static MeasuredVariable *CreateMeasuredVariableFromObservationJSON (const json_t *observation_json_p, const FieldTrialServiceData *data_p);
 
+static uint32 HashObservationDate (uint32 hash, const struct tm *date_p);
+
 
 /*
  * API definitions
@@ -579,11 +585,11 @@ bool AreObservationsMatching (const Observation *observation_0_p, const Observat
 
 	if (bson_oid_equal (observation_0_p -> ob_phenotype_p -> mv_id_p, observation_1_p -> ob_phenotype_p -> mv_id_p))
 		{
-			if ((observation_0_p -> ob_start_date_p) && (observation_0_p -> ob_start_date_p))
+			if ((observation_0_p -> ob_start_date_p) && (observation_1_p -> ob_start_date_p))
 				{
 					if (CompareDates (observation_0_p -> ob_start_date_p, observation_1_p -> ob_start_date_p, true))
 						{
-							if ((observation_0_p -> ob_end_date_p) && (observation_0_p -> ob_end_date_p))
+							if ((observation_0_p -> ob_end_date_p) && (observation_1_p -> ob_end_date_p))
 								{
 									if (CompareDates (observation_0_p -> ob_end_date_p, observation_1_p -> ob_end_date_p, true))
 										{
@@ -598,11 +604,92 @@ bool AreObservationsMatching (const Observation *observation_0_p, const Observat
 }
 
 
+bool GetObservationMatchHash (const Observation *observation_p, uint32 *hash_p)
+{
+	bool success_flag = false;
+
+	/*
+	 * Observations without both dates never match any others so they are not hashed
+	 */
+	if ((observation_p -> ob_phenotype_p) && (observation_p -> ob_phenotype_p -> mv_id_p) && (observation_p -> ob_start_date_p) && (observation_p -> ob_end_date_p))
+		{
+			uint32 hash = LI_HASH_SEED;
+
+			hash = HashListIndexBytes (hash, observation_p -> ob_phenotype_p -> mv_id_p -> bytes, sizeof (observation_p -> ob_phenotype_p -> mv_id_p -> bytes));
+			hash = HashObservationDate (hash, observation_p -> ob_start_date_p);
+			hash = HashObservationDate (hash, observation_p -> ob_end_date_p);
+
+			*hash_p = hash;
+			success_flag = true;
+		}
+
+	return success_flag;
+}
+
+
+void MergeObservationValues (Observation *observation_p, Observation *existing_observation_p)
+{
+	if (! (observation_p -> ob_raw_value_s))
+		{
+			observation_p -> ob_raw_value_s = existing_observation_p -> ob_raw_value_s;
+			existing_observation_p -> ob_raw_value_s = NULL;
+		}
+
+	if (! (observation_p -> ob_corrected_value_s))
+		{
+			observation_p -> ob_corrected_value_s = existing_observation_p -> ob_corrected_value_s;
+			existing_observation_p -> ob_corrected_value_s = NULL;
+		}
+}
+
+
+bool GetObservationValueAsReal (const Observation *observation_p, double64 *value_p)
+{
+	const char *value_s = IsStringEmpty (observation_p -> ob_corrected_value_s) ? observation_p -> ob_raw_value_s : observation_p -> ob_corrected_value_s;
+
+	if (!IsStringEmpty (value_s))
+		{
+			char *end_s = NULL;
+			const double64 d = strtod (value_s, &end_s);
+
+			if (end_s != value_s)
+				{
+					while (isspace ((unsigned char) *end_s))
+						{
+							++ end_s;
+						}
+
+					if ((*end_s == '\0') && (isfinite (d)))
+						{
+							*value_p = d;
+							return true;
+						}
+				}
+		}
+
+	return false;
+}
+
+
 
 /*
  * static definitions
  */
 
+/*
+ * AreObservationsMatching () calls CompareDates () without the times,
+ * so only the day goes into the hash
+ */
+static uint32 HashObservationDate (uint32 hash, const struct tm *date_p)
+{
+	hash = HashListIndexBytes (hash, & (date_p -> tm_year), sizeof (date_p -> tm_year));
+	hash = HashListIndexBytes (hash, & (date_p -> tm_mon), sizeof (date_p -> tm_mon));
+	hash = HashListIndexBytes (hash, & (date_p -> tm_mday), sizeof (date_p -> tm_mday));
+
+	return hash;
+}
+
+
 static bool CreateInstrumentFromObservationJSON (const json_t *observation_json_p, Instrument **instrument_pp, const FieldTrialServiceData *data_p)
 {
 	bool success_flag = false;
@@ -0,0 +1,898 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * observation_jobs.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#define ALLOCATE_OBSERVATION_JOBS_TAGS (1)
+#include "observation_jobs.h"
+
+#include "dfw_util.h"
+#include "json_util.h"
+#include "memory_allocations.h"
+#include "mongodb_tool.h"
+#include "mongodb_util.h"
+#include "observation.h"
+#include "streams.h"
+#include "string_utils.h"
+#include "time_util.h"
+
+
+static const int S_DEFAULT_OBSERVATIONS_BATCH_SIZE = 1000;
+
+
+/*
+ * The upserts of the documents for a single unordered update command.
+ * Once it holds odb_max_num_docs documents, it is sent and a new one
+ * started. The ids of every document that has been added are kept
+ * in odb_written_ids_p so that anything else can be removed afterwards.
+ */
+typedef struct ObservationDocumentsBatch
+{
+	bson_t *odb_command_p;
+
+	bson_t odb_updates;
+
+	uint32 odb_num_docs;
+
+	uint32 odb_max_num_docs;
+
+	bson_t *odb_written_ids_p;
+
+	uint32 odb_num_written_ids;
+} ObservationDocumentsBatch;
+
+
+static bool WriteObservationDocuments (const char *key_s, const bson_oid_t **ids_pp, const size_t num_ids, Row **rows_pp, const bool *saved_flags_p, const size_t num_rows, Plot **plots_pp, const size_t num_plots, const FieldTrialServiceData *data_p);
+
+static bool RemoveObservationDocuments (const char *key_s, const bson_oid_t **ids_pp, const size_t num_ids, const bson_t *written_ids_p, const FieldTrialServiceData *data_p);
+
+static bool InitObservationDocumentsBatch (ObservationDocumentsBatch *batch_p, const FieldTrialServiceData *data_p);
+
+static void ClearObservationDocumentsBatch (ObservationDocumentsBatch *batch_p);
+
+static bool AddRowToObservationDocumentsBatch (ObservationDocumentsBatch *batch_p, const Row *row_p, const FieldTrialServiceData *data_p);
+
+static bool SendObservationDocumentsBatch (ObservationDocumentsBatch *batch_p, const FieldTrialServiceData *data_p);
+
+static json_t *GetObservationDocument (const Observation *observation_p, const Row *row_p);
+
+static json_t *GetObservationsCollectionResults (bson_t *query_p, const FieldTrialServiceData *data_p);
+
+
+
+bool AddObservationsCollectionIndexes (const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+
+	if (data_p -> dftsd_observations_collection_flag)
+		{
+			bson_t *command_p = BCON_NEW ("createIndexes", BCON_UTF8 (data_p -> dftsd_collection_ss [DFTD_OBSERVATION]),
+																		"indexes", "[",
+																			"{",
+																				"key", "{", RO_STUDY_ID_S, BCON_INT32 (1), OB_PHENOTYPE_ID_S, BCON_INT32 (1), OB_START_DATE_S, BCON_INT32 (1), "}",
+																				"name", BCON_UTF8 ("study_id_phenotype_id_date"),
+																			"}",
+																			"{",
+																				"key", "{", RO_MATERIAL_ID_S, BCON_INT32 (1), OB_PHENOTYPE_ID_S, BCON_INT32 (1), "}",
+																				"name", BCON_UTF8 ("material_id_phenotype_id"),
+																			"}",
+																			"{",
+																				"key", "{", RO_PLOT_ID_S, BCON_INT32 (1), "}",
+																				"name", BCON_UTF8 ("plot_id"),
+																			"}",
+																			"{",
+																				"key", "{", OJ_ROW_ID_S, BCON_INT32 (1), "}",
+																				"name", BCON_UTF8 ("row_id"),
+																			"}",
+																		"]");
+
+			success_flag = false;
+
+			if (command_p)
+				{
+					bson_t *reply_p = NULL;
+
+					if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p))
+						{
+							success_flag = true;
+
+							if (reply_p)
+								{
+									bson_destroy (reply_p);
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add indexes to \"%s\"", data_p -> dftsd_collection_ss [DFTD_OBSERVATION]);
+						}
+
+					bson_destroy (command_p);
+				}		/* if (command_p) */
+
+		}		/* if (data_p -> dftsd_observations_collection_flag) */
+
+	return success_flag;
+}
+
+
+bool SavePlotsToObservationsCollection (Plot **plots_pp, const bool *saved_flags_p, const size_t num_plots, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+
+	if (data_p -> dftsd_observations_collection_flag)
+		{
+			const bson_oid_t **ids_pp = (const bson_oid_t **) AllocMemoryArray (num_plots, sizeof (const bson_oid_t *));
+
+			success_flag = false;
+
+			if (ids_pp)
+				{
+					size_t num_ids = 0;
+					size_t i;
+
+					for (i = 0; i < num_plots; ++ i)
+						{
+							if (* (saved_flags_p + i))
+								{
+									* (ids_pp + num_ids) = (* (plots_pp + i)) -> pl_id_p;
+									++ num_ids;
+								}
+						}
+
+					success_flag = WriteObservationDocuments (RO_PLOT_ID_S, ids_pp, num_ids, NULL, saved_flags_p, 0, plots_pp, num_plots, data_p);
+
+					FreeMemory (ids_pp);
+				}		/* if (ids_pp) */
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to update \"%s\" for " SIZET_FMT " plots", data_p -> dftsd_collection_ss [DFTD_OBSERVATION], num_plots);
+				}
+
+		}		/* if (data_p -> dftsd_observations_collection_flag) */
+
+	return success_flag;
+}
+
+
+bool SaveRowsToObservationsCollection (Row **rows_pp, const bool *saved_flags_p, const size_t num_rows, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+
+	if (data_p -> dftsd_observations_collection_flag)
+		{
+			const bson_oid_t **ids_pp = (const bson_oid_t **) AllocMemoryArray (num_rows, sizeof (const bson_oid_t *));
+
+			success_flag = false;
+
+			if (ids_pp)
+				{
+					size_t num_ids = 0;
+					size_t i;
+
+					for (i = 0; i < num_rows; ++ i)
+						{
+							if (* (saved_flags_p + i))
+								{
+									* (ids_pp + num_ids) = (* (rows_pp + i)) -> ro_id_p;
+									++ num_ids;
+								}
+						}
+
+					success_flag = WriteObservationDocuments (OJ_ROW_ID_S, ids_pp, num_ids, rows_pp, saved_flags_p, num_rows, NULL, 0, data_p);
+
+					FreeMemory (ids_pp);
+				}		/* if (ids_pp) */
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to update \"%s\" for " SIZET_FMT " rows", data_p -> dftsd_collection_ss [DFTD_OBSERVATION], num_rows);
+				}
+
+		}		/* if (data_p -> dftsd_observations_collection_flag) */
+
+	return success_flag;
+}
+
+
+bool RemoveStudyFromObservationsCollection (const bson_oid_t *study_id_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+
+	if (data_p -> dftsd_observations_collection_flag)
+		{
+			success_flag = false;
+
+			if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_OBSERVATION]))
+				{
+					bson_t *query_p = BCON_NEW (RO_STUDY_ID_S, BCON_OID (study_id_p));
+
+					if (query_p)
+						{
+							success_flag = RemoveMongoDocumentsByBSON (data_p -> dftsd_mongo_p, query_p, false);
+
+							bson_destroy (query_p);
+						}		/* if (query_p) */
+				}
+
+			if (!success_flag)
+				{
+					char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+					bson_oid_to_string (study_id_p, id_s);
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to remove study \"%s\" from \"%s\"", id_s, data_p -> dftsd_collection_ss [DFTD_OBSERVATION]);
+				}
+
+		}		/* if (data_p -> dftsd_observations_collection_flag) */
+
+	return success_flag;
+}
+
+
+json_t *GetStudyVariableObservations (const bson_oid_t *study_id_p, const bson_oid_t *variable_id_p, struct tm *from_p, struct tm *to_p, const FieldTrialServiceData *data_p)
+{
+	json_t *results_p = NULL;
+
+	if (data_p -> dftsd_observations_collection_flag)
+		{
+			bson_t *query_p = BCON_NEW (RO_STUDY_ID_S, BCON_OID (study_id_p), OB_PHENOTYPE_ID_S, BCON_OID (variable_id_p));
+
+			if (query_p)
+				{
+					bool success_flag = true;
+
+					/*
+					 * The dates are stored as YYYY-MM-DD strings so they sort in date order
+					 */
+					if (from_p || to_p)
+						{
+							bson_t dates;
+
+							success_flag = false;
+
+							if (BSON_APPEND_DOCUMENT_BEGIN (query_p, OB_START_DATE_S, &dates))
+								{
+									char *from_s = NULL;
+									char *to_s = NULL;
+
+									if (from_p)
+										{
+											from_s = GetTimeAsString (from_p, false);
+										}
+
+									if (to_p)
+										{
+											to_s = GetTimeAsString (to_p, false);
+										}
+
+									if (((!from_p) || (from_s && BSON_APPEND_UTF8 (&dates, "$gte", from_s))) && ((!to_p) || (to_s && BSON_APPEND_UTF8 (&dates, "$lte", to_s))))
+										{
+											success_flag = true;
+										}
+
+									if (!bson_append_document_end (query_p, &dates))
+										{
+											success_flag = false;
+										}
+
+									if (from_s)
+										{
+											FreeCopiedString (from_s);
+										}
+
+									if (to_s)
+										{
+											FreeCopiedString (to_s);
+										}
+								}
+
+						}		/* if (from_p || to_p) */
+
+					if (success_flag)
+						{
+							results_p = GetObservationsCollectionResults (query_p, data_p);
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add the date range to the observations query");
+						}
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (data_p -> dftsd_observations_collection_flag) */
+
+	return results_p;
+}
+
+
+json_t *GetMaterialVariableObservations (const bson_oid_t *material_id_p, const bson_oid_t *variable_id_p, const FieldTrialServiceData *data_p)
+{
+	json_t *results_p = NULL;
+
+	if (data_p -> dftsd_observations_collection_flag)
+		{
+			bson_t *query_p = BCON_NEW (RO_MATERIAL_ID_S, BCON_OID (material_id_p), OB_PHENOTYPE_ID_S, BCON_OID (variable_id_p));
+
+			if (query_p)
+				{
+					results_p = GetObservationsCollectionResults (query_p, data_p);
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (data_p -> dftsd_observations_collection_flag) */
+
+	return results_p;
+}
+
+
+bool AddVariableObservationsToServiceJob (const char *study_id_s, const char *material_id_s, const char *variable_id_s, const char *from_s, const char *to_s, ServiceJob *job_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	const char *error_s = "Failed to get the observations of the Measured Variable";
+
+	if (data_p -> dftsd_observations_collection_flag)
+		{
+			bson_oid_t *variable_id_p = GetBSONOidFromString (variable_id_s);
+
+			if (variable_id_p)
+				{
+					json_t *results_p = NULL;
+
+					if (!IsStringEmpty (material_id_s))
+						{
+							bson_oid_t *material_id_p = GetBSONOidFromString (material_id_s);
+
+							if (material_id_p)
+								{
+									results_p = GetMaterialVariableObservations (material_id_p, variable_id_p, data_p);
+									FreeBSONOid (material_id_p);
+								}
+							else
+								{
+									error_s = "Invalid Material id";
+								}
+						}
+					else if (!IsStringEmpty (study_id_s))
+						{
+							bson_oid_t *study_id_p = GetBSONOidFromString (study_id_s);
+
+							if (study_id_p)
+								{
+									struct tm *from_p = NULL;
+									struct tm *to_p = NULL;
+
+									if ((IsStringEmpty (from_s) || ((from_p = GetTimeFromString (from_s)) != NULL)) && (IsStringEmpty (to_s) || ((to_p = GetTimeFromString (to_s)) != NULL)))
+										{
+											results_p = GetStudyVariableObservations (study_id_p, variable_id_p, from_p, to_p, data_p);
+										}
+									else
+										{
+											error_s = "Invalid date range";
+										}
+
+									if (from_p)
+										{
+											FreeTime (from_p);
+										}
+
+									if (to_p)
+										{
+											FreeTime (to_p);
+										}
+
+									FreeBSONOid (study_id_p);
+								}
+							else
+								{
+									error_s = "Invalid Study id";
+								}
+						}
+					else
+						{
+							error_s = "Either a Study or a Material is needed";
+						}
+
+					if (results_p)
+						{
+							json_t *dest_record_p = GetResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, variable_id_s, results_p);
+
+							if (dest_record_p)
+								{
+									if (AddResultToServiceJob (job_p, dest_record_p))
+										{
+											success_flag = true;
+										}
+									else
+										{
+											json_decref (dest_record_p);
+										}
+								}
+
+							json_decref (results_p);
+						}		/* if (results_p) */
+
+					FreeBSONOid (variable_id_p);
+				}		/* if (variable_id_p) */
+			else
+				{
+					error_s = "Invalid Measured Variable id";
+				}
+
+		}		/* if (data_p -> dftsd_observations_collection_flag) */
+	else
+		{
+			error_s = "The Observations collection is not enabled";
+		}
+
+	if (!success_flag)
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, error_s);
+		}
+
+	SetServiceJobStatus (job_p, success_flag ? OS_SUCCEEDED : OS_FAILED);
+
+	return success_flag;
+}
+
+
+
+/*
+ * static definitions
+ */
+
+/*
+ * Upsert the documents for the saved Rows, or for all of the Rows of the
+ * saved Plots, and only once all of them have been written, remove any
+ * other documents for the same Rows or Plots.
+ *
+ * The Rows and Plots themselves have already been saved, so if a write
+ * fails, all of their documents are removed rather than leaving ones
+ * that no longer match them. The backfill tool can then rewrite them.
+ */
+static bool WriteObservationDocuments (const char *key_s, const bson_oid_t **ids_pp, const size_t num_ids, Row **rows_pp, const bool *saved_flags_p, const size_t num_rows, Plot **plots_pp, const size_t num_plots, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+
+	if (num_ids > 0)
+		{
+			ObservationDocumentsBatch batch;
+
+			success_flag = false;
+
+			if (InitObservationDocumentsBatch (&batch, data_p))
+				{
+					size_t i;
+
+					success_flag = true;
+
+					for (i = 0; i < num_rows; ++ i)
+						{
+							if (* (saved_flags_p + i))
+								{
+									if (!AddRowToObservationDocumentsBatch (&batch, * (rows_pp + i), data_p))
+										{
+											success_flag = false;
+										}
+								}
+						}
+
+					for (i = 0; i < num_plots; ++ i)
+						{
+							if (* (saved_flags_p + i))
+								{
+									const RowNode *node_p = (const RowNode *) ((* (plots_pp + i)) -> pl_rows_p -> ll_head_p);
+
+									while (node_p)
+										{
+											if (!AddRowToObservationDocumentsBatch (&batch, node_p -> rn_row_p, data_p))
+												{
+													success_flag = false;
+												}
+
+											node_p = (const RowNode *) (node_p -> rn_node.ln_next_p);
+										}
+								}
+						}
+
+					if (!SendObservationDocumentsBatch (&batch, data_p))
+						{
+							success_flag = false;
+						}
+
+					/*
+					 * Rows and Observations may have been dropped since they were
+					 * last saved so take out any documents that weren't just written.
+					 */
+					if (success_flag)
+						{
+							success_flag = RemoveObservationDocuments (key_s, ids_pp, num_ids, batch.odb_written_ids_p, data_p);
+						}
+					else
+						{
+							if (!RemoveObservationDocuments (key_s, ids_pp, num_ids, NULL, data_p))
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to remove the out of date \"%s\" documents, run the observations backfiller to rewrite them", data_p -> dftsd_collection_ss [DFTD_OBSERVATION]);
+								}
+						}
+
+					ClearObservationDocumentsBatch (&batch);
+				}		/* if (InitObservationDocumentsBatch (&batch, data_p)) */
+
+		}		/* if (num_ids > 0) */
+
+	return success_flag;
+}
+
+
+static bool RemoveObservationDocuments (const char *key_s, const bson_oid_t **ids_pp, const size_t num_ids, const bson_t *written_ids_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (num_ids == 0)
+		{
+			success_flag = true;
+		}
+	else if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_OBSERVATION]))
+		{
+			bson_t *query_p = bson_new ();
+
+			if (query_p)
+				{
+					bson_t key;
+
+					if (BSON_APPEND_DOCUMENT_BEGIN (query_p, key_s, &key))
+						{
+							bson_t ids;
+
+							if (BSON_APPEND_ARRAY_BEGIN (&key, "$in", &ids))
+								{
+									size_t i;
+
+									success_flag = true;
+
+									for (i = 0; i < num_ids; ++ i)
+										{
+											char index_buffer [16];
+											const char *index_s;
+
+											bson_uint32_to_string ((uint32) i, &index_s, index_buffer, sizeof (index_buffer));
+
+											if (!BSON_APPEND_OID (&ids, index_s, * (ids_pp + i)))
+												{
+													success_flag = false;
+												}
+										}
+
+									if (!bson_append_array_end (&key, &ids))
+										{
+											success_flag = false;
+										}
+								}
+
+							if (!bson_append_document_end (query_p, &key))
+								{
+									success_flag = false;
+								}
+						}
+
+					/*
+					 * Without any written ids, all of the documents are removed
+					 */
+					if (success_flag && written_ids_p)
+						{
+							bson_t written;
+
+							success_flag = false;
+
+							if (BSON_APPEND_DOCUMENT_BEGIN (query_p, MONGO_ID_S, &written))
+								{
+									if (BSON_APPEND_ARRAY (&written, "$nin", written_ids_p))
+										{
+											success_flag = true;
+										}
+
+									if (!bson_append_document_end (query_p, &written))
+										{
+											success_flag = false;
+										}
+								}
+						}
+
+					if (success_flag)
+						{
+							success_flag = RemoveMongoDocumentsByBSON (data_p -> dftsd_mongo_p, query_p, false);
+						}
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* else if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_OBSERVATION])) */
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to remove the \"%s\" documents for " SIZET_FMT " \"%s\" values", data_p -> dftsd_collection_ss [DFTD_OBSERVATION], num_ids, key_s);
+		}
+
+	return success_flag;
+}
+
+
+static bool InitObservationDocumentsBatch (ObservationDocumentsBatch *batch_p, const FieldTrialServiceData *data_p)
+{
+	int batch_size = S_DEFAULT_OBSERVATIONS_BATCH_SIZE;
+
+	if ((!GetJSONInteger (data_p -> dftsd_base_data.sd_config_p, "observations_collection_batch_size", &batch_size)) || (batch_size < 1))
+		{
+			batch_size = S_DEFAULT_OBSERVATIONS_BATCH_SIZE;
+		}
+
+	batch_p -> odb_command_p = NULL;
+	batch_p -> odb_num_docs = 0;
+	batch_p -> odb_max_num_docs = (uint32) batch_size;
+	batch_p -> odb_num_written_ids = 0;
+	batch_p -> odb_written_ids_p = bson_new ();
+
+	if (batch_p -> odb_written_ids_p)
+		{
+			return true;
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate the list of written observation ids");
+
+	return false;
+}
+
+
+static void ClearObservationDocumentsBatch (ObservationDocumentsBatch *batch_p)
+{
+	if (batch_p -> odb_command_p)
+		{
+			bson_destroy (batch_p -> odb_command_p);
+			batch_p -> odb_command_p = NULL;
+		}
+
+	if (batch_p -> odb_written_ids_p)
+		{
+			bson_destroy (batch_p -> odb_written_ids_p);
+			batch_p -> odb_written_ids_p = NULL;
+		}
+}
+
+
+static bool AddRowToObservationDocumentsBatch (ObservationDocumentsBatch *batch_p, const Row *row_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+	const ObservationNode *node_p = (const ObservationNode *) (row_p -> ro_observations_p -> ll_head_p);
+
+	while (node_p && success_flag)
+		{
+			json_t *doc_json_p = GetObservationDocument (node_p -> on_observation_p, row_p);
+
+			success_flag = false;
+
+			if (doc_json_p)
+				{
+					bson_t *doc_p = ConvertJSONToBSON (doc_json_p);
+
+					if (doc_p)
+						{
+							if (! (batch_p -> odb_command_p))
+								{
+									batch_p -> odb_command_p = bson_new ();
+
+									if (batch_p -> odb_command_p)
+										{
+											if (! ((BSON_APPEND_UTF8 (batch_p -> odb_command_p, "update", data_p -> dftsd_collection_ss [DFTD_OBSERVATION])) && (BSON_APPEND_ARRAY_BEGIN (batch_p -> odb_command_p, "updates", & (batch_p -> odb_updates)))))
+												{
+													bson_destroy (batch_p -> odb_command_p);
+													batch_p -> odb_command_p = NULL;
+												}
+										}
+								}
+
+							if (batch_p -> odb_command_p)
+								{
+									const bson_oid_t *id_p = node_p -> on_observation_p -> ob_id_p;
+									char index_buffer [16];
+									const char *index_s;
+									char written_buffer [16];
+									const char *written_s;
+									bson_t update;
+
+									bson_uint32_to_string (batch_p -> odb_num_docs, &index_s, index_buffer, sizeof (index_buffer));
+									bson_uint32_to_string (batch_p -> odb_num_written_ids, &written_s, written_buffer, sizeof (written_buffer));
+
+									if (BSON_APPEND_DOCUMENT_BEGIN (& (batch_p -> odb_updates), index_s, &update))
+										{
+											bson_t q;
+
+											if (BSON_APPEND_DOCUMENT_BEGIN (&update, "q", &q))
+												{
+													if (BSON_APPEND_OID (&q, MONGO_ID_S, id_p))
+														{
+															success_flag = true;
+														}
+
+													if (!bson_append_document_end (&update, &q))
+														{
+															success_flag = false;
+														}
+												}
+
+											if (success_flag)
+												{
+													success_flag = (BSON_APPEND_DOCUMENT (&update, "u", doc_p)) && (BSON_APPEND_BOOL (&update, "upsert", true));
+												}
+
+											if (!bson_append_document_end (& (batch_p -> odb_updates), &update))
+												{
+													success_flag = false;
+												}
+										}
+
+									if (success_flag)
+										{
+											success_flag = BSON_APPEND_OID (batch_p -> odb_written_ids_p, written_s, id_p);
+										}
+
+									if (success_flag)
+										{
+											++ (batch_p -> odb_num_docs);
+											++ (batch_p -> odb_num_written_ids);
+
+											if (batch_p -> odb_num_docs >= batch_p -> odb_max_num_docs)
+												{
+													success_flag = SendObservationDocumentsBatch (batch_p, data_p);
+												}
+										}
+								}
+
+							bson_destroy (doc_p);
+						}		/* if (doc_p) */
+					else
+						{
+							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_json_p, "Failed to convert observation to BSON");
+						}
+
+					json_decref (doc_json_p);
+				}		/* if (doc_json_p) */
+
+			node_p = (const ObservationNode *) (node_p -> on_node.ln_next_p);
+		}		/* while (node_p && success_flag) */
+
+	return success_flag;
+}
+
+
+static bool SendObservationDocumentsBatch (ObservationDocumentsBatch *batch_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+
+	if (batch_p -> odb_command_p)
+		{
+			success_flag = false;
+
+			if ((bson_append_array_end (batch_p -> odb_command_p, & (batch_p -> odb_updates))) && (BSON_APPEND_BOOL (batch_p -> odb_command_p, "ordered", false)))
+				{
+					bson_t *reply_p = NULL;
+
+					if (RunMongoCommand (data_p -> dftsd_mongo_p, batch_p -> odb_command_p, &reply_p))
+						{
+							success_flag = true;
+
+							if (reply_p)
+								{
+									json_t *reply_json_p = ConvertBSONToJSON (reply_p);
+
+									if (reply_json_p)
+										{
+											const json_t *write_errors_p = json_object_get (reply_json_p, "writeErrors");
+
+											if (json_array_size (write_errors_p) > 0)
+												{
+													PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, write_errors_p, "Failed to write " SIZET_FMT " observations", json_array_size (write_errors_p));
+													success_flag = false;
+												}
+
+											json_decref (reply_json_p);
+										}		/* if (reply_json_p) */
+
+									bson_destroy (reply_p);
+								}		/* if (reply_p) */
+
+						}		/* if (RunMongoCommand (data_p -> dftsd_mongo_p, batch_p -> odb_command_p, &reply_p)) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write " UINT32_FMT " observations", batch_p -> odb_num_docs);
+						}
+				}
+
+			bson_destroy (batch_p -> odb_command_p);
+			batch_p -> odb_command_p = NULL;
+			batch_p -> odb_num_docs = 0;
+		}		/* if (batch_p -> odb_command_p) */
+
+	return success_flag;
+}
+
+
+/*
+ * The stored Observation along with the ids needed to query it
+ * without going through its Plot.
+ */
+static json_t *GetObservationDocument (const Observation *observation_p, const Row *row_p)
+{
+	json_t *doc_p = GetObservationAsJSON (observation_p, VF_STORAGE);
+
+	if (doc_p)
+		{
+			if (AddNamedCompoundIdToJSON (doc_p, row_p -> ro_id_p, OJ_ROW_ID_S))
+				{
+					if (AddNamedCompoundIdToJSON (doc_p, row_p -> ro_plot_p -> pl_id_p, RO_PLOT_ID_S))
+						{
+							if (AddNamedCompoundIdToJSON (doc_p, row_p -> ro_study_p -> st_id_p, RO_STUDY_ID_S))
+								{
+									if (AddNamedCompoundIdToJSON (doc_p, row_p -> ro_material_p -> ma_id_p, RO_MATERIAL_ID_S))
+										{
+											return doc_p;
+										}
+								}
+						}
+				}
+
+			json_decref (doc_p);
+		}		/* if (doc_p) */
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get document for observation in row " UINT32_FMT " of study \"%s\"", row_p -> ro_by_study_index, row_p -> ro_study_p -> st_name_s);
+
+	return NULL;
+}
+
+
+static json_t *GetObservationsCollectionResults (bson_t *query_p, const FieldTrialServiceData *data_p)
+{
+	json_t *results_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_OBSERVATION]))
+		{
+			bson_t *opts_p = BCON_NEW ("sort", "{", OB_START_DATE_S, BCON_INT32 (1), "}");
+
+			if (opts_p)
+				{
+					results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, opts_p);
+
+					if (!results_p)
+						{
+							PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, query_p, "Failed to get results from \"%s\"", data_p -> dftsd_collection_ss [DFTD_OBSERVATION]);
+						}
+
+					bson_destroy (opts_p);
+				}		/* if (opts_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_OBSERVATION])) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set collection to \"%s\"", data_p -> dftsd_collection_ss [DFTD_OBSERVATION]);
+		}
+
+	return results_p;
+}
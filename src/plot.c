@@ -30,6 +30,7 @@
 #include "time_util.h"
 #include "study.h"
 #include "int_linked_list.h"
+#include "observation_jobs.h"
 
 
 static bool AddRowsToJSON (const Plot *plot_p, json_t *plot_json_p, const ViewFormat format, JSONProcessor *processor_p, const FieldTrialServiceData *data_p);
@@ -326,6 +327,18 @@ bool SavePlot (Plot *plot_p, const FieldTrialServiceData *data_p)
 					json_decref (plot_json_p);
 				}		/* if (plot_json_p) */
 
+			/*
+			 * The Plot has been saved even if its Observations can't be
+			 * written through, in which case their old documents are removed.
+			 */
+			if (success_flag)
+				{
+					if (!SavePlotsToObservationsCollection (&plot_p, &success_flag, 1, data_p))
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write the observations for plot at [" UINT32_FMT ", " UINT32_FMT "] through to \"%s\"", plot_p -> pl_row_index, plot_p -> pl_column_index, data_p -> dftsd_collection_ss [DFTD_OBSERVATION]);
+						}
+				}
+
 
 			if (selector_p)
 				{
@@ -338,6 +351,35 @@ bool SavePlot (Plot *plot_p, const FieldTrialServiceData *data_p)
 }
 
 
+bool AddPlotToCachedStudyPatch (json_t *plots_p, Plot *plot_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	json_t *plot_json_p = GetPlotAsJSON (plot_p, VF_CLIENT_FULL, NULL, data_p);
+
+	if (plot_json_p)
+		{
+			char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+			bson_oid_to_string (plot_p -> pl_id_p, id_s);
+
+			if (json_object_set_new (plots_p, id_s, plot_json_p) == 0)
+				{
+					success_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add plot \"%s\" to cached study patch", id_s);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get plot json for cached study patch");
+		}
+
+	return success_flag;
+}
+
+
 json_t *GetPlotAsJSON (Plot *plot_p, const ViewFormat format, JSONProcessor *processor_p, const FieldTrialServiceData *data_p)
 {
 	json_t *plot_json_p = json_object ();
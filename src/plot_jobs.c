@@ -20,6 +20,10 @@
  *      Author: billy
  */
 
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
 #define ALLOCATE_PLOT_JOB_CONSTANTS (1)
 #include "plot_jobs.h"
 
@@ -32,7 +36,15 @@
 #include "material.h"
 #include "row.h"
 #include "gene_bank.h"
+#include "delimited_table.h"
+#include "background_jobs.h"
 #include "dfw_util.h"
+#include "document_cache.h"
+#include "grassroots_server.h"
+#include "mongodb_tool.h"
+#include "observation_jobs.h"
+#include "trait_statistics.h"
+#include "upload_session.h"
 
 #include "boolean_parameter.h"
 #include "char_parameter.h"
@@ -121,14 +133,256 @@ static const char * const S_WALKING_ORDER_DESCRIPTION_S = "The order that the pl
 
 static NamedParameterType S_PLOT_TABLE_COLUMN_DELIMITER = { "PL Data delimiter", PT_CHAR };
 static NamedParameterType S_PLOT_TABLE = { "PL Upload", PT_JSON_TABLE};
+static NamedParameterType S_PLOT_DELIMITED_TABLE = { "PL Delimited upload", PT_LARGE_STRING };
 
 static NamedParameterType S_AMEND = { "PL Amend", PT_BOOLEAN};
 
+static NamedParameterType S_DRY_RUN = { "PL Dry run", PT_BOOLEAN};
+
 static NamedParameterType S_STUDIES_LIST = { "PL Study", PT_STRING };
 
+static NamedParameterType S_PLOT_UPLOAD_SESSION = { "PL upload session", PT_STRING };
+
+static NamedParameterType S_PLOT_UPLOAD_CHUNK_START = { "PL upload chunk start", PT_UNSIGNED_INT };
+
 
 static const char S_DEFAULT_COLUMN_DELIMITER =  '|';
 
+static const char * const S_DEFAULT_GENE_BANK_S = "Germplasm Resources Unit";
+
+
+/*
+ * The keys for the values copied out of the ParameterSet for a plot import
+ * as the import may run after the ParameterSet has been freed.
+ */
+static const char * const S_IMPORT_STUDY_ID_S = "study_id";
+static const char * const S_IMPORT_TABLE_S = "table";
+static const char * const S_IMPORT_DELIMITED_TABLE_S = "delimited_table";
+static const char * const S_IMPORT_DELIMITER_S = "delimiter";
+static const char * const S_IMPORT_APPEND_S = "append";
+static const char * const S_IMPORT_DRY_RUN_S = "dry_run";
+static const char * const S_IMPORT_UPLOAD_SESSION_S = "upload_session";
+static const char * const S_IMPORT_CHUNK_START_S = "chunk_start";
+
+
+/*
+ * The default number of plots that are written with each bulk
+ * upsert when importing a plot table. This can be changed with
+ * the "plot_import_batch_size" config key.
+ */
+#define S_DEFAULT_PLOT_IMPORT_BATCH_SIZE (100)
+
+
+/*
+ * The largest size, in bytes, that an update command can grow to
+ * before it is sent. This is MongoDB's maximum BSON document size.
+ */
+#define S_MAX_UPSERT_COMMAND_SIZE (16 * 1024 * 1024)
+
+
+/*
+ * The number of bytes allowed for the query and options that
+ * wrap each Plot in an update command.
+ */
+#define S_UPSERT_ENTRY_OVERHEAD (256)
+
+
+/*
+ * The default number of rows of uploaded delimited text whose
+ * materials are resolved together. This can be changed with
+ * the "plot_import_window_size" config key.
+ */
+#define S_DEFAULT_PLOT_IMPORT_WINDOW_SIZE (1000)
+
+
+/*
+ * Big enough for "<row>,<column>"
+ */
+#define S_PLOT_POSITION_KEY_SIZE (32)
+
+
+/*
+ * The default number of threads used to check a plot table
+ * in a dry run. This can be changed with the
+ * "plot_validation_threads" config key.
+ */
+#define S_DEFAULT_NUM_VALIDATION_THREADS (4)
+
+
+/*
+ * The number of table rows that each validation task checks.
+ */
+#define S_NUM_ROWS_PER_VALIDATION_TASK (256)
+
+
+static const char * const S_VALIDATION_ROW_S = "row";
+
+static const char * const S_VALIDATION_COLUMN_S = "column";
+
+static const char * const S_VALIDATION_ERROR_S = "error";
+
+
+/*
+ * A Plot that rows from an uploaded table are being added to.
+ */
+typedef struct ImportedPlot
+{
+	Plot *ip_plot_p;
+
+	/* The indexes of the table rows that have been added to the Plot */
+	json_t *ip_table_rows_p;
+
+	bool ip_saved_flag;
+} ImportedPlot;
+
+
+/*
+ * The in-memory state used whilst importing a plot table.
+ */
+typedef struct PlotImport
+{
+	ImportedPlot *pi_plots_p;
+
+	size_t pi_num_plots;
+
+	size_t pi_max_num_plots;
+
+	/* The indexes into pi_plots_p keyed by "<row>,<column>" */
+	json_t *pi_positions_p;
+
+	/* The Material JSON keyed by gene bank name and then by accession */
+	json_t *pi_materials_p;
+
+	/* The parsed headings of any phenotype columns */
+	LinkedList *pi_phenotype_columns_p;
+
+	/* The changes to the Study's trait statistics */
+	LinkedList *pi_trait_statistics_p;
+} PlotImport;
+
+
+/*
+ * The standard columns of a plot table.
+ */
+typedef enum
+{
+	PTC_SOWING_DATE,
+	PTC_HARVEST_DATE,
+	PTC_WIDTH,
+	PTC_LENGTH,
+	PTC_INDEX,
+	PTC_ROW,
+	PTC_COLUMN,
+	PTC_RACK,
+	PTC_ACCESSION,
+	PTC_GENE_BANK,
+	PTC_TREATMENT,
+	PTC_REPLICATE,
+	PTC_COMMENT,
+	PTC_IMAGE,
+	PTC_THUMBNAIL,
+	PTC_SOWING_ORDER,
+	PTC_WALKING_ORDER,
+	PTC_NUM_COLUMNS
+} PlotTableColumn;
+
+
+/*
+ * The positions of the columns of a delimited plot table which are
+ * found once from its header rather than for every row.
+ */
+typedef struct PlotTableLayout
+{
+	/* The index of each standard column or -1 if the table doesn't have it */
+	int32 ptl_indexes [PTC_NUM_COLUMNS];
+
+	/* What each of the table's columns is added to a Row as, in column order */
+	RowValueColumn *ptl_value_columns_p;
+
+	size_t ptl_num_columns;
+} PlotTableLayout;
+
+
+/*
+ * A row of a plot table. This is either a row of a JSON table or, if
+ * ptr_json_p is NULL, the current row of a delimited table whose cells
+ * are read in place.
+ */
+typedef struct PlotTableRow
+{
+	json_t *ptr_json_p;
+
+	DelimitedTableReader *ptr_reader_p;
+
+	const PlotTableLayout *ptr_layout_p;
+} PlotTableRow;
+
+
+/*
+ * The position of a table row that is used to check
+ * for clashes once all of the rows have been checked.
+ */
+typedef struct PlotTablePosition
+{
+	int32 ptp_row;
+
+	int32 ptp_column;
+
+	int32 ptp_rack;
+
+	int32 ptp_study_index;
+
+	bool ptp_valid_flag;
+} PlotTablePosition;
+
+
+/*
+ * The shared state for all of the threads checking a plot table.
+ */
+typedef struct PlotTableValidator
+{
+	const json_t *ptv_table_p;
+
+	size_t ptv_num_rows;
+
+	PlotTablePosition *ptv_positions_p;
+
+	/* The distinct non-standard column headings */
+	json_t *ptv_headings_p;
+
+	/* The index of the first table row for each heading in ptv_headings_p */
+	json_t *ptv_heading_rows_p;
+
+	/* The distinct gene bank names */
+	json_t *ptv_gene_banks_p;
+
+	/* The table row indexes keyed by gene bank name and then by accession */
+	json_t *ptv_accessions_p;
+
+	json_t *ptv_errors_p;
+
+	/* The accessions that would be created by the import */
+	json_t *ptv_new_accessions_p;
+
+	size_t ptv_num_row_tasks;
+
+	size_t ptv_num_tasks;
+
+	/* The index of the next task to run */
+	size_t ptv_next_task;
+
+	/* The number of checks that couldn't be completed */
+	uint32 ptv_num_incomplete_checks;
+
+	const FieldTrialServiceData *ptv_data_p;
+
+	GrassrootsServer *ptv_grassroots_p;
+
+	pthread_mutex_t ptv_lock;
+
+	bool ptv_lock_flag;
+} PlotTableValidator;
+
 
 /*
  * static declarations
@@ -136,7 +390,89 @@ static const char S_DEFAULT_COLUMN_DELIMITER =  '|';
 
 
 
-static bool AddPlotsFromJSON (ServiceJob *job_p, json_t *plots_json_p, Study *study_p,  const FieldTrialServiceData *data_p);
+static bool AddPlotsFromJSON (ServiceJob *job_p, json_t *plots_json_p, const size_t first_row_index, Study *study_p, const FieldTrialServiceData *data_p);
+
+static bool AddPlotsFromDelimitedText (ServiceJob *job_p, const char *table_s, const char delimiter, Study *study_p, const FieldTrialServiceData *data_p);
+
+static bool RunPlotImport (ServiceJob *job_p, const json_t *params_p, FieldTrialServiceData *data_p);
+
+static bool AddPlotImportOptions (json_t *import_params_p, ParameterSet *param_set_p);
+
+static bool RunPlotImportChunk (ServiceJob *job_p, json_t *plots_json_p, const char *session_id_s, const bool append_flag, const json_t *params_p, Study *study_p, const FieldTrialServiceData *data_p);
+
+static bool RunForDelimitedPlotsTable (ServiceJob *job_p, const char *table_s, const char delimiter, const bool dry_run_flag, const bool append_flag, Study *study_p, const FieldTrialServiceData *data_p);
+
+static bool PrepareStudyForPlotsImport (const bool append_flag, Study *study_p, const FieldTrialServiceData *data_p);
+
+static bool HasRequiredPlotTableColumns (ServiceJob *job_p, const PlotTableLayout *layout_p);
+
+static json_t *GetDelimitedTextAsPlotsTable (const char *table_s, const char delimiter);
+
+static bool InitPlotImport (PlotImport *import_p, const size_t num_table_rows, Study *study_p, const FieldTrialServiceData *data_p);
+
+static OperationStatus FinishPlotImport (ServiceJob *job_p, PlotImport *import_p, const size_t num_rows, const size_t num_empty_rows, Study *study_p, const FieldTrialServiceData *data_p);
+
+static void ClearPlotImport (PlotImport *import_p);
+
+static bool AddStudyPlotsToPlotImport (PlotImport *import_p, const size_t num_table_rows, Study *study_p, const FieldTrialServiceData *data_p);
+
+static ImportedPlot *AddPlotToPlotImport (PlotImport *import_p, Plot *plot_p);
+
+static bool AddMaterialsToPlotImport (PlotImport *import_p, json_t *plots_json_p, const FieldTrialServiceData *data_p);
+
+static bool AddDelimitedMaterialsToPlotImport (PlotImport *import_p, DelimitedTableReader *reader_p, const PlotTableLayout *layout_p, const size_t max_num_rows, size_t *num_rows_p, const FieldTrialServiceData *data_p);
+
+static bool AddPlotTableRowAccession (PlotImport *import_p, const PlotTableRow *table_row_p);
+
+static void ResolvePlotImportMaterials (PlotImport *import_p, const FieldTrialServiceData *data_p);
+
+static const char *GetTableRowGeneBankName (const json_t *table_row_json_p);
+
+static const char *GetPlotTableRowGeneBankName (const PlotTableRow *table_row_p);
+
+static void GetPlotPositionKey (char *key_s, const int32 row, const int32 column);
+
+static ImportedPlot *GetImportedPlot (PlotImport *import_p, const PlotTableRow *table_row_p, const int32 row, const int32 column, Study *study_p, const FieldTrialServiceData *data_p);
+
+static bool AddTableRowToPlotImport (ServiceJob *job_p, PlotTableRow *table_row_p, const size_t index, PlotImport *import_p, Study *study_p, const FieldTrialServiceData *data_p);
+
+static OperationStatus AddPlotTableRowValuesToRow (Row *row_p, PlotTableRow *table_row_p, PlotImport *import_p, Study *study_p, const FieldTrialServiceData *data_p);
+
+static size_t SavePlotImport (ServiceJob *job_p, PlotImport *import_p, json_t **cached_plots_pp, const FieldTrialServiceData *data_p);
+
+static size_t UpsertPlots (Plot **plots_pp, bool *saved_flags_p, const size_t num_plots, const FieldTrialServiceData *data_p);
+
+static bool ValidatePlotsTable (ServiceJob *job_p, const json_t *plots_json_p, const FieldTrialServiceData *data_p);
+
+static bool InitPlotTableValidator (PlotTableValidator *validator_p, const json_t *plots_json_p, const FieldTrialServiceData *data_p, GrassrootsServer *grassroots_p);
+
+static void ClearPlotTableValidator (PlotTableValidator *validator_p);
+
+static bool AddPlotTableValidationAccession (PlotTableValidator *validator_p, const char *gene_bank_s, const char *accession_s, const size_t index);
+
+static void *RunPlotTableValidationWorker (void *data_p);
+
+static void RunPlotTableValidationTask (PlotTableValidator *validator_p, size_t task, const FieldTrialServiceData *data_p);
+
+static void ValidatePlotTableRow (PlotTableValidator *validator_p, const size_t index);
+
+static bool ValidatePlotTableInteger (PlotTableValidator *validator_p, const json_t *table_row_json_p, const size_t index, const char *key_s, int32 *value_p);
+
+static void ValidatePlotTableHeading (PlotTableValidator *validator_p, const size_t index, const FieldTrialServiceData *data_p);
+
+static void ValidatePlotTableGeneBank (PlotTableValidator *validator_p, const size_t index, const FieldTrialServiceData *data_p);
+
+static void AddPlotTableValidationGeneBankErrors (PlotTableValidator *validator_p, const json_t *accessions_p, const char *column_s, const char *message_s);
+
+static void CheckPlotTableClashes (PlotTableValidator *validator_p);
+
+static void AddPlotTableValidationError (PlotTableValidator *validator_p, const size_t row, const char *column_s, const char *message_s);
+
+static void AddPlotTableValidationNewAccession (PlotTableValidator *validator_p, const char *gene_bank_s, const char *accession_s);
+
+static void SetPlotTableValidationMetadata (ServiceJob *job_p, const PlotTableValidator *validator_p, const uint32 num_threads, const struct timespec *start_time_p);
+
+static bool IsStandardPlotTableHeading (const char *key_s);
 
 static Parameter *GetTableParameter (ParameterSet *param_set_p, ParameterGroup *group_p, Study *active_study_p, const FieldTrialServiceData *data_p);
 
@@ -150,7 +486,27 @@ static json_t *GetStudyPlotsForSubmissionTable (Study *study_p, const FieldTrial
 
 static bool AddPlotRowsToTable (const Plot *plot_p, json_t *plots_table_p, const FieldTrialServiceData *service_data_p);
 
-static Plot *CreatePlotFromTabularJSON (const json_t *table_row_json_p, const int32 row, const int32 column, Study *study_p, const FieldTrialServiceData *data_p);
+static const char *GetPlotTableColumnHeading (const PlotTableColumn column);
+
+static void InitPlotTableLayout (PlotTableLayout *layout_p, const DelimitedTableHeader *header_p);
+
+static bool SetPlotTableLayoutValueColumns (PlotTableLayout *layout_p, const DelimitedTableHeader *header_p, PlotImport *import_p, Study *study_p, const FieldTrialServiceData *data_p);
+
+static void ClearPlotTableLayout (PlotTableLayout *layout_p);
+
+static void SetJSONPlotTableRow (PlotTableRow *table_row_p, json_t *table_row_json_p);
+
+static void SetDelimitedPlotTableRow (PlotTableRow *table_row_p, DelimitedTableReader *reader_p, const PlotTableLayout *layout_p);
+
+static const char *GetPlotTableRowValue (const PlotTableRow *table_row_p, const PlotTableColumn column);
+
+static bool GetPlotTableRowInteger (const PlotTableRow *table_row_p, const PlotTableColumn column, int32 *value_p);
+
+static void GetPlotTableRowReal (const PlotTableRow *table_row_p, const PlotTableColumn column, double64 **value_pp);
+
+static void GetPlotTableRowUnsignedInteger (const PlotTableRow *table_row_p, const PlotTableColumn column, uint32 **value_pp);
+
+static Plot *CreatePlotFromTableRow (const PlotTableRow *table_row_p, const int32 row, const int32 column, Study *study_p, const FieldTrialServiceData *data_p);
 
 static json_t *GetPlotRowTemplate (const uint32 row, const uint32 column, const double64 *width_p, const double64 *height_p);
 
@@ -206,7 +562,39 @@ bool AddSubmissionPlotParams (ServiceData *data_p, ParameterSet *param_set_p, Re
 
 									if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, param_set_p, group_p, S_AMEND.npt_name_s, "Append to existing plot data", "Append these plots to the already existing ones rather than removing the existing entries upon submission", &append_flag, PL_ALL)) != NULL)
 										{
-											success_flag = true;
+											bool dry_run_flag = false;
+
+											if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, param_set_p, group_p, S_DRY_RUN.npt_name_s, "Check only", "Check the plots for errors without saving anything", &dry_run_flag, PL_ALL)) != NULL)
+												{
+													if ((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_PLOT_DELIMITED_TABLE.npt_type, S_PLOT_DELIMITED_TABLE.npt_name_s, "Delimited plot data", "Plot data as CSV or TSV text with a header row. If this is set, it is used instead of the table. Set the delimiter to a comma or a tab to match.", NULL, PL_ADVANCED)) != NULL)
+														{
+															if ((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_PLOT_UPLOAD_SESSION.npt_type, S_PLOT_UPLOAD_SESSION.npt_name_s, "Upload session", "To upload a large table in chunks, set this to the same unique id for each chunk. The chunks are applied one at a time, in order, so each chunk must be sent once the previous one has finished. Chunks that have already been applied are skipped so a failed chunk can be resent.", NULL, PL_ADVANCED)) != NULL)
+																{
+																	uint32 chunk_start = 0;
+
+																	if ((param_p = EasyCreateAndAddUnsignedIntParameterToParameterSet (data_p, param_set_p, group_p, S_PLOT_UPLOAD_CHUNK_START.npt_name_s, "Chunk start", "The index, in the whole table, of the first row of this chunk", &chunk_start, PL_ADVANCED)) != NULL)
+																		{
+																			success_flag = true;
+																		}
+																	else
+																		{
+																			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_PLOT_UPLOAD_CHUNK_START.npt_name_s);
+																		}
+																}
+															else
+																{
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_PLOT_UPLOAD_SESSION.npt_name_s);
+																}
+														}
+													else
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_PLOT_DELIMITED_TABLE.npt_name_s);
+														}
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_DRY_RUN.npt_name_s);
+												}
 										}
 									else
 										{
@@ -249,72 +637,90 @@ bool RunForSubmissionPlotParams (FieldTrialServiceData *data_p, ParameterSet *pa
 
 	if (GetCurrentStringParameterValueFromParameterSet (param_set_p, S_STUDIES_LIST.npt_name_s, &study_id_s))
 		{
-			Study *study_p = GetStudyByIdString (study_id_s, VF_STORAGE, data_p);
+			const char *delimited_table_s = NULL;
+			json_t *plots_table_p = NULL;
+			json_t *import_params_p = NULL;
 
-			if (study_p)
+			/*
+			 * Plots uploaded as CSV or TSV text take precedence over the table
+			 */
+			if ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_PLOT_DELIMITED_TABLE.npt_name_s, &delimited_table_s)) && (!IsStringEmpty (delimited_table_s)))
 				{
-					json_t *plots_table_p = NULL;
+					job_done_flag = true;
 
-					if (GetCurrentJSONParameterValueFromParameterSet (param_set_p, S_PLOT_TABLE.npt_name_s, (const json_t **) &plots_table_p))
-						{
-							job_done_flag = true;
+					import_params_p = json_pack ("{s:s,s:s}", S_IMPORT_STUDY_ID_S, study_id_s, S_IMPORT_DELIMITED_TABLE_S, delimited_table_s);
+				}
+			else if (GetCurrentJSONParameterValueFromParameterSet (param_set_p, S_PLOT_TABLE.npt_name_s, (const json_t **) &plots_table_p))
+				{
+					job_done_flag = true;
 
-							/*
-							 * Has a spreadsheet been uploaded?
-							 */
-							if (plots_table_p)
+					/*
+					 * Has a spreadsheet been uploaded?
+					 */
+					if (plots_table_p)
+						{
+							if (json_array_size (plots_table_p) > 0)
 								{
-									const size_t num_rows = json_array_size (plots_table_p);
+									import_params_p = json_pack ("{s:s,s:O}", S_IMPORT_STUDY_ID_S, study_id_s, S_IMPORT_TABLE_S, plots_table_p);
 
-									if (num_rows > 0)
+									if (import_params_p)
 										{
-											const bool *append_flag_p = NULL;
-											bool success_flag = true;
-
-											GetCurrentBooleanParameterValueFromParameterSet (param_set_p, S_AMEND.npt_name_s, &append_flag_p);
+											const char *session_id_s = NULL;
 
-											if (!append_flag_p || (! (*append_flag_p)))
+											/*
+											 * Is this a chunk of a larger table?
+											 */
+											if ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_PLOT_UPLOAD_SESSION.npt_name_s, &session_id_s)) && (!IsStringEmpty (session_id_s)))
 												{
-													if (!RemoveExistingPlotsForStudy (study_p, data_p))
-														{
-															success_flag = false;
-															PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to remove existing plots for study \"%s\"", study_id_s);
-														}
-												}
+													const uint32 *chunk_start_p = NULL;
 
-											if (success_flag)
-												{
-													if (!AddPlotsFromJSON (job_p, plots_table_p, study_p, data_p))
+													GetCurrentUnsignedIntParameterValueFromParameterSet (param_set_p, S_PLOT_UPLOAD_CHUNK_START.npt_name_s, &chunk_start_p);
+
+													if ((!SetJSONString (import_params_p, S_IMPORT_UPLOAD_SESSION_S, session_id_s)) || (!SetJSONInteger (import_params_p, S_IMPORT_CHUNK_START_S, chunk_start_p ? *chunk_start_p : 0)))
 														{
-															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, plots_table_p, "AddPlotsFromJSON failed for study \"%s\"", study_p -> st_name_s);
+															json_decref (import_params_p);
+															import_params_p = NULL;
 														}
 												}
-
-										}		/* if (num_rows > 0) */
-									else
-										{
-											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Empty JSON for uploaded plots for study \"%s\"", study_id_s);
 										}
-
-								}		/* if (table_value.st_json_p) */
+								}
 							else
 								{
-									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "NULL JSON for uploaded plots for study \"%s\"", study_id_s);
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Empty JSON for uploaded plots for study \"%s\"", study_id_s);
 								}
-
-						}		/* if (GetCurrentParameterValueFromParameterSet (param_set_p, S_PLOT_TABLE.npt_name_s, &table_value)) */
+						}
 					else
 						{
-							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get param \%s\"", S_PLOT_TABLE.npt_name_s);
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "NULL JSON for uploaded plots for study \"%s\"", study_id_s);
 						}
 
-					FreeStudy (study_p);
-				}		/* if (study_p) */
+				}		/* else if (GetCurrentJSONParameterValueFromParameterSet (param_set_p, S_PLOT_TABLE.npt_name_s, (const json_t **) &plots_table_p)) */
 			else
 				{
-					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get parent study for plots with id \%s\"", study_id_s);
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get param \%s\"", S_PLOT_TABLE.npt_name_s);
 				}
 
+			if (import_params_p)
+				{
+					if (AddPlotImportOptions (import_params_p, param_set_p))
+						{
+							/*
+							 * Imports of large tables can take a long time so they are
+							 * run on the background workers and the job is polled.
+							 */
+							if (!RunBackgroundServiceJob (job_p, RunPlotImport, import_params_p, data_p))
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to import plots for study \"%s\"", study_id_s);
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the plot import options for study \"%s\"", study_id_s);
+						}
+
+					json_decref (import_params_p);
+				}		/* if (import_params_p) */
+
 		}		/* if (GetCurrentParameterValueFromParameterSet (param_set_p, S_STUDIES_LIST.npt_name_s, &parent_study_value)) */
 	else
 		{
@@ -325,7 +731,6 @@ bool RunForSubmissionPlotParams (FieldTrialServiceData *data_p, ParameterSet *pa
 }
 
 
-
 bool GetSubmissionPlotParameterTypeForNamedParameter (const char *param_name_s, ParameterType *pt_p)
 {
 	bool success_flag = true;
@@ -342,10 +747,26 @@ bool GetSubmissionPlotParameterTypeForNamedParameter (const char *param_name_s,
 		{
 			*pt_p = S_PLOT_TABLE.npt_type;
 		}
+	else if (strcmp (param_name_s, S_PLOT_DELIMITED_TABLE.npt_name_s) == 0)
+		{
+			*pt_p = S_PLOT_DELIMITED_TABLE.npt_type;
+		}
 	else if (strcmp (param_name_s, S_AMEND.npt_name_s) == 0)
 		{
 			*pt_p = S_AMEND.npt_type;
 		}
+	else if (strcmp (param_name_s, S_DRY_RUN.npt_name_s) == 0)
+		{
+			*pt_p = S_DRY_RUN.npt_type;
+		}
+	else if (strcmp (param_name_s, S_PLOT_UPLOAD_SESSION.npt_name_s) == 0)
+		{
+			*pt_p = S_PLOT_UPLOAD_SESSION.npt_type;
+		}
+	else if (strcmp (param_name_s, S_PLOT_UPLOAD_CHUNK_START.npt_name_s) == 0)
+		{
+			*pt_p = S_PLOT_UPLOAD_CHUNK_START.npt_type;
+		}
 	else
 		{
 			success_flag = GetSubmissionStudyParameterTypeForDefaultPlotNamedParameter (param_name_s, pt_p);
@@ -945,7 +1366,11 @@ static Parameter *GetTableParameter (ParameterSet *param_set_p, ParameterGroup *
 }
 
 
-static bool AddPlotsFromJSON (ServiceJob *job_p, json_t *plots_json_p, Study *study_p, const FieldTrialServiceData *data_p)
+/*
+ * first_row_index is the index, in the whole table, of the first row of
+ * plots_json_p which is only non-zero when a table is uploaded in chunks.
+ */
+static bool AddPlotsFromJSON (ServiceJob *job_p, json_t *plots_json_p, const size_t first_row_index, Study *study_p, const FieldTrialServiceData *data_p)
 {
 	OperationStatus status = OS_FAILED;
 	bool success_flag	= true;
@@ -953,323 +1378,2678 @@ static bool AddPlotsFromJSON (ServiceJob *job_p, json_t *plots_json_p, Study *st
 	if (json_is_array (plots_json_p))
 		{
 			const size_t num_rows = json_array_size (plots_json_p);
-			size_t i;
-			size_t num_empty_rows = 0;
-			size_t num_imported = 0;
-			bool imported_row_flag;
-			char *study_id_s = NULL;
+			PlotImport plot_import;
 
-			for (i = 0; i < num_rows; ++ i)
+			/*
+			 * Load the existing plots and resolve all of the gene banks
+			 * and materials up front rather than once per row.
+			 */
+			if (InitPlotImport (&plot_import, num_rows, study_p, data_p))
 				{
-					json_t *table_row_json_p = json_array_get (plots_json_p, i);
-
-					/*
-					 * Is the row non-empty?
-					 */
-					if (json_object_size (table_row_json_p) > 0)
+					if (AddMaterialsToPlotImport (&plot_import, plots_json_p, data_p))
 						{
+							size_t i;
+							size_t num_empty_rows = 0;
+							BackgroundJob *bg_job_p = GetBackgroundJob (job_p);
+							PlotTableRow table_row;
+
 							/*
-							 * For the first r
+							 * Add the rows to the plots in memory
 							 */
-							/*
-							if ((i > 0) || (!IsHeaderRow (table_row_json_p)))
-								{
-
-								}
-	*/
-
-							const char *gene_bank_s = GetJSONString (table_row_json_p, S_GENE_BANK_S);
-							GeneBank *gene_bank_p = NULL;
-
-							imported_row_flag = false;
-
-							if (IsStringEmpty (gene_bank_s))
-								{
-									/* default to using the GRU */
-									gene_bank_s = "Germplasm Resources Unit";
-								}
-
-							gene_bank_p = GetGeneBankByName (gene_bank_s, data_p);
-
-							if (gene_bank_p)
+							for (i = 0; i < num_rows; ++ i)
 								{
-									const char *accession_s = GetJSONString (table_row_json_p, PL_ACCESSION_TABLE_TITLE_S);
+									json_t *table_row_json_p = json_array_get (plots_json_p, i);
 
-									if (!IsStringEmpty (accession_s))
+									/*
+									 * Is the row non-empty?
+									 */
+									if (json_object_size (table_row_json_p) > 0)
 										{
-											Material *material_p = GetOrCreateMaterialByAccession (accession_s, gene_bank_p, data_p);
+											SetJSONPlotTableRow (&table_row, table_row_json_p);
 
-											if (material_p)
+											if (!AddTableRowToPlotImport (job_p, &table_row, first_row_index + i, &plot_import, study_p, data_p))
 												{
-													Plot *plot_p = NULL;
-													int32 row = -1;
+													PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, table_row_json_p, "Failed to import plot data");
+												}
+										}
+									else
+										{
+											++ num_empty_rows;
+										}
 
-													if (GetJSONStringAsInteger (table_row_json_p, S_ROW_TITLE_S, &row))
-														{
-															int32 column = -1;
+									SetBackgroundJobProgress (bg_job_p, i + 1, num_rows);
 
-															if (GetJSONStringAsInteger (table_row_json_p, S_COLUMN_TITLE_S, &column))
-																{
-																	/*
-																	 * does the plot already exist?
-																	 */
-																	plot_p = GetPlotByRowAndColumn (row, column, study_p, data_p);
+								}		/* for (i = 0; i < num_rows; ++ i) */
 
-																	if (!plot_p)
-																		{
-																			plot_p = CreatePlotFromTabularJSON (table_row_json_p, row, column, study_p, data_p);
+							status = FinishPlotImport (job_p, &plot_import, num_rows, num_empty_rows, study_p, data_p);
+						}		/* if (AddMaterialsToPlotImport (&plot_import, plots_json_p, data_p)) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to resolve the materials for the plots of study \"%s\"", study_p -> st_name_s);
+							success_flag = false;
+						}
+
+					ClearPlotImport (&plot_import);
+				}		/* if (InitPlotImport (&plot_import, num_rows, study_p, data_p)) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to prepare plot import for study \"%s\"", study_p -> st_name_s);
+					success_flag = false;
+				}
+
+		}		/* if (json_is_array (plots_json_p)) */
+
+
+
+	SetServiceJobStatus (job_p, status);
+
+	return success_flag;
+}
+
+
+/*
+ * Import plots from CSV or TSV text. The columns are found once from
+ * the header and the rows go through the import in windows straight
+ * from their cells. Each window is read twice, first to resolve its
+ * materials together and then to add its rows, so no rows are held
+ * between reads. The Plots themselves stay in memory until the end
+ * as a Plot's rows can be anywhere in the table.
+ */
+static bool AddPlotsFromDelimitedText (ServiceJob *job_p, const char *table_s, const char delimiter, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	OperationStatus status = OS_FAILED;
+	bool success_flag = false;
+	DelimitedTableReader reader;
+
+	if (InitDelimitedTableReader (&reader, table_s, delimiter))
+		{
+			DelimitedTableHeader header;
+
+			if (ReadDelimitedTableHeader (&reader, &header))
+				{
+					PlotTableLayout layout;
+
+					InitPlotTableLayout (&layout, &header);
+
+					if (HasRequiredPlotTableColumns (job_p, &layout))
+						{
+							PlotImport plot_import;
+
+							/* The header row doesn't need a plot */
+							const size_t max_num_rows = GetMaximumNumberOfDelimitedTableRows (table_s) - 1;
+
+							if (InitPlotImport (&plot_import, max_num_rows, study_p, data_p))
+								{
+									if (SetPlotTableLayoutValueColumns (&layout, &header, &plot_import, study_p, data_p))
+										{
+											int window_size = S_DEFAULT_PLOT_IMPORT_WINDOW_SIZE;
+											size_t num_rows = 0;
+											size_t num_empty_rows = 0;
+											bool loop_flag = true;
+											BackgroundJob *bg_job_p = GetBackgroundJob (job_p);
+											PlotTableRow table_row;
+
+											if ((!GetJSONInteger (data_p -> dftsd_base_data.sd_config_p, "plot_import_window_size", &window_size)) || (window_size < 1))
+												{
+													window_size = S_DEFAULT_PLOT_IMPORT_WINDOW_SIZE;
+												}
+
+											SetDelimitedPlotTableRow (&table_row, &reader, &layout);
+											success_flag = true;
+
+											while (loop_flag)
+												{
+													const size_t window_start = num_rows;
+													size_t num_window_rows = 0;
+													size_t i;
+													DelimitedTablePosition window_position;
+
+													GetDelimitedTablePosition (&reader, &window_position);
+
+													/*
+													 * The materials are resolved a window at a time
+													 */
+													if (!AddDelimitedMaterialsToPlotImport (&plot_import, &reader, &layout, (size_t) window_size, &num_window_rows, data_p))
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to resolve all of the materials for rows " SIZET_FMT " to " SIZET_FMT " of study \"%s\"", window_start, window_start + num_window_rows, study_p -> st_name_s);
+														}
+
+													if (reader.dtr_error_flag)
+														{
+															AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_DELIMITED_TABLE.npt_name_s, S_PLOT_DELIMITED_TABLE.npt_type, "Failed to read row", window_start + num_window_rows, NULL);
+															success_flag = false;
+															loop_flag = false;
+														}
+													else if (num_window_rows == 0)
+														{
+															loop_flag = false;
+														}
+
+													/*
+													 * Go back to the start of the window and add its rows
+													 */
+													SetDelimitedTablePosition (&reader, &window_position);
+
+													for (i = 0; (i < num_window_rows) && (ReadDelimitedTableRow (&reader)); ++ i)
+														{
+															/*
+															 * Empty rows still count so the indexes in any
+															 * error messages match the rows of the table.
+															 */
+															if (IsDelimitedTableRowEmpty (&reader))
+																{
+																	++ num_empty_rows;
+																}
+															else if (!AddTableRowToPlotImport (job_p, &table_row, num_rows, &plot_import, study_p, data_p))
+																{
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to import plot data for table row " SIZET_FMT, num_rows);
+																}
+
+															++ num_rows;
+														}
+
+													if (num_window_rows > 0)
+														{
+															SetBackgroundJobProgress (bg_job_p, num_rows, max_num_rows);
+														}
+
+												}		/* while (loop_flag) */
+
+											status = FinishPlotImport (job_p, &plot_import, num_rows, num_empty_rows, study_p, data_p);
+										}		/* if (SetPlotTableLayoutValueColumns (&layout, &header, &plot_import, study_p, data_p)) */
+
+									ClearPlotImport (&plot_import);
+								}		/* if (InitPlotImport (&plot_import, max_num_rows, study_p, data_p)) */
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to prepare plot import for study \"%s\"", study_p -> st_name_s);
+								}
+
+						}		/* if (HasRequiredPlotTableColumns (job_p, &layout)) */
+
+					ClearPlotTableLayout (&layout);
+					ClearDelimitedTableHeader (&header);
+				}		/* if (ReadDelimitedTableHeader (&reader, &header)) */
+			else
+				{
+					AddParameterErrorMessageToServiceJob (job_p, S_PLOT_DELIMITED_TABLE.npt_name_s, S_PLOT_DELIMITED_TABLE.npt_type, "Failed to read the column headings");
+				}
+
+			ClearDelimitedTableReader (&reader);
+		}		/* if (InitDelimitedTableReader (&reader, table_s, delimiter)) */
+
+	/*
+	 * If any of the text couldn't be read, the import
+	 * can't have fully succeeded.
+	 */
+	if ((status == OS_SUCCEEDED) && (!success_flag))
+		{
+			status = OS_PARTIALLY_SUCCEEDED;
+		}
+
+	SetServiceJobStatus (job_p, status);
+
+	return success_flag;
+}
+
+
+/*
+ * Do the work of a plot import. This may be running on a background worker
+ * so everything that it needs comes from params_p rather than the ParameterSet.
+ */
+static bool RunPlotImport (ServiceJob *job_p, const json_t *params_p, FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	const char *study_id_s = GetJSONString (params_p, S_IMPORT_STUDY_ID_S);
+	Study *study_p = GetStudyByIdString (study_id_s, VF_STORAGE, data_p);
+
+	if (study_p)
+		{
+			const char *delimited_table_s = GetJSONString (params_p, S_IMPORT_DELIMITED_TABLE_S);
+			json_t *plots_table_p = json_object_get (params_p, S_IMPORT_TABLE_S);
+			bool dry_run_flag = false;
+			bool append_flag = false;
+
+			GetJSONBoolean (params_p, S_IMPORT_DRY_RUN_S, &dry_run_flag);
+			GetJSONBoolean (params_p, S_IMPORT_APPEND_S, &append_flag);
+
+			if (delimited_table_s)
+				{
+					const char *delimiter_s = GetJSONString (params_p, S_IMPORT_DELIMITER_S);
+					char delimiter = S_DEFAULT_COLUMN_DELIMITER;
+
+					if (delimiter_s && (*delimiter_s != '\0'))
+						{
+							delimiter = *delimiter_s;
+						}
+
+					success_flag = RunForDelimitedPlotsTable (job_p, delimited_table_s, delimiter, dry_run_flag, append_flag, study_p, data_p);
+
+					if (!success_flag)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to import delimited plot data for study \"%s\"", study_p -> st_name_s);
+						}
+				}
+			else if (plots_table_p)
+				{
+					if (dry_run_flag)
+						{
+							/*
+							 * Just check the table, nothing is written to the database
+							 */
+							success_flag = ValidatePlotsTable (job_p, plots_table_p, data_p);
+
+							if (!success_flag)
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Not all of the checks could be run on the plots for study \"%s\"", study_p -> st_name_s);
+								}
+						}
+					else
+						{
+							const char *session_id_s = GetJSONString (params_p, S_IMPORT_UPLOAD_SESSION_S);
+
+							if (session_id_s)
+								{
+									success_flag = RunPlotImportChunk (job_p, plots_table_p, session_id_s, append_flag, params_p, study_p, data_p);
+								}
+							else if (PrepareStudyForPlotsImport (append_flag, study_p, data_p))
+								{
+									success_flag = AddPlotsFromJSON (job_p, plots_table_p, 0, study_p, data_p);
+								}
+
+							if (!success_flag)
+								{
+									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, plots_table_p, "AddPlotsFromJSON failed for study \"%s\"", study_p -> st_name_s);
+								}
+						}		/* if (dry_run_flag) else ... */
+
+				}		/* else if (plots_table_p) */
+
+			FreeStudy (study_p);
+		}		/* if (study_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get parent study for plots with id \%s\"", study_id_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Import one chunk of a table that is being uploaded over several requests.
+ * Only the rows after the session's checkpoint are applied and the checkpoint
+ * is moved on once all of them have been saved.
+ */
+static bool RunPlotImportChunk (ServiceJob *job_p, json_t *plots_json_p, const char *session_id_s, const bool append_flag, const json_t *params_p, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	const char *study_id_s = GetJSONString (params_p, S_IMPORT_STUDY_ID_S);
+	const json_t *chunk_start_p = json_object_get (params_p, S_IMPORT_CHUNK_START_S);
+	const int64 chunk_start = json_is_integer (chunk_start_p) ? json_integer_value (chunk_start_p) : 0;
+	UploadChunk chunk;
+
+	if (BeginUploadChunk (&chunk, session_id_s, US_PLOTS_TYPE_S, study_id_s, chunk_start, json_array_size (plots_json_p), job_p, &S_PLOT_UPLOAD_SESSION, data_p))
+		{
+			json_t *rows_to_apply_p = GetUploadChunkRowsToApply (&chunk, plots_json_p);
+
+			if (rows_to_apply_p)
+				{
+					if (json_array_size (rows_to_apply_p) > 0)
+						{
+							/*
+							 * Only the session's first rows can replace the existing
+							 * plots, every later chunk is added to them.
+							 */
+							if (PrepareStudyForPlotsImport (append_flag || (chunk.uc_committed_rows > 0), study_p, data_p))
+								{
+									OperationStatus status;
+
+									success_flag = AddPlotsFromJSON (job_p, rows_to_apply_p, (size_t) GetUploadChunkFirstRowToApply (&chunk), study_p, data_p);
+
+									/*
+									 * If any rows failed, the checkpoint stays where it is so that
+									 * the whole chunk can be sent again. Reapplying the rows that
+									 * were saved just updates their existing Rows.
+									 */
+									status = GetServiceJobStatus (job_p);
+
+									if (status == OS_SUCCEEDED)
+										{
+											if (!CommitUploadChunk (&chunk, data_p))
+												{
+													AddParameterErrorMessageToServiceJob (job_p, S_PLOT_UPLOAD_SESSION.npt_name_s, S_PLOT_UPLOAD_SESSION.npt_type, "Failed to store the upload session's checkpoint");
+													SetServiceJobStatus (job_p, OS_PARTIALLY_SUCCEEDED);
+												}
+										}
+								}
+						}
+					else
+						{
+							/* Every row was applied by an earlier attempt */
+							SetServiceJobStatus (job_p, OS_SUCCEEDED);
+							success_flag = true;
+						}
+
+					json_decref (rows_to_apply_p);
+				}		/* if (rows_to_apply_p) */
+
+			/* If nothing was committed, let the rows be sent again */
+			ReleaseUploadChunk (&chunk, data_p);
+
+			AddUploadChunkToServiceJob (&chunk, job_p);
+		}		/* if (BeginUploadChunk (&chunk, session_id_s, US_PLOTS_TYPE_S, study_id_s, chunk_start, json_array_size (plots_json_p), job_p, &S_PLOT_UPLOAD_SESSION, data_p)) */
+	else
+		{
+			SetServiceJobStatus (job_p, OS_FAILED);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Copy the options for a plot import out of the ParameterSet.
+ */
+static bool AddPlotImportOptions (json_t *import_params_p, ParameterSet *param_set_p)
+{
+	bool success_flag = false;
+	const bool *append_flag_p = NULL;
+	const bool *dry_run_flag_p = NULL;
+
+	GetCurrentBooleanParameterValueFromParameterSet (param_set_p, S_AMEND.npt_name_s, &append_flag_p);
+	GetCurrentBooleanParameterValueFromParameterSet (param_set_p, S_DRY_RUN.npt_name_s, &dry_run_flag_p);
+
+	if (SetJSONBoolean (import_params_p, S_IMPORT_APPEND_S, append_flag_p && (*append_flag_p)))
+		{
+			if (SetJSONBoolean (import_params_p, S_IMPORT_DRY_RUN_S, dry_run_flag_p && (*dry_run_flag_p)))
+				{
+					const char *delimiter_p = NULL;
+
+					if ((GetCurrentCharParameterValueFromParameterSet (param_set_p, S_PLOT_TABLE_COLUMN_DELIMITER.npt_name_s, &delimiter_p)) && (delimiter_p) && (*delimiter_p != '\0'))
+						{
+							char delimiter_s [2];
+
+							*delimiter_s = *delimiter_p;
+							* (delimiter_s + 1) = '\0';
+
+							success_flag = SetJSONString (import_params_p, S_IMPORT_DELIMITER_S, delimiter_s);
+						}
+					else
+						{
+							success_flag = true;
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool RunForDelimitedPlotsTable (ServiceJob *job_p, const char *table_s, const char delimiter, const bool dry_run_flag, const bool append_flag, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (dry_run_flag)
+		{
+			/*
+			 * The checks need all of the rows at once so the
+			 * whole table is converted.
+			 */
+			json_t *plots_table_p = GetDelimitedTextAsPlotsTable (table_s, delimiter);
+
+			if (plots_table_p)
+				{
+					success_flag = ValidatePlotsTable (job_p, plots_table_p, data_p);
+					json_decref (plots_table_p);
+				}
+			else
+				{
+					AddParameterErrorMessageToServiceJob (job_p, S_PLOT_DELIMITED_TABLE.npt_name_s, S_PLOT_DELIMITED_TABLE.npt_type, "Failed to read the plot data");
+					SetServiceJobStatus (job_p, OS_FAILED);
+				}
+		}
+	else if (PrepareStudyForPlotsImport (append_flag, study_p, data_p))
+		{
+			success_flag = AddPlotsFromDelimitedText (job_p, table_s, delimiter, study_p, data_p);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Unless the plots are being appended, remove the Study's existing ones.
+ */
+static bool PrepareStudyForPlotsImport (const bool append_flag, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+
+	if (!append_flag)
+		{
+			if (!RemoveExistingPlotsForStudy (study_p, data_p))
+				{
+					success_flag = false;
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to remove existing plots for study \"%s\"", study_p -> st_name_s);
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Check the headings once rather than reporting the same missing
+ * column on every row.
+ */
+static bool HasRequiredPlotTableColumns (ServiceJob *job_p, const PlotTableLayout *layout_p)
+{
+	bool success_flag = true;
+	const PlotTableColumn required_columns [] = { PTC_ROW, PTC_COLUMN, PTC_RACK, PTC_INDEX, PTC_ACCESSION };
+	size_t i;
+
+	for (i = 0; i < sizeof (required_columns) / sizeof (required_columns [0]); ++ i)
+		{
+			if (layout_p -> ptl_indexes [required_columns [i]] == -1)
+				{
+					const char *heading_s = GetPlotTableColumnHeading (required_columns [i]);
+					char *error_s = ConcatenateVarargsStrings ("Missing column \"", heading_s, "\"", NULL);
+
+					if (error_s)
+						{
+							AddParameterErrorMessageToServiceJob (job_p, S_PLOT_DELIMITED_TABLE.npt_name_s, S_PLOT_DELIMITED_TABLE.npt_type, error_s);
+							FreeCopiedString (error_s);
+						}
+					else
+						{
+							AddParameterErrorMessageToServiceJob (job_p, S_PLOT_DELIMITED_TABLE.npt_name_s, S_PLOT_DELIMITED_TABLE.npt_type, heading_s);
+						}
+
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+static json_t *GetDelimitedTextAsPlotsTable (const char *table_s, const char delimiter)
+{
+	json_t *plots_table_p = NULL;
+	DelimitedTableReader reader;
+
+	if (InitDelimitedTableReader (&reader, table_s, delimiter))
+		{
+			DelimitedTableHeader header;
+
+			if (ReadDelimitedTableHeader (&reader, &header))
+				{
+					if ((plots_table_p = json_array ()) != NULL)
+						{
+							bool success_flag = true;
+
+							while (success_flag && (ReadDelimitedTableRow (&reader)))
+								{
+									json_t *table_row_json_p = GetDelimitedTableRowAsJSON (&reader, &header);
+
+									if ((!table_row_json_p) || (json_array_append_new (plots_table_p, table_row_json_p) != 0))
+										{
+											success_flag = false;
+										}
+								}
+
+							if ((!success_flag) || (reader.dtr_error_flag))
+								{
+									json_decref (plots_table_p);
+									plots_table_p = NULL;
+								}
+						}
+
+					ClearDelimitedTableHeader (&header);
+				}
+
+			ClearDelimitedTableReader (&reader);
+		}
+
+	return plots_table_p;
+}
+
+
+static bool InitPlotImport (PlotImport *import_p, const size_t num_table_rows, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	import_p -> pi_plots_p = NULL;
+	import_p -> pi_num_plots = 0;
+	import_p -> pi_max_num_plots = 0;
+	import_p -> pi_materials_p = NULL;
+	import_p -> pi_phenotype_columns_p = NULL;
+	import_p -> pi_trait_statistics_p = NULL;
+
+	if ((import_p -> pi_positions_p = json_object ()) != NULL)
+		{
+			if ((import_p -> pi_phenotype_columns_p = AllocatePhenotypeColumnsList ()) != NULL)
+				{
+					if ((import_p -> pi_trait_statistics_p = AllocateTraitStatisticsList ()) != NULL)
+						{
+							if (AddStudyPlotsToPlotImport (import_p, num_table_rows, study_p, data_p))
+								{
+									return true;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to load the existing plots for study \"%s\"", study_p -> st_name_s);
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate trait statistics list for study \"%s\"", study_p -> st_name_s);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate phenotype columns list for study \"%s\"", study_p -> st_name_s);
+				}
+
+			ClearPlotImport (import_p);
+		}		/* if ((import_p -> pi_positions_p = json_object ()) != NULL) */
+
+	return false;
+}
+
+
+/*
+ * Write all of the plots and patch them into any cached copy of the Study.
+ */
+static OperationStatus FinishPlotImport (ServiceJob *job_p, PlotImport *import_p, const size_t num_rows, const size_t num_empty_rows, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	OperationStatus status = OS_FAILED;
+	size_t num_imported = 0;
+	char *study_id_s = NULL;
+
+	/*
+	 * The updated plots to splice into any cached copy of the study
+	 */
+	json_t *cached_plots_p = json_object ();
+
+	/*
+	 * Note which versions of the trait statistics could
+	 * not yet include the values that are being saved.
+	 */
+	GetStudyTraitStatisticsRevisions (study_p -> st_id_p, import_p -> pi_trait_statistics_p, data_p);
+
+	/*
+	 * Write all of the plots that have changed
+	 */
+	num_imported = SavePlotImport (job_p, import_p, &cached_plots_p, data_p);
+
+	/*
+	 * As with SaveObservationImport (), the changes aren't tracked per Plot
+	 * so if any rows weren't saved, the statistics are rebuilt from the
+	 * stored Plots rather than including their changes.
+	 */
+	if (num_imported > 0)
+		{
+			if (!SaveStudyTraitStatistics (study_p -> st_id_p, import_p -> pi_trait_statistics_p, num_imported + num_empty_rows < num_rows, data_p))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to update the trait statistics for Study \"%s\"", study_p -> st_name_s);
+				}
+		}
+
+	if (num_imported + num_empty_rows == num_rows)
+		{
+			status = OS_SUCCEEDED;
+		}
+	else if (num_imported > 0)
+		{
+			status = OS_PARTIALLY_SUCCEEDED;
+		}
+
+	/*
+	 * As the plots have been updated, patch them into any cached
+	 * study. If we couldn't keep track of them all, clear it instead.
+	 */
+	study_id_s = GetBSONOidAsString (study_p -> st_id_p);
+
+	if (study_id_s)
+		{
+			if (cached_plots_p)
+				{
+					if (!PatchCachedStudyPlots (study_id_s, cached_plots_p, data_p))
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to patch cached Study with id \"%s\"", study_id_s);
+						}
+				}
+			else if (!ClearCachedStudy (study_id_s, data_p))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to clear cached Study with id \"%s\"", study_id_s);
+				}
+
+			FreeCopiedString (study_id_s);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get id for Study \"%s\"", study_p -> st_name_s);
+		}
+
+	if (cached_plots_p)
+		{
+			json_decref (cached_plots_p);
+		}
+
+	return status;
+}
+
+
+/*
+ * The Plots themselves belong to the Study so only the
+ * import's own bookkeeping is freed.
+ */
+static void ClearPlotImport (PlotImport *import_p)
+{
+	if (import_p -> pi_plots_p)
+		{
+			size_t i;
+			ImportedPlot *imported_plot_p = import_p -> pi_plots_p;
+
+			for (i = 0; i < import_p -> pi_num_plots; ++ i, ++ imported_plot_p)
+				{
+					json_decref (imported_plot_p -> ip_table_rows_p);
+				}
+
+			FreeMemory (import_p -> pi_plots_p);
+			import_p -> pi_plots_p = NULL;
+		}
+
+	if (import_p -> pi_positions_p)
+		{
+			json_decref (import_p -> pi_positions_p);
+			import_p -> pi_positions_p = NULL;
+		}
+
+	if (import_p -> pi_materials_p)
+		{
+			json_decref (import_p -> pi_materials_p);
+			import_p -> pi_materials_p = NULL;
+		}
+
+	if (import_p -> pi_phenotype_columns_p)
+		{
+			FreeLinkedList (import_p -> pi_phenotype_columns_p);
+			import_p -> pi_phenotype_columns_p = NULL;
+		}
+
+	if (import_p -> pi_trait_statistics_p)
+		{
+			FreeLinkedList (import_p -> pi_trait_statistics_p);
+			import_p -> pi_trait_statistics_p = NULL;
+		}
+
+	import_p -> pi_num_plots = 0;
+	import_p -> pi_max_num_plots = 0;
+}
+
+
+/*
+ * Load all of the Study's existing Plots with a single query and
+ * key them by their position. There is also room reserved for a new
+ * Plot for each of the num_table_rows rows in the uploaded table.
+ */
+static bool AddStudyPlotsToPlotImport (PlotImport *import_p, const size_t num_table_rows, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	size_t max_num_plots = 0;
+
+	/*
+	 * If there are no plots for the Study yet, there might not
+	 * be any results at all which isn't an error.
+	 */
+	if (!GetStudyPlots (study_p, data_p))
+		{
+			PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "No existing plots found for study \"%s\"", study_p -> st_name_s);
+		}
+
+	max_num_plots = study_p -> st_plots_p -> ll_size + num_table_rows;
+
+	if (max_num_plots > 0)
+		{
+			import_p -> pi_plots_p = (ImportedPlot *) AllocMemoryArray (max_num_plots, sizeof (ImportedPlot));
+
+			if (import_p -> pi_plots_p)
+				{
+					PlotNode *node_p = (PlotNode *) (study_p -> st_plots_p -> ll_head_p);
+
+					import_p -> pi_max_num_plots = max_num_plots;
+					success_flag = true;
+
+					while (node_p && success_flag)
+						{
+							if (AddPlotToPlotImport (import_p, node_p -> pn_plot_p))
+								{
+									node_p = (PlotNode *) (node_p -> pn_node.ln_next_p);
+								}
+							else
+								{
+									success_flag = false;
+								}
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " imported plots for study \"%s\"", max_num_plots, study_p -> st_name_s);
+				}
+		}
+	else
+		{
+			success_flag = true;
+		}
+
+	return success_flag;
+}
+
+
+static ImportedPlot *AddPlotToPlotImport (PlotImport *import_p, Plot *plot_p)
+{
+	if (import_p -> pi_num_plots < import_p -> pi_max_num_plots)
+		{
+			ImportedPlot *imported_plot_p = (import_p -> pi_plots_p) + (import_p -> pi_num_plots);
+
+			if ((imported_plot_p -> ip_table_rows_p = json_array ()) != NULL)
+				{
+					char key_s [S_PLOT_POSITION_KEY_SIZE];
+
+					GetPlotPositionKey (key_s, plot_p -> pl_row_index, plot_p -> pl_column_index);
+
+					if (json_object_set_new (import_p -> pi_positions_p, key_s, json_integer (import_p -> pi_num_plots)) == 0)
+						{
+							imported_plot_p -> ip_plot_p = plot_p;
+							imported_plot_p -> ip_saved_flag = false;
+
+							++ (import_p -> pi_num_plots);
+
+							return imported_plot_p;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add plot at \"%s\" to import", key_s);
+						}
+
+					json_decref (imported_plot_p -> ip_table_rows_p);
+					imported_plot_p -> ip_table_rows_p = NULL;
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Plot import is full at " SIZET_FMT " plots", import_p -> pi_max_num_plots);
+		}
+
+	return NULL;
+}
+
+
+/*
+ * Resolve each distinct gene bank once and all of the accessions for it
+ * in bulk. Any gene bank that can't be found is left out of the map so
+ * that the rows that use it are reported when they are added.
+ */
+static bool AddMaterialsToPlotImport (PlotImport *import_p, json_t *plots_json_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if ((import_p -> pi_materials_p = json_object ()) != NULL)
+		{
+			size_t i;
+			json_t *table_row_json_p;
+			PlotTableRow table_row;
+
+			success_flag = true;
+
+			/*
+			 * Collect the distinct accessions for each gene bank
+			 */
+			json_array_foreach (plots_json_p, i, table_row_json_p)
+				{
+					SetJSONPlotTableRow (&table_row, table_row_json_p);
+
+					if (!AddPlotTableRowAccession (import_p, &table_row))
+						{
+							success_flag = false;
+						}
+				}
+
+			ResolvePlotImportMaterials (import_p, data_p);
+		}		/* if ((import_p -> pi_materials_p = json_object ()) != NULL) */
+
+	return success_flag;
+}
+
+
+/*
+ * Read up to max_num_rows rows of a delimited table and resolve the
+ * materials that they use in the same way as AddMaterialsToPlotImport().
+ * The caller goes back to the first of the rows to add them once their
+ * materials are known so no row is held between the two passes.
+ */
+static bool AddDelimitedMaterialsToPlotImport (PlotImport *import_p, DelimitedTableReader *reader_p, const PlotTableLayout *layout_p, const size_t max_num_rows, size_t *num_rows_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+	size_t num_rows = 0;
+	PlotTableRow table_row;
+
+	if (import_p -> pi_materials_p)
+		{
+			json_decref (import_p -> pi_materials_p);
+		}
+
+	if ((import_p -> pi_materials_p = json_object ()) == NULL)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate materials for plot import");
+			success_flag = false;
+		}
+
+	SetDelimitedPlotTableRow (&table_row, reader_p, layout_p);
+
+	/*
+	 * The rows are still counted without any materials so that
+	 * they are reported as failures rather than being skipped
+	 */
+	while ((num_rows < max_num_rows) && (ReadDelimitedTableRow (reader_p)))
+		{
+			if (import_p -> pi_materials_p)
+				{
+					if (!AddPlotTableRowAccession (import_p, &table_row))
+						{
+							success_flag = false;
+						}
+				}
+
+			++ num_rows;
+		}
+
+	if (import_p -> pi_materials_p)
+		{
+			ResolvePlotImportMaterials (import_p, data_p);
+		}
+
+	*num_rows_p = num_rows;
+
+	return success_flag;
+}
+
+
+/*
+ * Add a table row's accession to the ones to resolve for its gene bank.
+ */
+static bool AddPlotTableRowAccession (PlotImport *import_p, const PlotTableRow *table_row_p)
+{
+	bool success_flag = true;
+	const char *accession_s = GetPlotTableRowValue (table_row_p, PTC_ACCESSION);
+
+	if (!IsStringEmpty (accession_s))
+		{
+			const char *gene_bank_s = GetPlotTableRowGeneBankName (table_row_p);
+			json_t *accessions_p = json_object_get (import_p -> pi_materials_p, gene_bank_s);
+
+			if (!accessions_p)
+				{
+					accessions_p = json_object ();
+
+					if (accessions_p)
+						{
+							if (json_object_set_new (import_p -> pi_materials_p, gene_bank_s, accessions_p) != 0)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add gene bank \"%s\" to import", gene_bank_s);
+									accessions_p = NULL;
+								}
+						}
+				}
+
+			if (accessions_p)
+				{
+					if (!json_object_get (accessions_p, accession_s))
+						{
+							if (json_object_set_new (accessions_p, accession_s, json_null ()) != 0)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add accession \"%s\" in gene bank \"%s\" to import", accession_s, gene_bank_s);
+									success_flag = false;
+								}
+						}
+				}
+			else
+				{
+					success_flag = false;
+				}
+
+		}		/* if (!IsStringEmpty (accession_s)) */
+
+	return success_flag;
+}
+
+
+/*
+ * Resolve all of the collected accessions with one query per gene bank.
+ */
+static void ResolvePlotImportMaterials (PlotImport *import_p, const FieldTrialServiceData *data_p)
+{
+	const char *gene_bank_s;
+	json_t *accessions_p;
+	void *tmp_p;
+
+	json_object_foreach_safe (import_p -> pi_materials_p, tmp_p, gene_bank_s, accessions_p)
+		{
+			GeneBank *gene_bank_p = GetGeneBankByName (gene_bank_s, data_p);
+
+			if (gene_bank_p)
+				{
+					if (!GetOrCreateMaterialsByAccession (accessions_p, gene_bank_p, data_p))
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get all of the materials for gene bank \"%s\"", gene_bank_s);
+						}
+
+					FreeGeneBank (gene_bank_p);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get gene bank \"%s\"", gene_bank_s);
+					json_object_del (import_p -> pi_materials_p, gene_bank_s);
+				}
+		}
+}
+
+
+static const char *GetTableRowGeneBankName (const json_t *table_row_json_p)
+{
+	const char *gene_bank_s = GetJSONString (table_row_json_p, S_GENE_BANK_S);
+
+	if (IsStringEmpty (gene_bank_s))
+		{
+			/* default to using the GRU */
+			gene_bank_s = S_DEFAULT_GENE_BANK_S;
+		}
+
+	return gene_bank_s;
+}
+
+
+static const char *GetPlotTableRowGeneBankName (const PlotTableRow *table_row_p)
+{
+	const char *gene_bank_s = GetPlotTableRowValue (table_row_p, PTC_GENE_BANK);
+
+	if (IsStringEmpty (gene_bank_s))
+		{
+			/* default to using the GRU */
+			gene_bank_s = S_DEFAULT_GENE_BANK_S;
+		}
+
+	return gene_bank_s;
+}
+
+
+static void GetPlotPositionKey (char *key_s, const int32 row, const int32 column)
+{
+	sprintf (key_s, INT32_FMT "," INT32_FMT, row, column);
+}
+
+
+/*
+ * Get the Plot at the given position, creating it in memory if
+ * it doesn't already exist.
+ */
+static ImportedPlot *GetImportedPlot (PlotImport *import_p, const PlotTableRow *table_row_p, const int32 row, const int32 column, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	ImportedPlot *imported_plot_p = NULL;
+	char key_s [S_PLOT_POSITION_KEY_SIZE];
+	const json_t *index_p;
+
+	GetPlotPositionKey (key_s, row, column);
+
+	index_p = json_object_get (import_p -> pi_positions_p, key_s);
+
+	if (index_p)
+		{
+			imported_plot_p = (import_p -> pi_plots_p) + json_integer_value (index_p);
+		}
+	else
+		{
+			Plot *plot_p = CreatePlotFromTableRow (table_row_p, row, column, study_p, data_p);
+
+			if (plot_p)
+				{
+					PlotNode *node_p = AllocatePlotNode (plot_p);
+
+					if (node_p)
+						{
+							/*
+							 * The Study now owns the Plot
+							 */
+							LinkedListAddTail (study_p -> st_plots_p, & (node_p -> pn_node));
+
+							imported_plot_p = AddPlotToPlotImport (import_p, plot_p);
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add plot at \"%s\" to study's list", key_s);
+							FreePlot (plot_p);
+						}
+				}
+
+		}		/* if (index_p) else */
+
+	return imported_plot_p;
+}
+
+
+static bool AddTableRowToPlotImport (ServiceJob *job_p, PlotTableRow *table_row_p, const size_t index, PlotImport *import_p, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	bool imported_row_flag = false;
+	const char *gene_bank_s = GetPlotTableRowGeneBankName (table_row_p);
+	const json_t *accessions_p = json_object_get (import_p -> pi_materials_p, gene_bank_s);
+
+	if (accessions_p)
+		{
+			const char *accession_s = GetPlotTableRowValue (table_row_p, PTC_ACCESSION);
+
+			if (!IsStringEmpty (accession_s))
+				{
+					const json_t *material_json_p = json_object_get (accessions_p, accession_s);
+					Material *material_p = json_is_object (material_json_p) ? GetMaterialFromJSON (material_json_p, VF_STORAGE, data_p) : NULL;
+
+					if (material_p)
+						{
+							int32 row = -1;
+
+							if (GetPlotTableRowInteger (table_row_p, PTC_ROW, &row))
+								{
+									int32 column = -1;
+
+									if (GetPlotTableRowInteger (table_row_p, PTC_COLUMN, &column))
+										{
+											/*
+											 * does the plot already exist?
+											 */
+											ImportedPlot *imported_plot_p = GetImportedPlot (import_p, table_row_p, row, column, study_p, data_p);
+
+											if (imported_plot_p)
+												{
+													Plot *plot_p = imported_plot_p -> ip_plot_p;
+
+													/*
+													 * plot_p now has an id, so we can add the row/rack.
+													 */
+													int32 rack_plotwise_index = -1;
+
+													if (GetPlotTableRowInteger (table_row_p, PTC_RACK, &rack_plotwise_index))
+														{
+															int32 rack_studywise_index = -1;
+
+															if (GetPlotTableRowInteger (table_row_p, PTC_INDEX, &rack_studywise_index))
+																{
+																	int32 replicate = 1;
+																	const char *rep_s = GetPlotTableRowValue (table_row_p, PTC_REPLICATE);
+																	bool control_rep_flag = false;
+																	bool rep_flag = true;
+
+																	if (!IsStringEmpty (rep_s))
+																		{
+																			if (Stricmp (rep_s, RO_REPLICATE_CONTROL_S) == 0)
+																				{
+																					control_rep_flag = true;
+																				}
+																			else
+																				{
+																					rep_flag = GetValidInteger (&rep_s, &replicate);
+																				}		/* if (value_s) */
+																		}
+
+																	if (rep_flag)
+																		{
+																			Row *row_p = GetRowFromPlotByStudyIndex (plot_p, rack_studywise_index);
+																			bool is_existing_row_flag = true;
+																			const MEM_FLAG material_mem = MF_SHALLOW_COPY;
+
+																			if (row_p)
+																				{
+																					/*
+																					 * update existing row
+																					 */
+																					UpdateRow (row_p, rack_plotwise_index, material_p, material_mem, control_rep_flag, replicate);
+																				}
+																			else
+																				{
+																					row_p = AllocateRow (NULL, rack_plotwise_index, rack_studywise_index, replicate, material_p, material_mem, plot_p);
+																					is_existing_row_flag = false;
+																				}
+
+																			if (row_p)
+																				{
+																					/*
+																					 * The row now owns the material
+																					 */
+																					material_p = NULL;
+
+																					AddPlotTableRowValuesToRow (row_p, table_row_p, import_p, study_p, data_p);
+
+																					if (control_rep_flag)
+																						{
+																							SetRowGenotypeControl (row_p, true);
+																						}
+
+																					if (is_existing_row_flag || (AddRowToPlot (plot_p, row_p)))
+																						{
+																							/*
+																							 * Remember the row so that any error when the plot
+																							 * is saved can be reported against it.
+																							 */
+																							if (json_array_append_new (imported_plot_p -> ip_table_rows_p, json_integer (index)) == 0)
+																								{
+																									imported_row_flag = true;
+																								}
+																							else
+																								{
+																									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add table row " SIZET_FMT " to plot import", index);
+																								}
+																						}
+																					else
+																						{
+																							FreeRow (row_p);
+																						}
+
+																				}
+																			else
+																				{
+																					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate row for table row " SIZET_FMT, index);
+																				}
+
+																		}		/* if (rep_flag) */
+																	else
+																		{
+																			AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, "Invalid value", index, PL_REPLICATE_TITLE_S);
+																			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Invalid \"%s\" for table row " SIZET_FMT, PL_REPLICATE_TITLE_S, index);
+																		}
+
+																}		/* if (GetPlotTableRowInteger (table_row_p, PTC_INDEX, &rack_studywise_index)) */
+															else
+																{
+																	AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, "Value not set", index, PL_INDEX_TABLE_TITLE_S);
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get \"%s\" for table row " SIZET_FMT, PL_INDEX_TABLE_TITLE_S, index);
+																}
+
+														}		/* if (GetPlotTableRowInteger (table_row_p, PTC_RACK, &rack_plotwise_index)) */
+													else
+														{
+															AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, "Value not set", index, S_RACK_TITLE_S);
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get \"%s\" for table row " SIZET_FMT, S_RACK_TITLE_S, index);
+														}
+
+												}		/* if (imported_plot_p) */
+
+										}		/* if (GetPlotTableRowInteger (table_row_p, PTC_COLUMN, &column)) */
+									else
+										{
+											AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, "Value not set", index, S_COLUMN_TITLE_S);
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get \"%s\" for table row " SIZET_FMT, S_COLUMN_TITLE_S, index);
+										}
+
+								}		/* if (GetPlotTableRowInteger (table_row_p, PTC_ROW, &row)) */
+							else
+								{
+									AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, "Value not set", index, S_ROW_TITLE_S);
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get \"%s\" for table row " SIZET_FMT, S_ROW_TITLE_S, index);
+								}
+
+							if (material_p)
+								{
+									FreeMaterial (material_p);
+								}
+
+						}		/* if (material_p) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get Material with internal name \"%s\" for area \"%s\"", accession_s, study_p -> st_name_s);
+						}
+
+				}		/* if (accession_s) */
+			else
+				{
+					AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, "Value not set", index, PL_ACCESSION_TABLE_TITLE_S);
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get \"%s\" for table row " SIZET_FMT, PL_ACCESSION_TABLE_TITLE_S, index);
+				}
+
+		}		/* if (accessions_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get gene bank \"%s\" for table row " SIZET_FMT, gene_bank_s, index);
+		}
+
+	return imported_row_flag;
+}
+
+
+/*
+ * Add the values of any treatment factor and phenotype columns in
+ * a table row to a Row.
+ */
+static OperationStatus AddPlotTableRowValuesToRow (Row *row_p, PlotTableRow *table_row_p, PlotImport *import_p, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	OperationStatus status = OS_IDLE;
+
+	if (table_row_p -> ptr_json_p)
+		{
+			json_t *table_row_json_p = table_row_p -> ptr_json_p;
+
+			/*
+			 * Remove any of the normal plot keys
+			 */
+			json_object_del (table_row_json_p, S_SOWING_TITLE_S);
+			json_object_del (table_row_json_p, S_HARVEST_TITLE_S);
+			json_object_del (table_row_json_p, S_WIDTH_TITLE_S);
+			json_object_del (table_row_json_p, S_LENGTH_TITLE_S);
+			json_object_del (table_row_json_p, PL_INDEX_TABLE_TITLE_S);
+			json_object_del (table_row_json_p, S_ROW_TITLE_S);
+			json_object_del (table_row_json_p, S_COLUMN_TITLE_S);
+			json_object_del (table_row_json_p, S_RACK_TITLE_S);
+			json_object_del (table_row_json_p, PL_ACCESSION_TABLE_TITLE_S);
+			json_object_del (table_row_json_p, S_GENE_BANK_S);
+			json_object_del (table_row_json_p, S_TREATMENT_TITLE_S);
+			json_object_del (table_row_json_p, PL_REPLICATE_TITLE_S);
+			json_object_del (table_row_json_p, S_COMMENT_TITLE_S);
+			json_object_del (table_row_json_p, S_IMAGE_TITLE_S);
+			json_object_del (table_row_json_p, S_THUMBNAIL_TITLE_S);
+			json_object_del (table_row_json_p, S_SOWING_ORDER_TITLE_S);
+			json_object_del (table_row_json_p, S_WALKING_ORDER_TITLE_S);
+
+			/*
+			 * If there are any columns left, try to add them as treatments and observations
+			 */
+			if (json_object_size (table_row_json_p) > 0)
+				{
+					AddTreatmentFactorValuesToRow (row_p, table_row_json_p, study_p, data_p);
+
+					status = AddObservationValuesToRow (row_p, table_row_json_p, import_p -> pi_phenotype_columns_p, import_p -> pi_trait_statistics_p, study_p, data_p);
+				}
+		}
+	else
+		{
+			const PlotTableLayout *layout_p = table_row_p -> ptr_layout_p;
+
+			/*
+			 * The standard columns were left out of the layout's value columns
+			 */
+			status = AddDelimitedTableValuesToRow (row_p, table_row_p -> ptr_reader_p, layout_p -> ptl_value_columns_p, layout_p -> ptl_num_columns, import_p -> pi_trait_statistics_p, data_p);
+		}
+
+	return status;
+}
+
+
+/*
+ * Write all of the Plots that have had rows added to them using
+ * one unordered bulk upsert per batch. Any rows whose Plot failed
+ * to save are reported on the ServiceJob.
+ *
+ * Returns the number of table rows that were saved.
+ */
+static size_t SavePlotImport (ServiceJob *job_p, PlotImport *import_p, json_t **cached_plots_pp, const FieldTrialServiceData *data_p)
+{
+	size_t num_imported = 0;
+	size_t num_to_save = 0;
+	size_t i;
+	ImportedPlot *imported_plot_p = import_p -> pi_plots_p;
+
+	for (i = 0; i < import_p -> pi_num_plots; ++ i, ++ imported_plot_p)
+		{
+			if (json_array_size (imported_plot_p -> ip_table_rows_p) > 0)
+				{
+					++ num_to_save;
+				}
+		}
+
+	if (num_to_save > 0)
+		{
+			Plot **plots_pp = (Plot **) AllocMemoryArray (num_to_save, sizeof (Plot *));
+
+			if (plots_pp)
+				{
+					bool *saved_flags_p = (bool *) AllocMemoryArray (num_to_save, sizeof (bool));
+
+					if (saved_flags_p)
+						{
+							size_t j = 0;
+							bool observations_flag = true;
+
+							imported_plot_p = import_p -> pi_plots_p;
+
+							for (i = 0; i < import_p -> pi_num_plots; ++ i, ++ imported_plot_p)
+								{
+									if (json_array_size (imported_plot_p -> ip_table_rows_p) > 0)
+										{
+											* (plots_pp + j) = imported_plot_p -> ip_plot_p;
+											++ j;
+										}
+								}
+
+							SavePlots (plots_pp, saved_flags_p, num_to_save, &observations_flag, data_p);
+
+							if (!observations_flag)
+								{
+									AddGeneralErrorMessageToServiceJob (job_p, "The plots were saved but their observations could not be added to the Observations collection");
+								}
+
+							j = 0;
+							imported_plot_p = import_p -> pi_plots_p;
+
+							for (i = 0; i < import_p -> pi_num_plots; ++ i, ++ imported_plot_p)
+								{
+									if (json_array_size (imported_plot_p -> ip_table_rows_p) > 0)
+										{
+											imported_plot_p -> ip_saved_flag = * (saved_flags_p + j);
+											++ j;
+										}
+								}
+
+							FreeMemory (saved_flags_p);
+						}		/* if (saved_flags_p) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " plot save flags", num_to_save);
+						}
+
+					FreeMemory (plots_pp);
+				}		/* if (plots_pp) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " plots to save", num_to_save);
+				}
+
+		}		/* if (num_to_save > 0) */
+
+
+	/*
+	 * Report the outcome of each row
+	 */
+	if (import_p -> pi_plots_p)
+		{
+			imported_plot_p = import_p -> pi_plots_p;
+
+			for (i = 0; i < import_p -> pi_num_plots; ++ i, ++ imported_plot_p)
+				{
+					const size_t num_rows = json_array_size (imported_plot_p -> ip_table_rows_p);
+
+					if (num_rows > 0)
+						{
+							if (imported_plot_p -> ip_saved_flag)
+								{
+									num_imported += num_rows;
+
+									if (*cached_plots_pp)
+										{
+											if (!AddPlotToCachedStudyPatch (*cached_plots_pp, imported_plot_p -> ip_plot_p, data_p))
+												{
+													json_decref (*cached_plots_pp);
+													*cached_plots_pp = NULL;
+												}
+										}
+								}
+							else
+								{
+									size_t j;
+									const json_t *row_index_p;
+
+									json_array_foreach (imported_plot_p -> ip_table_rows_p, j, row_index_p)
+										{
+											AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, "Failed to save plot", (size_t) json_integer_value (row_index_p), NULL);
+										}
+								}
+
+						}		/* if (num_rows > 0) */
+
+				}		/* for (i = 0; i < import_p -> pi_num_plots; ++ i, ++ imported_plot_p) */
+
+		}		/* if (import_p -> pi_plots_p) */
+
+	return num_imported;
+}
+
+
+size_t SavePlots (Plot **plots_pp, bool *saved_flags_p, const size_t num_plots, bool *observations_flag_p, const FieldTrialServiceData *data_p)
+{
+	size_t num_saved = 0;
+	size_t i;
+	int batch_size = S_DEFAULT_PLOT_IMPORT_BATCH_SIZE;
+
+	*observations_flag_p = true;
+
+	if ((!GetJSONInteger (data_p -> dftsd_base_data.sd_config_p, "plot_import_batch_size", &batch_size)) || (batch_size < 1))
+		{
+			batch_size = S_DEFAULT_PLOT_IMPORT_BATCH_SIZE;
+		}
+
+	for (i = 0; i < num_plots; i += (size_t) batch_size)
+		{
+			const size_t num_left = num_plots - i;
+			const size_t num_in_batch = (num_left < (size_t) batch_size) ? num_left : (size_t) batch_size;
+			size_t num_upserted = 0;
+
+			/*
+			 * Large plots may not all fit into a single command
+			 * so keep going until the whole batch has been sent.
+			 */
+			while (num_upserted < num_in_batch)
+				{
+					num_upserted += UpsertPlots (plots_pp + i + num_upserted, saved_flags_p + i + num_upserted, num_in_batch - num_upserted, data_p);
+				}
+
+			/*
+			 * The Plots have been saved even if the Observations collection
+			 * couldn't be updated, so this is reported separately.
+			 */
+			if (!SavePlotsToObservationsCollection (plots_pp + i, saved_flags_p + i, num_in_batch, data_p))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write the observations for " SIZET_FMT " plots through to \"%s\"", num_in_batch, data_p -> dftsd_collection_ss [DFTD_OBSERVATION]);
+					*observations_flag_p = false;
+				}
+		}
+
+	for (i = 0; i < num_plots; ++ i)
+		{
+			if (* (saved_flags_p + i))
+				{
+					++ num_saved;
+				}
+		}
+
+	return num_saved;
+}
+
+
+/*
+ * Upsert a batch of Plots with a single unordered update command
+ * and mark each one that was saved successfully. The command stops
+ * growing before it would go over S_MAX_UPSERT_COMMAND_SIZE, so this
+ * returns the number of Plots at the start of the batch that were
+ * dealt with. This is always at least one.
+ */
+static size_t UpsertPlots (Plot **plots_pp, bool *saved_flags_p, const size_t num_plots, const FieldTrialServiceData *data_p)
+{
+	/*
+	 * The indexes of the plots that made it into the command, in the
+	 * same order, so that any write errors can be matched back to them.
+	 */
+	size_t *sent_indexes_p = (size_t *) AllocMemoryArray (num_plots, sizeof (size_t));
+	size_t num_handled = num_plots;
+	size_t i;
+
+	for (i = 0; i < num_plots; ++ i)
+		{
+			* (saved_flags_p + i) = false;
+		}
+
+	if (sent_indexes_p)
+		{
+			bson_t *command_p = bson_new ();
+
+			if (command_p)
+				{
+					bson_t updates;
+					uint32 num_sent = 0;
+
+					if ((BSON_APPEND_UTF8 (command_p, "update", data_p -> dftsd_collection_ss [DFTD_PLOT])) && (BSON_APPEND_ARRAY_BEGIN (command_p, "updates", &updates)))
+						{
+							bool success_flag = true;
+
+							for (i = 0; i < num_handled; ++ i)
+								{
+									Plot *plot_p = * (plots_pp + i);
+									json_t *plot_json_p = GetPlotAsJSON (plot_p, VF_STORAGE, NULL, data_p);
+
+									if (plot_json_p)
+										{
+											bson_t *plot_bson_p = ConvertJSONToBSON (plot_json_p);
+
+											if (plot_bson_p && (num_sent > 0) && (command_p -> len + plot_bson_p -> len + S_UPSERT_ENTRY_OVERHEAD > S_MAX_UPSERT_COMMAND_SIZE))
+												{
+													/*
+													 * Leave this plot and the rest of the batch for the next command
+													 */
+													num_handled = i;
+												}
+											else if (plot_bson_p)
+												{
+													char index_buffer [16];
+													const char *index_s;
+													bson_t update;
+
+													bson_uint32_to_string (num_sent, &index_s, index_buffer, sizeof (index_buffer));
+
+													if (BSON_APPEND_DOCUMENT_BEGIN (&updates, index_s, &update))
+														{
+															bson_t query;
+
+															if (BSON_APPEND_DOCUMENT_BEGIN (&update, "q", &query))
+																{
+																	if (!BSON_APPEND_OID (&query, MONGO_ID_S, plot_p -> pl_id_p))
+																		{
+																			success_flag = false;
+																		}
+
+																	if (!bson_append_document_end (&update, &query))
+																		{
+																			success_flag = false;
+																		}
+																}
+															else
+																{
+																	success_flag = false;
+																}
+
+															if (success_flag)
+																{
+																	success_flag = (BSON_APPEND_DOCUMENT (&update, "u", plot_bson_p)) && (BSON_APPEND_BOOL (&update, "upsert", true));
+																}
+
+															if (!bson_append_document_end (&updates, &update))
+																{
+																	success_flag = false;
+																}
+
+															if (success_flag)
+																{
+																	* (sent_indexes_p + num_sent) = i;
+																	++ num_sent;
+																}
+														}
+													else
+														{
+															success_flag = false;
+														}
+
+												}		/* else if (plot_bson_p) */
+											else
+												{
+													PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, plot_json_p, "Failed to convert plot to BSON");
+												}
+
+											if (plot_bson_p)
+												{
+													bson_destroy (plot_bson_p);
+												}
+
+											json_decref (plot_json_p);
+										}		/* if (plot_json_p) */
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get plot at [" UINT32_FMT ", " UINT32_FMT "] as JSON", plot_p -> pl_row_index, plot_p -> pl_column_index);
+										}
+
+								}		/* for (i = 0; i < num_handled; ++ i) */
+
+							/*
+							 * A partially-built update would leave the command
+							 * in an unknown state so don't send any of it.
+							 */
+							if (!bson_append_array_end (command_p, &updates))
+								{
+									success_flag = false;
+								}
+
+							if (success_flag && (num_sent > 0))
+								{
+									if (BSON_APPEND_BOOL (command_p, "ordered", false))
+										{
+											bson_t *reply_p = NULL;
+
+											if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p))
+												{
+													for (i = 0; i < num_sent; ++ i)
+														{
+															* (saved_flags_p + * (sent_indexes_p + i)) = true;
+														}
+
+													if (reply_p)
+														{
+															json_t *reply_json_p = ConvertBSONToJSON (reply_p);
+
+															if (reply_json_p)
+																{
+																	const json_t *write_errors_p = json_object_get (reply_json_p, "writeErrors");
+
+																	if (write_errors_p)
+																		{
+																			const json_t *write_error_p;
+
+																			json_array_foreach (write_errors_p, i, write_error_p)
+																				{
+																					const json_t *index_p = json_object_get (write_error_p, "index");
+
+																					if (json_is_integer (index_p))
+																						{
+																							const json_int_t index = json_integer_value (index_p);
+
+																							if ((index >= 0) && (index < num_sent))
+																								{
+																									* (saved_flags_p + * (sent_indexes_p + index)) = false;
+																								}
+																						}
+
+																					PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, write_error_p, "Failed to save plot");
+																				}
+																		}
+
+																	json_decref (reply_json_p);
+																}		/* if (reply_json_p) */
+
+															bson_destroy (reply_p);
+														}		/* if (reply_p) */
+
+												}		/* if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p)) */
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to save " UINT32_FMT " plots", num_sent);
+												}
+										}
+
+								}		/* if (success_flag && (num_sent > 0)) */
+							else if (!success_flag)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to build the command to save " SIZET_FMT " plots", num_handled);
+								}
+
+						}		/* if ((BSON_APPEND_UTF8 (command_p, "update", ...)) && (BSON_APPEND_ARRAY_BEGIN (command_p, "updates", &updates))) */
+
+					bson_destroy (command_p);
+				}		/* if (command_p) */
+
+			FreeMemory (sent_indexes_p);
+		}		/* if (sent_indexes_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " plots to save", num_plots);
+		}
+
+	return num_handled;
+}
+
+
+/*
+ * Check a plot table without saving anything. The independent checks are
+ * shared between a pool of worker threads and any problems are reported
+ * on the ServiceJob along with a summary in its metadata.
+ */
+static bool ValidatePlotsTable (ServiceJob *job_p, const json_t *plots_json_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	PlotTableValidator validator;
+	struct timespec start_time;
+	int num_threads = S_DEFAULT_NUM_VALIDATION_THREADS;
+	uint32 num_started = 0;
+
+	clock_gettime (CLOCK_MONOTONIC, &start_time);
+
+	if ((!GetJSONInteger (data_p -> dftsd_base_data.sd_config_p, "plot_validation_threads", &num_threads)) || (num_threads < 1))
+		{
+			num_threads = S_DEFAULT_NUM_VALIDATION_THREADS;
+		}
+
+	if (InitPlotTableValidator (&validator, plots_json_p, data_p, GetGrassrootsServerFromService (job_p -> sj_service_p)))
+		{
+			pthread_t *threads_p = NULL;
+			size_t i;
+			const json_t *error_p;
+
+			if ((size_t) num_threads > validator.ptv_num_tasks)
+				{
+					num_threads = (int) validator.ptv_num_tasks;
+				}
+
+			if (num_threads > 0)
+				{
+					threads_p = (pthread_t *) AllocMemoryArray (num_threads, sizeof (pthread_t));
+
+					if (threads_p)
+						{
+							int j;
+
+							for (j = 0; j < num_threads; ++ j)
+								{
+									if (pthread_create (threads_p + num_started, NULL, RunPlotTableValidationWorker, &validator) == 0)
+										{
+											++ num_started;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to start plot validation thread %d", j);
+										}
+								}
+
+							for (j = 0; j < (int) num_started; ++ j)
+								{
+									pthread_join (* (threads_p + j), NULL);
+								}
+
+							FreeMemory (threads_p);
+						}		/* if (threads_p) */
+
+					/*
+					 * If we couldn't start any threads, do the work ourselves
+					 */
+					if (num_started == 0)
+						{
+							RunPlotTableValidationWorker (&validator);
+						}
+
+				}		/* if (num_threads > 0) */
+
+			/*
+			 * The clashes need all of the rows so are checked once
+			 * the workers have finished.
+			 */
+			CheckPlotTableClashes (&validator);
+
+			json_array_foreach (validator.ptv_errors_p, i, error_p)
+				{
+					const json_int_t row = json_integer_value (json_object_get (error_p, S_VALIDATION_ROW_S));
+					const char *column_s = GetJSONString (error_p, S_VALIDATION_COLUMN_S);
+					const char *message_s = GetJSONString (error_p, S_VALIDATION_ERROR_S);
+
+					AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, message_s, (size_t) row, column_s);
+				}
+
+			if (validator.ptv_num_incomplete_checks == 0)
+				{
+					success_flag = true;
+				}
+
+			SetPlotTableValidationMetadata (job_p, &validator, num_started, &start_time);
+
+			SetServiceJobStatus (job_p, (json_array_size (validator.ptv_errors_p) == 0) && success_flag ? OS_SUCCEEDED : OS_FAILED);
+
+			ClearPlotTableValidator (&validator);
+		}		/* if (InitPlotTableValidator (&validator, plots_json_p, data_p, grassroots_p)) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set up plot table validation");
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Collect the distinct headings and accessions so that each one is
+ * only checked once, and work out the tasks for the worker threads.
+ */
+static bool InitPlotTableValidator (PlotTableValidator *validator_p, const json_t *plots_json_p, const FieldTrialServiceData *data_p, GrassrootsServer *grassroots_p)
+{
+	memset (validator_p, 0, sizeof (PlotTableValidator));
+
+	validator_p -> ptv_table_p = plots_json_p;
+	validator_p -> ptv_num_rows = json_array_size (plots_json_p);
+	validator_p -> ptv_data_p = data_p;
+	validator_p -> ptv_grassroots_p = grassroots_p;
+
+	if (((validator_p -> ptv_heading_rows_p = json_object ()) != NULL) &&
+			((validator_p -> ptv_headings_p = json_array ()) != NULL) &&
+			((validator_p -> ptv_accessions_p = json_object ()) != NULL) &&
+			((validator_p -> ptv_gene_banks_p = json_array ()) != NULL) &&
+			((validator_p -> ptv_errors_p = json_array ()) != NULL) &&
+			((validator_p -> ptv_new_accessions_p = json_array ()) != NULL))
+		{
+			bool success_flag = true;
+
+			if (validator_p -> ptv_num_rows > 0)
+				{
+					validator_p -> ptv_positions_p = (PlotTablePosition *) AllocMemoryArray (validator_p -> ptv_num_rows, sizeof (PlotTablePosition));
+
+					if (!validator_p -> ptv_positions_p)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " plot table positions", validator_p -> ptv_num_rows);
+							success_flag = false;
+						}
+				}
+
+			if (success_flag)
+				{
+					size_t i;
+					const json_t *table_row_json_p;
+
+					json_array_foreach (plots_json_p, i, table_row_json_p)
+						{
+							const char *key_s;
+							json_t *value_p;
+							const char *accession_s = GetJSONString (table_row_json_p, PL_ACCESSION_TABLE_TITLE_S);
+
+							json_object_foreach ((json_t *) table_row_json_p, key_s, value_p)
+								{
+									if ((!IsStandardPlotTableHeading (key_s)) && (!json_object_get (validator_p -> ptv_heading_rows_p, key_s)))
+										{
+											if ((json_object_set_new (validator_p -> ptv_heading_rows_p, key_s, json_integer (i)) != 0) ||
+													(json_array_append_new (validator_p -> ptv_headings_p, json_string (key_s)) != 0))
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add heading \"%s\" to validator", key_s);
+													success_flag = false;
+												}
+										}
+								}
+
+							if (!IsStringEmpty (accession_s))
+								{
+									const char *gene_bank_s = GetTableRowGeneBankName (table_row_json_p);
+
+									if (!AddPlotTableValidationAccession (validator_p, gene_bank_s, accession_s, i))
+										{
+											success_flag = false;
+										}
+								}
+
+						}		/* json_array_foreach (plots_json_p, i, table_row_json_p) */
+
+					if (success_flag)
+						{
+							if (pthread_mutex_init (& (validator_p -> ptv_lock), NULL) == 0)
+								{
+									validator_p -> ptv_lock_flag = true;
+
+									validator_p -> ptv_num_row_tasks = (validator_p -> ptv_num_rows + S_NUM_ROWS_PER_VALIDATION_TASK - 1) / S_NUM_ROWS_PER_VALIDATION_TASK;
+									validator_p -> ptv_num_tasks = validator_p -> ptv_num_row_tasks + json_array_size (validator_p -> ptv_headings_p) + json_array_size (validator_p -> ptv_gene_banks_p);
+
+									return true;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to initialise plot validation lock");
+								}
+						}
+
+				}		/* if (success_flag) */
+
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate plot validation data");
+		}
+
+	ClearPlotTableValidator (validator_p);
+
+	return false;
+}
+
+
+static void ClearPlotTableValidator (PlotTableValidator *validator_p)
+{
+	if (validator_p -> ptv_lock_flag)
+		{
+			pthread_mutex_destroy (& (validator_p -> ptv_lock));
+			validator_p -> ptv_lock_flag = false;
+		}
+
+	if (validator_p -> ptv_positions_p)
+		{
+			FreeMemory (validator_p -> ptv_positions_p);
+			validator_p -> ptv_positions_p = NULL;
+		}
+
+	json_decref (validator_p -> ptv_heading_rows_p);
+	validator_p -> ptv_heading_rows_p = NULL;
+
+	json_decref (validator_p -> ptv_headings_p);
+	validator_p -> ptv_headings_p = NULL;
+
+	json_decref (validator_p -> ptv_accessions_p);
+	validator_p -> ptv_accessions_p = NULL;
+
+	json_decref (validator_p -> ptv_gene_banks_p);
+	validator_p -> ptv_gene_banks_p = NULL;
+
+	json_decref (validator_p -> ptv_errors_p);
+	validator_p -> ptv_errors_p = NULL;
+
+	json_decref (validator_p -> ptv_new_accessions_p);
+	validator_p -> ptv_new_accessions_p = NULL;
+}
+
+
+/*
+ * Record the table row that uses an accession. The accessions are
+ * stored by gene bank name and then by accession with the values being
+ * arrays of the table row indexes.
+ */
+static bool AddPlotTableValidationAccession (PlotTableValidator *validator_p, const char *gene_bank_s, const char *accession_s, const size_t index)
+{
+	json_t *accessions_p = json_object_get (validator_p -> ptv_accessions_p, gene_bank_s);
+
+	if (!accessions_p)
+		{
+			if ((accessions_p = json_object ()) != NULL)
+				{
+					if (json_object_set_new (validator_p -> ptv_accessions_p, gene_bank_s, accessions_p) == 0)
+						{
+							if (json_array_append_new (validator_p -> ptv_gene_banks_p, json_string (gene_bank_s)) != 0)
+								{
+									accessions_p = NULL;
+								}
+						}
+					else
+						{
+							accessions_p = NULL;
+						}
+				}
+		}
+
+	if (accessions_p)
+		{
+			json_t *rows_p = json_object_get (accessions_p, accession_s);
+
+			if (!rows_p)
+				{
+					if ((rows_p = json_array ()) != NULL)
+						{
+							if (json_object_set_new (accessions_p, accession_s, rows_p) != 0)
+								{
+									rows_p = NULL;
+								}
+						}
+				}
+
+			if (rows_p)
+				{
+					if (json_array_append_new (rows_p, json_integer (index)) == 0)
+						{
+							return true;
+						}
+				}
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add accession \"%s\" in gene bank \"%s\" to validator", accession_s, gene_bank_s);
+
+	return false;
+}
+
+
+static void *RunPlotTableValidationWorker (void *data_p)
+{
+	PlotTableValidator *validator_p = (PlotTableValidator *) data_p;
+
+	FieldTrialServiceData *worker_data_p = AllocateWorkerServiceData (validator_p -> ptv_data_p, validator_p -> ptv_grassroots_p);
+
+	if (worker_data_p)
+		{
+			bool loop_flag = true;
+
+			while (loop_flag)
+				{
+					size_t task;
+
+					pthread_mutex_lock (& (validator_p -> ptv_lock));
+					task = (validator_p -> ptv_next_task) ++;
+					pthread_mutex_unlock (& (validator_p -> ptv_lock));
+
+					if (task < validator_p -> ptv_num_tasks)
+						{
+							RunPlotTableValidationTask (validator_p, task, worker_data_p);
+						}
+					else
+						{
+							loop_flag = false;
+						}
+
+				}		/* while (loop_flag) */
+
+			FreeWorkerServiceData (worker_data_p);
+		}		/* if (worker_data_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set up the service data for plot validation");
+		}
+
+	return NULL;
+}
+
+
+/*
+ * The tasks are the blocks of rows, followed by the distinct
+ * headings and then the distinct gene banks.
+ */
+static void RunPlotTableValidationTask (PlotTableValidator *validator_p, size_t task, const FieldTrialServiceData *data_p)
+{
+	if (task < validator_p -> ptv_num_row_tasks)
+		{
+			size_t i = task * S_NUM_ROWS_PER_VALIDATION_TASK;
+			size_t end = i + S_NUM_ROWS_PER_VALIDATION_TASK;
+
+			if (end > validator_p -> ptv_num_rows)
+				{
+					end = validator_p -> ptv_num_rows;
+				}
+
+			for ( ; i < end; ++ i)
+				{
+					ValidatePlotTableRow (validator_p, i);
+				}
+		}
+	else
+		{
+			const size_t num_headings = json_array_size (validator_p -> ptv_headings_p);
+
+			task -= validator_p -> ptv_num_row_tasks;
+
+			if (task < num_headings)
+				{
+					ValidatePlotTableHeading (validator_p, task, data_p);
+				}
+			else
+				{
+					ValidatePlotTableGeneBank (validator_p, task - num_headings, data_p);
+				}
+		}
+}
+
+
+static void ValidatePlotTableRow (PlotTableValidator *validator_p, const size_t index)
+{
+	const json_t *table_row_json_p = json_array_get (validator_p -> ptv_table_p, index);
+	PlotTablePosition *position_p = (validator_p -> ptv_positions_p) + index;
+
+	position_p -> ptp_valid_flag = false;
+
+	if (json_object_size (table_row_json_p) > 0)
+		{
+			const char *rep_s = GetJSONString (table_row_json_p, PL_REPLICATE_TITLE_S);
+			bool valid_flag = true;
+
+			if (IsStringEmpty (GetJSONString (table_row_json_p, PL_ACCESSION_TABLE_TITLE_S)))
+				{
+					AddPlotTableValidationError (validator_p, index, PL_ACCESSION_TABLE_TITLE_S, "Value not set");
+				}
+
+			if (!ValidatePlotTableInteger (validator_p, table_row_json_p, index, S_ROW_TITLE_S, & (position_p -> ptp_row)))
+				{
+					valid_flag = false;
+				}
+
+			if (!ValidatePlotTableInteger (validator_p, table_row_json_p, index, S_COLUMN_TITLE_S, & (position_p -> ptp_column)))
+				{
+					valid_flag = false;
+				}
+
+			if (!ValidatePlotTableInteger (validator_p, table_row_json_p, index, S_RACK_TITLE_S, & (position_p -> ptp_rack)))
+				{
+					valid_flag = false;
+				}
+
+			if (!ValidatePlotTableInteger (validator_p, table_row_json_p, index, PL_INDEX_TABLE_TITLE_S, & (position_p -> ptp_study_index)))
+				{
+					valid_flag = false;
+				}
+
+			if (!IsStringEmpty (rep_s))
+				{
+					if (Stricmp (rep_s, RO_REPLICATE_CONTROL_S) != 0)
+						{
+							int32 replicate;
+
+							if (!GetValidInteger (&rep_s, &replicate))
+								{
+									AddPlotTableValidationError (validator_p, index, PL_REPLICATE_TITLE_S, "Invalid value");
+								}
+						}
+				}
+
+			position_p -> ptp_valid_flag = valid_flag;
+		}		/* if (json_object_size (table_row_json_p) > 0) */
+}
+
+
+static bool ValidatePlotTableInteger (PlotTableValidator *validator_p, const json_t *table_row_json_p, const size_t index, const char *key_s, int32 *value_p)
+{
+	bool success_flag = GetJSONStringAsInteger (table_row_json_p, key_s, value_p);
+
+	if (!success_flag)
+		{
+			const char *value_s = GetJSONString (table_row_json_p, key_s);
+
+			AddPlotTableValidationError (validator_p, index, key_s, IsStringEmpty (value_s) ? "Value not set" : "Invalid value");
+		}
+
+	return success_flag;
+}
+
+
+static void ValidatePlotTableHeading (PlotTableValidator *validator_p, const size_t index, const FieldTrialServiceData *data_p)
+{
+	const char *heading_s = json_string_value (json_array_get (validator_p -> ptv_headings_p, index));
+
+	if (!IsKnownRowColumnHeading (heading_s, data_p))
+		{
+			/*
+			 * Report it against the first row that uses it
+			 */
+			const json_int_t row = json_integer_value (json_object_get (validator_p -> ptv_heading_rows_p, heading_s));
+
+			AddPlotTableValidationError (validator_p, (size_t) row, heading_s, "Unknown column heading");
+		}
+}
+
+
+static void ValidatePlotTableGeneBank (PlotTableValidator *validator_p, const size_t index, const FieldTrialServiceData *data_p)
+{
+	const char *gene_bank_s = json_string_value (json_array_get (validator_p -> ptv_gene_banks_p, index));
+	const json_t *accessions_p = json_object_get (validator_p -> ptv_accessions_p, gene_bank_s);
+	GeneBank *gene_bank_p = GetGeneBankByName (gene_bank_s, data_p);
+
+	if (gene_bank_p)
+		{
+			json_t *materials_p = json_object ();
+
+			if (materials_p)
+				{
+					const char *accession_s;
+					json_t *rows_p;
+					bool success_flag = true;
+
+					json_object_foreach ((json_t *) accessions_p, accession_s, rows_p)
+						{
+							if (json_object_set_new (materials_p, accession_s, json_null ()) != 0)
+								{
+									success_flag = false;
+								}
+						}
+
+					if (success_flag)
+						{
+							success_flag = GetMaterialsByAccession (materials_p, gene_bank_p, data_p);
+						}
+
+					if (success_flag)
+						{
+							json_t *material_p;
+
+							/*
+							 * Any accessions that don't exist yet will be created by the
+							 * import, so they're noted rather than being errors.
+							 */
+							json_object_foreach (materials_p, accession_s, material_p)
+								{
+									if (json_is_null (material_p))
+										{
+											AddPlotTableValidationNewAccession (validator_p, gene_bank_s, accession_s);
+										}
+								}
+						}
+					else
+						{
+							AddPlotTableValidationGeneBankErrors (validator_p, accessions_p, PL_ACCESSION_TABLE_TITLE_S, "Failed to check accession");
+						}
+
+					json_decref (materials_p);
+				}		/* if (materials_p) */
+			else
+				{
+					AddPlotTableValidationGeneBankErrors (validator_p, accessions_p, PL_ACCESSION_TABLE_TITLE_S, "Failed to check accession");
+				}
+
+			FreeGeneBank (gene_bank_p);
+		}		/* if (gene_bank_p) */
+	else
+		{
+			AddPlotTableValidationGeneBankErrors (validator_p, accessions_p, S_GENE_BANK_S, "Unknown gene bank");
+		}
+}
+
+
+static void AddPlotTableValidationGeneBankErrors (PlotTableValidator *validator_p, const json_t *accessions_p, const char *column_s, const char *message_s)
+{
+	const char *accession_s;
+	json_t *rows_p;
 
-																			if (!plot_p)
-																				{
+	json_object_foreach ((json_t *) accessions_p, accession_s, rows_p)
+		{
+			size_t i;
+			const json_t *row_p;
 
-																				}		/* if (!plot_p) */
+			json_array_foreach (rows_p, i, row_p)
+				{
+					AddPlotTableValidationError (validator_p, (size_t) json_integer_value (row_p), column_s, message_s);
+				}
+		}
+}
 
-																		}		/* if (!plot_p) */
 
+static void CheckPlotTableClashes (PlotTableValidator *validator_p)
+{
+	json_t *positions_p = json_object ();
 
-																	if (plot_p)
-																		{
-																			/*
-																			 * plot_p now has an id, so we can add the row/rack.
-																			 */
-																			int32 rack_plotwise_index = -1;
+	if (positions_p)
+		{
+			json_t *study_indexes_p = json_object ();
 
-																			if (GetJSONStringAsInteger (table_row_json_p, S_RACK_TITLE_S, &rack_plotwise_index))
-																				{
-																					int32 rack_studywise_index = -1;
+			if (study_indexes_p)
+				{
+					size_t i;
+					const PlotTablePosition *position_p = validator_p -> ptv_positions_p;
 
-																					if (GetJSONStringAsInteger (table_row_json_p, PL_INDEX_TABLE_TITLE_S, &rack_studywise_index))
-																						{
-																							int32 replicate = 1;
-																							const char *rep_s = GetJSONString (table_row_json_p, PL_REPLICATE_TITLE_S);
-																							bool control_rep_flag = false;
+					for (i = 0; i < validator_p -> ptv_num_rows; ++ i, ++ position_p)
+						{
+							if (position_p -> ptp_valid_flag)
+								{
+									char key_s [S_PLOT_POSITION_KEY_SIZE + 16];
 
-																							if (!IsStringEmpty (rep_s))
-																								{
-																									if (Stricmp (rep_s, RO_REPLICATE_CONTROL_S) == 0)
-																										{
-																											control_rep_flag = true;
-																										}
-																									else
-																										{
-																											success_flag = GetValidInteger (&rep_s, &replicate);
-																										}		/* if (value_s) */
-																								}
+									sprintf (key_s, INT32_FMT "," INT32_FMT "," INT32_FMT, position_p -> ptp_row, position_p -> ptp_column, position_p -> ptp_rack);
 
-																							if (success_flag)
-																								{
-																									Row *row_p = GetRowFromPlotByStudyIndex (plot_p, rack_studywise_index);
-																									bool is_existing_row_flag = true;
-																									const MEM_FLAG material_mem = MF_SHALLOW_COPY;
+									if (json_object_get (positions_p, key_s))
+										{
+											AddPlotTableValidationError (validator_p, i, S_RACK_TITLE_S, "Same row, column and rack as an earlier row");
+										}
+									else if (json_object_set_new (positions_p, key_s, json_true ()) != 0)
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add position \"%s\"", key_s);
+											++ (validator_p -> ptv_num_incomplete_checks);
+										}
 
-																									if (row_p)
-																										{
-																											/*
-																											 * update existing row
-																											 */
-																											UpdateRow (row_p, rack_plotwise_index, material_p, material_mem, control_rep_flag, replicate);
-																										}
-																									else
-																										{
-																											row_p = AllocateRow (NULL, rack_plotwise_index, rack_studywise_index, replicate, material_p, material_mem, plot_p);
-																											is_existing_row_flag = false;
-																										}
+									sprintf (key_s, INT32_FMT, position_p -> ptp_study_index);
 
-																									if (row_p)
-																										{
-																											/*
-																											 * Remove any of the normal plot keys
-																											 */
-																											json_object_del (table_row_json_p, S_SOWING_TITLE_S);
-																											json_object_del (table_row_json_p, S_HARVEST_TITLE_S);
-																											json_object_del (table_row_json_p, S_WIDTH_TITLE_S);
-																											json_object_del (table_row_json_p, S_LENGTH_TITLE_S);
-																											json_object_del (table_row_json_p, PL_INDEX_TABLE_TITLE_S);
-																											json_object_del (table_row_json_p, S_ROW_TITLE_S);
-																											json_object_del (table_row_json_p, S_COLUMN_TITLE_S);
-																											json_object_del (table_row_json_p, S_RACK_TITLE_S);
-																											json_object_del (table_row_json_p, PL_ACCESSION_TABLE_TITLE_S);
-																											json_object_del (table_row_json_p, S_GENE_BANK_S);
-																											json_object_del (table_row_json_p, S_TREATMENT_TITLE_S);
-																											json_object_del (table_row_json_p, PL_REPLICATE_TITLE_S);
-																											json_object_del (table_row_json_p, S_COMMENT_TITLE_S);
-																											json_object_del (table_row_json_p, S_IMAGE_TITLE_S);
-																											json_object_del (table_row_json_p, S_THUMBNAIL_TITLE_S);
-																											json_object_del (table_row_json_p, S_SOWING_ORDER_TITLE_S);
-																											json_object_del (table_row_json_p, S_WALKING_ORDER_TITLE_S);
-
-
-																											/*
-																											 * If there are any columns left, try to add them as observations
-																											 */
-																											if (json_object_size (table_row_json_p) > 0)
-																												{
-																													OperationStatus tr_status = AddTreatmentFactorValuesToRow (row_p, table_row_json_p, study_p, data_p);
+									if (json_object_get (study_indexes_p, key_s))
+										{
+											AddPlotTableValidationError (validator_p, i, PL_INDEX_TABLE_TITLE_S, "Same value as an earlier row");
+										}
+									else if (json_object_set_new (study_indexes_p, key_s, json_true ()) != 0)
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add study index \"%s\"", key_s);
+											++ (validator_p -> ptv_num_incomplete_checks);
+										}
+								}
+						}
 
-																													OperationStatus obs_status = AddObservationValuesToRow (row_p, table_row_json_p, study_p, data_p);
+					json_decref (study_indexes_p);
+				}		/* if (study_indexes_p) */
+			else
+				{
+					++ (validator_p -> ptv_num_incomplete_checks);
+				}
 
-																													if (obs_status != OS_SUCCEEDED)
-																														{
+			json_decref (positions_p);
+		}		/* if (positions_p) */
+	else
+		{
+			++ (validator_p -> ptv_num_incomplete_checks);
+		}
+}
 
-																														}
 
-																												}		/* if (json_object_size (table_row_json_p) > 0) */
+static void AddPlotTableValidationError (PlotTableValidator *validator_p, const size_t row, const char *column_s, const char *message_s)
+{
+	json_t *error_p = json_pack ("{s:I,s:s}", S_VALIDATION_ROW_S, (json_int_t) row, S_VALIDATION_ERROR_S, message_s);
 
+	if (error_p)
+		{
+			if (column_s)
+				{
+					if (!SetJSONString (error_p, S_VALIDATION_COLUMN_S, column_s))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add column \"%s\" to error for row " SIZET_FMT, column_s, row);
+						}
+				}
 
+			pthread_mutex_lock (& (validator_p -> ptv_lock));
 
-																											if (control_rep_flag)
-																												{
-																													SetRowGenotypeControl (row_p, true);
-																												}
+			if (json_array_append_new (validator_p -> ptv_errors_p, error_p) != 0)
+				{
+					++ (validator_p -> ptv_num_incomplete_checks);
+				}
 
-																											if (is_existing_row_flag || (AddRowToPlot (plot_p, row_p)))
-																												{
-																													if (SavePlot (plot_p, data_p))
-																														{
-																															++ num_imported;
-																															imported_row_flag = true;
-																														}
-																													else
-																														{
-																															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, table_row_json_p, "Failed to save row");
-																														}
+			pthread_mutex_unlock (& (validator_p -> ptv_lock));
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create error \"%s\" for row " SIZET_FMT, message_s, row);
 
-																												}
-																											else
-																												{
-																													FreeRow (row_p);
-																												}
+			pthread_mutex_lock (& (validator_p -> ptv_lock));
+			++ (validator_p -> ptv_num_incomplete_checks);
+			pthread_mutex_unlock (& (validator_p -> ptv_lock));
+		}
+}
 
-																										}
-																									else
-																										{
-																											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, table_row_json_p, "Failed to allocate row");
-																										}
 
-																								}		/* if (success_flag) */
+static void AddPlotTableValidationNewAccession (PlotTableValidator *validator_p, const char *gene_bank_s, const char *accession_s)
+{
+	json_t *accession_p = json_pack ("{s:s,s:s}", S_GENE_BANK_S, gene_bank_s, PL_ACCESSION_TABLE_TITLE_S, accession_s);
 
-																						}		/* if (GetJSONStringAsInteger (table_row_json_p, S_INDEX_TITLE_S, &study_index)) */
-																					else
-																						{
-																							AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, "Value not set", i, PL_INDEX_TABLE_TITLE_S);
-																							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, table_row_json_p, "Failed to get \"%s\"", PL_INDEX_TABLE_TITLE_S);
-																						}
+	pthread_mutex_lock (& (validator_p -> ptv_lock));
 
-																				}		/* if (GetJSONStringAsInteger (table_row_json_p, S_RACK_TITLE_S, &rack)) */
-																			else
-																				{
-																					AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, "Value not set", i, S_RACK_TITLE_S);
-																					PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, table_row_json_p, "Failed to get \"%s\"", S_RACK_TITLE_S);
-																				}
+	if ((!accession_p) || (json_array_append_new (validator_p -> ptv_new_accessions_p, accession_p) != 0))
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to note new accession \"%s\" in gene bank \"%s\"", accession_s, gene_bank_s);
+			++ (validator_p -> ptv_num_incomplete_checks);
+		}
 
-																			FreePlot (plot_p);
-																		}		/* if (plot_p) */
+	pthread_mutex_unlock (& (validator_p -> ptv_lock));
+}
 
-																}		/* if (GetJSONStringAsInteger (row_p, S_COLUMN_TITLE_S, &column)) */
-															else
-																{
-																	AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, "Value not set", i, S_COLUMN_TITLE_S);
-																	PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, table_row_json_p, "Failed to get \"%s\"", S_COLUMN_TITLE_S);
-																}
 
-														}		/* if (GetJSONStringAsInteger (row_p, S_ROW_TITLE_S, &row)) */
-													else
-														{
-															AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, "Value not set", i, S_ROW_TITLE_S);
-															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, table_row_json_p, "Failed to get \"%s\"", S_ROW_TITLE_S);
-														}
+static void SetPlotTableValidationMetadata (ServiceJob *job_p, const PlotTableValidator *validator_p, const uint32 num_threads, const struct timespec *start_time_p)
+{
+	struct timespec end_time;
+	json_int_t time_taken;
+	json_t *metadata_p;
 
+	clock_gettime (CLOCK_MONOTONIC, &end_time);
 
-												}		/* if (material_p) */
-											else
-												{
-													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get Material with internal name \"%s\" for area \"%s\"", accession_s, study_p -> st_name_s);
-												}
+	time_taken = ((json_int_t) (end_time.tv_sec - start_time_p -> tv_sec)) * 1000 + (end_time.tv_nsec - start_time_p -> tv_nsec) / 1000000;
 
-										}		/* if (accession_s) */
-									else
-										{
-											AddTabularParameterErrorMessageToServiceJob (job_p, S_PLOT_TABLE.npt_name_s, S_PLOT_TABLE.npt_type, "Value not set", i, PL_ACCESSION_TABLE_TITLE_S);
-											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, table_row_json_p, "Failed to get \"%s\"", PL_ACCESSION_TABLE_TITLE_S);
-										}
+	metadata_p = json_pack ("{s:b,s:I,s:I,s:I,s:I,s:O,s:O,s:I}",
+		"dry_run", true,
+		"rows", (json_int_t) (validator_p -> ptv_num_rows),
+		"threads", (json_int_t) (num_threads > 0 ? num_threads : 1),
+		"num_errors", (json_int_t) json_array_size (validator_p -> ptv_errors_p),
+		"incomplete_checks", (json_int_t) (validator_p -> ptv_num_incomplete_checks),
+		"errors", validator_p -> ptv_errors_p,
+		"new_accessions", validator_p -> ptv_new_accessions_p,
+		"time_ms", time_taken);
 
-									FreeGeneBank (gene_bank_p);
-								}		/* if (gene_bank_p) */
-							else
-								{
-									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, table_row_json_p, "Failed to get gene bank \%s\"", gene_bank_s);
-								}
+	if (metadata_p)
+		{
+			if (job_p -> sj_metadata_p)
+				{
+					json_decref (job_p -> sj_metadata_p);
+				}
 
-							if (!imported_row_flag)
-								{
-									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, table_row_json_p, "Failed to import plot data");
-								}
+			job_p -> sj_metadata_p = metadata_p;
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create metadata for plot table validation");
+		}
+}
+
+
+static bool IsStandardPlotTableHeading (const char *key_s)
+{
+	return ((strcmp (key_s, S_SOWING_TITLE_S) == 0) ||
+					(strcmp (key_s, S_HARVEST_TITLE_S) == 0) ||
+					(strcmp (key_s, S_WIDTH_TITLE_S) == 0) ||
+					(strcmp (key_s, S_LENGTH_TITLE_S) == 0) ||
+					(strcmp (key_s, PL_INDEX_TABLE_TITLE_S) == 0) ||
+					(strcmp (key_s, S_ROW_TITLE_S) == 0) ||
+					(strcmp (key_s, S_COLUMN_TITLE_S) == 0) ||
+					(strcmp (key_s, S_RACK_TITLE_S) == 0) ||
+					(strcmp (key_s, PL_ACCESSION_TABLE_TITLE_S) == 0) ||
+					(strcmp (key_s, S_GENE_BANK_S) == 0) ||
+					(strcmp (key_s, S_TREATMENT_TITLE_S) == 0) ||
+					(strcmp (key_s, PL_REPLICATE_TITLE_S) == 0) ||
+					(strcmp (key_s, S_COMMENT_TITLE_S) == 0) ||
+					(strcmp (key_s, S_IMAGE_TITLE_S) == 0) ||
+					(strcmp (key_s, S_THUMBNAIL_TITLE_S) == 0) ||
+					(strcmp (key_s, S_SOWING_ORDER_TITLE_S) == 0) ||
+					(strcmp (key_s, S_WALKING_ORDER_TITLE_S) == 0));
+}
+
+
+static const char *GetPlotTableColumnHeading (const PlotTableColumn column)
+{
+	const char *heading_s = NULL;
+
+	switch (column)
+		{
+			case PTC_SOWING_DATE:
+				heading_s = S_SOWING_TITLE_S;
+				break;
+
+			case PTC_HARVEST_DATE:
+				heading_s = S_HARVEST_TITLE_S;
+				break;
+
+			case PTC_WIDTH:
+				heading_s = S_WIDTH_TITLE_S;
+				break;
+
+			case PTC_LENGTH:
+				heading_s = S_LENGTH_TITLE_S;
+				break;
+
+			case PTC_INDEX:
+				heading_s = PL_INDEX_TABLE_TITLE_S;
+				break;
+
+			case PTC_ROW:
+				heading_s = S_ROW_TITLE_S;
+				break;
 
-						}		/* if (json_object_size (table_row_json_p) > 0) */
+			case PTC_COLUMN:
+				heading_s = S_COLUMN_TITLE_S;
+				break;
+
+			case PTC_RACK:
+				heading_s = S_RACK_TITLE_S;
+				break;
+
+			case PTC_ACCESSION:
+				heading_s = PL_ACCESSION_TABLE_TITLE_S;
+				break;
+
+			case PTC_GENE_BANK:
+				heading_s = S_GENE_BANK_S;
+				break;
+
+			case PTC_TREATMENT:
+				heading_s = S_TREATMENT_TITLE_S;
+				break;
+
+			case PTC_REPLICATE:
+				heading_s = PL_REPLICATE_TITLE_S;
+				break;
+
+			case PTC_COMMENT:
+				heading_s = S_COMMENT_TITLE_S;
+				break;
+
+			case PTC_IMAGE:
+				heading_s = S_IMAGE_TITLE_S;
+				break;
+
+			case PTC_THUMBNAIL:
+				heading_s = S_THUMBNAIL_TITLE_S;
+				break;
+
+			case PTC_SOWING_ORDER:
+				heading_s = S_SOWING_ORDER_TITLE_S;
+				break;
+
+			case PTC_WALKING_ORDER:
+				heading_s = S_WALKING_ORDER_TITLE_S;
+				break;
+
+			default:
+				break;
+		}
+
+	return heading_s;
+}
+
+
+/*
+ * Find the standard columns of a delimited plot table from its header.
+ */
+static void InitPlotTableLayout (PlotTableLayout *layout_p, const DelimitedTableHeader *header_p)
+{
+	PlotTableColumn column;
+
+	for (column = 0; column < PTC_NUM_COLUMNS; ++ column)
+		{
+			layout_p -> ptl_indexes [column] = GetDelimitedTableColumnIndex (header_p, GetPlotTableColumnHeading (column));
+		}
+
+	layout_p -> ptl_value_columns_p = NULL;
+	layout_p -> ptl_num_columns = 0;
+}
+
+
+/*
+ * Work out what each of the non-standard columns of a delimited plot
+ * table holds once rather than for every row.
+ */
+static bool SetPlotTableLayoutValueColumns (PlotTableLayout *layout_p, const DelimitedTableHeader *header_p, PlotImport *import_p, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	RowValueColumn *columns_p = (RowValueColumn *) AllocMemoryArray (header_p -> dth_num_headings, sizeof (RowValueColumn));
+
+	if (columns_p)
+		{
+			size_t i;
+			RowValueColumn *column_p = columns_p;
+			char **heading_ss = header_p -> dth_headings_ss;
+
+			for (i = header_p -> dth_num_headings; i > 0; -- i, ++ column_p, ++ heading_ss)
+				{
+					if (IsStandardPlotTableHeading (*heading_ss))
+						{
+							column_p -> rvc_treatment_factor_p = NULL;
+							column_p -> rvc_phenotype_column_p = NULL;
+						}
 					else
 						{
-							++ num_empty_rows;
+							SetRowValueColumn (column_p, *heading_ss, true, import_p -> pi_phenotype_columns_p, study_p, data_p);
 						}
+				}
 
-				}		/* for (i = 0; i < num_rows; ++ i) */
+			layout_p -> ptl_value_columns_p = columns_p;
+			layout_p -> ptl_num_columns = header_p -> dth_num_headings;
 
-			if (num_imported + num_empty_rows == num_rows)
-				{
-					status = OS_SUCCEEDED;
-				}
-			else if (num_imported > 0)
-				{
-					status = OS_PARTIALLY_SUCCEEDED;
-				}
+			return true;
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " plot table columns", header_p -> dth_num_headings);
+		}
+
+	return false;
+}
+
+
+static void ClearPlotTableLayout (PlotTableLayout *layout_p)
+{
+	if (layout_p -> ptl_value_columns_p)
+		{
+			FreeMemory (layout_p -> ptl_value_columns_p);
+			layout_p -> ptl_value_columns_p = NULL;
+		}
+
+	layout_p -> ptl_num_columns = 0;
+}
+
+
+static void SetJSONPlotTableRow (PlotTableRow *table_row_p, json_t *table_row_json_p)
+{
+	table_row_p -> ptr_json_p = table_row_json_p;
+	table_row_p -> ptr_reader_p = NULL;
+	table_row_p -> ptr_layout_p = NULL;
+}
+
+
+static void SetDelimitedPlotTableRow (PlotTableRow *table_row_p, DelimitedTableReader *reader_p, const PlotTableLayout *layout_p)
+{
+	table_row_p -> ptr_json_p = NULL;
+	table_row_p -> ptr_reader_p = reader_p;
+	table_row_p -> ptr_layout_p = layout_p;
+}
 
-			/*
-			 * As the plots have been updated, clear any cached study
-			 */
-			study_id_s = GetBSONOidAsString (study_p -> st_id_p);
 
-			if (study_id_s)
+/*
+ * Get the value of a standard column in a table row or NULL if it
+ * isn't set.
+ */
+static const char *GetPlotTableRowValue (const PlotTableRow *table_row_p, const PlotTableColumn column)
+{
+	if (table_row_p -> ptr_json_p)
+		{
+			return GetJSONString (table_row_p -> ptr_json_p, GetPlotTableColumnHeading (column));
+		}
+	else
+		{
+			return GetDelimitedTableCellValue (table_row_p -> ptr_reader_p, table_row_p -> ptr_layout_p -> ptl_indexes [column]);
+		}
+}
+
+
+static bool GetPlotTableRowInteger (const PlotTableRow *table_row_p, const PlotTableColumn column, int32 *value_p)
+{
+	if (table_row_p -> ptr_json_p)
+		{
+			return GetJSONStringAsInteger (table_row_p -> ptr_json_p, GetPlotTableColumnHeading (column), value_p);
+		}
+	else
+		{
+			return GetDelimitedTableCellAsInteger (table_row_p -> ptr_reader_p, table_row_p -> ptr_layout_p -> ptl_indexes [column], value_p);
+		}
+}
+
+
+/*
+ * Get a copy of the real number in a standard column of a table row.
+ * *value_pp is left as NULL if the value isn't set or isn't valid.
+ */
+static void GetPlotTableRowReal (const PlotTableRow *table_row_p, const PlotTableColumn column, double64 **value_pp)
+{
+	if (table_row_p -> ptr_json_p)
+		{
+			GetValidRealFromJSON (table_row_p -> ptr_json_p, GetPlotTableColumnHeading (column), value_pp);
+		}
+	else
+		{
+			const char *value_s = GetPlotTableRowValue (table_row_p, column);
+
+			if (value_s)
 				{
-					if (!ClearCachedStudy (study_id_s, data_p))
+					double64 d;
+
+					if (GetValidRealNumber (&value_s, &d, NULL))
 						{
-							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to clear cached Study with id \"%s\"", study_id_s);
+							CopyValidReal (&d, value_pp);
 						}
-
-					FreeCopiedString (study_id_s);
-				}
-			else
-				{
-					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get id for Study \"%s\"", study_p -> st_name_s);
 				}
-		}		/* if (json_is_array (plots_json_p)) */
+		}
+}
 
 
+/*
+ * Get a copy of the unsigned integer in a standard column of a table row.
+ * *value_pp is left as NULL if the value isn't set or isn't valid.
+ */
+static void GetPlotTableRowUnsignedInteger (const PlotTableRow *table_row_p, const PlotTableColumn column, uint32 **value_pp)
+{
+	if (table_row_p -> ptr_json_p)
+		{
+			GetValidUnsignedIntFromJSON (table_row_p -> ptr_json_p, GetPlotTableColumnHeading (column), value_pp);
+		}
+	else
+		{
+			int32 i;
 
-	SetServiceJobStatus (job_p, status);
+			if (GetPlotTableRowInteger (table_row_p, column, &i) && (i >= 0))
+				{
+					const uint32 u = (uint32) i;
 
-	return success_flag;
+					CopyValidUnsignedInteger (&u, value_pp);
+				}
+		}
 }
 
 
-static Plot *CreatePlotFromTabularJSON (const json_t *table_row_json_p, const int32 row, const int32 column, Study *study_p, const FieldTrialServiceData *data_p)
+static Plot *CreatePlotFromTableRow (const PlotTableRow *table_row_p, const int32 row, const int32 column, Study *study_p, const FieldTrialServiceData *data_p)
 {
 	double *width_p = NULL;
 	double *length_p = NULL;
 	Plot *plot_p = NULL;
-	const char *treatment_s = GetJSONString (table_row_json_p, S_TREATMENT_TITLE_S);
-	const char *comment_s = GetJSONString (table_row_json_p, S_COMMENT_TITLE_S);
-	const char *image_s = GetJSONString (table_row_json_p, S_IMAGE_TITLE_S);
-	const char *thumbnail_s = GetJSONString (table_row_json_p, S_THUMBNAIL_TITLE_S);
+	const char *treatment_s = GetPlotTableRowValue (table_row_p, PTC_TREATMENT);
+	const char *comment_s = GetPlotTableRowValue (table_row_p, PTC_COMMENT);
+	const char *image_s = GetPlotTableRowValue (table_row_p, PTC_IMAGE);
+	const char *thumbnail_s = GetPlotTableRowValue (table_row_p, PTC_THUMBNAIL);
 	struct tm *sowing_date_p = NULL;
 	struct tm *harvest_date_p = NULL;
-	const char *date_s = GetJSONString (table_row_json_p, S_SOWING_TITLE_S);
+	const char *date_s = GetPlotTableRowValue (table_row_p, PTC_SOWING_DATE);
 	uint32 *sowing_order_p = NULL;
 	uint32 *walking_order_p = NULL;
 
-	GetValidRealFromJSON (table_row_json_p, S_WIDTH_TITLE_S, &width_p);
-	GetValidRealFromJSON (table_row_json_p, S_LENGTH_TITLE_S, &length_p);
+	GetPlotTableRowReal (table_row_p, PTC_WIDTH, &width_p);
+	GetPlotTableRowReal (table_row_p, PTC_LENGTH, &length_p);
 
-	GetValidUnsignedIntFromJSON (table_row_json_p, S_SOWING_ORDER_TITLE_S, &sowing_order_p);
-	GetValidUnsignedIntFromJSON (table_row_json_p, S_WALKING_ORDER_TITLE_S, &walking_order_p);
+	GetPlotTableRowUnsignedInteger (table_row_p, PTC_SOWING_ORDER, &sowing_order_p);
+	GetPlotTableRowUnsignedInteger (table_row_p, PTC_WALKING_ORDER, &walking_order_p);
 
 
 	if (!IsStringEmpty (date_s))
@@ -1282,7 +4062,7 @@ static Plot *CreatePlotFromTabularJSON (const json_t *table_row_json_p, const in
 				}
 		}
 
-	date_s = GetJSONString (table_row_json_p, S_HARVEST_TITLE_S);
+	date_s = GetPlotTableRowValue (table_row_p, PTC_HARVEST_DATE);
 	if (!IsStringEmpty (date_s))
 		{
 			harvest_date_p = GetTimeFromString (date_s);
@@ -1298,17 +4078,21 @@ static Plot *CreatePlotFromTabularJSON (const json_t *table_row_json_p, const in
 
 	if (plot_p)
 		{
-			if (!SavePlot (plot_p, data_p))
+			/*
+			 * The plot is saved along with the rest of the import, but it
+			 * needs an id now so that its rows can refer to it.
+			 */
+			if ((plot_p -> pl_id_p = GetNewBSONOid ()) == NULL)
 				{
-					PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, table_row_json_p, "Failed to save plot");
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate id for plot at row " INT32_FMT " column " INT32_FMT, row, column);
 
 					FreePlot (plot_p);
 					plot_p = NULL;
-				}		/* if (!SavePlot (plot_p, data_p)) */
+				}		/* if ((plot_p -> pl_id_p = GetNewBSONOid ()) == NULL) */
 		}		/* if (plot_p) */
 	else
 		{
-			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, table_row_json_p, "Failed to allocate Plot");
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate Plot at row " INT32_FMT " column " INT32_FMT, row, column);
 		}
 
 	if (width_p)
@@ -1321,6 +4105,16 @@ static Plot *CreatePlotFromTabularJSON (const json_t *table_row_json_p, const in
 			FreeMemory (length_p);
 		}
 
+	if (sowing_order_p)
+		{
+			FreeMemory (sowing_order_p);
+		}
+
+	if (walking_order_p)
+		{
+			FreeMemory (walking_order_p);
+		}
+
 
 	if (harvest_date_p)
 		{
@@ -1413,6 +4207,19 @@ static bool RemoveExistingPlotsForStudy (Study *study_p, const FieldTrialService
 				}		/* if (query_p) */
 		}
 
+	if (success_flag)
+		{
+			success_flag = RemoveStudyFromObservationsCollection (study_p -> st_id_p, data_p);
+		}
+
+	/*
+	 * The statistics are for the Plots that have just been removed
+	 */
+	if (success_flag)
+		{
+			success_flag = RemoveStudyTraitStatistics (study_p -> st_id_p, data_p);
+		}
+
 	return success_flag;
 }
 
@@ -26,6 +26,7 @@
 
 #include "memory_allocations.h"
 #include "dfw_util.h"
+#include "change_tracking.h"
 #include "indexing.h"
 
 #include "programme_jobs.h"
@@ -623,7 +624,11 @@ OperationStatus SaveProgramme (Programme *programme_p, ServiceJob *job_p, FieldT
 
 			if (programme_json_p)
 				{
-					if (SaveMongoData (data_p -> dftsd_mongo_p, programme_json_p, data_p -> dftsd_collection_ss [DFTD_PROGRAM], selector_p))
+					if (!StampModification (programme_json_p, data_p))
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add modification marker to Programme \"%s\" so it has not been saved", programme_p -> pr_name_s);
+						}
+					else if (SaveMongoData (data_p -> dftsd_mongo_p, programme_json_p, data_p -> dftsd_collection_ss [DFTD_PROGRAM], selector_p))
 						{
 							OperationStatus s;
 
@@ -351,46 +351,56 @@ json_t *GetProgrammeIndexingData (Service *service_p)
 
 	if (src_programs_p)
 		{
-			if (json_is_array (src_programs_p))
-				{
-					FieldTrialServiceData *dfw_data_p = (FieldTrialServiceData *) (service_p -> se_data_p);
-					size_t i;
-					json_t *src_program_p;
-					size_t num_added = 0;
+			PrepareProgrammesForIndexing (src_programs_p, data_p);
 
-					json_array_foreach (src_programs_p, i, src_program_p)
-						{
-							bson_oid_t id;
+			return src_programs_p;
+		}		/* if (src_programs_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "No programs for \"%s\"", GetServiceName (service_p));
+		}
 
-							if (AddDatatype (src_program_p, DFTD_PROGRAM))
-								{
-									if (GetMongoIdFromJSON (src_program_p, &id))
-										{
-											Crop *crop_p = GetStoredCropValue (src_program_p, PR_CROP_S, data_p);
+	return NULL;
+}
 
-											if (crop_p)
-												{
-													SetJSONString (src_program_p, PR_CROP_S, crop_p -> cr_name_s);
-													FreeCrop (crop_p);
-												}
 
-										}		/* if (GetMongoIdFromJSON (entry_p, &id)) */
+bool PrepareProgrammesForIndexing (json_t *programmes_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
 
-								}
+	if (json_is_array (programmes_p))
+		{
+			size_t i;
+			json_t *src_program_p;
+			size_t num_added = 0;
 
+			json_array_foreach (programmes_p, i, src_program_p)
+				{
+					bson_oid_t id;
 
-						}		/* json_array_foreach (src_studies_p, i, src_study_p) */
+					if (AddDatatype (src_program_p, DFTD_PROGRAM))
+						{
+							if (GetMongoIdFromJSON (src_program_p, &id))
+								{
+									Crop *crop_p = GetStoredCropValue (src_program_p, PR_CROP_S, data_p);
 
-				}		/* if (json_is_array (src_studies_p)) */
+									if (crop_p)
+										{
+											SetJSONString (src_program_p, PR_CROP_S, crop_p -> cr_name_s);
+											FreeCrop (crop_p);
+										}
 
-			return src_programs_p;
-		}		/* if (src_studies_p) */
-	else
-		{
-			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "No programs for \"%s\"", GetServiceName (service_p));
-		}
+									++ num_added;
+								}		/* if (GetMongoIdFromJSON (src_program_p, &id)) */
 
-	return NULL;
+						}
+
+				}		/* json_array_foreach (programmes_p, i, src_program_p) */
+
+			success_flag = (num_added == json_array_size (programmes_p));
+		}		/* if (json_is_array (programmes_p)) */
+
+	return success_flag;
 }
 
 
@@ -0,0 +1,654 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * reference_cache.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <string.h>
+
+#include "reference_cache.h"
+#include "memory_allocations.h"
+#include "string_utils.h"
+#include "streams.h"
+#include "mongodb_util.h"
+#include "schema_keys.h"
+
+
+/*
+ * The default maximum size for each cached datatype
+ */
+static const size_t S_DEFAULT_MAX_BYTES = 4 * 1024 * 1024;
+
+
+/*
+ * The slowly-changing datatypes that are worth caching across requests
+ */
+static const DFWFieldTrialData S_CACHED_TYPES [] =
+{
+	DFTD_LOCATION,
+	DFTD_MEASURED_VARIABLE,
+	DFTD_INSTRUMENT,
+	DFTD_GENE_BANK,
+	DFTD_CROP,
+	DFTD_TREATMENT
+};
+
+
+/*
+ * The default maximum size of the in-memory copies of the cached Studies
+ */
+static const size_t S_DEFAULT_MAX_STUDY_BYTES = 64 * 1024 * 1024;
+
+
+/*
+ * The default number of seconds that a cached document stays valid for
+ */
+static const time_t S_DEFAULT_TTL = 300;
+
+
+static ReferenceCache s_reference_cache;
+
+static pthread_once_t s_reference_cache_once = PTHREAD_ONCE_INIT;
+
+
+static void InitReferenceCache (void);
+
+static void ResizeTier (ReferenceCacheTier *tier_p, const size_t max_bytes);
+
+static bool IsReferenceDatatype (const DFWFieldTrialData datatype);
+
+static size_t GetTierMaxBytes (ReferenceCache *cache_p, const ReferenceCacheTier *tier_p);
+
+static json_t *LookUpReference (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const char *key_s, const bool check_revision_flag, const int64 revision);
+
+static uint32 GetKeyHash (const char *key_s);
+
+static ReferenceCacheEntry *FindEntry (ReferenceCacheTier *tier_p, const char *key_s, const uint32 bucket);
+
+static void UnlinkEntry (ReferenceCacheTier *tier_p, ReferenceCacheEntry *entry_p);
+
+static void LinkEntryAsNewest (ReferenceCacheTier *tier_p, ReferenceCacheEntry *entry_p);
+
+static void RemoveEntry (ReferenceCacheTier *tier_p, ReferenceCacheEntry *entry_p);
+
+static void FreeReferenceCacheEntry (ReferenceCacheEntry *entry_p);
+
+static size_t GetDocumentSize (const json_t *doc_p);
+
+static bool AddTierStatisticsToJSON (json_t *stats_p, const DFWFieldTrialData datatype, const ReferenceCacheTier *tier_p);
+
+
+
+ReferenceCache *GetReferenceCache (void)
+{
+	pthread_once (&s_reference_cache_once, InitReferenceCache);
+
+	return &s_reference_cache;
+}
+
+
+void SetReferenceCacheSize (ReferenceCache *cache_p, const size_t max_bytes)
+{
+	const size_t num_types = sizeof (S_CACHED_TYPES) / sizeof (S_CACHED_TYPES [0]);
+	size_t i;
+
+	pthread_mutex_lock (& (cache_p -> rc_lock));
+
+	for (i = 0; i < num_types; ++ i)
+		{
+			ResizeTier (& (cache_p -> rc_tiers [S_CACHED_TYPES [i]]), max_bytes);
+		}
+
+	pthread_mutex_unlock (& (cache_p -> rc_lock));
+}
+
+
+void SetReferenceCacheTierSize (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const size_t max_bytes)
+{
+	if (datatype < DFTD_NUM_TYPES)
+		{
+			pthread_mutex_lock (& (cache_p -> rc_lock));
+			ResizeTier (& (cache_p -> rc_tiers [datatype]), max_bytes);
+			pthread_mutex_unlock (& (cache_p -> rc_lock));
+		}
+}
+
+
+void SetReferenceCacheTimeToLive (ReferenceCache *cache_p, const time_t ttl)
+{
+	pthread_mutex_lock (& (cache_p -> rc_lock));
+	cache_p -> rc_ttl = ttl;
+	pthread_mutex_unlock (& (cache_p -> rc_lock));
+}
+
+
+json_t *GetCachedReference (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const char *key_s)
+{
+	return LookUpReference (cache_p, datatype, key_s, false, 0);
+}
+
+
+json_t *GetCachedReferenceAtRevision (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const char *key_s, const int64 revision)
+{
+	return LookUpReference (cache_p, datatype, key_s, true, revision);
+}
+
+
+json_t *GetCachedReferenceById (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const bson_oid_t *id_p)
+{
+	json_t *doc_p = NULL;
+
+	if (IsReferenceDatatype (datatype))
+		{
+			char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+			bson_oid_to_string (id_p, id_s);
+
+			doc_p = GetCachedReference (cache_p, datatype, id_s);
+		}
+
+	return doc_p;
+}
+
+
+bool CacheReference (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const char *key_s, json_t *doc_p)
+{
+	return CacheReferenceAtRevision (cache_p, datatype, key_s, doc_p, 0);
+}
+
+
+bool CacheReferenceAtRevision (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const char *key_s, json_t *doc_p, const int64 revision)
+{
+	bool success_flag = true;
+
+	if (datatype < DFTD_NUM_TYPES)
+		{
+			ReferenceCacheTier *tier_p = & (cache_p -> rc_tiers [datatype]);
+
+			/*
+			 * Check the limit before serialising the document to get its size so
+			 * that nothing is done when caching is disabled. The limit can change
+			 * at any time so it is checked again once the entry is ready.
+			 */
+			if (GetTierMaxBytes (cache_p, tier_p) > 0)
+				{
+					const size_t num_bytes = GetDocumentSize (doc_p) + strlen (key_s) + sizeof (ReferenceCacheEntry);
+					ReferenceCacheEntry *entry_p = (ReferenceCacheEntry *) AllocMemory (sizeof (ReferenceCacheEntry));
+
+					success_flag = false;
+
+					if (entry_p)
+						{
+							entry_p -> rce_doc_p = NULL;
+
+							if ((entry_p -> rce_key_s = EasyCopyToNewString (key_s)) != NULL)
+								{
+									const uint32 bucket = GetKeyHash (key_s);
+									ReferenceCacheEntry *old_entry_p;
+
+									entry_p -> rce_doc_p = json_incref (doc_p);
+									entry_p -> rce_num_bytes = num_bytes;
+									entry_p -> rce_revision = revision;
+									entry_p -> rce_newer_p = NULL;
+									entry_p -> rce_older_p = NULL;
+
+									pthread_mutex_lock (& (cache_p -> rc_lock));
+
+									if (num_bytes <= tier_p -> rct_max_bytes)
+										{
+											entry_p -> rce_expiry = (cache_p -> rc_ttl > 0) ? time (NULL) + cache_p -> rc_ttl : 0;
+
+											/* Replace any existing entry */
+											if ((old_entry_p = FindEntry (tier_p, key_s, bucket)) != NULL)
+												{
+													RemoveEntry (tier_p, old_entry_p);
+												}
+
+											/* Make space for the new entry */
+											while ((tier_p -> rct_oldest_p) && (tier_p -> rct_num_bytes + num_bytes > tier_p -> rct_max_bytes))
+												{
+													RemoveEntry (tier_p, tier_p -> rct_oldest_p);
+													++ (tier_p -> rct_evictions);
+												}
+
+											entry_p -> rce_bucket_next_p = tier_p -> rct_buckets_pp [bucket];
+											tier_p -> rct_buckets_pp [bucket] = entry_p;
+
+											LinkEntryAsNewest (tier_p, entry_p);
+
+											tier_p -> rct_num_bytes += num_bytes;
+											++ (tier_p -> rct_num_entries);
+
+											entry_p = NULL;
+										}		/* if (num_bytes <= tier_p -> rct_max_bytes) */
+
+									pthread_mutex_unlock (& (cache_p -> rc_lock));
+
+									success_flag = true;
+								}		/* if ((entry_p -> rce_key_s = EasyCopyToNewString (key_s)) != NULL) */
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to copy cache key \"%s\"", key_s);
+								}
+
+							/* The entry was too big to cache or failed to be set up */
+							if (entry_p)
+								{
+									FreeReferenceCacheEntry (entry_p);
+								}
+
+						}		/* if (entry_p) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate cache entry for \"%s\"", key_s);
+						}
+
+				}		/* if (GetTierMaxBytes (cache_p, tier_p) > 0) */
+
+		}		/* if (datatype < DFTD_NUM_TYPES) */
+
+	return success_flag;
+}
+
+
+bool CacheReferenceById (ReferenceCache *cache_p, const DFWFieldTrialData datatype, json_t *doc_p)
+{
+	bool success_flag = true;
+
+	if (IsReferenceDatatype (datatype))
+		{
+			bson_oid_t id;
+
+			if (GetMongoIdFromJSON (doc_p, &id))
+				{
+					char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+					bson_oid_to_string (&id, id_s);
+
+					success_flag = CacheReference (cache_p, datatype, id_s, doc_p);
+				}
+			else
+				{
+					PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Failed to get id for reference cache");
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+void InvalidateCachedReference (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const char *key_s)
+{
+	if (datatype < DFTD_NUM_TYPES)
+		{
+			ReferenceCacheTier *tier_p = & (cache_p -> rc_tiers [datatype]);
+			ReferenceCacheEntry *entry_p;
+
+			pthread_mutex_lock (& (cache_p -> rc_lock));
+
+			if ((entry_p = FindEntry (tier_p, key_s, GetKeyHash (key_s))) != NULL)
+				{
+					RemoveEntry (tier_p, entry_p);
+				}
+
+			pthread_mutex_unlock (& (cache_p -> rc_lock));
+		}
+}
+
+
+void InvalidateCachedReferenceById (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const bson_oid_t *id_p)
+{
+	char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+	bson_oid_to_string (id_p, id_s);
+
+	InvalidateCachedReference (cache_p, datatype, id_s);
+}
+
+
+json_t *GetReferenceCacheStatisticsAsJSON (ReferenceCache *cache_p)
+{
+	json_t *stats_p = json_array ();
+
+	if (stats_p)
+		{
+			DFWFieldTrialData i;
+			bool success_flag = true;
+
+			pthread_mutex_lock (& (cache_p -> rc_lock));
+
+			for (i = 0; i < DFTD_NUM_TYPES; ++ i)
+				{
+					const ReferenceCacheTier *tier_p = & (cache_p -> rc_tiers [i]);
+
+					if ((tier_p -> rct_max_bytes > 0) || (tier_p -> rct_num_entries > 0))
+						{
+							if (!AddTierStatisticsToJSON (stats_p, i, tier_p))
+								{
+									success_flag = false;
+									i = DFTD_NUM_TYPES;		/* force exit from loop */
+								}
+						}
+				}
+
+			pthread_mutex_unlock (& (cache_p -> rc_lock));
+
+			if (!success_flag)
+				{
+					json_decref (stats_p);
+					stats_p = NULL;
+				}
+		}
+
+	return stats_p;
+}
+
+
+
+/*
+ * static definitions
+ */
+
+static void InitReferenceCache (void)
+{
+	const size_t num_types = sizeof (S_CACHED_TYPES) / sizeof (S_CACHED_TYPES [0]);
+	size_t i;
+
+	memset (& (s_reference_cache.rc_tiers), 0, DFTD_NUM_TYPES * sizeof (ReferenceCacheTier));
+
+	for (i = 0; i < num_types; ++ i)
+		{
+			s_reference_cache.rc_tiers [S_CACHED_TYPES [i]].rct_max_bytes = S_DEFAULT_MAX_BYTES;
+		}
+
+	s_reference_cache.rc_tiers [DFTD_STUDY].rct_max_bytes = S_DEFAULT_MAX_STUDY_BYTES;
+	s_reference_cache.rc_ttl = S_DEFAULT_TTL;
+
+	pthread_mutex_init (& (s_reference_cache.rc_lock), NULL);
+}
+
+
+static void ResizeTier (ReferenceCacheTier *tier_p, const size_t max_bytes)
+{
+	tier_p -> rct_max_bytes = max_bytes;
+
+	/* Shrink the tier if needed */
+	while ((tier_p -> rct_oldest_p) && (tier_p -> rct_num_bytes > tier_p -> rct_max_bytes))
+		{
+			RemoveEntry (tier_p, tier_p -> rct_oldest_p);
+			++ (tier_p -> rct_evictions);
+		}
+}
+
+
+static bool IsReferenceDatatype (const DFWFieldTrialData datatype)
+{
+	const size_t num_types = sizeof (S_CACHED_TYPES) / sizeof (S_CACHED_TYPES [0]);
+	size_t i;
+
+	for (i = 0; i < num_types; ++ i)
+		{
+			if (S_CACHED_TYPES [i] == datatype)
+				{
+					return true;
+				}
+		}
+
+	return false;
+}
+
+
+static size_t GetTierMaxBytes (ReferenceCache *cache_p, const ReferenceCacheTier *tier_p)
+{
+	size_t max_bytes;
+
+	pthread_mutex_lock (& (cache_p -> rc_lock));
+	max_bytes = tier_p -> rct_max_bytes;
+	pthread_mutex_unlock (& (cache_p -> rc_lock));
+
+	return max_bytes;
+}
+
+
+static json_t *LookUpReference (ReferenceCache *cache_p, const DFWFieldTrialData datatype, const char *key_s, const bool check_revision_flag, const int64 revision)
+{
+	json_t *doc_p = NULL;
+
+	if (datatype < DFTD_NUM_TYPES)
+		{
+			ReferenceCacheTier *tier_p = & (cache_p -> rc_tiers [datatype]);
+
+			pthread_mutex_lock (& (cache_p -> rc_lock));
+
+			if (tier_p -> rct_max_bytes > 0)
+				{
+					ReferenceCacheEntry *entry_p = FindEntry (tier_p, key_s, GetKeyHash (key_s));
+
+					if ((entry_p) && (entry_p -> rce_expiry > 0) && (entry_p -> rce_expiry <= time (NULL)))
+						{
+							RemoveEntry (tier_p, entry_p);
+							entry_p = NULL;
+							++ (tier_p -> rct_expirations);
+						}
+
+					if ((entry_p) && (check_revision_flag) && (entry_p -> rce_revision != revision))
+						{
+							RemoveEntry (tier_p, entry_p);
+							entry_p = NULL;
+						}
+
+					if (entry_p)
+						{
+							/* Move it to the front of the queue */
+							UnlinkEntry (tier_p, entry_p);
+							LinkEntryAsNewest (tier_p, entry_p);
+
+							doc_p = json_incref (entry_p -> rce_doc_p);
+							++ (tier_p -> rct_hits);
+						}
+					else
+						{
+							++ (tier_p -> rct_misses);
+						}
+				}
+
+			pthread_mutex_unlock (& (cache_p -> rc_lock));
+		}
+
+	return doc_p;
+}
+
+
+static uint32 GetKeyHash (const char *key_s)
+{
+	uint32 hash = 5381;
+	const char *c_p = key_s;
+
+	while (*c_p)
+		{
+			hash = ((hash << 5) + hash) + ((unsigned char) *c_p);
+			++ c_p;
+		}
+
+	return hash % RC_NUM_BUCKETS;
+}
+
+
+static ReferenceCacheEntry *FindEntry (ReferenceCacheTier *tier_p, const char *key_s, const uint32 bucket)
+{
+	ReferenceCacheEntry *entry_p = tier_p -> rct_buckets_pp [bucket];
+
+	while (entry_p)
+		{
+			if (strcmp (entry_p -> rce_key_s, key_s) == 0)
+				{
+					return entry_p;
+				}
+
+			entry_p = entry_p -> rce_bucket_next_p;
+		}
+
+	return NULL;
+}
+
+
+static void UnlinkEntry (ReferenceCacheTier *tier_p, ReferenceCacheEntry *entry_p)
+{
+	if (entry_p -> rce_newer_p)
+		{
+			entry_p -> rce_newer_p -> rce_older_p = entry_p -> rce_older_p;
+		}
+	else
+		{
+			tier_p -> rct_newest_p = entry_p -> rce_older_p;
+		}
+
+	if (entry_p -> rce_older_p)
+		{
+			entry_p -> rce_older_p -> rce_newer_p = entry_p -> rce_newer_p;
+		}
+	else
+		{
+			tier_p -> rct_oldest_p = entry_p -> rce_newer_p;
+		}
+
+	entry_p -> rce_newer_p = NULL;
+	entry_p -> rce_older_p = NULL;
+}
+
+
+static void LinkEntryAsNewest (ReferenceCacheTier *tier_p, ReferenceCacheEntry *entry_p)
+{
+	entry_p -> rce_newer_p = NULL;
+	entry_p -> rce_older_p = tier_p -> rct_newest_p;
+
+	if (tier_p -> rct_newest_p)
+		{
+			tier_p -> rct_newest_p -> rce_newer_p = entry_p;
+		}
+	else
+		{
+			tier_p -> rct_oldest_p = entry_p;
+		}
+
+	tier_p -> rct_newest_p = entry_p;
+}
+
+
+static void RemoveEntry (ReferenceCacheTier *tier_p, ReferenceCacheEntry *entry_p)
+{
+	ReferenceCacheEntry **link_pp = & (tier_p -> rct_buckets_pp [GetKeyHash (entry_p -> rce_key_s)]);
+
+	while (*link_pp != entry_p)
+		{
+			link_pp = & ((*link_pp) -> rce_bucket_next_p);
+		}
+
+	*link_pp = entry_p -> rce_bucket_next_p;
+
+	UnlinkEntry (tier_p, entry_p);
+
+	tier_p -> rct_num_bytes -= entry_p -> rce_num_bytes;
+	-- (tier_p -> rct_num_entries);
+
+	FreeReferenceCacheEntry (entry_p);
+}
+
+
+static void FreeReferenceCacheEntry (ReferenceCacheEntry *entry_p)
+{
+	if (entry_p -> rce_key_s)
+		{
+			FreeCopiedString (entry_p -> rce_key_s);
+		}
+
+	if (entry_p -> rce_doc_p)
+		{
+			json_decref (entry_p -> rce_doc_p);
+		}
+
+	FreeMemory (entry_p);
+}
+
+
+static size_t GetDocumentSize (const json_t *doc_p)
+{
+	size_t size = 0;
+
+	if (json_is_string (doc_p))
+		{
+			/* Already serialised, e.g. a cached Study */
+			size = json_string_length (doc_p);
+		}
+	else
+		{
+			char *doc_s = json_dumps (doc_p, JSON_COMPACT);
+
+			if (doc_s)
+				{
+					size = strlen (doc_s);
+					free (doc_s);
+				}
+		}
+
+	return size;
+}
+
+
+static bool AddTierStatisticsToJSON (json_t *stats_p, const DFWFieldTrialData datatype, const ReferenceCacheTier *tier_p)
+{
+	json_t *tier_json_p = json_object ();
+
+	if (tier_json_p)
+		{
+			if (SetJSONString (tier_json_p, CONTEXT_PREFIX_SCHEMA_ORG_S "name", GetDatatypeDescriptionAsString (datatype)))
+				{
+					if (json_object_set_new (tier_json_p, "entries", json_integer (tier_p -> rct_num_entries)) == 0)
+						{
+							if (json_object_set_new (tier_json_p, "bytes", json_integer (tier_p -> rct_num_bytes)) == 0)
+								{
+									if (json_object_set_new (tier_json_p, "max_bytes", json_integer (tier_p -> rct_max_bytes)) == 0)
+										{
+											if (json_object_set_new (tier_json_p, "hits", json_integer (tier_p -> rct_hits)) == 0)
+												{
+													if (json_object_set_new (tier_json_p, "misses", json_integer (tier_p -> rct_misses)) == 0)
+														{
+															if (json_object_set_new (tier_json_p, "evictions", json_integer (tier_p -> rct_evictions)) == 0)
+																{
+																	if (json_object_set_new (tier_json_p, "expirations", json_integer (tier_p -> rct_expirations)) == 0)
+																		{
+																			if (json_array_append_new (stats_p, tier_json_p) == 0)
+																				{
+																					return true;
+																				}
+																		}
+																}
+														}
+												}
+										}
+								}
+						}
+				}
+
+			json_decref (tier_json_p);
+		}		/* if (tier_json_p) */
+
+	return false;
+}
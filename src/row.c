@@ -41,6 +41,10 @@ static bool GetTreatmentFactorValuesFromJSON (const json_t *row_json_p, Row *row
 
 static bool AddTreatmentFactorsToJSON (json_t *row_json_p, LinkedList *treatment_factors_p, const Study *study_p, const ViewFormat format);
 
+static bool IsObservationNodeMatching (const ListItem *item_p, const void *value_p);
+
+static bool IsTreatmentFactorValueNodeMatching (const ListItem *item_p, const void *value_p);
+
 
 Row *AllocateRow (bson_oid_t *id_p, const uint32 rack_index, const uint32 study_index, const uint32 replicate, Material *material_p, MEM_FLAG material_mem, Plot *parent_plot_p)
 {
@@ -54,46 +58,70 @@ Row *AllocateRow (bson_oid_t *id_p, const uint32 rack_index, const uint32 study_
 
 					if (tf_values_p)
 						{
-							Row *row_p = (Row *) AllocMemory (sizeof (Row));
+							ListIndex *observations_index_p = AllocateListIndex ();
 
-							if (row_p)
+							if (observations_index_p)
 								{
-									bool success_flag = true;
+									ListIndex *tf_values_index_p = AllocateListIndex ();
 
-									if (!id_p)
+									if (tf_values_index_p)
 										{
-											id_p = GetNewBSONOid ();
+											Row *row_p = (Row *) AllocMemory (sizeof (Row));
 
-											if (!id_p)
+											if (row_p)
 												{
-													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate BSON oid for row at [" UINT32_FMT ", " UINT32_FMT "] for study \"%s\"", parent_plot_p -> pl_parent_p -> st_name_s);
-													success_flag = false;
+													bool success_flag = true;
+
+													if (!id_p)
+														{
+															id_p = GetNewBSONOid ();
+
+															if (!id_p)
+																{
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate BSON oid for row at [" UINT32_FMT ", " UINT32_FMT "] for study \"%s\"", parent_plot_p -> pl_parent_p -> st_name_s);
+																	success_flag = false;
+																}
+														}
+
+													if (success_flag)
+														{
+															row_p -> ro_id_p = id_p;
+
+															row_p -> ro_rack_index = rack_index;
+															row_p -> ro_by_study_index = study_index;
+															row_p -> ro_material_p = material_p;
+															row_p -> ro_material_mem = material_mem;
+															row_p -> ro_plot_p = parent_plot_p;
+															row_p -> ro_study_p = parent_plot_p -> pl_parent_p;
+															row_p -> ro_observations_p = observations_p;
+															row_p -> ro_treatment_factor_values_p = tf_values_p;
+															row_p -> ro_observations_index_p = observations_index_p;
+															row_p -> ro_treatment_factor_values_index_p = tf_values_index_p;
+															row_p -> ro_replicate_index = replicate;
+															row_p -> ro_replicate_control_flag = false;
+
+															return row_p;
+														}
+
+													FreeMemory (row_p);
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate row " UINT32_FMT " at [" UINT32_FMT "," UINT32_FMT "]", parent_plot_p -> pl_row_index, parent_plot_p -> pl_column_index, index);
 												}
-										}
 
-									if (success_flag)
+											FreeListIndex (tf_values_index_p);
+										}		/* if (tf_values_index_p) */
+									else
 										{
-											row_p -> ro_id_p = id_p;
-
-											row_p -> ro_rack_index = rack_index;
-											row_p -> ro_by_study_index = study_index;
-											row_p -> ro_material_p = material_p;
-											row_p -> ro_material_mem = material_mem;
-											row_p -> ro_plot_p = parent_plot_p;
-											row_p -> ro_study_p = parent_plot_p -> pl_parent_p;
-											row_p -> ro_observations_p = observations_p;
-											row_p -> ro_treatment_factor_values_p = tf_values_p;
-											row_p -> ro_replicate_index = replicate;
-											row_p -> ro_replicate_control_flag = false;
-
-											return row_p;
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate treatment factors index " UINT32_FMT " at [" UINT32_FMT "," UINT32_FMT "]", parent_plot_p -> pl_row_index, parent_plot_p -> pl_column_index, index);
 										}
 
-									FreeMemory (row_p);
-								}
+									FreeListIndex (observations_index_p);
+								}		/* if (observations_index_p) */
 							else
 								{
-									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate row " UINT32_FMT " at [" UINT32_FMT "," UINT32_FMT "]", parent_plot_p -> pl_row_index, parent_plot_p -> pl_column_index, index);
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate observations index " UINT32_FMT " at [" UINT32_FMT "," UINT32_FMT "]", parent_plot_p -> pl_row_index, parent_plot_p -> pl_column_index, index);
 								}
 
 							FreeLinkedList (tf_values_p);
@@ -122,6 +150,10 @@ Row *AllocateRow (bson_oid_t *id_p, const uint32 rack_index, const uint32 study_
 
 void FreeRow (Row *row_p)
 {
+	FreeListIndex (row_p -> ro_treatment_factor_values_index_p);
+
+	FreeListIndex (row_p -> ro_observations_index_p);
+
 	FreeLinkedList (row_p -> ro_treatment_factor_values_p);
 
 	FreeLinkedList (row_p -> ro_observations_p);
@@ -584,26 +616,27 @@ bool AddObservationToRow (Row *row_p, Observation *observation_p)
 {
 	bool success_flag = false;
 	ObservationNode *node_p = NULL;
+	uint32 hash = 0;
+	const bool hashed_flag = GetObservationMatchHash (observation_p, &hash);
 
 	/*
-	 * If the observation has the same phenotype and date as an existing one,
-	 * then replace it. If not, then simply add it.
+	 * If the observation has the same phenotype and dates as an existing one,
+	 * then replace it in place so the order of the list doesn't change, keeping
+	 * whichever of the raw and corrected values it doesn't set itself. If not,
+	 * then simply add it.
 	 */
-	node_p = (ObservationNode *) (row_p -> ro_observations_p -> ll_head_p);
-	while (node_p)
+	if (hashed_flag)
 		{
-			Observation *existing_observation_p = node_p -> on_observation_p;
+			node_p = (ObservationNode *) FindListIndexItem (row_p -> ro_observations_index_p, hash, IsObservationNodeMatching, observation_p);
 
-			if (AreObservationsMatching (existing_observation_p, observation_p))
+			if (node_p)
 				{
+					Observation *existing_observation_p = node_p -> on_observation_p;
+
+					MergeObservationValues (observation_p, existing_observation_p);
 					node_p -> on_observation_p = observation_p;
 					FreeObservation (existing_observation_p);
 					success_flag = true;
-					node_p = NULL;		/* force exit from loop */
-				}
-			else
-				{
-					node_p = (ObservationNode *) (node_p -> on_node.ln_next_p);
 				}
 		}
 
@@ -613,10 +646,19 @@ bool AddObservationToRow (Row *row_p, Observation *observation_p)
 
 			if (node_p)
 				{
-					LinkedListAddTail (row_p -> ro_observations_p, & (node_p -> on_node));
-					success_flag = true;
+					if ((!hashed_flag) || (AddListIndexItem (row_p -> ro_observations_index_p, & (node_p -> on_node), hash)))
+						{
+							LinkedListAddTail (row_p -> ro_observations_p, & (node_p -> on_node));
+							success_flag = true;
+						}
+					else
+						{
+							/* The caller still owns the observation so just free the node */
+							FreeMemory (node_p);
+						}
 				}
-			else
+
+			if (!success_flag)
 				{
 					char row_id_s [MONGO_OID_STRING_BUFFER_SIZE];
 					char observation_id_s [MONGO_OID_STRING_BUFFER_SIZE];
@@ -632,31 +674,51 @@ bool AddObservationToRow (Row *row_p, Observation *observation_p)
 }
 
 
+/*
+ * Get the Observation that AddObservationToRow () would replace with
+ * observation_p, if there is one.
+ */
+const Observation *GetMatchingObservationFromRow (const Row *row_p, const Observation *observation_p)
+{
+	uint32 hash = 0;
+
+	if (GetObservationMatchHash (observation_p, &hash))
+		{
+			const ObservationNode *node_p = (const ObservationNode *) FindListIndexItem (row_p -> ro_observations_index_p, hash, IsObservationNodeMatching, observation_p);
+
+			if (node_p)
+				{
+					return node_p -> on_observation_p;
+				}
+		}
+
+	return NULL;
+}
+
+
 
 bool AddTreatmentFactorValueToRow (Row *row_p, TreatmentFactorValue *tf_value_p)
 {
 	bool success_flag = false;
 	TreatmentFactorValueNode *node_p = NULL;
+	uint32 hash = 0;
+	const bool hashed_flag = GetTreatmentFactorValueMatchHash (tf_value_p, &hash);
 
 	/*
-	 * If the treatment factor has the same treatment factor and date as an existing one,
-	 * then replace it. If not, then simply add it.
+	 * If the treatment factor has the same treatment as an existing one,
+	 * then replace it in place. If not, then simply add it.
 	 */
-	node_p = (TreatmentFactorValueNode *) (row_p -> ro_treatment_factor_values_p -> ll_head_p);
-	while (node_p)
+	if (hashed_flag)
 		{
-			TreatmentFactorValue *existing_tf_value_p = node_p -> tfvn_value_p;
+			node_p = (TreatmentFactorValueNode *) FindListIndexItem (row_p -> ro_treatment_factor_values_index_p, hash, IsTreatmentFactorValueNodeMatching, tf_value_p);
 
-			if (AreTreatmentFactorValuesMatching (existing_tf_value_p, tf_value_p))
+			if (node_p)
 				{
+					TreatmentFactorValue *existing_tf_value_p = node_p -> tfvn_value_p;
+
 					node_p -> tfvn_value_p = tf_value_p;
 					FreeTreatmentFactorValue (existing_tf_value_p);
 					success_flag = true;
-					node_p = NULL;		/* force exit from loop */
-				}
-			else
-				{
-					node_p = (TreatmentFactorValueNode *) (node_p -> tfvn_node.ln_next_p);
 				}
 		}
 
@@ -666,10 +728,19 @@ bool AddTreatmentFactorValueToRow (Row *row_p, TreatmentFactorValue *tf_value_p)
 
 			if (node_p)
 				{
-					LinkedListAddTail (row_p -> ro_treatment_factor_values_p, & (node_p -> tfvn_node));
-					success_flag = true;
+					if ((!hashed_flag) || (AddListIndexItem (row_p -> ro_treatment_factor_values_index_p, & (node_p -> tfvn_node), hash)))
+						{
+							LinkedListAddTail (row_p -> ro_treatment_factor_values_p, & (node_p -> tfvn_node));
+							success_flag = true;
+						}
+					else
+						{
+							/* The caller still owns the value so just free the node */
+							FreeMemory (node_p);
+						}
 				}
-			else
+
+			if (!success_flag)
 				{
 					char row_id_s [MONGO_OID_STRING_BUFFER_SIZE];
 					char treatment_id_s [MONGO_OID_STRING_BUFFER_SIZE];
@@ -726,6 +797,83 @@ void UpdateRow (Row *row_p, const uint32 rack_plotwise_index, Material *material
 }
 
 
+json_t *GetRowValuesUpdateAsJSON (const Row *row_p, const char *filter_id_s)
+{
+	json_t *values_p = json_object ();
+
+	if (values_p)
+		{
+			if (AddObservationsToJSON (values_p, row_p -> ro_observations_p, VF_STORAGE))
+				{
+					if (AddTreatmentFactorsToJSON (values_p, row_p -> ro_treatment_factor_values_p, row_p -> ro_study_p, VF_STORAGE))
+						{
+							json_t *update_p = json_object ();
+
+							if (update_p)
+								{
+									const char *key_s;
+									json_t *value_p;
+									bool success_flag = true;
+
+									json_object_foreach (values_p, key_s, value_p)
+										{
+											char *path_s = ConcatenateVarargsStrings (PL_ROWS_S, ".$[", filter_id_s, "].", key_s, NULL);
+
+											if (path_s)
+												{
+													if (json_object_set (update_p, path_s, value_p) != 0)
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add \"%s\" to row update", path_s);
+															success_flag = false;
+														}
+
+													FreeCopiedString (path_s);
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to make row update path for \"%s\"", key_s);
+													success_flag = false;
+												}
+										}
+
+									if (success_flag)
+										{
+											json_decref (values_p);
+											return update_p;
+										}
+
+									json_decref (update_p);
+								}		/* if (update_p) */
+
+						}		/* if (AddTreatmentFactorsToJSON (values_p, row_p -> ro_treatment_factor_values_p, row_p -> ro_study_p, VF_STORAGE)) */
+
+				}		/* if (AddObservationsToJSON (values_p, row_p -> ro_observations_p, VF_STORAGE)) */
+
+			json_decref (values_p);
+		}		/* if (values_p) */
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get update for row " UINT32_FMT " in study \"%s\"", row_p -> ro_by_study_index, row_p -> ro_study_p -> st_name_s);
+
+	return NULL;
+}
+
+
+static bool IsObservationNodeMatching (const ListItem *item_p, const void *value_p)
+{
+	const ObservationNode *node_p = (const ObservationNode *) item_p;
+
+	return AreObservationsMatching (node_p -> on_observation_p, (const Observation *) value_p);
+}
+
+
+static bool IsTreatmentFactorValueNodeMatching (const ListItem *item_p, const void *value_p)
+{
+	const TreatmentFactorValueNode *node_p = (const TreatmentFactorValueNode *) item_p;
+
+	return AreTreatmentFactorValuesMatching (node_p -> tfvn_value_p, (const TreatmentFactorValue *) value_p);
+}
+
+
 static bool AddObservationsToJSON (json_t *row_json_p, LinkedList *observations_p, const ViewFormat format)
 {
 	bool success_flag = false;
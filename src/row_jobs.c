@@ -28,15 +28,23 @@
 #include "study_jobs.h"
 #include "math_utils.h"
 #include "time_util.h"
+#include "memory_allocations.h"
+#include "background_jobs.h"
+#include "delimited_table.h"
+#include "dfw_util.h"
 #include "observation.h"
+#include "observation_jobs.h"
+#include "trait_statistics.h"
 #include "treatment.h"
 #include "treatment_factor.h"
 #include "treatment_jobs.h"
 #include "treatment_factor_value.h"
+#include "upload_session.h"
 
 #include "char_parameter.h"
 #include "json_parameter.h"
 #include "string_parameter.h"
+#include "unsigned_int_parameter.h"
 
 #include "frictionless_data_util.h"
 
@@ -54,13 +62,153 @@ static const char * const S_PLOT_INDEX_S = "Plot index";
 
 static NamedParameterType S_ROW_PHENOTYPE_DATA_TABLE_COLUMN_DELIMITER = { "RO phenotype data delimiter", PT_CHAR };
 static NamedParameterType S_ROW_PHENOTYPE_DATA_TABLE = { "RO phenotype data upload", PT_JSON_TABLE};
+static NamedParameterType S_ROW_PHENOTYPE_DELIMITED_DATA = { "RO phenotype delimited data upload", PT_LARGE_STRING };
 static NamedParameterType S_STUDIES_LIST = { "RO Study", PT_STRING };
+static NamedParameterType S_ROW_UPLOAD_SESSION = { "RO upload session", PT_STRING };
+static NamedParameterType S_ROW_UPLOAD_CHUNK_START = { "RO upload chunk start", PT_UNSIGNED_INT };
+
+
+/*
+ * The default number of rows that are written with each bulk
+ * update when importing a phenotype table. This can be changed
+ * with the "row_update_batch_size" config key.
+ */
+#define S_DEFAULT_ROW_UPDATE_BATCH_SIZE (100)
+
+
+/*
+ * The identifier used in the array filter of a row update
+ */
+static const char * const S_ROW_FILTER_ID_S = "r";
+
+
+/*
+ * The keys for the values copied out of the ParameterSet for a phenotype
+ * import as the import may run after the ParameterSet has been freed.
+ */
+static const char * const S_IMPORT_STUDY_ID_S = "study_id";
+static const char * const S_IMPORT_TABLE_S = "table";
+static const char * const S_IMPORT_DELIMITED_TABLE_S = "delimited_table";
+static const char * const S_IMPORT_DELIMITER_S = "delimiter";
+static const char * const S_IMPORT_UPLOAD_SESSION_S = "upload_session";
+static const char * const S_IMPORT_CHUNK_START_S = "chunk_start";
+
+
+/*
+ * The parsed details of a phenotype column heading such as
+ * "<variable> [<start date>] [<end date>] [corrected]".
+ */
+typedef struct PhenotypeColumnNode
+{
+	ListItem pcn_node;
+
+	char *pcn_heading_s;
+
+	/*
+	 * The stored JSON for the column's MeasuredVariable. Each Observation
+	 * takes ownership of its MeasuredVariable so a new one is decoded from
+	 * this for every value. This is NULL if the heading isn't valid.
+	 */
+	json_t *pcn_variable_json_p;
+
+	struct tm *pcn_start_date_p;
+
+	struct tm *pcn_end_date_p;
+
+	bool pcn_corrected_value_flag;
+} PhenotypeColumnNode;
+
+
+/*
+ * A Plot of the Study that a phenotype table is being applied to.
+ */
+typedef struct ObservedPlot
+{
+	Plot *op_plot_p;
+
+	/* The number of the Plot's Rows whose changes have been saved */
+	size_t op_num_saved_rows;
+} ObservedPlot;
+
+
+/*
+ * A Row of the Study along with the Plot that it belongs to. The
+ * ListItem is only used to find the ObservedRow with a ListIndex, it
+ * isn't in any LinkedList.
+ */
+typedef struct ObservedRow
+{
+	ListItem or_node;
+
+	Row *or_row_p;
+
+	ObservedPlot *or_plot_p;
+
+	/* The number of table rows whose observations have been added to the Row */
+	size_t or_num_table_rows;
+} ObservedRow;
+
+
+/*
+ * The in-memory state used whilst importing a phenotype table. The
+ * Study's Plots are loaded once, every table row is applied to them
+ * and then each Row that has changed is saved once.
+ */
+typedef struct ObservationImport
+{
+	ObservedPlot *oi_plots_p;
+
+	size_t oi_num_plots;
+
+	/* The Study's Rows that have a ro_by_study_index */
+	ObservedRow *oi_rows_p;
+
+	size_t oi_num_rows;
+
+	/*
+	 * oi_rows_p hashed by ro_by_study_index. The indexes don't have to be
+	 * contiguous so they are hashed rather than used as array offsets.
+	 */
+	ListIndex *oi_rows_index_p;
+
+	/* The parsed headings of the table's columns */
+	LinkedList *oi_phenotype_columns_p;
+
+	/* The changes to the Study's trait statistics */
+	LinkedList *oi_trait_statistics_p;
+} ObservationImport;
 
 
 static Parameter *GetPhenotypesDataTableParameter (ParameterSet *param_set_p, ParameterGroup *group_p, const FieldTrialServiceData *data_p);
 
+static bool RunPhenotypeImport (ServiceJob *job_p, const json_t *params_p, FieldTrialServiceData *data_p);
+
+static bool RunPhenotypeImportChunk (ServiceJob *job_p, const json_t *rows_json_p, const char *session_id_s, const json_t *params_p, Study *study_p, const FieldTrialServiceData *data_p);
+
 static bool AddObservationValuesFromJSON (ServiceJob *job_p, const json_t *observations_json_p, Study *study_p, const FieldTrialServiceData *data_p);
 
+static bool AddObservationValuesFromDelimitedText (ServiceJob *job_p, const char *table_s, const char delimiter, Study *study_p, const FieldTrialServiceData *data_p);
+
+static bool AddObservationValuesFromTableRow (json_t *observation_json_p, ObservationImport *import_p, Study *study_p, const FieldTrialServiceData *data_p);
+
+static RowValueColumn *GetObservationValueColumns (const DelimitedTableHeader *header_p, ObservationImport *import_p, Study *study_p, const FieldTrialServiceData *data_p);
+
+static bool AddObservationValuesFromDelimitedRow (DelimitedTableReader *reader_p, const int32 index_column, const RowValueColumn *columns_p, const size_t num_columns, ObservationImport *import_p, Study *study_p, const FieldTrialServiceData *data_p);
+
+static void UpdateCachedStudyObservations (Study *study_p, const size_t num_imported, json_t *cached_plots_p, const FieldTrialServiceData *data_p);
+
+static bool InitObservationImport (ObservationImport *import_p, Study *study_p, const FieldTrialServiceData *data_p);
+
+static ObservedRow *GetObservedRow (const ObservationImport *import_p, const int32 by_study_index);
+
+static bool IsObservedRowForStudyIndex (const ListItem *item_p, const void *value_p);
+
+static size_t SaveObservationImport (ServiceJob *job_p, ObservationImport *import_p, json_t **cached_plots_pp, Study *study_p, const FieldTrialServiceData *data_p);
+
+static void ClearObservationImport (ObservationImport *import_p);
+
+static void UpdateRowValues (Row **rows_pp, bool *saved_flags_p, const size_t num_rows, const FieldTrialServiceData *data_p);
+
 
 static json_t *GetTableParameterHints (void);
 
@@ -68,6 +216,16 @@ static bool GetRackStudyIndex (const json_t *observation_json_p, int32 *plot_ind
 
 static bool GetObservationMetadata (const char *key_s, MeasuredVariable **measured_variable_pp, struct tm **start_date_pp, struct tm **end_date_pp, bool *corrected_value_flag_p, const FieldTrialServiceData *data_p);
 
+static const PhenotypeColumnNode *GetPhenotypeColumn (LinkedList *phenotype_columns_p, const char *heading_s, const FieldTrialServiceData *data_p);
+
+static PhenotypeColumnNode *AllocatePhenotypeColumnNode (const char *heading_s, const FieldTrialServiceData *data_p);
+
+static bool AddPhenotypeValueToRow (Row *row_p, const PhenotypeColumnNode *column_p, const char *value_s, LinkedList *trait_statistics_p, const FieldTrialServiceData *data_p);
+
+static bool AddTreatmentFactorLabelToRow (Row *row_p, TreatmentFactor *tf_p, const char *name_s);
+
+static void FreePhenotypeColumnNode (ListItem *node_p);
+
 
 /*
  * API Definitions
@@ -95,7 +253,18 @@ bool AddSubmissionRowPhenotypeParams (ServiceData *data_p, ParameterSet *param_s
 								{
 									if ((param_p = GetPhenotypesDataTableParameter (param_set_p, group_p, dfw_service_data_p)) != NULL)
 										{
-											success_flag = true;
+											if ((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_ROW_PHENOTYPE_DELIMITED_DATA.npt_type, S_ROW_PHENOTYPE_DELIMITED_DATA.npt_name_s, "Delimited phenotype data", "Phenotype data as CSV or TSV text with a header row. If this is set, it is used instead of the table. Set the delimiter to a comma or a tab to match.", NULL, PL_ADVANCED)) != NULL)
+												{
+													if ((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_ROW_UPLOAD_SESSION.npt_type, S_ROW_UPLOAD_SESSION.npt_name_s, "Upload session", "To upload a large table in chunks, set this to the same unique id for each chunk. The chunks are applied one at a time, in order, so each chunk must be sent once the previous one has finished. Chunks that have already been applied are skipped so a failed chunk can be resent.", NULL, PL_ADVANCED)) != NULL)
+														{
+															uint32 chunk_start = 0;
+
+															if ((param_p = EasyCreateAndAddUnsignedIntParameterToParameterSet (data_p, param_set_p, group_p, S_ROW_UPLOAD_CHUNK_START.npt_name_s, "Chunk start", "The index, in the whole table, of the first row of this chunk", &chunk_start, PL_ADVANCED)) != NULL)
+																{
+																	success_flag = true;
+																}
+														}
+												}
 										}
 								}
 
@@ -117,55 +286,101 @@ bool RunForSubmissionRowPhenotypeParams (FieldTrialServiceData *data_p, Paramete
 
 	if (GetCurrentStringParameterValueFromParameterSet (param_set_p, S_STUDIES_LIST.npt_name_s, &study_id_s))
 		{
-			Study *study_p = GetStudyByIdString (study_id_s, VF_STORAGE, data_p);
-
-			if (study_p)
+			const char *delimited_rows_s = NULL;
+			const json_t *rows_json_p = NULL;
+			json_t *import_params_p = NULL;
+
+			/*
+			 * Phenotypes uploaded as CSV or TSV text take precedence over the table
+			 */
+			if ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_ROW_PHENOTYPE_DELIMITED_DATA.npt_name_s, &delimited_rows_s)) && (!IsStringEmpty (delimited_rows_s)))
 				{
-					const json_t *rows_json_p = NULL;
+					const char *delimiter_p = NULL;
 
-					if (GetCurrentJSONParameterValueFromParameterSet (param_set_p, S_ROW_PHENOTYPE_DATA_TABLE.npt_name_s, &rows_json_p))
-						{
-							/*
-							 * Has a spreadsheet been uploaded?
-							 */
-							job_done_flag = true;
+					job_done_flag = true;
 
-							/*
-							 * Has a spreadsheet been uploaded?
-							 */
-							if (rows_json_p)
+					import_params_p = json_pack ("{s:s,s:s}", S_IMPORT_STUDY_ID_S, study_id_s, S_IMPORT_DELIMITED_TABLE_S, delimited_rows_s);
+
+					if (import_params_p)
+						{
+							if ((GetCurrentCharParameterValueFromParameterSet (param_set_p, S_ROW_PHENOTYPE_DATA_TABLE_COLUMN_DELIMITER.npt_name_s, &delimiter_p)) && (delimiter_p) && (*delimiter_p != '\0'))
 								{
-									const size_t num_rows = json_array_size (rows_json_p);
+									char delimiter_s [2];
+
+									*delimiter_s = *delimiter_p;
+									* (delimiter_s + 1) = '\0';
 
-									if (num_rows > 0)
+									if (!SetJSONString (import_params_p, S_IMPORT_DELIMITER_S, delimiter_s))
 										{
-											//if (AddTreatmentFactorsFromJSON (job_p, rows_json_p, study_p, data_p))
-												{
+											json_decref (import_params_p);
+											import_params_p = NULL;
+										}
+								}
+						}
+				}
+			else if (GetCurrentJSONParameterValueFromParameterSet (param_set_p, S_ROW_PHENOTYPE_DATA_TABLE.npt_name_s, &rows_json_p))
+				{
+					job_done_flag = true;
 
-												}
+					/*
+					 * Has a spreadsheet been uploaded?
+					 */
+					if (rows_json_p)
+						{
+							if (json_array_size (rows_json_p) > 0)
+								{
+									import_params_p = json_pack ("{s:s,s:O}", S_IMPORT_STUDY_ID_S, study_id_s, S_IMPORT_TABLE_S, rows_json_p);
+
+									if (import_params_p)
+										{
+											const char *session_id_s = NULL;
 
-											if (!AddObservationValuesFromJSON (job_p, rows_json_p, study_p, data_p))
+											/*
+											 * Is this a chunk of a larger table?
+											 */
+											if ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_ROW_UPLOAD_SESSION.npt_name_s, &session_id_s)) && (!IsStringEmpty (session_id_s)))
 												{
-													PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, rows_json_p, "AddObservationValuesFromJSON for study \"%s\" failed", study_id_s);
-												}
+													const uint32 *chunk_start_p = NULL;
 
-										}		/* if (num_rows > 0) */
+													GetCurrentUnsignedIntParameterValueFromParameterSet (param_set_p, S_ROW_UPLOAD_CHUNK_START.npt_name_s, &chunk_start_p);
 
-									else
-										{
-											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Empty JSON for uploaded plots for study \"%s\"", study_id_s);
+													if ((!SetJSONString (import_params_p, S_IMPORT_UPLOAD_SESSION_S, session_id_s)) || (!SetJSONInteger (import_params_p, S_IMPORT_CHUNK_START_S, chunk_start_p ? *chunk_start_p : 0)))
+														{
+															json_decref (import_params_p);
+															import_params_p = NULL;
+														}
+												}
 										}
-
-								}		/* if (table_value.st_json_p) */
+								}
 							else
 								{
-									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "NULL JSON for uploaded plots for study \"%s\"", study_id_s);
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Empty JSON for uploaded plots for study \"%s\"", study_id_s);
 								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "NULL JSON for uploaded plots for study \"%s\"", study_id_s);
+						}
+
+				}		/* if (GetParameterValueFromParameterSet (param_set_p, S_PHENOTYPE_TABLE.npt_name_s, &value, true)) */
 
-						}		/* if (GetParameterValueFromParameterSet (param_set_p, S_PHENOTYPE_TABLE.npt_name_s, &value, true)) */
+			if (import_params_p)
+				{
+					/*
+					 * Imports of large tables can take a long time so they are
+					 * run on the background workers and the job is polled.
+					 */
+					if (!RunBackgroundServiceJob (job_p, RunPhenotypeImport, import_params_p, data_p))
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to import phenotypes for study \"%s\"", study_id_s);
+						}
 
-					FreeStudy (study_p);
-				}		/* if (study_p) */
+					json_decref (import_params_p);
+				}
+			else if (job_done_flag)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the phenotype import values for study \"%s\"", study_id_s);
+				}
 
 		}		/* if (GetParameterValueFromParameterSet (param_set_p, S_STUDIES_LIST.npt_name_s, &parent_experimental_area_value, true)) */
 
@@ -189,6 +404,18 @@ bool GetSubmissionRowPhenotypeParameterTypeForNamedParameter (const char *param_
 		{
 			*pt_p = S_ROW_PHENOTYPE_DATA_TABLE.npt_type;
 		}
+	else if (strcmp (param_name_s, S_ROW_PHENOTYPE_DELIMITED_DATA.npt_name_s) == 0)
+		{
+			*pt_p = S_ROW_PHENOTYPE_DELIMITED_DATA.npt_type;
+		}
+	else if (strcmp (param_name_s, S_ROW_UPLOAD_SESSION.npt_name_s) == 0)
+		{
+			*pt_p = S_ROW_UPLOAD_SESSION.npt_type;
+		}
+	else if (strcmp (param_name_s, S_ROW_UPLOAD_CHUNK_START.npt_name_s) == 0)
+		{
+			*pt_p = S_ROW_UPLOAD_CHUNK_START.npt_type;
+		}
 	else
 		{
 			success_flag = false;
@@ -503,94 +730,195 @@ static bool GetRackStudyIndex (const json_t *observation_json_p, int32 *rack_stu
 }
 
 
-static bool AddObservationValuesFromJSON (ServiceJob *job_p, const json_t *observations_json_p, Study *study_p, const FieldTrialServiceData *data_p)
+/*
+ * Do the work of a phenotype import. This may be running on a background
+ * worker so everything that it needs comes from params_p rather than the
+ * ParameterSet.
+ */
+static bool RunPhenotypeImport (ServiceJob *job_p, const json_t *params_p, FieldTrialServiceData *data_p)
 {
-	bool success_flag	= true;
-	OperationStatus status = OS_FAILED;
+	bool success_flag = false;
+	const char *study_id_s = GetJSONString (params_p, S_IMPORT_STUDY_ID_S);
+	Study *study_p = GetStudyByIdString (study_id_s, VF_STORAGE, data_p);
 
-	if (json_is_array (observations_json_p))
+	if (study_p)
 		{
-			const size_t num_rows = json_array_size (observations_json_p);
-			size_t i;
-			size_t num_imported = 0;
-			size_t num_empty_rows = 0;
-			bool imported_obeservation_flag = false;
+			const char *delimited_rows_s = GetJSONString (params_p, S_IMPORT_DELIMITED_TABLE_S);
 
-			for (i = 0; i < num_rows; ++ i)
+			if (delimited_rows_s)
 				{
-					json_t *observation_json_p = json_array_get (observations_json_p, i);
-					const size_t row_size = json_object_size (observation_json_p);
+					const char *delimiter_s = GetJSONString (params_p, S_IMPORT_DELIMITER_S);
+					char delimiter = S_DEFAULT_COLUMN_DELIMITER;
 
-					if (row_size > 0)
+					if (delimiter_s && (*delimiter_s != '\0'))
 						{
-							int32 rack_index = -1;
+							delimiter = *delimiter_s;
+						}
 
-							imported_obeservation_flag = false;
+					success_flag = AddObservationValuesFromDelimitedText (job_p, delimited_rows_s, delimiter, study_p, data_p);
 
-							if (GetRackStudyIndex (observation_json_p, &rack_index))
-								{
-									const bool expand_fields_flag = true;
-									Row *row_p = GetRowByStudyIndex (rack_index, study_p, data_p);
+					if (!success_flag)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "AddObservationValuesFromDelimitedText for study \"%s\" failed", study_id_s);
+						}
+				}
+			else
+				{
+					const json_t *rows_json_p = json_object_get (params_p, S_IMPORT_TABLE_S);
+					const char *session_id_s = GetJSONString (params_p, S_IMPORT_UPLOAD_SESSION_S);
 
-									if (row_p)
-										{
-											OperationStatus import_row_status = AddObservationValuesToRow (row_p, observation_json_p, study_p, data_p);
+					if (session_id_s)
+						{
+							success_flag = RunPhenotypeImportChunk (job_p, rows_json_p, session_id_s, params_p, study_p, data_p);
+						}
+					else
+						{
+							success_flag = AddObservationValuesFromJSON (job_p, rows_json_p, study_p, data_p);
+						}
 
-											if ((import_row_status == OS_PARTIALLY_SUCCEEDED) || (import_row_status == OS_SUCCEEDED))
-												{
-													if (SavePlot (row_p -> ro_plot_p, data_p))
-														{
-															imported_obeservation_flag = true;
-															++ num_imported;
-														}
-													else
-														{
-															char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+					if (!success_flag)
+						{
+							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, rows_json_p, "AddObservationValuesFromJSON for study \"%s\" failed", study_id_s);
+						}
+				}
 
-															bson_oid_to_string (study_p -> st_id_p, id_s);
-															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, observation_json_p, "Failed to save row " INT32_FMT " for Study \"%s\"", rack_index, id_s);
-														}
-												}		/* if (loop_success_flag) */
+			FreeStudy (study_p);
+		}		/* if (study_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get parent study for phenotypes with id \"%s\"", study_id_s);
+		}
 
-											FreeRow (row_p);
+	return success_flag;
+}
 
-										}		/*  if (row_p) */
-									else
-										{
-											char id_s [MONGO_OID_STRING_BUFFER_SIZE];
 
-											bson_oid_to_string (study_p -> st_id_p, id_s);
-											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, observation_json_p, "Failed to get row " INT32_FMT " for Study \"%s\"", rack_index, id_s);
-										}
+/*
+ * Import one chunk of a table that is being uploaded over several requests.
+ * Only the rows after the session's checkpoint are applied and the checkpoint
+ * is moved on once all of them have been saved.
+ */
+static bool RunPhenotypeImportChunk (ServiceJob *job_p, const json_t *rows_json_p, const char *session_id_s, const json_t *params_p, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	const char *study_id_s = GetJSONString (params_p, S_IMPORT_STUDY_ID_S);
+	const json_t *chunk_start_p = json_object_get (params_p, S_IMPORT_CHUNK_START_S);
+	const int64 chunk_start = json_is_integer (chunk_start_p) ? json_integer_value (chunk_start_p) : 0;
+	UploadChunk chunk;
 
-								}		/* if (GetIntegerFromJSON (observation_json_p, S_PLOT_INDEX_S, &plot_index)) */
-							else
-								{
-									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, observation_json_p, "Failed to get %s", S_PLOT_INDEX_S);
-								}
+	if (BeginUploadChunk (&chunk, session_id_s, US_PHENOTYPES_TYPE_S, study_id_s, chunk_start, json_array_size (rows_json_p), job_p, &S_ROW_UPLOAD_SESSION, data_p))
+		{
+			json_t *rows_to_apply_p = GetUploadChunkRowsToApply (&chunk, rows_json_p);
 
-							if (!imported_obeservation_flag)
+			if (rows_to_apply_p)
+				{
+					if (json_array_size (rows_to_apply_p) > 0)
+						{
+							OperationStatus status;
+
+							success_flag = AddObservationValuesFromJSON (job_p, rows_to_apply_p, study_p, data_p);
+
+							/*
+							 * If any rows failed, the checkpoint stays where it is so that
+							 * the whole chunk can be sent again. Reapplying the rows that
+							 * were saved just replaces their Observations with the same values.
+							 */
+							status = GetServiceJobStatus (job_p);
+
+							if (status == OS_SUCCEEDED)
 								{
-									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, observation_json_p, "Failed to import observations");
+									if (!CommitUploadChunk (&chunk, data_p))
+										{
+											AddParameterErrorMessageToServiceJob (job_p, S_ROW_UPLOAD_SESSION.npt_name_s, S_ROW_UPLOAD_SESSION.npt_type, "Failed to store the upload session's checkpoint");
+											SetServiceJobStatus (job_p, OS_PARTIALLY_SUCCEEDED);
+										}
 								}
-
-						}		/* if (row_size > 0) */
+						}
 					else
 						{
-							++ num_empty_rows;
+							/* Every row was applied by an earlier attempt */
+							SetServiceJobStatus (job_p, OS_SUCCEEDED);
+							success_flag = true;
 						}
 
+					json_decref (rows_to_apply_p);
+				}		/* if (rows_to_apply_p) */
+
+			/* If nothing was committed, let the rows be sent again */
+			ReleaseUploadChunk (&chunk, data_p);
+
+			AddUploadChunkToServiceJob (&chunk, job_p);
+		}		/* if (BeginUploadChunk (&chunk, session_id_s, US_PHENOTYPES_TYPE_S, study_id_s, chunk_start, json_array_size (rows_json_p), job_p, &S_ROW_UPLOAD_SESSION, data_p)) */
+	else
+		{
+			SetServiceJobStatus (job_p, OS_FAILED);
+		}
+
+	return success_flag;
+}
+
 
-				}		/* for (i = 0; i < num_rows; ++ i) */
+static bool AddObservationValuesFromJSON (ServiceJob *job_p, const json_t *observations_json_p, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag	= true;
+	OperationStatus status = OS_FAILED;
 
+	if (json_is_array (observations_json_p))
+		{
+			ObservationImport import;
 
-			if (num_imported + num_empty_rows == num_rows)
+			if (InitObservationImport (&import, study_p, data_p))
 				{
-					status = OS_SUCCEEDED;
-				}
-			else if (num_imported > 0)
+					const size_t num_rows = json_array_size (observations_json_p);
+					size_t i;
+					size_t num_imported = 0;
+					size_t num_empty_rows = 0;
+					BackgroundJob *bg_job_p = GetBackgroundJob (job_p);
+
+					/*
+					 * The updated plots to splice into any cached copy of the study
+					 */
+					json_t *cached_plots_p = json_object ();
+
+					for (i = 0; i < num_rows; ++ i)
+						{
+							json_t *observation_json_p = json_array_get (observations_json_p, i);
+
+							if (json_object_size (observation_json_p) > 0)
+								{
+									AddObservationValuesFromTableRow (observation_json_p, &import, study_p, data_p);
+								}
+							else
+								{
+									++ num_empty_rows;
+								}
+
+							SetBackgroundJobProgress (bg_job_p, i + 1, num_rows);
+						}		/* for (i = 0; i < num_rows; ++ i) */
+
+					num_imported = SaveObservationImport (job_p, &import, &cached_plots_p, study_p, data_p);
+
+					if (num_imported + num_empty_rows == num_rows)
+						{
+							status = OS_SUCCEEDED;
+						}
+					else if (num_imported > 0)
+						{
+							status = OS_PARTIALLY_SUCCEEDED;
+						}
+
+					UpdateCachedStudyObservations (study_p, num_imported, cached_plots_p, data_p);
+
+					if (cached_plots_p)
+						{
+							json_decref (cached_plots_p);
+						}
+
+					ClearObservationImport (&import);
+				}		/* if (InitObservationImport (&import, study_p, data_p)) */
+			else
 				{
-					status = OS_PARTIALLY_SUCCEEDED;
+					success_flag = false;
 				}
 
 		}		/* if (json_is_array (plots_json_p)) */
@@ -601,6 +929,966 @@ static bool AddObservationValuesFromJSON (ServiceJob *job_p, const json_t *obser
 }
 
 
+/*
+ * Import phenotypes from CSV or TSV text. The columns are worked out
+ * once from the header and each row's values are added straight from
+ * its cells before the next row is read.
+ */
+static bool AddObservationValuesFromDelimitedText (ServiceJob *job_p, const char *table_s, const char delimiter, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	OperationStatus status = OS_FAILED;
+	DelimitedTableReader reader;
+
+	if (InitDelimitedTableReader (&reader, table_s, delimiter))
+		{
+			DelimitedTableHeader header;
+
+			if (ReadDelimitedTableHeader (&reader, &header))
+				{
+					const int32 index_column = GetDelimitedTableColumnIndex (&header, PL_INDEX_TABLE_TITLE_S);
+
+					if (index_column != -1)
+						{
+							ObservationImport import;
+
+							if (InitObservationImport (&import, study_p, data_p))
+								{
+									RowValueColumn *columns_p = GetObservationValueColumns (&header, &import, study_p, data_p);
+
+									if (columns_p)
+										{
+											size_t num_rows = 0;
+											size_t num_imported = 0;
+
+											/* The header row doesn't hold any phenotypes */
+											const size_t max_num_rows = GetMaximumNumberOfDelimitedTableRows (table_s) - 1;
+											size_t num_empty_rows = 0;
+											BackgroundJob *bg_job_p = GetBackgroundJob (job_p);
+
+											/*
+											 * The updated plots to splice into any cached copy of the study
+											 */
+											json_t *cached_plots_p = json_object ();
+
+											success_flag = true;
+
+											while (ReadDelimitedTableRow (&reader))
+												{
+													if (IsDelimitedTableRowEmpty (&reader))
+														{
+															++ num_empty_rows;
+														}
+													else
+														{
+															AddObservationValuesFromDelimitedRow (&reader, index_column, columns_p, header.dth_num_headings, &import, study_p, data_p);
+														}
+
+													++ num_rows;
+
+													SetBackgroundJobProgress (bg_job_p, num_rows, max_num_rows);
+												}		/* while (ReadDelimitedTableRow (&reader)) */
+
+											if (reader.dtr_error_flag)
+												{
+													AddTabularParameterErrorMessageToServiceJob (job_p, S_ROW_PHENOTYPE_DELIMITED_DATA.npt_name_s, S_ROW_PHENOTYPE_DELIMITED_DATA.npt_type, "Failed to read row", num_rows, NULL);
+													success_flag = false;
+												}
+
+											num_imported = SaveObservationImport (job_p, &import, &cached_plots_p, study_p, data_p);
+
+											if ((num_imported + num_empty_rows == num_rows) && success_flag)
+												{
+													status = OS_SUCCEEDED;
+												}
+											else if (num_imported > 0)
+												{
+													status = OS_PARTIALLY_SUCCEEDED;
+												}
+
+											UpdateCachedStudyObservations (study_p, num_imported, cached_plots_p, data_p);
+
+											if (cached_plots_p)
+												{
+													json_decref (cached_plots_p);
+												}
+
+											FreeMemory (columns_p);
+										}		/* if (columns_p) */
+
+									ClearObservationImport (&import);
+								}		/* if (InitObservationImport (&import, study_p, data_p)) */
+
+						}		/* if (index_column != -1) */
+					else
+						{
+							char *error_s = ConcatenateVarargsStrings ("Missing column \"", PL_INDEX_TABLE_TITLE_S, "\"", NULL);
+
+							if (error_s)
+								{
+									AddParameterErrorMessageToServiceJob (job_p, S_ROW_PHENOTYPE_DELIMITED_DATA.npt_name_s, S_ROW_PHENOTYPE_DELIMITED_DATA.npt_type, error_s);
+									FreeCopiedString (error_s);
+								}
+							else
+								{
+									AddParameterErrorMessageToServiceJob (job_p, S_ROW_PHENOTYPE_DELIMITED_DATA.npt_name_s, S_ROW_PHENOTYPE_DELIMITED_DATA.npt_type, PL_INDEX_TABLE_TITLE_S);
+								}
+						}
+
+					ClearDelimitedTableHeader (&header);
+				}		/* if (ReadDelimitedTableHeader (&reader, &header)) */
+			else
+				{
+					AddParameterErrorMessageToServiceJob (job_p, S_ROW_PHENOTYPE_DELIMITED_DATA.npt_name_s, S_ROW_PHENOTYPE_DELIMITED_DATA.npt_type, "Failed to read the column headings");
+				}
+
+			ClearDelimitedTableReader (&reader);
+		}		/* if (InitDelimitedTableReader (&reader, table_s, delimiter)) */
+
+	SetServiceJobStatus (job_p, status);
+
+	return success_flag;
+}
+
+
+/*
+ * Work out what each column of a delimited phenotype table holds once
+ * rather than for every row. The columns that identify the Row are
+ * ignored.
+ */
+static RowValueColumn *GetObservationValueColumns (const DelimitedTableHeader *header_p, ObservationImport *import_p, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	RowValueColumn *columns_p = (RowValueColumn *) AllocMemoryArray (header_p -> dth_num_headings, sizeof (RowValueColumn));
+
+	if (columns_p)
+		{
+			size_t i;
+			RowValueColumn *column_p = columns_p;
+			char **heading_ss = header_p -> dth_headings_ss;
+
+			for (i = header_p -> dth_num_headings; i > 0; -- i, ++ column_p, ++ heading_ss)
+				{
+					if ((strcmp (*heading_ss, PL_INDEX_TABLE_TITLE_S) == 0) || (strcmp (*heading_ss, S_PLOT_INDEX_S) == 0) || (strcmp (*heading_ss, S_RACK_S) == 0))
+						{
+							column_p -> rvc_treatment_factor_p = NULL;
+							column_p -> rvc_phenotype_column_p = NULL;
+						}
+					else
+						{
+							SetRowValueColumn (column_p, *heading_ss, false, import_p -> oi_phenotype_columns_p, study_p, data_p);
+						}
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " phenotype table columns", header_p -> dth_num_headings);
+		}
+
+	return columns_p;
+}
+
+
+/*
+ * Add the observations in the current row of a delimited table to
+ * the Row that it refers to.
+ */
+static bool AddObservationValuesFromDelimitedRow (DelimitedTableReader *reader_p, const int32 index_column, const RowValueColumn *columns_p, const size_t num_columns, ObservationImport *import_p, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	bool imported_obeservation_flag = false;
+	int32 rack_index = -1;
+
+	if (GetDelimitedTableCellAsInteger (reader_p, index_column, &rack_index))
+		{
+			ObservedRow *observed_row_p = GetObservedRow (import_p, rack_index);
+
+			if (observed_row_p)
+				{
+					OperationStatus import_row_status = AddDelimitedTableValuesToRow (observed_row_p -> or_row_p, reader_p, columns_p, num_columns, import_p -> oi_trait_statistics_p, data_p);
+
+					if ((import_row_status == OS_PARTIALLY_SUCCEEDED) || (import_row_status == OS_SUCCEEDED))
+						{
+							++ (observed_row_p -> or_num_table_rows);
+							imported_obeservation_flag = true;
+						}
+
+				}		/*  if (observed_row_p) */
+			else
+				{
+					char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+					bson_oid_to_string (study_p -> st_id_p, id_s);
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get row " INT32_FMT " for Study \"%s\"", rack_index, id_s);
+				}
+
+		}		/* if (GetDelimitedTableCellAsInteger (reader_p, index_column, &rack_index)) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get \"%s\" for table row " SIZET_FMT, PL_INDEX_TABLE_TITLE_S, reader_p -> dtr_num_rows_read);
+		}
+
+	if (!imported_obeservation_flag)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to import observations for table row " SIZET_FMT, reader_p -> dtr_num_rows_read);
+		}
+
+	return imported_obeservation_flag;
+}
+
+
+/*
+ * Add the observations in a row of an uploaded table to the Row
+ * that it refers to. The Row's Plot is saved by SaveObservationImport()
+ * once all of the table rows have been applied.
+ */
+static bool AddObservationValuesFromTableRow (json_t *observation_json_p, ObservationImport *import_p, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	bool imported_obeservation_flag = false;
+	int32 rack_index = -1;
+
+	if (GetRackStudyIndex (observation_json_p, &rack_index))
+		{
+			ObservedRow *observed_row_p = GetObservedRow (import_p, rack_index);
+
+			if (observed_row_p)
+				{
+					OperationStatus import_row_status = AddObservationValuesToRow (observed_row_p -> or_row_p, observation_json_p, import_p -> oi_phenotype_columns_p, import_p -> oi_trait_statistics_p, study_p, data_p);
+
+					if ((import_row_status == OS_PARTIALLY_SUCCEEDED) || (import_row_status == OS_SUCCEEDED))
+						{
+							++ (observed_row_p -> or_num_table_rows);
+							imported_obeservation_flag = true;
+						}
+
+				}		/*  if (observed_row_p) */
+			else
+				{
+					char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+					bson_oid_to_string (study_p -> st_id_p, id_s);
+					PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, observation_json_p, "Failed to get row " INT32_FMT " for Study \"%s\"", rack_index, id_s);
+				}
+
+		}		/* if (GetRackStudyIndex (observation_json_p, &rack_index)) */
+	else
+		{
+			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, observation_json_p, "Failed to get %s", S_PLOT_INDEX_S);
+		}
+
+	if (!imported_obeservation_flag)
+		{
+			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, observation_json_p, "Failed to import observations");
+		}
+
+	return imported_obeservation_flag;
+}
+
+
+/*
+ * Load all of the Study's Plots with a single query and index their
+ * Rows by ro_by_study_index so that each table row can find its Row
+ * without going back to the database.
+ */
+static bool InitObservationImport (ObservationImport *import_p, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	size_t num_plots = 0;
+
+	import_p -> oi_plots_p = NULL;
+	import_p -> oi_num_plots = 0;
+	import_p -> oi_rows_p = NULL;
+	import_p -> oi_num_rows = 0;
+	import_p -> oi_rows_index_p = NULL;
+	import_p -> oi_phenotype_columns_p = NULL;
+	import_p -> oi_trait_statistics_p = NULL;
+
+	/*
+	 * If there are no plots for the Study yet, there might not
+	 * be any results at all which isn't an error.
+	 */
+	if (!GetStudyPlots (study_p, data_p))
+		{
+			PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "No existing plots found for study \"%s\"", study_p -> st_name_s);
+		}
+
+	num_plots = study_p -> st_plots_p -> ll_size;
+
+	if (num_plots > 0)
+		{
+			PlotNode *plot_node_p = (PlotNode *) (study_p -> st_plots_p -> ll_head_p);
+			size_t num_rows = 0;
+
+			/*
+			 * Rows without a study index can't be referred to by a
+			 * phenotype table so they are left out of the index.
+			 */
+			while (plot_node_p)
+				{
+					RowNode *row_node_p = (RowNode *) (plot_node_p -> pn_plot_p -> pl_rows_p -> ll_head_p);
+
+					while (row_node_p)
+						{
+							const uint32 study_index = row_node_p -> rn_row_p -> ro_by_study_index;
+
+							if ((study_index > 0) && (study_index <= INT32_MAX))
+								{
+									++ num_rows;
+								}
+
+							row_node_p = (RowNode *) (row_node_p -> rn_node.ln_next_p);
+						}
+
+					plot_node_p = (PlotNode *) (plot_node_p -> pn_node.ln_next_p);
+				}
+
+			import_p -> oi_plots_p = (ObservedPlot *) AllocMemoryArray (num_plots, sizeof (ObservedPlot));
+
+			if (import_p -> oi_plots_p)
+				{
+					if ((num_rows == 0) || ((import_p -> oi_rows_p = (ObservedRow *) AllocMemoryArray (num_rows, sizeof (ObservedRow))) != NULL))
+						{
+							if ((import_p -> oi_rows_index_p = AllocateListIndex ()) != NULL)
+								{
+									ObservedPlot *observed_plot_p = import_p -> oi_plots_p;
+									ObservedRow *observed_row_p = import_p -> oi_rows_p;
+
+									success_flag = true;
+									import_p -> oi_num_plots = num_plots;
+
+									plot_node_p = (PlotNode *) (study_p -> st_plots_p -> ll_head_p);
+
+									while (plot_node_p && success_flag)
+										{
+											RowNode *row_node_p = (RowNode *) (plot_node_p -> pn_plot_p -> pl_rows_p -> ll_head_p);
+
+											observed_plot_p -> op_plot_p = plot_node_p -> pn_plot_p;
+											observed_plot_p -> op_num_saved_rows = 0;
+
+											while (row_node_p && success_flag)
+												{
+													Row *row_p = row_node_p -> rn_row_p;
+
+													if ((row_p -> ro_by_study_index > 0) && (row_p -> ro_by_study_index <= INT32_MAX))
+														{
+															if (!GetObservedRow (import_p, (int32) (row_p -> ro_by_study_index)))
+																{
+																	const uint32 hash = HashListIndexBytes (LI_HASH_SEED, & (row_p -> ro_by_study_index), sizeof (row_p -> ro_by_study_index));
+
+																	observed_row_p -> or_node.ln_prev_p = NULL;
+																	observed_row_p -> or_node.ln_next_p = NULL;
+																	observed_row_p -> or_row_p = row_p;
+																	observed_row_p -> or_plot_p = observed_plot_p;
+																	observed_row_p -> or_num_table_rows = 0;
+
+																	if (AddListIndexItem (import_p -> oi_rows_index_p, & (observed_row_p -> or_node), hash))
+																		{
+																			++ observed_row_p;
+																			++ (import_p -> oi_num_rows);
+																		}
+																	else
+																		{
+																			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to index row " UINT32_FMT " for study \"%s\"", row_p -> ro_by_study_index, study_p -> st_name_s);
+																			success_flag = false;
+																		}
+																}
+															else
+																{
+																	PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "More than one row with study index " UINT32_FMT " in study \"%s\"", row_p -> ro_by_study_index, study_p -> st_name_s);
+																}
+														}
+
+													row_node_p = (RowNode *) (row_node_p -> rn_node.ln_next_p);
+												}
+
+											++ observed_plot_p;
+											plot_node_p = (PlotNode *) (plot_node_p -> pn_node.ln_next_p);
+										}		/* while (plot_node_p && success_flag) */
+
+									if (!success_flag)
+										{
+											ClearObservationImport (import_p);
+										}
+
+								}		/* if ((import_p -> oi_rows_index_p = AllocateListIndex ()) != NULL) */
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate index of " SIZET_FMT " rows for study \"%s\"", num_rows, study_p -> st_name_s);
+									ClearObservationImport (import_p);
+								}
+
+						}		/* if ((num_rows == 0) || ((import_p -> oi_rows_p = ...) != NULL)) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " rows for study \"%s\"", num_rows, study_p -> st_name_s);
+							ClearObservationImport (import_p);
+						}
+
+				}		/* if (import_p -> oi_plots_p) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " plots for study \"%s\"", num_plots, study_p -> st_name_s);
+					ClearObservationImport (import_p);
+				}
+
+		}		/* if (num_plots > 0) */
+	else
+		{
+			success_flag = true;
+		}
+
+	if (success_flag)
+		{
+			if (! (import_p -> oi_phenotype_columns_p = AllocatePhenotypeColumnsList ()))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate phenotype columns list for study \"%s\"", study_p -> st_name_s);
+					ClearObservationImport (import_p);
+					success_flag = false;
+				}
+			else if (! (import_p -> oi_trait_statistics_p = AllocateTraitStatisticsList ()))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate trait statistics list for study \"%s\"", study_p -> st_name_s);
+					ClearObservationImport (import_p);
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+static ObservedRow *GetObservedRow (const ObservationImport *import_p, const int32 by_study_index)
+{
+	if ((by_study_index > 0) && (import_p -> oi_rows_index_p))
+		{
+			const uint32 study_index = (uint32) by_study_index;
+			const uint32 hash = HashListIndexBytes (LI_HASH_SEED, &study_index, sizeof (study_index));
+
+			return ((ObservedRow *) FindListIndexItem (import_p -> oi_rows_index_p, hash, IsObservedRowForStudyIndex, &study_index));
+		}
+
+	return NULL;
+}
+
+
+static bool IsObservedRowForStudyIndex (const ListItem *item_p, const void *value_p)
+{
+	const ObservedRow *observed_row_p = (const ObservedRow *) item_p;
+	const uint32 *study_index_p = (const uint32 *) value_p;
+
+	return (observed_row_p -> or_row_p -> ro_by_study_index == *study_index_p);
+}
+
+
+/*
+ * Write each Row that any table rows have been applied to using
+ * SaveRowValues() so that only the Row's values are rewritten rather
+ * than its whole Plot.
+ *
+ * Returns the number of table rows that were saved.
+ */
+static size_t SaveObservationImport (ServiceJob *job_p, ObservationImport *import_p, json_t **cached_plots_pp, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	size_t num_imported = 0;
+	size_t num_to_save = 0;
+	size_t num_saved = 0;
+	size_t i;
+	ObservedRow *observed_row_p = import_p -> oi_rows_p;
+
+	for (i = 0; i < import_p -> oi_num_rows; ++ i, ++ observed_row_p)
+		{
+			if (observed_row_p -> or_num_table_rows > 0)
+				{
+					++ num_to_save;
+				}
+		}
+
+	if (num_to_save > 0)
+		{
+			Row **rows_pp = (Row **) AllocMemoryArray (num_to_save, sizeof (Row *));
+
+			if (rows_pp)
+				{
+					bool *saved_flags_p = (bool *) AllocMemoryArray (num_to_save, sizeof (bool));
+
+					if (saved_flags_p)
+						{
+							size_t j = 0;
+							bool observations_flag = true;
+							ObservedPlot *observed_plot_p = import_p -> oi_plots_p;
+
+							observed_row_p = import_p -> oi_rows_p;
+
+							for (i = 0; i < import_p -> oi_num_rows; ++ i, ++ observed_row_p)
+								{
+									if (observed_row_p -> or_num_table_rows > 0)
+										{
+											* (rows_pp + j) = observed_row_p -> or_row_p;
+											++ j;
+										}
+								}
+
+							/*
+							 * Note which versions of the trait statistics could
+							 * not yet include the values that are being saved.
+							 */
+							GetStudyTraitStatisticsRevisions (study_p -> st_id_p, import_p -> oi_trait_statistics_p, data_p);
+
+							SaveRowValues (rows_pp, saved_flags_p, num_to_save, &observations_flag, data_p);
+
+							if (!observations_flag)
+								{
+									AddGeneralErrorMessageToServiceJob (job_p, "The phenotypes were saved but could not be added to the Observations collection");
+								}
+
+							j = 0;
+							observed_row_p = import_p -> oi_rows_p;
+
+							for (i = 0; i < import_p -> oi_num_rows; ++ i, ++ observed_row_p)
+								{
+									if (observed_row_p -> or_num_table_rows > 0)
+										{
+											if (* (saved_flags_p + j))
+												{
+													num_imported += observed_row_p -> or_num_table_rows;
+													++ num_saved;
+													++ (observed_row_p -> or_plot_p -> op_num_saved_rows);
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to save row " UINT32_FMT " for Study \"%s\"", observed_row_p -> or_row_p -> ro_by_study_index, study_p -> st_name_s);
+												}
+
+											++ j;
+										}		/* if (observed_row_p -> or_num_table_rows > 0) */
+
+								}		/* for (i = 0; i < import_p -> oi_num_rows; ++ i, ++ observed_row_p) */
+
+							/*
+							 * Any cached copy of the Study holds whole Plots
+							 */
+							for (i = 0; i < import_p -> oi_num_plots; ++ i, ++ observed_plot_p)
+								{
+									if ((observed_plot_p -> op_num_saved_rows > 0) && (*cached_plots_pp))
+										{
+											if (!AddPlotToCachedStudyPatch (*cached_plots_pp, observed_plot_p -> op_plot_p, data_p))
+												{
+													json_decref (*cached_plots_pp);
+													*cached_plots_pp = NULL;
+												}
+										}
+								}
+
+							FreeMemory (saved_flags_p);
+						}		/* if (saved_flags_p) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " row save flags", num_to_save);
+						}
+
+					FreeMemory (rows_pp);
+				}		/* if (rows_pp) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " rows to save", num_to_save);
+				}
+
+		}		/* if (num_to_save > 0) */
+
+	/*
+	 * The changes aren't tracked per Row so if only some of the
+	 * Rows were saved, the statistics are rebuilt from the stored
+	 * Plots rather than including the changes for the others.
+	 */
+	if (num_imported > 0)
+		{
+			if (!SaveStudyTraitStatistics (study_p -> st_id_p, import_p -> oi_trait_statistics_p, num_saved < num_to_save, data_p))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to update the trait statistics for Study \"%s\"", study_p -> st_name_s);
+				}
+		}
+
+	return num_imported;
+}
+
+
+/*
+ * The Plots and Rows themselves belong to the Study so only
+ * the import's own bookkeeping is freed.
+ */
+static void ClearObservationImport (ObservationImport *import_p)
+{
+	if (import_p -> oi_rows_index_p)
+		{
+			FreeListIndex (import_p -> oi_rows_index_p);
+			import_p -> oi_rows_index_p = NULL;
+		}
+
+	if (import_p -> oi_rows_p)
+		{
+			FreeMemory (import_p -> oi_rows_p);
+			import_p -> oi_rows_p = NULL;
+		}
+
+	if (import_p -> oi_plots_p)
+		{
+			FreeMemory (import_p -> oi_plots_p);
+			import_p -> oi_plots_p = NULL;
+		}
+
+	if (import_p -> oi_phenotype_columns_p)
+		{
+			FreeLinkedList (import_p -> oi_phenotype_columns_p);
+			import_p -> oi_phenotype_columns_p = NULL;
+		}
+
+	if (import_p -> oi_trait_statistics_p)
+		{
+			FreeLinkedList (import_p -> oi_trait_statistics_p);
+			import_p -> oi_trait_statistics_p = NULL;
+		}
+
+	import_p -> oi_num_rows = 0;
+	import_p -> oi_num_plots = 0;
+}
+
+
+size_t SaveRowValues (Row **rows_pp, bool *saved_flags_p, const size_t num_rows, bool *observations_flag_p, const FieldTrialServiceData *data_p)
+{
+	size_t num_saved = 0;
+	size_t i;
+	int batch_size = S_DEFAULT_ROW_UPDATE_BATCH_SIZE;
+
+	*observations_flag_p = true;
+
+	if ((!GetJSONInteger (data_p -> dftsd_base_data.sd_config_p, "row_update_batch_size", &batch_size)) || (batch_size < 1))
+		{
+			batch_size = S_DEFAULT_ROW_UPDATE_BATCH_SIZE;
+		}
+
+	for (i = 0; i < num_rows; i += (size_t) batch_size)
+		{
+			const size_t num_left = num_rows - i;
+			const size_t num_in_batch = (num_left < (size_t) batch_size) ? num_left : (size_t) batch_size;
+
+			UpdateRowValues (rows_pp + i, saved_flags_p + i, num_in_batch, data_p);
+
+			/*
+			 * The Rows have been saved even if the Observations collection
+			 * couldn't be updated, so this is reported separately.
+			 */
+			if (!SaveRowsToObservationsCollection (rows_pp + i, saved_flags_p + i, num_in_batch, data_p))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write the observations for " SIZET_FMT " rows through to \"%s\"", num_in_batch, data_p -> dftsd_collection_ss [DFTD_OBSERVATION]);
+					*observations_flag_p = false;
+				}
+		}
+
+	for (i = 0; i < num_rows; ++ i)
+		{
+			if (* (saved_flags_p + i))
+				{
+					++ num_saved;
+				}
+		}
+
+	return num_saved;
+}
+
+
+/*
+ * Update a batch of Rows with a single unordered update command. Each
+ * statement sets just the Row's values within its Plot's document, using
+ * an array filter on the Row's study index to find it, and each Row that
+ * was saved successfully is marked.
+ */
+static void UpdateRowValues (Row **rows_pp, bool *saved_flags_p, const size_t num_rows, const FieldTrialServiceData *data_p)
+{
+	/*
+	 * The indexes of the rows that made it into the command, in the
+	 * same order, so that any write errors can be matched back to them.
+	 */
+	size_t *sent_indexes_p = (size_t *) AllocMemoryArray (num_rows, sizeof (size_t));
+	char *filter_key_s = ConcatenateVarargsStrings (S_ROW_FILTER_ID_S, ".", RO_STUDY_INDEX_S, NULL);
+	char *row_key_s = ConcatenateVarargsStrings (PL_ROWS_S, ".", RO_STUDY_INDEX_S, NULL);
+	size_t i;
+
+	for (i = 0; i < num_rows; ++ i)
+		{
+			* (saved_flags_p + i) = false;
+		}
+
+	if (sent_indexes_p && filter_key_s && row_key_s)
+		{
+			bson_t *command_p = bson_new ();
+
+			if (command_p)
+				{
+					bson_t updates;
+					uint32 num_sent = 0;
+
+					if ((BSON_APPEND_UTF8 (command_p, "update", data_p -> dftsd_collection_ss [DFTD_PLOT])) && (BSON_APPEND_ARRAY_BEGIN (command_p, "updates", &updates)))
+						{
+							bool success_flag = true;
+
+							for (i = 0; i < num_rows; ++ i)
+								{
+									Row *row_p = * (rows_pp + i);
+									json_t *values_json_p = GetRowValuesUpdateAsJSON (row_p, S_ROW_FILTER_ID_S);
+
+									if (values_json_p)
+										{
+											if (json_object_size (values_json_p) > 0)
+												{
+													bson_t *values_bson_p = ConvertJSONToBSON (values_json_p);
+
+													if (values_bson_p)
+														{
+															char index_buffer [16];
+															const char *index_s;
+															bson_t update;
+
+															bson_uint32_to_string (num_sent, &index_s, index_buffer, sizeof (index_buffer));
+
+															if (BSON_APPEND_DOCUMENT_BEGIN (&updates, index_s, &update))
+																{
+																	bson_t query;
+																	bson_t set;
+																	bson_t filters;
+																	bson_t filter;
+
+																	/*
+																	 * Matching on the Row as well as its Plot means that
+																	 * the matched count shows whether the Row was found.
+																	 */
+																	if (BSON_APPEND_DOCUMENT_BEGIN (&update, "q", &query))
+																		{
+																			success_flag = (BSON_APPEND_OID (&query, MONGO_ID_S, row_p -> ro_plot_p -> pl_id_p)) && success_flag;
+																			success_flag = (BSON_APPEND_INT32 (&query, row_key_s, row_p -> ro_by_study_index)) && success_flag;
+																			success_flag = (bson_append_document_end (&update, &query)) && success_flag;
+																		}
+																	else
+																		{
+																			success_flag = false;
+																		}
+
+																	if (success_flag && (BSON_APPEND_DOCUMENT_BEGIN (&update, "u", &set)))
+																		{
+																			success_flag = (BSON_APPEND_DOCUMENT (&set, "$set", values_bson_p)) && success_flag;
+																			success_flag = (bson_append_document_end (&update, &set)) && success_flag;
+																		}
+																	else
+																		{
+																			success_flag = false;
+																		}
+
+																	if (success_flag && (BSON_APPEND_ARRAY_BEGIN (&update, "arrayFilters", &filters)))
+																		{
+																			if (BSON_APPEND_DOCUMENT_BEGIN (&filters, "0", &filter))
+																				{
+																					success_flag = (BSON_APPEND_INT32 (&filter, filter_key_s, row_p -> ro_by_study_index)) && success_flag;
+																					success_flag = (bson_append_document_end (&filters, &filter)) && success_flag;
+																				}
+																			else
+																				{
+																					success_flag = false;
+																				}
+
+																			success_flag = (bson_append_array_end (&update, &filters)) && success_flag;
+																		}
+																	else
+																		{
+																			success_flag = false;
+																		}
+
+																	if (!bson_append_document_end (&updates, &update))
+																		{
+																			success_flag = false;
+																		}
+
+																	if (success_flag)
+																		{
+																			* (sent_indexes_p + num_sent) = i;
+																			++ num_sent;
+																		}
+																}
+															else
+																{
+																	success_flag = false;
+																}
+
+															bson_destroy (values_bson_p);
+														}		/* if (values_bson_p) */
+													else
+														{
+															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, values_json_p, "Failed to convert row values to BSON");
+														}
+
+												}		/* if (json_object_size (values_json_p) > 0) */
+											else
+												{
+													/* There is nothing to write */
+													* (saved_flags_p + i) = true;
+												}
+
+											json_decref (values_json_p);
+										}		/* if (values_json_p) */
+
+								}		/* for (i = 0; i < num_rows; ++ i) */
+
+							/*
+							 * A partially-built update would leave the command
+							 * in an unknown state so don't send any of it.
+							 */
+							if (!bson_append_array_end (command_p, &updates))
+								{
+									success_flag = false;
+								}
+
+							if (success_flag && (num_sent > 0))
+								{
+									if (BSON_APPEND_BOOL (command_p, "ordered", false))
+										{
+											bson_t *reply_p = NULL;
+
+											if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p))
+												{
+													bool checked_flag = false;
+
+													for (i = 0; i < num_sent; ++ i)
+														{
+															* (saved_flags_p + * (sent_indexes_p + i)) = true;
+														}
+
+													if (reply_p)
+														{
+															json_t *reply_json_p = ConvertBSONToJSON (reply_p);
+
+															if (reply_json_p)
+																{
+																	const json_t *write_errors_p = json_object_get (reply_json_p, "writeErrors");
+																	const json_t *num_matched_p = json_object_get (reply_json_p, "n");
+																	const size_t num_errors = json_array_size (write_errors_p);
+
+																	if (write_errors_p)
+																		{
+																			const json_t *write_error_p;
+
+																			json_array_foreach (write_errors_p, i, write_error_p)
+																				{
+																					const json_t *index_p = json_object_get (write_error_p, "index");
+
+																					if (json_is_integer (index_p))
+																						{
+																							const json_int_t index = json_integer_value (index_p);
+
+																							if ((index >= 0) && (index < num_sent))
+																								{
+																									* (saved_flags_p + * (sent_indexes_p + index)) = false;
+																								}
+																						}
+
+																					PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, write_error_p, "Failed to save row");
+																				}
+																		}
+
+																	/*
+																	 * Every update without an error should have matched its Row.
+																	 * nModified isn't checked as it is lower when a Row's values
+																	 * haven't changed. The reply doesn't say which updates missed,
+																	 * so if any did, none of the batch is treated as saved.
+																	 */
+																	if ((json_is_integer (num_matched_p)) && (json_integer_value (num_matched_p) + (json_int_t) num_errors == (json_int_t) num_sent))
+																		{
+																			checked_flag = true;
+																		}
+																	else
+																		{
+																			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, reply_json_p, "Only some of " UINT32_FMT " rows were found when saving them", num_sent);
+																		}
+
+																	json_decref (reply_json_p);
+																}		/* if (reply_json_p) */
+
+															bson_destroy (reply_p);
+														}		/* if (reply_p) */
+
+													if (!checked_flag)
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Couldn't check that " UINT32_FMT " rows were saved", num_sent);
+
+															for (i = 0; i < num_sent; ++ i)
+																{
+																	* (saved_flags_p + * (sent_indexes_p + i)) = false;
+																}
+														}
+
+												}		/* if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p)) */
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to save " UINT32_FMT " rows", num_sent);
+												}
+										}
+
+								}		/* if (success_flag && (num_sent > 0)) */
+							else if (!success_flag)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to build the command to save " SIZET_FMT " rows", num_rows);
+								}
+
+						}		/* if ((BSON_APPEND_UTF8 (command_p, "update", ...)) && (BSON_APPEND_ARRAY_BEGIN (command_p, "updates", &updates))) */
+
+					bson_destroy (command_p);
+				}		/* if (command_p) */
+
+		}		/* if (sent_indexes_p && filter_key_s && row_key_s) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " rows to save", num_rows);
+		}
+
+	if (filter_key_s)
+		{
+			FreeCopiedString (filter_key_s);
+		}
+
+	if (row_key_s)
+		{
+			FreeCopiedString (row_key_s);
+		}
+
+	if (sent_indexes_p)
+		{
+			FreeMemory (sent_indexes_p);
+		}
+}
+
+
+/*
+ * As the plots have been updated, patch them into any cached
+ * study. If we couldn't keep track of them all, clear it instead.
+ */
+static void UpdateCachedStudyObservations (Study *study_p, const size_t num_imported, json_t *cached_plots_p, const FieldTrialServiceData *data_p)
+{
+	if (num_imported > 0)
+		{
+			char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+			bson_oid_to_string (study_p -> st_id_p, id_s);
+
+			if (cached_plots_p)
+				{
+					if (!PatchCachedStudyPlots (id_s, cached_plots_p, data_p))
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to patch cached Study with id \"%s\"", id_s);
+						}
+				}
+			else if (!ClearCachedStudy (id_s, data_p))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to clear cached Study with id \"%s\"", id_s);
+				}
+		}
+}
+
+
 OperationStatus AddTreatmentFactorValuesToRow (Row *row_p, json_t *plot_json_p, Study *study_p, const FieldTrialServiceData *data_p)
 {
 	OperationStatus status = OS_IDLE;
@@ -628,16 +1916,9 @@ OperationStatus AddTreatmentFactorValuesToRow (Row *row_p, json_t *plot_json_p,
 						{
 							if (json_is_string (value_p))
 								{
-									const char *name_s = json_string_value (value_p);
-									const char *value_s = GetTreatmentFactorValue (tf_p, name_s);
-
-									/* Is it a valid defined label? */
-									if (value_s)
+									if (AddTreatmentFactorLabelToRow (row_p, tf_p, json_string_value (value_p)))
 										{
-											if (AddTreatmentFactorValueToRowByParts (row_p, tf_p, name_s))
-												{
-													++ num_added;
-												}
+											++ num_added;
 										}
 								}
 
@@ -678,6 +1959,45 @@ OperationStatus AddTreatmentFactorValuesToRow (Row *row_p, json_t *plot_json_p,
 }
 
 
+bool IsKnownRowColumnHeading (const char *key_s, const FieldTrialServiceData *data_p)
+{
+	bool known_flag = false;
+	Treatment *treatment_p = GetTreatmentByURL (key_s, VF_STORAGE, data_p);
+
+	if (treatment_p)
+		{
+			known_flag = true;
+			FreeTreatment (treatment_p);
+		}
+	else
+		{
+			MeasuredVariable *measured_variable_p = NULL;
+			struct tm *start_date_p = NULL;
+			struct tm *end_date_p = NULL;
+			bool corrected_value_flag = false;
+
+			if (GetObservationMetadata (key_s, &measured_variable_p, &start_date_p, &end_date_p, &corrected_value_flag, data_p))
+				{
+					known_flag = true;
+
+					if (start_date_p)
+						{
+							FreeTime (start_date_p);
+						}
+
+					if (end_date_p)
+						{
+							FreeTime (end_date_p);
+						}
+
+					FreeMeasuredVariable (measured_variable_p);
+				}
+		}
+
+	return known_flag;
+}
+
+
 
 //OperationStatus OldAddObservationValuesToRow (Row *row_p, json_t *observation_json_p, Study *study_p, const FieldTrialServiceData *data_p)
 //{
@@ -854,144 +2174,153 @@ OperationStatus AddTreatmentFactorValuesToRow (Row *row_p, json_t *plot_json_p,
 
 
 
-OperationStatus AddObservationValuesToRow (Row *row_p, json_t *observation_json_p, Study *study_p, const FieldTrialServiceData *data_p)
+LinkedList *AllocatePhenotypeColumnsList (void)
 {
-	OperationStatus status = OS_FAILED;
+	return AllocateLinkedList (FreePhenotypeColumnNode);
+}
 
-	bool loop_success_flag = true;
+
+OperationStatus AddObservationValuesToRow (Row *row_p, json_t *observation_json_p, LinkedList *phenotype_columns_p, LinkedList *trait_statistics_p, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	OperationStatus status = OS_FAILED;
 	void *iterator_p = json_object_iter (observation_json_p);
 	size_t imported_obs = 0;
 	size_t total_obs = 0;
-	LinkedList *processed_keys_p = AllocateStringLinkedList ();
 
-	if (processed_keys_p)
+	while (iterator_p)
 		{
-			while (iterator_p && loop_success_flag)
+			const char *key_s = json_object_iter_key (iterator_p);
+			json_t *value_p = json_object_iter_value (iterator_p);
+
+			/*
+			 * ignore our column names
+			 */
+			if ((strcmp (key_s, S_PLOT_INDEX_S) != 0) && (strcmp (key_s, S_RACK_S) != 0))
 				{
-					const char *key_s = json_object_iter_key (iterator_p);
-					json_t *value_p = json_object_iter_value (iterator_p);
+					const PhenotypeColumnNode *column_p = GetPhenotypeColumn (phenotype_columns_p, key_s, data_p);
 
-					/*
-					 * ignore our column names
-					 */
-					if ((strcmp (key_s, S_PLOT_INDEX_S) != 0) && (strcmp (key_s, S_RACK_S) != 0))
+					if (column_p && (column_p -> pcn_variable_json_p))
 						{
-							MeasuredVariable *measured_variable_p = NULL;
-							struct tm *start_date_p = NULL;
-							struct tm *end_date_p = NULL;
-							bool corrected_value_flag = false;
+							const char *value_s = json_string_value (value_p);
 
-							if (GetObservationMetadata (key_s, &measured_variable_p, &start_date_p, &end_date_p, &corrected_value_flag, data_p))
+							if (!IsStringEmpty (value_s))
 								{
-									Observation *observation_p = NULL;
-									bool added_phenotype_flag = false;
-									const char *value_s = json_string_value (value_p);
+									++ total_obs;
 
-									if (!IsStringEmpty (value_s))
+									if (AddPhenotypeValueToRow (row_p, column_p, value_s, trait_statistics_p, data_p))
 										{
-											const char *growth_stage_s = NULL;
-											const char *method_s = NULL;
-											ObservationNature nature = ON_ROW;
-											Instrument *instrument_p = NULL;
-											bson_oid_t *observation_id_p = GetNewBSONOid ();
-											const char *raw_value_s = NULL;
-											const char *corrected_value_s = NULL;
-
-											if (corrected_value_flag)
-												{
-													corrected_value_s = value_s;
-												}
-											else
-												{
-													raw_value_s = value_s;
-												}
+											++ imported_obs;
+										}
+								}		/* if (!IsStringEmpty (value_s)) */
+							else
+								{
+									PrintJSONToLog (STM_LEVEL_INFO, __FILE__, __LINE__, observation_json_p, "No measured value for \"%s\", skipping", key_s);
+								}
 
-											++ total_obs;
+						}		/* if (column_p && (column_p -> pcn_variable_json_p)) */
 
-											if (observation_id_p)
-												{
-													observation_p = AllocateObservation (observation_id_p, start_date_p, end_date_p, measured_variable_p, raw_value_s, corrected_value_s, growth_stage_s, method_s, instrument_p, nature);
+				}		/* if ((strcmp (key_s, S_PLOT_INDEX_S) != 0) && (strcmp (key_s, S_RACK_S) != 0)) */
 
-													if (observation_p)
-														{
-															if (AddObservationToRow (row_p, observation_p))
-																{
-																	++ imported_obs;
-																	added_phenotype_flag = true;
-																	loop_success_flag = true;
-																}
-															else
-																{
-																	char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+			iterator_p = json_object_iter_next (observation_json_p, iterator_p);
+		}		/* while (iterator_p) */
 
-																	bson_oid_to_string (row_p -> ro_id_p, id_s);
 
-																	PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, observation_json_p, "AddObservationToRow failed for row \"%s\" and key \"%s\"", id_s, key_s);
-																	FreeObservation (observation_p);
-																}
+	if (imported_obs == total_obs)
+		{
+			status = OS_SUCCEEDED;
+		}
+	else if (imported_obs > 0)
+		{
+			status = OS_PARTIALLY_SUCCEEDED;
+		}
 
-														}		/* if (observation_p) */
-													else
-														{
-															char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+	return status;
+}
 
-															bson_oid_to_string (row_p -> ro_id_p, id_s);
 
-															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, observation_json_p, "Failed to allocate Observation for row \"%s\" and key \"%s\"", id_s, key_s);
+void SetRowValueColumn (RowValueColumn *column_p, const char *heading_s, const bool treatments_flag, LinkedList *phenotype_columns_p, Study *study_p, const FieldTrialServiceData *data_p)
+{
+	column_p -> rvc_treatment_factor_p = NULL;
+	column_p -> rvc_phenotype_column_p = NULL;
 
-															FreeBSONOid (observation_id_p);
-														}
+	if (!IsStringEmpty (heading_s))
+		{
+			Treatment *treatment_p = NULL;
 
-												}		/* if (observation_id_p) */
-											else
-												{
-													PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, observation_json_p, "Failed to allocate observation id");
-												}
+			/* Is it a treatment? */
+			if (treatments_flag)
+				{
+					treatment_p = GetTreatmentByURL (heading_s, VF_STORAGE, data_p);
+				}
 
-										}		/* if ((!IsStringEmpty (raw_value_s)) */
-									else
-										{
-											PrintJSONToLog (STM_LEVEL_INFO, __FILE__, __LINE__, observation_json_p, "No measured value for \"%s\", skipping", key_s);
-										}
+			if (treatment_p)
+				{
+					/*
+					 * The Study owns its TreatmentFactors so this stays valid
+					 * for the whole import. If the Study doesn't have one for
+					 * this Treatment, the column is ignored.
+					 */
+					column_p -> rvc_treatment_factor_p = GetTreatmentFactorForStudy (study_p, treatment_p -> tr_id_p, data_p);
 
+					FreeTreatment (treatment_p);
+				}
+			else
+				{
+					const PhenotypeColumnNode *phenotype_column_p = GetPhenotypeColumn (phenotype_columns_p, heading_s, data_p);
 
-									if (start_date_p)
-										{
-											FreeTime (start_date_p);
-											start_date_p = NULL;
-										}
+					if (phenotype_column_p && (phenotype_column_p -> pcn_variable_json_p))
+						{
+							column_p -> rvc_phenotype_column_p = phenotype_column_p;
+						}
+				}
 
-									if (end_date_p)
-										{
-											FreeTime (end_date_p);
-											end_date_p = NULL;
-										}
+		}		/* if (!IsStringEmpty (heading_s)) */
+}
 
-									if (measured_variable_p)
-										{
-											FreeMeasuredVariable (measured_variable_p);
-											measured_variable_p = NULL;
-										}
 
+OperationStatus AddDelimitedTableValuesToRow (Row *row_p, DelimitedTableReader *reader_p, const RowValueColumn *columns_p, const size_t num_columns, LinkedList *trait_statistics_p, const FieldTrialServiceData *data_p)
+{
+	OperationStatus status = OS_FAILED;
+	size_t num_added = 0;
+	size_t num_values = 0;
+	size_t i;
 
-								}		/* if (GetObservationMetadata (key_s, &measured_variable_p, &start_date_p, &end_date_p, data_p)) */
+	for (i = 0; i < num_columns; ++ i, ++ columns_p)
+		{
+			if ((columns_p -> rvc_treatment_factor_p) || (columns_p -> rvc_phenotype_column_p))
+				{
+					const char *value_s = GetDelimitedTableCellValue (reader_p, (int32) i);
 
+					if (value_s)
+						{
+							bool added_flag = false;
 
-						}		/* if ((strcmp (key_s, S_PLOT_INDEX_S) != 0) && (strcmp (key_s, S_RACK_S) != 0)) */
+							++ num_values;
 
-					iterator_p = json_object_iter_next (observation_json_p, iterator_p);
-				}		/* while (iterator_p && loop_success_flag) */
+							if (columns_p -> rvc_treatment_factor_p)
+								{
+									added_flag = AddTreatmentFactorLabelToRow (row_p, columns_p -> rvc_treatment_factor_p, value_s);
+								}
+							else
+								{
+									added_flag = AddPhenotypeValueToRow (row_p, columns_p -> rvc_phenotype_column_p, value_s, trait_statistics_p, data_p);
+								}
 
+							if (added_flag)
+								{
+									++ num_added;
+								}
+						}		/* if (value_s) */
 
-			FreeLinkedList (processed_keys_p);
-		}		/* if (processed_keys_p) */
+				}		/* if ((columns_p -> rvc_treatment_factor_p) || (columns_p -> rvc_phenotype_column_p)) */
 
+		}		/* for (i = 0; i < num_columns; ++ i, ++ columns_p) */
 
-	if (imported_obs == total_obs)
+	if (num_added == num_values)
 		{
 			status = OS_SUCCEEDED;
 		}
-	else if (imported_obs > 0)
+	else if (num_added > 0)
 		{
 			status = OS_PARTIALLY_SUCCEEDED;
 		}
@@ -1000,6 +2329,133 @@ OperationStatus AddObservationValuesToRow (Row *row_p, json_t *observation_json_
 }
 
 
+/*
+ * Add a non-empty value from a phenotype column to a Row, replacing
+ * any existing value for the same variable and dates.
+ */
+static bool AddPhenotypeValueToRow (Row *row_p, const PhenotypeColumnNode *column_p, const char *value_s, LinkedList *trait_statistics_p, const FieldTrialServiceData *data_p)
+{
+	bool added_flag = false;
+	const char *growth_stage_s = NULL;
+	const char *method_s = NULL;
+	ObservationNature nature = ON_ROW;
+	Instrument *instrument_p = NULL;
+	const char *raw_value_s = NULL;
+	const char *corrected_value_s = NULL;
+	const char *key_s = column_p -> pcn_heading_s;
+
+	/*
+	 * The Observation takes ownership of this
+	 */
+	MeasuredVariable *measured_variable_p = GetMeasuredVariableFromJSON (column_p -> pcn_variable_json_p, data_p);
+
+	if (column_p -> pcn_corrected_value_flag)
+		{
+			corrected_value_s = value_s;
+		}
+	else
+		{
+			raw_value_s = value_s;
+		}
+
+	if (measured_variable_p)
+		{
+			bson_oid_t *observation_id_p = GetNewBSONOid ();
+
+			if (observation_id_p)
+				{
+					Observation *observation_p = AllocateObservation (observation_id_p, column_p -> pcn_start_date_p, column_p -> pcn_end_date_p, measured_variable_p, raw_value_s, corrected_value_s, growth_stage_s, method_s, instrument_p, nature);
+
+					if (observation_p)
+						{
+							/*
+							 * Replacing an existing Observation can't fail so its value
+							 * can be taken out of the statistics before it is freed.
+							 */
+							if (trait_statistics_p)
+								{
+									const Observation *existing_observation_p = GetMatchingObservationFromRow (row_p, observation_p);
+
+									if (existing_observation_p)
+										{
+											if (!RemoveObservationFromTraitStatistics (trait_statistics_p, existing_observation_p))
+												{
+													PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to remove replaced value of \"%s\" from trait statistics", key_s);
+												}
+										}
+								}
+
+							if (AddObservationToRow (row_p, observation_p))
+								{
+									added_flag = true;
+
+									if (trait_statistics_p)
+										{
+											if (!AddObservationToTraitStatistics (trait_statistics_p, observation_p))
+												{
+													PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add value of \"%s\" to trait statistics", key_s);
+												}
+										}
+								}
+							else
+								{
+									char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+									bson_oid_to_string (row_p -> ro_id_p, id_s);
+
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "AddObservationToRow failed for row \"%s\" and key \"%s\" with value \"%s\"", id_s, key_s, value_s);
+									FreeObservation (observation_p);
+								}
+
+						}		/* if (observation_p) */
+					else
+						{
+							char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+							bson_oid_to_string (row_p -> ro_id_p, id_s);
+
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate Observation for row \"%s\" and key \"%s\" with value \"%s\"", id_s, key_s, value_s);
+
+							FreeBSONOid (observation_id_p);
+							FreeMeasuredVariable (measured_variable_p);
+						}
+
+				}		/* if (observation_id_p) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate observation id for \"%s\"", key_s);
+					FreeMeasuredVariable (measured_variable_p);
+				}
+
+		}		/* if (measured_variable_p) */
+	else
+		{
+			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, column_p -> pcn_variable_json_p, "Failed to get Measured Variable for \"%s\"", key_s);
+		}
+
+	return added_flag;
+}
+
+
+/*
+ * Add the value of a TreatmentFactor to a Row if it is one of the
+ * labels that the TreatmentFactor defines.
+ */
+static bool AddTreatmentFactorLabelToRow (Row *row_p, TreatmentFactor *tf_p, const char *name_s)
+{
+	bool added_flag = false;
+	const char *value_s = GetTreatmentFactorValue (tf_p, name_s);
+
+	/* Is it a valid defined label? */
+	if (value_s)
+		{
+			added_flag = AddTreatmentFactorValueToRowByParts (row_p, tf_p, name_s);
+		}
+
+	return added_flag;
+}
+
+
 
 Row *GetRowByStudyIndex (const int32 by_study_index, Study *study_p, const FieldTrialServiceData *data_p)
 {
@@ -1150,6 +2606,11 @@ static bool GetObservationMetadata (const char *key_s, MeasuredVariable **measur
 					bool start_date_flag = true;
 					bool loop_flag = true;
 
+					/*
+					 * The optional dates and the corrected flag only
+					 * make this fail if they're invalid.
+					 */
+					success_flag = true;
 					*corrected_value_flag_p = false;
 					node_p = (StringListNode *) (node_p -> sln_node.ln_next_p);
 
@@ -1235,3 +2696,124 @@ static bool GetObservationMetadata (const char *key_s, MeasuredVariable **measur
 	return success_flag;
 }
 
+
+/*
+ * Get the parsed details of a column heading, parsing it and adding it to
+ * the list the first time that it is seen. An invalid heading is kept in
+ * the list too so that it is only reported once.
+ */
+static const PhenotypeColumnNode *GetPhenotypeColumn (LinkedList *phenotype_columns_p, const char *heading_s, const FieldTrialServiceData *data_p)
+{
+	PhenotypeColumnNode *node_p = (PhenotypeColumnNode *) (phenotype_columns_p -> ll_head_p);
+
+	while (node_p)
+		{
+			if (strcmp (node_p -> pcn_heading_s, heading_s) == 0)
+				{
+					return node_p;
+				}
+
+			node_p = (PhenotypeColumnNode *) (node_p -> pcn_node.ln_next_p);
+		}
+
+	node_p = AllocatePhenotypeColumnNode (heading_s, data_p);
+
+	if (node_p)
+		{
+			LinkedListAddTail (phenotype_columns_p, & (node_p -> pcn_node));
+		}
+
+	return node_p;
+}
+
+
+static PhenotypeColumnNode *AllocatePhenotypeColumnNode (const char *heading_s, const FieldTrialServiceData *data_p)
+{
+	char *copied_heading_s = EasyCopyToNewString (heading_s);
+
+	if (copied_heading_s)
+		{
+			PhenotypeColumnNode *node_p = (PhenotypeColumnNode *) AllocMemory (sizeof (PhenotypeColumnNode));
+
+			if (node_p)
+				{
+					MeasuredVariable *measured_variable_p = NULL;
+					struct tm *start_date_p = NULL;
+					struct tm *end_date_p = NULL;
+					bool corrected_value_flag = false;
+
+					InitListItem (& (node_p -> pcn_node));
+
+					node_p -> pcn_heading_s = copied_heading_s;
+					node_p -> pcn_variable_json_p = NULL;
+					node_p -> pcn_start_date_p = NULL;
+					node_p -> pcn_end_date_p = NULL;
+					node_p -> pcn_corrected_value_flag = false;
+
+					if (GetObservationMetadata (heading_s, &measured_variable_p, &start_date_p, &end_date_p, &corrected_value_flag, data_p))
+						{
+							node_p -> pcn_variable_json_p = GetMeasuredVariableAsJSON (measured_variable_p, VF_STORAGE);
+
+							if (node_p -> pcn_variable_json_p)
+								{
+									node_p -> pcn_start_date_p = start_date_p;
+									node_p -> pcn_end_date_p = end_date_p;
+									node_p -> pcn_corrected_value_flag = corrected_value_flag;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get Measured Variable as JSON for column \"%s\"", heading_s);
+
+									if (start_date_p)
+										{
+											FreeTime (start_date_p);
+										}
+
+									if (end_date_p)
+										{
+											FreeTime (end_date_p);
+										}
+								}
+
+							FreeMeasuredVariable (measured_variable_p);
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Column \"%s\" is not a valid phenotype so its values will be ignored", heading_s);
+						}
+
+					return node_p;
+				}		/* if (node_p) */
+
+			FreeCopiedString (copied_heading_s);
+		}		/* if (copied_heading_s) */
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate phenotype column for \"%s\"", heading_s);
+
+	return NULL;
+}
+
+
+static void FreePhenotypeColumnNode (ListItem *node_p)
+{
+	PhenotypeColumnNode *column_node_p = (PhenotypeColumnNode *) node_p;
+
+	if (column_node_p -> pcn_variable_json_p)
+		{
+			json_decref (column_node_p -> pcn_variable_json_p);
+		}
+
+	if (column_node_p -> pcn_start_date_p)
+		{
+			FreeTime (column_node_p -> pcn_start_date_p);
+		}
+
+	if (column_node_p -> pcn_end_date_p)
+		{
+			FreeTime (column_node_p -> pcn_end_date_p);
+		}
+
+	FreeCopiedString (column_node_p -> pcn_heading_s);
+	FreeMemory (column_node_p);
+}
+
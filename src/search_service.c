@@ -32,6 +32,7 @@
 #include "material_jobs.h"
 #include "treatment_jobs.h"
 #include "dfw_util.h"
+#include "document_cache.h"
 
 
 #include "boolean_parameter.h"
@@ -514,6 +515,12 @@ static ServiceJobSet *RunDFWFieldTrialSearchService (Service *service_p, Paramet
 
 			SetServiceJobStatus (job_p, OS_FAILED_TO_START);
 
+			/*
+			 * Any document fetched by id during this job will be kept
+			 * so that it is only read from the database once.
+			 */
+			BeginDocumentCacheScope (data_p -> dftsd_document_cache_p);
+
 			if (param_set_p)
 				{
 					/*
@@ -567,6 +574,8 @@ static ServiceJobSet *RunDFWFieldTrialSearchService (Service *service_p, Paramet
 
 				}		/* if (param_set_p) */
 
+			EndDocumentCacheScope (data_p -> dftsd_document_cache_p);
+
 #if DFW_FIELD_TRIAL_SERVICE_DEBUG >= STM_LEVEL_FINE
 			PrintJSONToLog (STM_LEVEL_FINE, __FILE__, __LINE__, job_p -> sj_metadata_p, "metadata 3: ");
 #endif
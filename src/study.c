@@ -26,9 +26,13 @@
 #include "memory_allocations.h"
 #include "string_utils.h"
 #include "plot.h"
+#include "row.h"
+#include "observation.h"
 #include "treatment_factor.h"
 #include "location.h"
 #include "dfw_util.h"
+#include "change_tracking.h"
+#include "document_cache.h"
 #include "time_util.h"
 #include "crop_jobs.h"
 
@@ -73,6 +77,8 @@ static bool AddFrictionlessDataLink (const Study * const study_p, json_t *study_
 
 static bool SetDateFromStudyJSON (const json_t *json_p, const char *key_s, uint32 *year_p, const char *deprecated_key_s);
 
+static bool PrefetchPlotReferences (const json_t *plots_json_p, const FieldTrialServiceData *data_p);
+
 
 /*
  * API FUNCTIONS
@@ -236,6 +242,8 @@ Study *AllocateStudy (bson_oid_t *id_p, const char *name_s, const char *data_url
 																																																							study_p -> st_predicted_sowing_year_p = copied_sowing_year_p;
 																																																							study_p -> st_predicted_harvest_year_p = copied_harvest_year_p;
 
+																																																							study_p -> st_num_plots = -1;
+
 																																																							return study_p;
 																																																						}
 
@@ -661,6 +669,18 @@ bool GetStudyPlots (Study *study_p, const FieldTrialServiceData *data_p)
 												{
 													json_t *plot_json_p;
 
+													/*
+													 * Resolve all of the materials, measured variables and instruments
+													 * used by the rows with a single query per collection before
+													 * we build the plots so that they don't need a query each.
+													 */
+													BeginDocumentCacheScope (data_p -> dftsd_document_cache_p);
+
+													if (!PrefetchPlotReferences (results_p, data_p))
+														{
+															PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to prefetch all plot references for study \"%s\"", study_p -> st_name_s);
+														}
+
 													json_array_foreach (results_p, i, plot_json_p)
 													{
 														Plot *plot_p = GetPlotFromJSON (plot_json_p, study_p, data_p);
@@ -682,6 +702,7 @@ bool GetStudyPlots (Study *study_p, const FieldTrialServiceData *data_p)
 
 													}		/* json_array_foreach (results_p, i, entry_p) */
 
+													EndDocumentCacheScope (data_p -> dftsd_document_cache_p);
 												}		/* if (num_results > 0) */
 
 
@@ -714,7 +735,11 @@ OperationStatus SaveStudy (Study *study_p, ServiceJob *job_p, FieldTrialServiceD
 
 			if (study_json_p)
 				{
-					if (SaveMongoData (data_p -> dftsd_mongo_p, study_json_p, data_p -> dftsd_collection_ss [DFTD_STUDY], selector_p))
+					if (!StampModification (study_json_p, data_p))
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add modification marker to Study \"%s\" so it has not been saved", study_p -> st_name_s);
+						}
+					else if (SaveMongoData (data_p -> dftsd_mongo_p, study_json_p, data_p -> dftsd_collection_ss [DFTD_STUDY], selector_p))
 						{
 							char *id_s = GetBSONOidAsString (study_p -> st_id_p);
 
@@ -1422,7 +1447,15 @@ static bool AddPlotsToJSON (Study *study_p, json_t *study_json_p, const ViewForm
 
 static int32 GetNumberOfPlotsInStudy (const Study *study_p, const FieldTrialServiceData *data_p)
 {
-	int32 res = -1;
+	int32 res = study_p -> st_num_plots;
+
+	/*
+	 * Have the plots already been counted?
+	 */
+	if (res >= 0)
+		{
+			return res;
+		}
 
 	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_PLOT]))
 		{
@@ -1433,17 +1466,27 @@ static int32 GetNumberOfPlotsInStudy (const Study *study_p, const FieldTrialServ
 			 */
 			if (query_p)
 				{
-					json_t *results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, NULL);
+					/*
+					 * We only need to count the plots so just get their ids
+					 */
+					bson_t *opts_p = BCON_NEW ("projection", "{", MONGO_ID_S, BCON_INT32 (1), "}");
 
-					if (results_p)
+					if (opts_p)
 						{
-							if (json_is_array (results_p))
+							json_t *results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, opts_p);
+
+							if (results_p)
 								{
-									res = json_array_size (results_p);
-								}		/* if (json_is_array (results_p)) */
+									if (json_is_array (results_p))
+										{
+											res = json_array_size (results_p);
+										}		/* if (json_is_array (results_p)) */
+
+									json_decref (results_p);
+								}		/* if (results_p) */
 
-							json_decref (results_p);
-						}		/* if (results_p) */
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
 
 					bson_destroy (query_p);
 				}		/* if (query_p) */
@@ -1836,3 +1879,101 @@ static bool SetDateFromStudyJSON (const json_t *json_p, const char *key_s, uint3
 
 	return success_flag;
 }
+
+
+static bool PrefetchPlotReferences (const json_t *plots_json_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	json_t *material_ids_p = json_object ();
+
+	if (material_ids_p)
+		{
+			json_t *measured_variable_ids_p = json_object ();
+
+			if (measured_variable_ids_p)
+				{
+					json_t *instrument_ids_p = json_object ();
+
+					if (instrument_ids_p)
+						{
+							size_t i;
+							const json_t *plot_json_p;
+
+							success_flag = true;
+
+							/*
+							 * First pass: collect the distinct ids
+							 */
+							json_array_foreach (plots_json_p, i, plot_json_p)
+								{
+									const json_t *rows_p = json_object_get (plot_json_p, PL_ROWS_S);
+
+									if (rows_p)
+										{
+											size_t j;
+											const json_t *row_json_p;
+
+											json_array_foreach (rows_p, j, row_json_p)
+												{
+													const json_t *observations_p = json_object_get (row_json_p, RO_OBSERVATIONS_S);
+
+													if (!AddReferencedIdToSet (material_ids_p, row_json_p, RO_MATERIAL_ID_S))
+														{
+															success_flag = false;
+														}
+
+													if (observations_p)
+														{
+															size_t k;
+															const json_t *observation_json_p;
+
+															json_array_foreach (observations_p, k, observation_json_p)
+																{
+																	if (!AddReferencedIdToSet (measured_variable_ids_p, observation_json_p, OB_PHENOTYPE_ID_S))
+																		{
+																			success_flag = false;
+																		}
+
+																	if (!AddReferencedIdToSet (instrument_ids_p, observation_json_p, OB_INSTRUMENT_ID_S))
+																		{
+																			success_flag = false;
+																		}
+																}
+														}
+
+												}		/* json_array_foreach (rows_p, j, row_json_p) */
+
+										}		/* if (rows_p) */
+
+								}		/* json_array_foreach (plots_json_p, i, plot_json_p) */
+
+
+							/*
+							 * Second pass: one query per collection
+							 */
+							if (!PrefetchDocumentsIntoDocumentCache (data_p -> dftsd_document_cache_p, DFTD_MATERIAL, material_ids_p, data_p))
+								{
+									success_flag = false;
+								}
+
+							if (!PrefetchDocumentsIntoDocumentCache (data_p -> dftsd_document_cache_p, DFTD_MEASURED_VARIABLE, measured_variable_ids_p, data_p))
+								{
+									success_flag = false;
+								}
+
+							if (!PrefetchDocumentsIntoDocumentCache (data_p -> dftsd_document_cache_p, DFTD_INSTRUMENT, instrument_ids_p, data_p))
+								{
+									success_flag = false;
+								}
+
+							json_decref (instrument_ids_p);
+						}		/* if (instrument_ids_p) */
+
+					json_decref (measured_variable_ids_p);
+				}		/* if (measured_variable_ids_p) */
+
+			json_decref (material_ids_p);
+		}		/* if (material_ids_p) */
+
+	return success_flag;
+}
@@ -0,0 +1,499 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * study_cache_file.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "study_cache_file.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define STUDY_CACHE_FILE_DEBUG	(STM_LEVEL_FINE)
+#else
+	#define STUDY_CACHE_FILE_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * The header is stored as:
+ *
+ * 	4 bytes: magic
+ * 	4 bytes: format version
+ * 	8 bytes: revision
+ * 	8 bytes: uncompressed size
+ * 	4 bytes: checksum
+ *
+ * with all of the numbers being little-endian.
+ */
+static const char S_MAGIC_S [] = "DFWZ";
+
+#define S_MAGIC_LENGTH (4)
+
+#define S_HEADER_LENGTH (S_MAGIC_LENGTH + 4 + 8 + 8 + 4)
+
+#define S_CHUNK_SIZE (65536)
+
+
+typedef struct StudyCacheFileReader
+{
+	FILE *scfr_file_f;
+
+	z_stream scfr_stream;
+
+	unsigned char scfr_input [S_CHUNK_SIZE];
+
+	uLong scfr_checksum;
+
+	uint64 scfr_uncompressed_size;
+
+	bool scfr_finished_flag;
+
+	bool scfr_error_flag;
+} StudyCacheFileReader;
+
+
+static void SetLittleEndianValue (unsigned char *buffer_p, uint64 value, const size_t num_bytes);
+
+static uint64 GetLittleEndianValue (const unsigned char *buffer_p, const size_t num_bytes);
+
+static bool ReadHeader (FILE *study_f, StudyCacheFileHeader *header_p, const char *filename_s);
+
+static size_t ReadCompressedChunk (void *buffer_p, size_t buffer_length, void *data_p);
+
+
+
+bool WritePlainStudyCacheFile (const char *filename_s, const char *study_s, const size_t study_length)
+{
+	bool success_flag = false;
+	char *temp_filename_s = NULL;
+	FILE *study_f = OpenTemporaryFile (filename_s, &temp_filename_s);
+
+	if (study_f)
+		{
+			if (fwrite (study_s, sizeof (char), study_length, study_f) == study_length)
+				{
+					success_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write cached study to \"%s\"", temp_filename_s);
+				}
+
+			success_flag = ReplaceWithTemporaryFile (study_f, temp_filename_s, success_flag, filename_s);
+		}		/* if (study_f) */
+
+	return success_flag;
+}
+
+
+bool WriteCompressedStudyCacheFile (const char *filename_s, const char *study_s, const size_t study_length)
+{
+	bool success_flag = false;
+	char *temp_filename_s = NULL;
+	FILE *study_f = OpenTemporaryFile (filename_s, &temp_filename_s);
+
+	if (study_f)
+		{
+			unsigned char header [S_HEADER_LENGTH];
+			unsigned char *header_p = header;
+			uLong checksum = crc32 (0L, Z_NULL, 0);
+
+			checksum = crc32 (checksum, (const Bytef *) study_s, (uInt) study_length);
+
+			memcpy (header_p, S_MAGIC_S, S_MAGIC_LENGTH);
+			header_p += S_MAGIC_LENGTH;
+
+			SetLittleEndianValue (header_p, SCF_FORMAT_VERSION, 4);
+			header_p += 4;
+
+			SetLittleEndianValue (header_p, (uint64) time (NULL), 8);
+			header_p += 8;
+
+			SetLittleEndianValue (header_p, (uint64) study_length, 8);
+			header_p += 8;
+
+			SetLittleEndianValue (header_p, (uint64) checksum, 4);
+
+			if (fwrite (header, 1, S_HEADER_LENGTH, study_f) == S_HEADER_LENGTH)
+				{
+					z_stream stream;
+
+					memset (&stream, 0, sizeof (z_stream));
+
+					if (deflateInit (&stream, Z_DEFAULT_COMPRESSION) == Z_OK)
+						{
+							unsigned char output [S_CHUNK_SIZE];
+							int res;
+
+							stream.next_in = (Bytef *) study_s;
+							stream.avail_in = (uInt) study_length;
+
+							success_flag = true;
+
+							do
+								{
+									size_t num_bytes;
+
+									stream.next_out = output;
+									stream.avail_out = S_CHUNK_SIZE;
+
+									res = deflate (&stream, Z_FINISH);
+
+									num_bytes = S_CHUNK_SIZE - stream.avail_out;
+
+									if (fwrite (output, 1, num_bytes, study_f) != num_bytes)
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write compressed study to \"%s\"", filename_s);
+											success_flag = false;
+										}
+								}
+							while (success_flag && (res == Z_OK));
+
+							if (res != Z_STREAM_END)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to compress study for \"%s\", error %d", filename_s, res);
+									success_flag = false;
+								}
+
+							deflateEnd (&stream);
+						}		/* if (deflateInit (&stream, Z_DEFAULT_COMPRESSION) == Z_OK) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to initialise compression for \"%s\"", filename_s);
+						}
+
+				}		/* if (fwrite (header, 1, S_HEADER_LENGTH, study_f) == S_HEADER_LENGTH) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write cache header to \"%s\"", filename_s);
+				}
+
+			success_flag = ReplaceWithTemporaryFile (study_f, temp_filename_s, success_flag, filename_s);
+		}		/* if (study_f) */
+
+	return success_flag;
+}
+
+
+json_t *ReadCompressedStudyCacheFile (const char *filename_s)
+{
+	json_t *study_json_p = NULL;
+	StudyCacheFileReader *reader_p = (StudyCacheFileReader *) AllocMemory (sizeof (StudyCacheFileReader));
+
+	if (reader_p)
+		{
+			memset (reader_p, 0, sizeof (StudyCacheFileReader));
+
+			if ((reader_p -> scfr_file_f = fopen (filename_s, "rb")) != NULL)
+				{
+					StudyCacheFileHeader header;
+
+					if (ReadHeader (reader_p -> scfr_file_f, &header, filename_s))
+						{
+							if (inflateInit (& (reader_p -> scfr_stream)) == Z_OK)
+								{
+									json_error_t err;
+
+									reader_p -> scfr_checksum = crc32 (0L, Z_NULL, 0);
+
+									study_json_p = json_load_callback (ReadCompressedChunk, reader_p, 0, &err);
+
+									if (study_json_p)
+										{
+											if ((reader_p -> scfr_uncompressed_size != header.scfh_uncompressed_size) || (reader_p -> scfr_checksum != header.scfh_checksum))
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Cached study \"%s\" is corrupt, expected " UINT64_FMT " bytes with checksum " UINT32_FMT " but got " UINT64_FMT " bytes with checksum " UINT32_FMT,
+														filename_s, header.scfh_uncompressed_size, header.scfh_checksum, reader_p -> scfr_uncompressed_size, (uint32) (reader_p -> scfr_checksum));
+
+													json_decref (study_json_p);
+													study_json_p = NULL;
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to load cached study from \"%s\", error \"%s\" at [%d, %d]", filename_s, err.text, err.line, err.column);
+										}
+
+									inflateEnd (& (reader_p -> scfr_stream));
+								}		/* if (inflateInit (& (reader_p -> scfr_stream)) == Z_OK) */
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to initialise decompression for \"%s\"", filename_s);
+								}
+
+						}		/* if (ReadHeader (reader_p -> scfr_file_f, &header, filename_s)) */
+
+					fclose (reader_p -> scfr_file_f);
+				}		/* if ((reader_p -> scfr_file_f = fopen (filename_s, "rb")) != NULL) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open \"%s\"", filename_s);
+				}
+
+			FreeMemory (reader_p);
+		}		/* if (reader_p) */
+
+	return study_json_p;
+}
+
+
+bool ReadStudyCacheFileHeader (const char *filename_s, StudyCacheFileHeader *header_p)
+{
+	bool success_flag = false;
+	FILE *study_f = fopen (filename_s, "rb");
+
+	if (study_f)
+		{
+			success_flag = ReadHeader (study_f, header_p, filename_s);
+			fclose (study_f);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open \"%s\"", filename_s);
+		}
+
+	return success_flag;
+}
+
+
+FILE *OpenTemporaryFile (const char *filename_s, char **temp_filename_ss)
+{
+	char *temp_filename_s = ConcatenateStrings (filename_s, ".XXXXXX");
+
+	if (temp_filename_s)
+		{
+			int fd = mkstemp (temp_filename_s);
+
+			if (fd != -1)
+				{
+					FILE *temp_f = NULL;
+
+					/* mkstemp creates the file as only readable by its owner */
+					fchmod (fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+					temp_f = fdopen (fd, "wb");
+
+					if (temp_f)
+						{
+							*temp_filename_ss = temp_filename_s;
+							return temp_f;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open stream for \"%s\"", temp_filename_s);
+						}
+
+					close (fd);
+					remove (temp_filename_s);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create temporary file \"%s\"", temp_filename_s);
+				}
+
+			FreeCopiedString (temp_filename_s);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get temporary filename for \"%s\"", filename_s);
+		}
+
+	return NULL;
+}
+
+
+bool ReplaceWithTemporaryFile (FILE *temp_f, char *temp_filename_s, const bool success_flag, const char *filename_s)
+{
+	bool replaced_flag = success_flag;
+
+	if (replaced_flag)
+		{
+			if ((fflush (temp_f) != 0) || (fsync (fileno (temp_f)) != 0))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to flush \"%s\"", temp_filename_s);
+					replaced_flag = false;
+				}
+		}
+
+	if (fclose (temp_f) != 0)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to close \"%s\"", temp_filename_s);
+			replaced_flag = false;
+		}
+
+	if (replaced_flag)
+		{
+			if (rename (temp_filename_s, filename_s) != 0)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to rename \"%s\" to \"%s\"", temp_filename_s, filename_s);
+					replaced_flag = false;
+				}
+		}
+
+	if (!replaced_flag)
+		{
+			remove (temp_filename_s);
+		}
+
+	FreeCopiedString (temp_filename_s);
+
+	return replaced_flag;
+}
+
+
+static bool ReadHeader (FILE *study_f, StudyCacheFileHeader *header_p, const char *filename_s)
+{
+	bool success_flag = false;
+	unsigned char header [S_HEADER_LENGTH];
+
+	if (fread (header, 1, S_HEADER_LENGTH, study_f) == S_HEADER_LENGTH)
+		{
+			if (memcmp (header, S_MAGIC_S, S_MAGIC_LENGTH) == 0)
+				{
+					const unsigned char *header_data_p = header + S_MAGIC_LENGTH;
+
+					header_p -> scfh_format_version = (uint32) GetLittleEndianValue (header_data_p, 4);
+					header_data_p += 4;
+
+					if (header_p -> scfh_format_version == SCF_FORMAT_VERSION)
+						{
+							header_p -> scfh_revision = GetLittleEndianValue (header_data_p, 8);
+							header_data_p += 8;
+
+							header_p -> scfh_uncompressed_size = GetLittleEndianValue (header_data_p, 8);
+							header_data_p += 8;
+
+							header_p -> scfh_checksum = (uint32) GetLittleEndianValue (header_data_p, 4);
+
+							success_flag = true;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Unsupported cache format version " UINT32_FMT " in \"%s\"", header_p -> scfh_format_version, filename_s);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is not a compressed cached study", filename_s);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to read cache header from \"%s\"", filename_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * A json_load_callback_t that decompresses the next chunk of the file.
+ */
+static size_t ReadCompressedChunk (void *buffer_p, size_t buffer_length, void *data_p)
+{
+	StudyCacheFileReader *reader_p = (StudyCacheFileReader *) data_p;
+	z_stream *stream_p = & (reader_p -> scfr_stream);
+	size_t num_bytes = 0;
+
+	stream_p -> next_out = (Bytef *) buffer_p;
+	stream_p -> avail_out = (uInt) buffer_length;
+
+	while ((!reader_p -> scfr_finished_flag) && (!reader_p -> scfr_error_flag) && (stream_p -> avail_out == buffer_length))
+		{
+			int res;
+
+			if (stream_p -> avail_in == 0)
+				{
+					stream_p -> avail_in = (uInt) fread (reader_p -> scfr_input, 1, S_CHUNK_SIZE, reader_p -> scfr_file_f);
+					stream_p -> next_in = reader_p -> scfr_input;
+
+					if (stream_p -> avail_in == 0)
+						{
+							/* The compressed data has been truncated */
+							reader_p -> scfr_error_flag = true;
+							break;
+						}
+				}
+
+			res = inflate (stream_p, Z_NO_FLUSH);
+
+			if (res == Z_STREAM_END)
+				{
+					reader_p -> scfr_finished_flag = true;
+				}
+			else if ((res != Z_OK) && (res != Z_BUF_ERROR))
+				{
+					reader_p -> scfr_error_flag = true;
+				}
+		}
+
+	if (reader_p -> scfr_error_flag)
+		{
+			return (size_t) -1;
+		}
+
+	num_bytes = buffer_length - stream_p -> avail_out;
+
+	if (num_bytes > 0)
+		{
+			reader_p -> scfr_checksum = crc32 (reader_p -> scfr_checksum, (const Bytef *) buffer_p, (uInt) num_bytes);
+			reader_p -> scfr_uncompressed_size += num_bytes;
+		}
+
+	return num_bytes;
+}
+
+
+static void SetLittleEndianValue (unsigned char *buffer_p, uint64 value, const size_t num_bytes)
+{
+	size_t i;
+
+	for (i = 0; i < num_bytes; ++ i, value >>= 8)
+		{
+			*buffer_p = (unsigned char) (value & 0xFF);
+			++ buffer_p;
+		}
+}
+
+
+static uint64 GetLittleEndianValue (const unsigned char *buffer_p, const size_t num_bytes)
+{
+	uint64 value = 0;
+	size_t i = num_bytes;
+
+	while (i > 0)
+		{
+			-- i;
+			value = (value << 8) | * (buffer_p + i);
+		}
+
+	return value;
+}
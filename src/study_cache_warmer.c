@@ -0,0 +1,412 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * study_cache_warmer.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <pthread.h>
+
+#include "study_cache_warmer.h"
+#include "study_jobs.h"
+#include "background_jobs.h"
+#include "change_tracking.h"
+#include "dfw_util.h"
+#include "memory_allocations.h"
+#include "mongodb_tool.h"
+#include "mongodb_util.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define STUDY_CACHE_WARMER_DEBUG	(STM_LEVEL_FINE)
+#else
+	#define STUDY_CACHE_WARMER_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * The shared state for all of the worker threads.
+ */
+typedef struct StudyCacheWarmer
+{
+	const json_t *scw_ids_p;
+
+	size_t scw_num_ids;
+
+	/* The index of the next Study to warm */
+	size_t scw_next_index;
+
+	uint32 scw_num_built;
+
+	uint32 scw_num_skipped;
+
+	/* The number of built Studies whose cached copies were out of date */
+	uint32 scw_num_stale;
+
+	uint32 scw_num_failed;
+
+	json_t *scw_failed_ids_p;
+
+	const FieldTrialServiceData *scw_data_p;
+
+	GrassrootsServer *scw_grassroots_p;
+
+	/* The BackgroundJob to report the progress to, if any */
+	BackgroundJob *scw_bg_job_p;
+
+	pthread_mutex_t scw_lock;
+} StudyCacheWarmer;
+
+
+static void *RunStudyCacheWarmingWorker (void *warmer_p);
+
+static bool WarmStudy (const char *id_s, const FieldTrialServiceData *data_p);
+
+static bool IsCachedStudyCurrent (const char *id_s, bool *cached_flag_p, const FieldTrialServiceData *data_p);
+
+static bool GetStudyModificationTime (const char *id_s, time_t *time_p, const FieldTrialServiceData *data_p);
+
+static json_t *GetStudyCacheWarmerResultsAsJSON (const StudyCacheWarmer *warmer_p);
+
+
+
+json_t *GetAllStudyIdsAsJSON (const FieldTrialServiceData *data_p)
+{
+	return GetAllIdsAsJSON (DFTD_STUDY, data_p);
+}
+
+
+json_t *WarmStudyCache (const json_t *study_ids_p, uint32 num_threads, ServiceJob *job_p, const FieldTrialServiceData *data_p, GrassrootsServer *grassroots_p)
+{
+	json_t *results_p = NULL;
+	StudyCacheWarmer warmer;
+
+	warmer.scw_ids_p = study_ids_p;
+	warmer.scw_num_ids = json_array_size (study_ids_p);
+	warmer.scw_next_index = 0;
+	warmer.scw_num_built = 0;
+	warmer.scw_num_skipped = 0;
+	warmer.scw_num_stale = 0;
+	warmer.scw_num_failed = 0;
+	warmer.scw_data_p = data_p;
+	warmer.scw_grassroots_p = grassroots_p;
+	warmer.scw_bg_job_p = GetBackgroundJob (job_p);
+
+	if ((warmer.scw_failed_ids_p = json_array ()) != NULL)
+		{
+			if (pthread_mutex_init (& (warmer.scw_lock), NULL) == 0)
+				{
+					pthread_t *threads_p = NULL;
+					uint32 num_started = 0;
+
+					if (num_threads == 0)
+						{
+							num_threads = 1;
+						}
+
+					if (num_threads > warmer.scw_num_ids)
+						{
+							num_threads = (uint32) warmer.scw_num_ids;
+						}
+
+					if (num_threads > 0)
+						{
+							threads_p = (pthread_t *) AllocMemoryArray (num_threads, sizeof (pthread_t));
+
+							if (threads_p)
+								{
+									uint32 i;
+
+									for (i = 0; i < num_threads; ++ i)
+										{
+											if (pthread_create (threads_p + num_started, NULL, RunStudyCacheWarmingWorker, &warmer) == 0)
+												{
+													++ num_started;
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to start study cache warming thread " UINT32_FMT, i);
+												}
+										}
+
+									for (i = 0; i < num_started; ++ i)
+										{
+											pthread_join (* (threads_p + i), NULL);
+										}
+
+									FreeMemory (threads_p);
+								}		/* if (threads_p) */
+
+							/*
+							 * If we couldn't start any threads, do the work ourselves
+							 */
+							if (num_started == 0)
+								{
+									RunStudyCacheWarmingWorker (&warmer);
+								}
+
+						}		/* if (num_threads > 0) */
+
+					results_p = GetStudyCacheWarmerResultsAsJSON (&warmer);
+
+					pthread_mutex_destroy (& (warmer.scw_lock));
+				}		/* if (pthread_mutex_init (& (warmer.scw_lock), NULL) == 0) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to initialise study cache warming lock");
+				}
+
+			json_decref (warmer.scw_failed_ids_p);
+		}		/* if ((warmer.scw_failed_ids_p = json_array ()) != NULL) */
+
+	return results_p;
+}
+
+
+static void *RunStudyCacheWarmingWorker (void *data_p)
+{
+	StudyCacheWarmer *warmer_p = (StudyCacheWarmer *) data_p;
+	FieldTrialServiceData *worker_data_p = AllocateWorkerServiceData (warmer_p -> scw_data_p, warmer_p -> scw_grassroots_p);
+
+	if (worker_data_p)
+		{
+			bool loop_flag = true;
+
+			while (loop_flag)
+				{
+					size_t index;
+
+					pthread_mutex_lock (& (warmer_p -> scw_lock));
+					index = (warmer_p -> scw_next_index) ++;
+					pthread_mutex_unlock (& (warmer_p -> scw_lock));
+
+					if (index < warmer_p -> scw_num_ids)
+						{
+							const char *id_s = json_string_value (json_array_get (warmer_p -> scw_ids_p, index));
+							bool cached_flag = false;
+							bool skipped_flag = false;
+							bool built_flag = false;
+
+							if (id_s)
+								{
+									if (IsCachedStudyCurrent (id_s, &cached_flag, worker_data_p))
+										{
+											skipped_flag = true;
+										}
+									else
+										{
+											/*
+											 * Remove any out of date copy so that it
+											 * gets rebuilt rather than loaded.
+											 */
+											if (cached_flag)
+												{
+													ClearCachedStudy (id_s, worker_data_p);
+												}
+
+											built_flag = WarmStudy (id_s, worker_data_p);
+										}
+								}
+
+							pthread_mutex_lock (& (warmer_p -> scw_lock));
+
+							if (skipped_flag)
+								{
+									++ (warmer_p -> scw_num_skipped);
+								}
+							else if (built_flag)
+								{
+									++ (warmer_p -> scw_num_built);
+
+									if (cached_flag)
+										{
+											++ (warmer_p -> scw_num_stale);
+										}
+								}
+							else
+								{
+									++ (warmer_p -> scw_num_failed);
+
+									if (id_s)
+										{
+											json_array_append_new (warmer_p -> scw_failed_ids_p, json_string (id_s));
+										}
+								}
+
+							SetBackgroundJobProgress (warmer_p -> scw_bg_job_p, warmer_p -> scw_num_skipped + warmer_p -> scw_num_built + warmer_p -> scw_num_failed, warmer_p -> scw_num_ids);
+
+							pthread_mutex_unlock (& (warmer_p -> scw_lock));
+
+							#if STUDY_CACHE_WARMER_DEBUG >= STM_LEVEL_FINE
+							PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Warmed study " SIZET_FMT " of " SIZET_FMT, index + 1, warmer_p -> scw_num_ids);
+							#endif
+						}
+					else
+						{
+							loop_flag = false;
+						}
+
+				}		/* while (loop_flag) */
+
+			FreeWorkerServiceData (worker_data_p);
+		}		/* if (worker_data_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set up the service data for study cache warming");
+		}
+
+	return NULL;
+}
+
+
+static bool WarmStudy (const char *id_s, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	char *study_name_s = NULL;
+	json_t *study_json_p = GetStudyJSONForId (id_s, VF_CLIENT_FULL, NULL, &study_name_s, data_p);
+
+	if (study_json_p)
+		{
+			success_flag = true;
+			json_decref (study_json_p);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to warm cached study \"%s\"", id_s);
+		}
+
+	if (study_name_s)
+		{
+			FreeCopiedString (study_name_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * A cached Study is current if its cache file was written after the Study
+ * was last saved. If the Study has never been stamped with a modification
+ * time, there's nothing to compare against so any cached copy is used.
+ */
+static bool IsCachedStudyCurrent (const char *id_s, bool *cached_flag_p, const FieldTrialServiceData *data_p)
+{
+	bool current_flag = false;
+	time_t cached_time = 0;
+
+	*cached_flag_p = GetCachedStudyTime (id_s, &cached_time, data_p);
+
+	if (*cached_flag_p)
+		{
+			time_t modified_time = 0;
+
+			if (GetStudyModificationTime (id_s, &modified_time, data_p))
+				{
+					/*
+					 * The times only have a resolution of a second so
+					 * a tie counts as out of date.
+					 */
+					current_flag = (cached_time > modified_time);
+				}
+		}
+
+	return current_flag;
+}
+
+
+/*
+ * Get the time at which a Study was last saved. If it doesn't have one,
+ * this is set to 0.
+ */
+static bool GetStudyModificationTime (const char *id_s, time_t *time_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_STUDY]))
+		{
+			bson_oid_t *id_p = GetBSONOidFromString (id_s);
+
+			if (id_p)
+				{
+					bson_t *query_p = BCON_NEW (MONGO_ID_S, BCON_OID (id_p));
+
+					if (query_p)
+						{
+							bson_t *opts_p = BCON_NEW ("projection", "{", CT_MODIFIED_AT_S, BCON_INT32 (1), "}");
+
+							if (opts_p)
+								{
+									json_t *results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, opts_p);
+
+									if (results_p)
+										{
+											const json_t *study_json_p = json_array_get (results_p, 0);
+
+											if (study_json_p)
+												{
+													const json_t *modified_at_p = json_object_get (study_json_p, CT_MODIFIED_AT_S);
+
+													*time_p = json_is_integer (modified_at_p) ? (time_t) json_integer_value (modified_at_p) : 0;
+													success_flag = true;
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "No study with id \"%s\"", id_s);
+												}
+
+											json_decref (results_p);
+										}		/* if (results_p) */
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get the modification time of study \"%s\"", id_s);
+										}
+
+									bson_destroy (opts_p);
+								}		/* if (opts_p) */
+
+							bson_destroy (query_p);
+						}		/* if (query_p) */
+
+					FreeBSONOid (id_p);
+				}		/* if (id_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_STUDY])) */
+
+	return success_flag;
+}
+
+
+static json_t *GetStudyCacheWarmerResultsAsJSON (const StudyCacheWarmer *warmer_p)
+{
+	json_t *results_p = json_pack ("{s:I,s:I,s:I,s:I,s:I,s:O}",
+		"studies", (json_int_t) (warmer_p -> scw_num_ids),
+		"built", (json_int_t) (warmer_p -> scw_num_built),
+		"stale", (json_int_t) (warmer_p -> scw_num_stale),
+		"skipped", (json_int_t) (warmer_p -> scw_num_skipped),
+		"failed", (json_int_t) (warmer_p -> scw_num_failed),
+		"failed_ids", warmer_p -> scw_failed_ids_p);
+
+	if (!results_p)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create study cache warming results");
+		}
+
+	return results_p;
+}
@@ -34,6 +34,7 @@
 #include "treatment_jobs.h"
 #include "treatment_factor_jobs.h"
 #include "dfw_util.h"
+#include "document_cache.h"
 #include "key_value_pair.h"
 #include "time_util.h"
 #include "frictionless_data_util.h"
@@ -42,6 +43,9 @@
 #include "plot.h"
 #include "row.h"
 #include "observation.h"
+#include "observation_jobs.h"
+#include "trait_matrix.h"
+#include "trait_statistics.h"
 #include "treatment_factor.h"
 
 #include "string_parameter.h"
@@ -164,6 +168,20 @@ static bool AddCropAsFrictionlessData (const Crop * const crop_p, json_t *json_p
 static bool AddTreatmentFactorsAsFrictionlessData (json_t *json_p, LinkedList *treatments_p, const char * const key_s);
 
 
+static bool PrefetchStudyIndexingReferences (const json_t *study_docs_p, const FieldTrialServiceData *data_p);
+
+
+static bool AddVariableObservationsParameters (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p);
+
+
+static json_t *GetPlotCountsForStudies (const json_t *study_ids_p, const size_t num_studies, const FieldTrialServiceData *data_p);
+
+static bool IsCursorExhausted (const json_t *cursor_p);
+
+
+static json_t *GetIdsOfStudiesWithShapes (const json_t *study_ids_p, const FieldTrialServiceData *data_p);
+
+
 /*
  * API DEFINITIONS
  */
@@ -975,6 +993,30 @@ bool GetSearchStudyParameterTypeForNamedParameter (const char *param_name_s, Par
 		{
 			*pt_p = STUDY_GET_ALL_PLOTS.npt_type;
 		}
+	else if (strcmp (param_name_s, STUDY_GET_TRAIT_MATRIX.npt_name_s) == 0)
+		{
+			*pt_p = STUDY_GET_TRAIT_MATRIX.npt_type;
+		}
+	else if (strcmp (param_name_s, STUDY_GET_TRAIT_STATISTICS.npt_name_s) == 0)
+		{
+			*pt_p = STUDY_GET_TRAIT_STATISTICS.npt_type;
+		}
+	else if (strcmp (param_name_s, STUDY_VARIABLE_OBSERVATIONS.npt_name_s) == 0)
+		{
+			*pt_p = STUDY_VARIABLE_OBSERVATIONS.npt_type;
+		}
+	else if (strcmp (param_name_s, STUDY_OBSERVATIONS_MATERIAL.npt_name_s) == 0)
+		{
+			*pt_p = STUDY_OBSERVATIONS_MATERIAL.npt_type;
+		}
+	else if (strcmp (param_name_s, STUDY_OBSERVATIONS_FROM.npt_name_s) == 0)
+		{
+			*pt_p = STUDY_OBSERVATIONS_FROM.npt_type;
+		}
+	else if (strcmp (param_name_s, STUDY_OBSERVATIONS_TO.npt_name_s) == 0)
+		{
+			*pt_p = STUDY_OBSERVATIONS_TO.npt_type;
+		}
 	else if (strcmp (param_name_s, STUDY_LOCATIONS_LIST.npt_name_s) == 0)
 		{
 			*pt_p = STUDY_LOCATIONS_LIST.npt_type;
@@ -1030,7 +1072,21 @@ bool AddSearchStudyParams (ServiceData *data_p, ParameterSet *param_set_p)
 
 																	if ((param_p = EasyCreateAndAddUnsignedIntParameterToParameterSet (data_p, param_set_p, group_p, STUDY_HARVEST_YEAR.npt_name_s, "Harvest year", "Year that the Study was/will be harvested", &year, PL_ADVANCED)) != NULL)
 																		{
-																			success_flag = true;
+																			if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, param_set_p, group_p, STUDY_GET_TRAIT_MATRIX.npt_name_s, "Trait matrix", "Export the phenotype values of the Study as a binary trait matrix", &search_flag, PL_ADVANCED)) != NULL)
+																				{
+																					if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, param_set_p, group_p, STUDY_GET_TRAIT_STATISTICS.npt_name_s, "Trait statistics", "Get the summary statistics of each of the Study's phenotypes", &search_flag, PL_ADVANCED)) != NULL)
+																						{
+																							success_flag = AddVariableObservationsParameters (data_p, param_set_p, group_p);
+																						}
+																					else
+																						{
+																							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", STUDY_GET_TRAIT_STATISTICS.npt_name_s);
+																						}
+																				}
+																			else
+																				{
+																					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", STUDY_GET_TRAIT_MATRIX.npt_name_s);
+																				}
 																		}
 																	else
 																		{
@@ -1107,6 +1163,72 @@ bool RunForSearchStudyParams (FieldTrialServiceData *data_p, ParameterSet *param
 
 						}		/* if (GetParameterValueFromParameterSet (param_set_p, S_GET_ALL_PLOTS.npt_name_s, &value, true)) */
 
+					/*
+					 * Are we exporting a Study's trait matrix?
+					 */
+					if (GetCurrentBooleanParameterValueFromParameterSet (param_set_p, STUDY_GET_TRAIT_MATRIX.npt_name_s, &search_flag_p))
+						{
+							if ((search_flag_p != NULL) && (*search_flag_p == true))
+								{
+									if (GetCurrentStringParameterValueFromParameterSet (param_set_p, STUDY_ID.npt_name_s, &id_s))
+										{
+											if (!IsStringEmpty (id_s))
+												{
+													AddStudyTraitMatrixToServiceJob (id_s, job_p, data_p);
+													job_done_flag = true;
+												}
+										}
+								}
+						}
+
+					/*
+					 * Are we getting a Study's trait statistics? These come from
+					 * their own collection so the Study's Plots aren't loaded.
+					 */
+					if ((!job_done_flag) && (GetCurrentBooleanParameterValueFromParameterSet (param_set_p, STUDY_GET_TRAIT_STATISTICS.npt_name_s, &search_flag_p)))
+						{
+							if ((search_flag_p != NULL) && (*search_flag_p == true))
+								{
+									if (GetCurrentStringParameterValueFromParameterSet (param_set_p, STUDY_ID.npt_name_s, &id_s))
+										{
+											if (!IsStringEmpty (id_s))
+												{
+													AddStudyTraitStatisticsToServiceJob (id_s, job_p, data_p);
+													job_done_flag = true;
+												}
+										}
+								}
+						}
+
+					/*
+					 * Are we getting the values of a Measured Variable? These
+					 * come from the Observations collection so no Plots are loaded.
+					 */
+					if (!job_done_flag)
+						{
+							const char *variable_id_s = NULL;
+
+							if (GetCurrentStringParameterValueFromParameterSet (param_set_p, STUDY_VARIABLE_OBSERVATIONS.npt_name_s, &variable_id_s))
+								{
+									if (!IsStringEmpty (variable_id_s))
+										{
+											const char *material_id_s = NULL;
+											const char *from_s = NULL;
+											const char *to_s = NULL;
+
+											id_s = NULL;
+
+											GetCurrentStringParameterValueFromParameterSet (param_set_p, STUDY_ID.npt_name_s, &id_s);
+											GetCurrentStringParameterValueFromParameterSet (param_set_p, STUDY_OBSERVATIONS_MATERIAL.npt_name_s, &material_id_s);
+											GetCurrentStringParameterValueFromParameterSet (param_set_p, STUDY_OBSERVATIONS_FROM.npt_name_s, &from_s);
+											GetCurrentStringParameterValueFromParameterSet (param_set_p, STUDY_OBSERVATIONS_TO.npt_name_s, &to_s);
+
+											AddVariableObservationsToServiceJob (id_s, material_id_s, variable_id_s, from_s, to_s, job_p, data_p);
+											job_done_flag = true;
+										}
+								}
+						}
+
 					/*
 					 * Are we searching for all studies within a trial?
 					 */
@@ -1773,85 +1895,437 @@ json_t *GetAllStudiesAsJSON (const FieldTrialServiceData *data_p)
 json_t *GetStudyIndexingData (Service *service_p)
 {
 	FieldTrialServiceData *data_p = (FieldTrialServiceData *) (service_p -> se_data_p);
+	json_t *studies_p = NULL;
 
 	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_STUDY]))
 		{
-			bson_t query;
-			const char *fields_ss [] = { MONGO_ID_S, NULL };
+			bson_t *query_p = bson_new ();
+
+			if (query_p)
+				{
+					/*
+					 * Get all of the Studies with a single cursor. The shape data can be
+					 * large and we only need to know whether it exists, so leave it out.
+					 */
+					bson_t *opts_p = BCON_NEW ("sort", "{", MONGO_ID_S, BCON_INT32 (1), "}", "projection", "{", ST_SHAPE_S, BCON_INT32 (0), "}");
+
+					if (opts_p)
+						{
+							if ((studies_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, opts_p)) != NULL)
+								{
+									if (!PrepareStudiesForIndexing (studies_p, data_p))
+										{
+											json_decref (studies_p);
+											studies_p = NULL;
+										}
+								}
+
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_STUDY])) */
+
+	return studies_p;
+}
+
+
+bool PrepareStudiesForIndexing (json_t *studies_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	json_t *study_ids_p = json_object ();
+
+	if (study_ids_p)
+		{
+			const size_t num_studies = json_array_size (studies_p);
+			size_t i;
+			const json_t *study_doc_p;
+			json_t *plot_counts_p = NULL;
+			json_t *shaped_ids_p = NULL;
+			size_t num_added = 0;
 
-			bson_init (&query);
+			/*
+			 * Keep the prefetched Locations, Field Trials, Programmes and Crops
+			 * for the lifetime of this call.
+			 */
+			BeginDocumentCacheScope (data_p -> dftsd_document_cache_p);
 
-			if (FindMatchingMongoDocumentsByBSON (data_p -> dftsd_mongo_p, &query, fields_ss, NULL))
+			if (!PrefetchStudyIndexingReferences (studies_p, data_p))
 				{
-					json_t *id_results_p = GetAllExistingMongoResultsAsJSON (data_p -> dftsd_mongo_p);
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to prefetch all of the references for indexing the studies");
+				}
 
-					if (id_results_p)
+			json_array_foreach (studies_p, i, study_doc_p)
+				{
+					if (!AddReferencedIdToSet (study_ids_p, study_doc_p, MONGO_ID_S))
 						{
-							json_t *studies_p = json_array ();
+							PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, study_doc_p, "Failed to add study id");
+						}
+				}
+
+			plot_counts_p = GetPlotCountsForStudies (study_ids_p, num_studies, data_p);
+			shaped_ids_p = GetIdsOfStudiesWithShapes (study_ids_p, data_p);
+
+			/*
+			 * Replace each of the raw documents with the minimal view
+			 * of its Study.
+			 */
+			for (i = 0; i < num_studies; ++ i)
+				{
+					Study *study_p;
 
-							if (studies_p)
+					study_doc_p = json_array_get (studies_p, i);
+
+					if ((study_p = GetStudyFromJSON (study_doc_p, VF_CLIENT_MINIMAL, data_p)) != NULL)
+						{
+							json_t *study_json_p = NULL;
+							char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+							bson_oid_to_string (study_p -> st_id_p, id_s);
+
+							if (plot_counts_p)
 								{
-									size_t i;
-									bson_oid_t oid;
-									const size_t num_results = json_array_size (id_results_p);
-									size_t num_added = 0;
+									const json_t *count_p = json_object_get (plot_counts_p, id_s);
+
+									study_p -> st_num_plots = count_p ? (int32) json_integer_value (count_p) : 0;
+								}
+
+							/*
+							 * For the minimal view, only the presence of the shape
+							 * data is used so we can use a placeholder for it.
+							 */
+							if ((! (study_p -> st_shape_p)) && (shaped_ids_p) && (json_object_get (shaped_ids_p, id_s)))
+								{
+									study_p -> st_shape_p = json_true ();
+								}
+
+							study_json_p = GetStudyAsJSON (study_p, VF_CLIENT_MINIMAL, NULL, data_p);
 
-									for (i = 0; i < num_results; ++ i)
+							if (study_json_p)
+								{
+									if (json_array_set_new (studies_p, i, study_json_p) == 0)
 										{
-											json_t *id_result_p = json_array_get (id_results_p, i);
+											++ num_added;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add study \"%s\" to array for indexing", study_p -> st_name_s);
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get study \"%s\" as json for indexing", study_p -> st_name_s);
+								}
+
+							FreeStudy (study_p);
+						}		/* if ((study_p = GetStudyFromJSON (study_doc_p, VF_CLIENT_MINIMAL, data_p)) != NULL) */
+					else
+						{
+							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, study_doc_p, "Failed to get study for indexing");
+						}
+
+				}		/* for (i = 0; i < num_studies; ++ i) */
+
+			if (shaped_ids_p)
+				{
+					json_decref (shaped_ids_p);
+				}
+
+			if (plot_counts_p)
+				{
+					json_decref (plot_counts_p);
+				}
+
+			EndDocumentCacheScope (data_p -> dftsd_document_cache_p);
+
+			success_flag = (num_added == num_studies);
+
+			json_decref (study_ids_p);
+		}		/* if (study_ids_p) */
+
+	return success_flag;
+}
 
-											if (GetMongoIdFromJSON (id_result_p, &oid))
+
+/*
+ * Fetch everything that the minimal view of the given Studies refers to
+ * with a single query per collection.
+ */
+static bool PrefetchStudyIndexingReferences (const json_t *study_docs_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	json_t *trial_ids_p = json_object ();
+
+	if (trial_ids_p)
+		{
+			json_t *location_ids_p = json_object ();
+
+			if (location_ids_p)
+				{
+					json_t *crop_ids_p = json_object ();
+
+					if (crop_ids_p)
+						{
+							json_t *programme_ids_p = json_object ();
+
+							if (programme_ids_p)
+								{
+									size_t i;
+									const json_t *study_doc_p;
+									const char *trial_id_s;
+									json_t *value_p;
+
+									success_flag = true;
+
+									json_array_foreach (study_docs_p, i, study_doc_p)
+										{
+											if (! ((AddReferencedIdToSet (trial_ids_p, study_doc_p, ST_PARENT_FIELD_TRIAL_S)) &&
+												(AddReferencedIdToSet (location_ids_p, study_doc_p, ST_LOCATION_ID_S)) &&
+												(AddReferencedIdToSet (crop_ids_p, study_doc_p, ST_CURRENT_CROP_S)) &&
+												(AddReferencedIdToSet (crop_ids_p, study_doc_p, ST_PREVIOUS_CROP_S))))
 												{
-													Study *study_p = GetStudyById (&oid, VF_CLIENT_MINIMAL, data_p);
+													success_flag = false;
+												}
+										}
+
+									if (!PrefetchDocumentsIntoDocumentCache (data_p -> dftsd_document_cache_p, DFTD_FIELD_TRIAL, trial_ids_p, data_p))
+										{
+											success_flag = false;
+										}
 
-													if (study_p)
+									if (!PrefetchDocumentsIntoDocumentCache (data_p -> dftsd_document_cache_p, DFTD_LOCATION, location_ids_p, data_p))
+										{
+											success_flag = false;
+										}
+
+									if (!PrefetchDocumentsIntoDocumentCache (data_p -> dftsd_document_cache_p, DFTD_CROP, crop_ids_p, data_p))
+										{
+											success_flag = false;
+										}
+
+									/*
+									 * Now the Field Trials are cached, get their Programmes
+									 */
+									json_object_foreach (trial_ids_p, trial_id_s, value_p)
+										{
+											bson_oid_t trial_id;
+											const json_t *trial_doc_p;
+
+											bson_oid_init_from_string (&trial_id, trial_id_s);
+
+											if ((trial_doc_p = GetDocumentFromDocumentCache (data_p -> dftsd_document_cache_p, DFTD_FIELD_TRIAL, &trial_id)) != NULL)
+												{
+													if (!AddReferencedIdToSet (programme_ids_p, trial_doc_p, FT_PARENT_PROGRAM_S))
 														{
-															json_t *study_json_p = GetStudyAsJSON (study_p, VF_CLIENT_MINIMAL, NULL, data_p);
+															success_flag = false;
+														}
+												}
+										}
+
+									if (!PrefetchDocumentsIntoDocumentCache (data_p -> dftsd_document_cache_p, DFTD_PROGRAM, programme_ids_p, data_p))
+										{
+											success_flag = false;
+										}
+
+									json_decref (programme_ids_p);
+								}		/* if (programme_ids_p) */
+
+							json_decref (crop_ids_p);
+						}		/* if (crop_ids_p) */
+
+					json_decref (location_ids_p);
+				}		/* if (location_ids_p) */
+
+			json_decref (trial_ids_p);
+		}		/* if (trial_ids_p) */
+
+	return success_flag;
+}
+
+
+/*
+ * Count the Plots for each of the given Studies with a single aggregation.
+ * The results are a JSON object keyed by the Study ids. Any Study that has
+ * no entry has no Plots. If the counts can't all be read from the reply,
+ * this returns NULL so that each Study counts its own Plots instead.
+ */
+static json_t *GetPlotCountsForStudies (const json_t *study_ids_p, const size_t num_studies, const FieldTrialServiceData *data_p)
+{
+	json_t *counts_p = NULL;
+	char *group_key_s = ConcatenateStrings ("$", PL_PARENT_STUDY_S);
+
+	if (group_key_s)
+		{
+			bson_t *match_p = GetIdsInQuery (PL_PARENT_STUDY_S, study_ids_p);
 
-															if (study_json_p)
+			if (match_p)
+				{
+					/*
+					 * Only the given Studies are grouped so there is at most one result
+					 * per Study, which means that they all fit in the first batch
+					 */
+					bson_t *command_p = BCON_NEW ("aggregate", BCON_UTF8 (data_p -> dftsd_collection_ss [DFTD_PLOT]),
+																				"pipeline", "[",
+																					"{", "$match", BCON_DOCUMENT (match_p), "}",
+																					"{", "$group", "{", MONGO_ID_S, BCON_UTF8 (group_key_s), "count", "{", "$sum", BCON_INT32 (1), "}", "}", "}",
+																				"]",
+																				"cursor", "{", "batchSize", BCON_INT32 ((int32) num_studies + 1), "}");
+
+					if (command_p)
+						{
+							bson_t *reply_p = NULL;
+
+							if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p))
+								{
+									if (reply_p)
+										{
+											json_t *reply_json_p = ConvertBSONToJSON (reply_p);
+
+											if (reply_json_p)
+												{
+													const json_t *cursor_p = json_object_get (reply_json_p, "cursor");
+													const json_t *batch_p = cursor_p ? json_object_get (cursor_p, "firstBatch") : NULL;
+
+													/*
+													 * Any Study missing from an incomplete batch would look like it has no
+													 * Plots, so the batch is only used if the cursor has been exhausted.
+													 */
+													if ((json_is_array (batch_p)) && (IsCursorExhausted (cursor_p)))
+														{
+															if ((counts_p = json_object ()) != NULL)
 																{
-																	if (json_array_append_new (studies_p, study_json_p) == 0)
-																		{
-																			++ num_added;
-																		}
-																	else
+																	size_t i;
+																	const json_t *group_p;
+
+																	json_array_foreach (batch_p, i, group_p)
 																		{
-																			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, study_json_p, "Failed to add study to array for indexing");
-																			json_decref (study_json_p);
+																			bson_oid_t study_id;
+																			int count;
+
+																			if ((GetMongoIdFromJSON (group_p, &study_id)) && (GetJSONInteger (group_p, "count", &count)))
+																				{
+																					char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+																					bson_oid_to_string (&study_id, id_s);
+
+																					if (json_object_set_new (counts_p, id_s, json_integer (count)) != 0)
+																						{
+																							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add plot count for study \"%s\"", id_s);
+																						}
+																				}
 																		}
-																}
 
-															FreeStudy (study_p);
-														}		/* if (study_p) */
+																}		/* if ((counts_p = json_object ()) != NULL) */
+
+														}		/* if ((json_is_array (batch_p)) && (IsCursorExhausted (cursor_p))) */
 													else
 														{
-															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get study \"%s\" as json for indexing", study_p -> st_name_s);
+															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, reply_json_p, "Failed to get all of the plot counts in a single batch");
 														}
 
-												}		/* if (GetMongoIdFromJSON (id_result_p, &oid)) */
-											else
-												{
-													PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, id_result_p, "Failed to get study id for indexing");
-												}
+													json_decref (reply_json_p);
+												}		/* if (reply_json_p) */
+
+											bson_destroy (reply_p);
+										}		/* if (reply_p) */
+
+								}		/* if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p)) */
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to count the plots for each study");
+								}
+
+							bson_destroy (command_p);
+						}		/* if (command_p) */
+
+					bson_destroy (match_p);
+				}		/* if (match_p) */
+
+			FreeCopiedString (group_key_s);
+		}		/* if (group_key_s) */
+
+	return counts_p;
+}
+
+
+/*
+ * A cursor in a command reply has no more results if its id is 0. Depending
+ * upon how the reply was converted, the 64-bit id can be a plain integer or
+ * an extended JSON object.
+ */
+static bool IsCursorExhausted (const json_t *cursor_p)
+{
+	bool exhausted_flag = false;
+	const json_t *id_p = json_object_get (cursor_p, "id");
+
+	if (json_is_integer (id_p))
+		{
+			exhausted_flag = (json_integer_value (id_p) == 0);
+		}
+	else if (json_is_object (id_p))
+		{
+			const char *id_s = GetJSONString (id_p, "$numberLong");
+
+			exhausted_flag = ((id_s != NULL) && (strcmp (id_s, "0") == 0));
+		}
+
+	return exhausted_flag;
+}
+
+
+/*
+ * Get the ids of those of the given Studies that have shape data, as the keys of a JSON object.
+ */
+static json_t *GetIdsOfStudiesWithShapes (const json_t *study_ids_p, const FieldTrialServiceData *data_p)
+{
+	json_t *ids_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_STUDY]))
+		{
+			bson_t *query_p = GetIdsInQuery (MONGO_ID_S, study_ids_p);
+
+			if (query_p)
+				{
+					bson_t *opts_p = NULL;
+
+					BCON_APPEND (query_p, ST_SHAPE_S, "{", "$exists", BCON_BOOL (true), "$ne", BCON_NULL, "}");
 
-										}		/* json_array_foreach (results_p, i, id_p) */
+					opts_p = BCON_NEW ("projection", "{", MONGO_ID_S, BCON_INT32 (1), "}");
 
-									if (num_added == num_results)
+					if (opts_p)
+						{
+							json_t *results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, opts_p);
+
+							if (results_p)
+								{
+									if ((ids_p = json_object ()) != NULL)
 										{
-											return studies_p;
+											size_t i;
+											const json_t *result_p;
+
+											json_array_foreach (results_p, i, result_p)
+												{
+													if (!AddReferencedIdToSet (ids_p, result_p, MONGO_ID_S))
+														{
+															PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, result_p, "Failed to add id of study with shape data");
+														}
+												}
 										}
 
-									json_decref (studies_p);
-								}		/* if (studies_p) */
+									json_decref (results_p);
+								}		/* if (results_p) */
 
-							json_decref (id_results_p);
-						}		/* if (id_results_p) */
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
 
-				}		/* if (FindMatchingMongoDocumentsByBSON (data_p -> dftsd_mongo_p, NULL, fields_ss, NULL)) */
+					bson_destroy (query_p);
+				}		/* if (query_p) */
 
 		}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, data_p -> dftsd_collection_ss [DFTD_STUDY])) */
 
-	return NULL;
+	return ids_p;
 }
 
 
@@ -3046,10 +3520,35 @@ json_t *GetStudyJSONForId (const char *id_s, const ViewFormat format, JSONProces
 {
 	json_t *study_json_p = NULL;
 
+	bool builder_flag = false;
+
 	if (format == VF_CLIENT_FULL)
 		{
 			study_json_p = GetCachedStudy (id_s, data_p);
 
+			/*
+			 * If the Study isn't cached, only let one request rebuild it
+			 * and have any others wait for that to finish and then use
+			 * the newly-cached copy.
+			 */
+			while ((!study_json_p) && (!builder_flag))
+				{
+					builder_flag = BeginStudyCacheBuild (id_s);
+
+					/*
+					 * Check again as either another request has just
+					 * built it or it was cached between our first look
+					 * and starting the build.
+					 */
+					study_json_p = GetCachedStudy (id_s, data_p);
+				}
+
+			if (study_json_p && builder_flag)
+				{
+					EndStudyCacheBuild (id_s);
+					builder_flag = false;
+				}
+
 			if (study_json_p)
 				{
 					const char *name_s = GetJSONString (study_json_p, ST_NAME_S);
@@ -3096,6 +3595,11 @@ json_t *GetStudyJSONForId (const char *id_s, const ViewFormat format, JSONProces
 
 		}		/* if (!study_json_p) */
 
+	if (builder_flag)
+		{
+			EndStudyCacheBuild (id_s);
+		}
+
 	return study_json_p;
 }
 
@@ -3581,6 +4085,16 @@ OperationStatus RemovePlotsForStudyById (const char *id_s, FieldTrialServiceData
 									if (RemoveMongoDocumentsByBSON (tool_p, query_p, false))
 										{
 											status = OS_SUCCEEDED;
+
+											if (!RemoveStudyFromObservationsCollection (id_p, data_p))
+												{
+													status = OS_PARTIALLY_SUCCEEDED;
+												}
+
+											if (!RemoveStudyTraitStatistics (id_p, data_p))
+												{
+													status = OS_PARTIALLY_SUCCEEDED;
+												}
 										}
 
 								}
@@ -3944,3 +4458,45 @@ static bool GetPersonFromParameters (Person **person_pp, ParameterSet *param_set
 
 	return success_flag;
 }
+
+
+/*
+ * The parameters for getting the values of a Measured Variable from the
+ * Observations collection, either across a Study or for a Material.
+ */
+static bool AddVariableObservationsParameters (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p)
+{
+	bool success_flag = false;
+
+	if (EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, STUDY_VARIABLE_OBSERVATIONS.npt_type, STUDY_VARIABLE_OBSERVATIONS.npt_name_s, "Measured Variable observations", "Get the values of the Measured Variable with this id across the Study, or for the Material if one is given", NULL, PL_ADVANCED))
+		{
+			if (EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, STUDY_OBSERVATIONS_MATERIAL.npt_type, STUDY_OBSERVATIONS_MATERIAL.npt_name_s, "Material", "Get the values for the Material with this id across all Studies", NULL, PL_ADVANCED))
+				{
+					if (EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, STUDY_OBSERVATIONS_FROM.npt_type, STUDY_OBSERVATIONS_FROM.npt_name_s, "From", "Only get the Study's values observed on or after this date", NULL, PL_ADVANCED))
+						{
+							if (EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, STUDY_OBSERVATIONS_TO.npt_type, STUDY_OBSERVATIONS_TO.npt_name_s, "To", "Only get the Study's values observed on or before this date", NULL, PL_ADVANCED))
+								{
+									success_flag = true;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", STUDY_OBSERVATIONS_TO.npt_name_s);
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", STUDY_OBSERVATIONS_FROM.npt_name_s);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", STUDY_OBSERVATIONS_MATERIAL.npt_name_s);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", STUDY_VARIABLE_OBSERVATIONS.npt_name_s);
+		}
+
+	return success_flag;
+}
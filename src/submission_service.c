@@ -94,7 +94,7 @@ Service *GetDFWFieldTrialSubmissionService (GrassrootsServer *grassroots_p)
 														 CloseDFWFieldTrialSubmissionService,
 														 NULL,
 														 false,
-														 SY_SYNCHRONOUS,
+														 SY_ASYNCHRONOUS_DETACHED,
 														 (ServiceData *) data_p,
 														 GetDFWFieldTrialSubmissionServiceMetadata,
 														 NULL,
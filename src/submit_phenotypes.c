@@ -86,7 +86,7 @@ Service *GetPhenotypesSubmissionService (GrassrootsServer *grassroots_p)
 														 ClosePhenotypesSubmissionService,
 														 NULL,
 														 false,
-														 SY_SYNCHRONOUS,
+														 SY_ASYNCHRONOUS_DETACHED,
 														 (ServiceData *) data_p,
 														 GetPhenotypesSubmissionServiceMetadata,
 														 NULL,
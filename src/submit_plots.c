@@ -84,7 +84,7 @@ Service *GetPlotsSubmissionService (GrassrootsServer *grassroots_p)
 														 ClosePlotsSubmissionService,
 														 NULL,
 														 false,
-														 SY_SYNCHRONOUS,
+														 SY_ASYNCHRONOUS_DETACHED,
 														 (ServiceData *) data_p,
 														 GetPlotsSubmissionServiceMetadata,
 														 NULL,
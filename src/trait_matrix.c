@@ -0,0 +1,661 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * trait_matrix.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "trait_matrix.h"
+
+#include "filesystem_utils.h"
+#include "memory_allocations.h"
+#include "observation.h"
+#include "plot.h"
+#include "row.h"
+#include "streams.h"
+#include "study_cache_file.h"
+#include "string_utils.h"
+
+
+static const char S_MAGIC_S [] = "DFWT";
+
+#define S_MAGIC_LENGTH (4)
+
+#define S_HEADER_LENGTH (S_MAGIC_LENGTH + 4 + 4 + 4)
+
+#define S_PAD_TO_8(x) (((x) + 7) & ~((size_t) 7))
+
+
+static const char * const S_TRAIT_MATRIX_SUFFIX_S = "_traits.dfwt";
+
+
+/*
+ * The Study's Rows and, for each MeasuredVariable, the Observation
+ * chosen for each Row. The cells are stored a column at a time so
+ * that each column can be parsed in a single pass.
+ */
+typedef struct TraitMatrix
+{
+	const Row **tm_rows_pp;
+
+	uint32 tm_num_rows;
+
+	const char **tm_variable_names_ss;
+
+	uint32 tm_num_variables;
+
+	const Observation **tm_cells_pp;
+} TraitMatrix;
+
+
+static bool InitTraitMatrix (TraitMatrix *matrix_p, const Study *study_p, json_t *variables_p);
+
+static void ClearTraitMatrix (TraitMatrix *matrix_p);
+
+static bool IsPreferredObservation (const Observation *observation_p, const Observation *current_p);
+
+static void ParseTraitColumn (const Observation **cells_pp, const uint32 num_rows, double64 *values_p, unsigned char *bitmap_p);
+
+static unsigned char *SerialiseTraitMatrix (const TraitMatrix *matrix_p, size_t *length_p);
+
+static unsigned char *SetLittleEndianValue (unsigned char *buffer_p, uint64 value, const size_t num_bytes);
+
+static bool WriteTraitMatrixFile (const char *filename_s, const unsigned char *matrix_p, const size_t length);
+
+
+
+unsigned char *GetStudyTraitMatrix (const Study *study_p, size_t *length_p, uint32 *num_rows_p, uint32 *num_variables_p)
+{
+	unsigned char *data_p = NULL;
+
+	/*
+	 * The MeasuredVariable id of each column mapped to its index
+	 */
+	json_t *variables_p = json_object ();
+
+	if (variables_p)
+		{
+			TraitMatrix matrix;
+
+			if (InitTraitMatrix (&matrix, study_p, variables_p))
+				{
+					data_p = SerialiseTraitMatrix (&matrix, length_p);
+
+					if (data_p)
+						{
+							*num_rows_p = matrix.tm_num_rows;
+							*num_variables_p = matrix.tm_num_variables;
+						}
+
+					ClearTraitMatrix (&matrix);
+				}		/* if (InitTraitMatrix (&matrix, study_p, variables_p)) */
+
+			json_decref (variables_p);
+		}		/* if (variables_p) */
+
+	if (!data_p)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get trait matrix for study \"%s\"", study_p -> st_name_s);
+		}
+
+	return data_p;
+}
+
+
+bool AddStudyTraitMatrixToServiceJob (const char *id_s, ServiceJob *job_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if ((data_p -> dftsd_fd_path_s) && (data_p -> dftsd_fd_url_s))
+		{
+			bson_oid_t *id_p = GetBSONOidFromString (id_s);
+
+			if (id_p)
+				{
+					Study *study_p = GetStudyById (id_p, VF_STORAGE, data_p);
+
+					if (study_p)
+						{
+							if (GetStudyPlots (study_p, data_p))
+								{
+									size_t length = 0;
+									uint32 num_rows = 0;
+									uint32 num_variables = 0;
+									unsigned char *matrix_p = GetStudyTraitMatrix (study_p, &length, &num_rows, &num_variables);
+
+									if (matrix_p)
+										{
+											char *local_filename_s = ConcatenateStrings (id_s, S_TRAIT_MATRIX_SUFFIX_S);
+
+											if (local_filename_s)
+												{
+													char *filename_s = MakeFilename (data_p -> dftsd_fd_path_s, local_filename_s);
+
+													if (filename_s)
+														{
+															if (WriteTraitMatrixFile (filename_s, matrix_p, length))
+																{
+																	char *url_s = ConcatenateStrings (data_p -> dftsd_fd_url_s, local_filename_s);
+
+																	if (url_s)
+																		{
+																			json_t *matrix_json_p = json_pack ("{s:s,s:i,s:I,s:I,s:I}",
+																				"url", url_s,
+																				"version", TM_FORMAT_VERSION,
+																				"rows", (json_int_t) num_rows,
+																				"variables", (json_int_t) num_variables,
+																				"size", (json_int_t) length);
+
+																			if (matrix_json_p)
+																				{
+																					json_t *dest_record_p = GetResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, study_p -> st_name_s, matrix_json_p);
+
+																					if (dest_record_p)
+																						{
+																							if (AddResultToServiceJob (job_p, dest_record_p))
+																								{
+																									success_flag = true;
+																								}
+																							else
+																								{
+																									json_decref (dest_record_p);
+																								}
+																						}
+
+																					json_decref (matrix_json_p);
+																				}		/* if (matrix_json_p) */
+
+																			FreeCopiedString (url_s);
+																		}		/* if (url_s) */
+
+																}		/* if (WriteTraitMatrixFile (filename_s, matrix_p, length)) */
+
+															FreeCopiedString (filename_s);
+														}		/* if (filename_s) */
+
+													FreeCopiedString (local_filename_s);
+												}		/* if (local_filename_s) */
+
+											FreeMemory (matrix_p);
+										}		/* if (matrix_p) */
+
+								}		/* if (GetStudyPlots (study_p, data_p)) */
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get plots for study \"%s\"", study_p -> st_name_s);
+								}
+
+							FreeStudy (study_p);
+						}		/* if (study_p) */
+
+					FreeBSONOid (id_p);
+				}		/* if (id_p) */
+
+			if (!success_flag)
+				{
+					AddGeneralErrorMessageToServiceJob (job_p, "Failed to export the trait matrix for the Study");
+				}
+
+		}		/* if ((data_p -> dftsd_fd_path_s) && (data_p -> dftsd_fd_url_s)) */
+	else
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, "Trait matrix exports are not enabled on this server");
+		}
+
+	SetServiceJobStatus (job_p, success_flag ? OS_SUCCEEDED : OS_FAILED);
+
+	return success_flag;
+}
+
+
+
+/*
+ * static definitions
+ */
+
+
+/*
+ * Walk the Study's Plots and Rows twice, first to count the Rows and
+ * MeasuredVariables and then to pick the Observation for each cell.
+ */
+static bool InitTraitMatrix (TraitMatrix *matrix_p, const Study *study_p, json_t *variables_p)
+{
+	bool success_flag = true;
+	const PlotNode *plot_node_p = (const PlotNode *) (study_p -> st_plots_p -> ll_head_p);
+	size_t num_rows = 0;
+
+	matrix_p -> tm_rows_pp = NULL;
+	matrix_p -> tm_variable_names_ss = NULL;
+	matrix_p -> tm_cells_pp = NULL;
+
+	while (plot_node_p && success_flag)
+		{
+			const RowNode *row_node_p = (const RowNode *) (plot_node_p -> pn_plot_p -> pl_rows_p -> ll_head_p);
+
+			while (row_node_p && success_flag)
+				{
+					const ObservationNode *obs_node_p = (const ObservationNode *) (row_node_p -> rn_row_p -> ro_observations_p -> ll_head_p);
+
+					while (obs_node_p && success_flag)
+						{
+							const MeasuredVariable *variable_p = obs_node_p -> on_observation_p -> ob_phenotype_p;
+
+							if (variable_p && (variable_p -> mv_id_p))
+								{
+									char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+									bson_oid_to_string (variable_p -> mv_id_p, id_s);
+
+									if (!json_object_get (variables_p, id_s))
+										{
+											if (json_object_set_new (variables_p, id_s, json_integer ((json_int_t) json_object_size (variables_p))) != 0)
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add variable \"%s\" to trait matrix", id_s);
+													success_flag = false;
+												}
+										}
+								}
+
+							obs_node_p = (const ObservationNode *) (obs_node_p -> on_node.ln_next_p);
+						}
+
+					++ num_rows;
+					row_node_p = (const RowNode *) (row_node_p -> rn_node.ln_next_p);
+				}
+
+			plot_node_p = (const PlotNode *) (plot_node_p -> pn_node.ln_next_p);
+		}
+
+	matrix_p -> tm_num_rows = (uint32) num_rows;
+	matrix_p -> tm_num_variables = (uint32) json_object_size (variables_p);
+
+	if (success_flag)
+		{
+			const size_t num_cells = (size_t) (matrix_p -> tm_num_rows) * (size_t) (matrix_p -> tm_num_variables);
+
+			success_flag = false;
+
+			/* Allocate at least one entry so that an empty Study doesn't look like a failure */
+			matrix_p -> tm_rows_pp = (const Row **) AllocMemoryArray (num_rows + 1, sizeof (const Row *));
+			matrix_p -> tm_variable_names_ss = (const char **) AllocMemoryArray (matrix_p -> tm_num_variables + 1, sizeof (const char *));
+			matrix_p -> tm_cells_pp = (const Observation **) AllocMemoryArray (num_cells + 1, sizeof (const Observation *));
+
+			if ((matrix_p -> tm_rows_pp) && (matrix_p -> tm_variable_names_ss) && (matrix_p -> tm_cells_pp))
+				{
+					uint32 row_index = 0;
+
+					plot_node_p = (const PlotNode *) (study_p -> st_plots_p -> ll_head_p);
+
+					while (plot_node_p)
+						{
+							const RowNode *row_node_p = (const RowNode *) (plot_node_p -> pn_plot_p -> pl_rows_p -> ll_head_p);
+
+							while (row_node_p)
+								{
+									const ObservationNode *obs_node_p = (const ObservationNode *) (row_node_p -> rn_row_p -> ro_observations_p -> ll_head_p);
+
+									* ((matrix_p -> tm_rows_pp) + row_index) = row_node_p -> rn_row_p;
+
+									while (obs_node_p)
+										{
+											const Observation *observation_p = obs_node_p -> on_observation_p;
+											const MeasuredVariable *variable_p = observation_p -> ob_phenotype_p;
+
+											if (variable_p && (variable_p -> mv_id_p))
+												{
+													char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+													void *iterator_p;
+
+													bson_oid_to_string (variable_p -> mv_id_p, id_s);
+													iterator_p = json_object_iter_at (variables_p, id_s);
+
+													if (iterator_p)
+														{
+															const size_t variable_index = (size_t) json_integer_value (json_object_iter_value (iterator_p));
+															const Observation **cell_pp = (matrix_p -> tm_cells_pp) + (variable_index * num_rows) + row_index;
+															const char **name_ss = (matrix_p -> tm_variable_names_ss) + variable_index;
+
+															if (! (*name_ss))
+																{
+																	*name_ss = GetMeasuredVariableName (variable_p);
+
+																	/* The key stays valid for as long as variables_p does */
+																	if (! (*name_ss))
+																		{
+																			*name_ss = json_object_iter_key (iterator_p);
+																		}
+																}
+
+															if ((! (*cell_pp)) || (IsPreferredObservation (observation_p, *cell_pp)))
+																{
+																	*cell_pp = observation_p;
+																}
+														}
+												}
+
+											obs_node_p = (const ObservationNode *) (obs_node_p -> on_node.ln_next_p);
+										}
+
+									++ row_index;
+									row_node_p = (const RowNode *) (row_node_p -> rn_node.ln_next_p);
+								}
+
+							plot_node_p = (const PlotNode *) (plot_node_p -> pn_node.ln_next_p);
+						}
+
+					success_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate trait matrix of " UINT32_FMT " rows and " UINT32_FMT " variables for study \"%s\"", matrix_p -> tm_num_rows, matrix_p -> tm_num_variables, study_p -> st_name_s);
+					ClearTraitMatrix (matrix_p);
+				}
+
+		}		/* if (success_flag) */
+
+	return success_flag;
+}
+
+
+static void ClearTraitMatrix (TraitMatrix *matrix_p)
+{
+	if (matrix_p -> tm_rows_pp)
+		{
+			FreeMemory (matrix_p -> tm_rows_pp);
+			matrix_p -> tm_rows_pp = NULL;
+		}
+
+	if (matrix_p -> tm_variable_names_ss)
+		{
+			FreeMemory (matrix_p -> tm_variable_names_ss);
+			matrix_p -> tm_variable_names_ss = NULL;
+		}
+
+	if (matrix_p -> tm_cells_pp)
+		{
+			FreeMemory (matrix_p -> tm_cells_pp);
+			matrix_p -> tm_cells_pp = NULL;
+		}
+
+	matrix_p -> tm_num_rows = 0;
+	matrix_p -> tm_num_variables = 0;
+}
+
+
+/*
+ * Is observation_p newer than current_p? An Observation without a
+ * start date is older than any with one and, on the same day, a
+ * corrected value wins over a raw one.
+ */
+static bool IsPreferredObservation (const Observation *observation_p, const Observation *current_p)
+{
+	const struct tm *date_p = observation_p -> ob_start_date_p;
+	const struct tm *current_date_p = current_p -> ob_start_date_p;
+
+	if (date_p && current_date_p)
+		{
+			if (date_p -> tm_year != current_date_p -> tm_year)
+				{
+					return (date_p -> tm_year > current_date_p -> tm_year);
+				}
+
+			if (date_p -> tm_mon != current_date_p -> tm_mon)
+				{
+					return (date_p -> tm_mon > current_date_p -> tm_mon);
+				}
+
+			if (date_p -> tm_mday != current_date_p -> tm_mday)
+				{
+					return (date_p -> tm_mday > current_date_p -> tm_mday);
+				}
+		}
+	else if (date_p || current_date_p)
+		{
+			return (date_p != NULL);
+		}
+
+	return ((!IsStringEmpty (observation_p -> ob_corrected_value_s)) && (IsStringEmpty (current_p -> ob_corrected_value_s)));
+}
+
+
+/*
+ * Parse a whole column at once so that the loop only touches that
+ * column's cells, values and bitmap.
+ */
+static void ParseTraitColumn (const Observation **cells_pp, const uint32 num_rows, double64 *values_p, unsigned char *bitmap_p)
+{
+	uint32 i;
+
+	memset (bitmap_p, 0, (num_rows + 7) / 8);
+
+	for (i = 0; i < num_rows; ++ i, ++ cells_pp, ++ values_p)
+		{
+			if ((*cells_pp) && (GetObservationValueAsReal (*cells_pp, values_p)))
+				{
+					* (bitmap_p + (i >> 3)) |= (unsigned char) (1 << (i & 7));
+				}
+			else
+				{
+					*values_p = NAN;
+				}
+		}
+}
+
+
+static unsigned char *SerialiseTraitMatrix (const TraitMatrix *matrix_p, size_t *length_p)
+{
+	const uint32 num_rows = matrix_p -> tm_num_rows;
+	const uint32 num_variables = matrix_p -> tm_num_variables;
+	const size_t bitmap_length = ((size_t) num_rows + 7) / 8;
+	size_t names_length = 0;
+	size_t accessions_length = 0;
+	size_t length;
+	uint32 i;
+	unsigned char *data_p = NULL;
+	double64 *values_p = (double64 *) AllocMemoryArray ((size_t) num_rows + 1, sizeof (double64));
+	unsigned char *bitmap_p = (unsigned char *) AllocMemoryArray (bitmap_length + 1, sizeof (unsigned char));
+
+	for (i = 0; i < num_variables; ++ i)
+		{
+			names_length += 4 + strlen (* ((matrix_p -> tm_variable_names_ss) + i));
+		}
+
+	for (i = 0; i < num_rows; ++ i)
+		{
+			const Material *material_p = (* ((matrix_p -> tm_rows_pp) + i)) -> ro_material_p;
+
+			if (material_p && (material_p -> ma_accession_s))
+				{
+					accessions_length += strlen (material_p -> ma_accession_s);
+				}
+		}
+
+	length = S_PAD_TO_8 (S_HEADER_LENGTH + names_length);
+	length += 16 * (size_t) num_rows;
+	length += S_PAD_TO_8 (4 * ((size_t) num_rows + 1) + accessions_length);
+	length += num_variables * (S_PAD_TO_8 (bitmap_length) + 8 * (size_t) num_rows);
+
+	if (values_p && bitmap_p)
+		{
+			/* The memory starts zeroed so the padding doesn't need writing */
+			data_p = (unsigned char *) AllocMemoryArray (length, sizeof (unsigned char));
+
+			if (data_p)
+				{
+					unsigned char *cursor_p = data_p;
+					uint32 offset = 0;
+
+					memcpy (cursor_p, S_MAGIC_S, S_MAGIC_LENGTH);
+					cursor_p += S_MAGIC_LENGTH;
+					cursor_p = SetLittleEndianValue (cursor_p, TM_FORMAT_VERSION, 4);
+					cursor_p = SetLittleEndianValue (cursor_p, num_rows, 4);
+					cursor_p = SetLittleEndianValue (cursor_p, num_variables, 4);
+
+					for (i = 0; i < num_variables; ++ i)
+						{
+							const char *name_s = * ((matrix_p -> tm_variable_names_ss) + i);
+							const size_t name_length = strlen (name_s);
+
+							cursor_p = SetLittleEndianValue (cursor_p, name_length, 4);
+							memcpy (cursor_p, name_s, name_length);
+							cursor_p += name_length;
+						}
+
+					cursor_p = data_p + S_PAD_TO_8 (cursor_p - data_p);
+
+					for (i = 0; i < num_rows; ++ i)
+						{
+							cursor_p = SetLittleEndianValue (cursor_p, (* ((matrix_p -> tm_rows_pp) + i)) -> ro_by_study_index, 4);
+						}
+
+					for (i = 0; i < num_rows; ++ i)
+						{
+							cursor_p = SetLittleEndianValue (cursor_p, (* ((matrix_p -> tm_rows_pp) + i)) -> ro_replicate_index, 4);
+						}
+
+					for (i = 0; i < num_rows; ++ i)
+						{
+							cursor_p = SetLittleEndianValue (cursor_p, (* ((matrix_p -> tm_rows_pp) + i)) -> ro_plot_p -> pl_row_index, 4);
+						}
+
+					for (i = 0; i < num_rows; ++ i)
+						{
+							cursor_p = SetLittleEndianValue (cursor_p, (* ((matrix_p -> tm_rows_pp) + i)) -> ro_plot_p -> pl_column_index, 4);
+						}
+
+					/*
+					 * The offsets, followed by the accessions themselves
+					 */
+					for (i = 0; i < num_rows; ++ i)
+						{
+							const Material *material_p = (* ((matrix_p -> tm_rows_pp) + i)) -> ro_material_p;
+
+							cursor_p = SetLittleEndianValue (cursor_p, offset, 4);
+
+							if (material_p && (material_p -> ma_accession_s))
+								{
+									offset += (uint32) strlen (material_p -> ma_accession_s);
+								}
+						}
+
+					cursor_p = SetLittleEndianValue (cursor_p, offset, 4);
+
+					for (i = 0; i < num_rows; ++ i)
+						{
+							const Material *material_p = (* ((matrix_p -> tm_rows_pp) + i)) -> ro_material_p;
+
+							if (material_p && (material_p -> ma_accession_s))
+								{
+									const size_t accession_length = strlen (material_p -> ma_accession_s);
+
+									memcpy (cursor_p, material_p -> ma_accession_s, accession_length);
+									cursor_p += accession_length;
+								}
+						}
+
+					cursor_p = data_p + S_PAD_TO_8 (cursor_p - data_p);
+
+					for (i = 0; i < num_variables; ++ i)
+						{
+							uint32 j;
+
+							ParseTraitColumn ((matrix_p -> tm_cells_pp) + ((size_t) i * num_rows), num_rows, values_p, bitmap_p);
+
+							memcpy (cursor_p, bitmap_p, bitmap_length);
+							cursor_p += S_PAD_TO_8 (bitmap_length);
+
+							for (j = 0; j < num_rows; ++ j)
+								{
+									uint64 bits;
+
+									memcpy (&bits, values_p + j, sizeof (bits));
+									cursor_p = SetLittleEndianValue (cursor_p, bits, 8);
+								}
+						}
+
+					*length_p = length;
+				}		/* if (data_p) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " bytes for trait matrix", length);
+				}
+
+		}		/* if (values_p && bitmap_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate trait matrix column buffers for " UINT32_FMT " rows", num_rows);
+		}
+
+	if (values_p)
+		{
+			FreeMemory (values_p);
+		}
+
+	if (bitmap_p)
+		{
+			FreeMemory (bitmap_p);
+		}
+
+	return data_p;
+}
+
+
+static unsigned char *SetLittleEndianValue (unsigned char *buffer_p, uint64 value, const size_t num_bytes)
+{
+	size_t i;
+
+	for (i = 0; i < num_bytes; ++ i, ++ buffer_p)
+		{
+			*buffer_p = (unsigned char) (value & 0xFF);
+			value >>= 8;
+		}
+
+	return buffer_p;
+}
+
+
+/*
+ * Write to a temporary file which is then renamed so that a client
+ * never downloads a partially-written matrix.
+ */
+static bool WriteTraitMatrixFile (const char *filename_s, const unsigned char *matrix_p, const size_t length)
+{
+	bool success_flag = false;
+	char *temp_filename_s = NULL;
+	FILE *matrix_f = OpenTemporaryFile (filename_s, &temp_filename_s);
+
+	if (matrix_f)
+		{
+			if (fwrite (matrix_p, 1, length, matrix_f) == length)
+				{
+					success_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write trait matrix to \"%s\"", temp_filename_s);
+				}
+
+			success_flag = ReplaceWithTemporaryFile (matrix_f, temp_filename_s, success_flag, filename_s);
+		}		/* if (matrix_f) */
+
+	return success_flag;
+}
@@ -0,0 +1,1423 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * trait_statistics.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <math.h>
+#include <string.h>
+
+#define ALLOCATE_TRAIT_STATISTICS_TAGS (1)
+#include "trait_statistics.h"
+
+#include "dfw_util.h"
+#include "json_util.h"
+#include "measured_variable.h"
+#include "memory_allocations.h"
+#include "mongodb_tool.h"
+#include "mongodb_util.h"
+#include "row.h"
+#include "study.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+/*
+ * The number of times to retry saving a document that
+ * another upload has changed since it was read.
+ */
+static const int S_MAX_NUM_SAVE_ATTEMPTS = 8;
+
+static const int S_DUPLICATE_KEY_ERROR = 11000;
+
+
+typedef enum
+{
+	TSS_SAVED,
+	TSS_CONFLICT,
+	TSS_FAILED
+} TraitStatisticsSaveStatus;
+
+
+/*
+ * The progress of saving a TraitStatisticsNode over
+ * one or more attempts.
+ */
+typedef struct TraitStatisticsUpdate
+{
+	const TraitStatisticsNode *tsu_node_p;
+
+	char *tsu_id_s;
+
+	/* The stored statistics with any changes applied */
+	TraitStatistics tsu_stats;
+
+	/* The revision that tsu_stats was read at */
+	int64 tsu_revision;
+
+	/* Does tsu_stats need rebuilding from the Study's Plots? */
+	bool tsu_rebuild_flag;
+
+	TraitStatisticsSaveStatus tsu_status;
+} TraitStatisticsUpdate;
+
+
+static void FreeTraitStatisticsNode (ListItem *node_p);
+
+static TraitStatisticsNode *GetTraitStatisticsNode (LinkedList *stats_p, const MeasuredVariable *variable_p);
+
+static void ClearTraitStatistics (TraitStatistics *ts_p);
+
+static void AddValueToTraitStatistics (TraitStatistics *ts_p, const double64 value);
+
+static void MergeTraitStatistics (TraitStatistics *ts_p, const TraitStatistics *other_p);
+
+static bool UnmergeTraitStatistics (TraitStatistics *ts_p, const TraitStatistics *other_p);
+
+static int64 GetHistogramBinIndex (const double64 value, const int32 exponent);
+
+static int64 HalveBinIndex (const int64 index);
+
+static void CoarsenHistogram (TraitStatistics *ts_p);
+
+static bool GetHistogramRange (const TraitStatistics *ts_p, int64 *first_p, int64 *last_p);
+
+static void FitHistogram (TraitStatistics *ts_p, int64 first, int64 last);
+
+static bool AddHistogram (TraitStatistics *ts_p, const TraitStatistics *other_p, const int64 sign);
+
+static char *GetTraitStatisticsId (const bson_oid_t *study_id_p, const bson_oid_t *variable_id_p);
+
+static size_t SaveTraitStatisticsUpdates (const bson_oid_t *study_id_p, TraitStatisticsUpdate *updates_p, const size_t num_updates, const bool recompute_flag, const FieldTrialServiceData *data_p);
+
+static void GetRecomputedTraitStatistics (const LinkedList *recomputed_stats_p, const bson_oid_t *variable_id_p, TraitStatistics *ts_p);
+
+static LinkedList *RecomputeStudyTraitStatistics (const bson_oid_t *study_id_p, const FieldTrialServiceData *data_p);
+
+static bool GetStoredTraitStatistics (const char *id_s, TraitStatistics *ts_p, int64 *revision_p, const FieldTrialServiceData *data_p);
+
+static bool GetTraitStatisticsFromJSON (const json_t *doc_p, TraitStatistics *ts_p, int64 *revision_p);
+
+static TraitStatisticsSaveStatus UpdateStoredTraitStatistics (const char *id_s, const bson_oid_t *study_id_p, const TraitStatisticsNode *node_p, const TraitStatistics *ts_p, const int64 revision, const FieldTrialServiceData *data_p);
+
+static bool AppendTraitStatisticsToBSON (bson_t *doc_p, const TraitStatistics *ts_p);
+
+static json_t *GetTraitStatisticsSummaryAsJSON (const json_t *doc_p);
+
+
+
+bool AddTraitStatisticsIndexes (const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	bson_t *command_p = BCON_NEW ("createIndexes", BCON_UTF8 (TS_COLLECTION_S),
+																"indexes", "[",
+																	"{",
+																		"key", "{", RO_STUDY_ID_S, BCON_INT32 (1), TS_NAME_S, BCON_INT32 (1), "}",
+																		"name", BCON_UTF8 ("study_id_name"),
+																	"}",
+																"]");
+
+	if (command_p)
+		{
+			bson_t *reply_p = NULL;
+
+			if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p))
+				{
+					success_flag = true;
+
+					if (reply_p)
+						{
+							bson_destroy (reply_p);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add indexes to \"%s\"", TS_COLLECTION_S);
+				}
+
+			bson_destroy (command_p);
+		}		/* if (command_p) */
+
+	return success_flag;
+}
+
+
+LinkedList *AllocateTraitStatisticsList (void)
+{
+	return AllocateLinkedList (FreeTraitStatisticsNode);
+}
+
+
+bool AddObservationToTraitStatistics (LinkedList *stats_p, const Observation *observation_p)
+{
+	bool success_flag = true;
+	double64 value;
+
+	if (GetObservationValueAsReal (observation_p, &value))
+		{
+			TraitStatisticsNode *node_p = GetTraitStatisticsNode (stats_p, observation_p -> ob_phenotype_p);
+
+			if (node_p)
+				{
+					AddValueToTraitStatistics (& (node_p -> tsn_added), value);
+				}
+			else
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+bool RemoveObservationFromTraitStatistics (LinkedList *stats_p, const Observation *observation_p)
+{
+	bool success_flag = true;
+	double64 value;
+
+	if (GetObservationValueAsReal (observation_p, &value))
+		{
+			TraitStatisticsNode *node_p = GetTraitStatisticsNode (stats_p, observation_p -> ob_phenotype_p);
+
+			if (node_p)
+				{
+					AddValueToTraitStatistics (& (node_p -> tsn_removed), value);
+				}
+			else
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+bool GetStudyTraitStatisticsRevisions (const bson_oid_t *study_id_p, LinkedList *stats_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, TS_COLLECTION_S))
+		{
+			bson_t *query_p = BCON_NEW (RO_STUDY_ID_S, BCON_OID (study_id_p));
+
+			if (query_p)
+				{
+					json_t *results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, NULL);
+
+					if (results_p)
+						{
+							TraitStatisticsNode *node_p = (TraitStatisticsNode *) (stats_p -> ll_head_p);
+
+							success_flag = true;
+
+							while (node_p)
+								{
+									char *id_s = GetTraitStatisticsId (study_id_p, & (node_p -> tsn_variable_id));
+
+									node_p -> tsn_revision = -1;
+
+									if (id_s)
+										{
+											size_t i;
+											const json_t *doc_p;
+
+											/*
+											 * If there isn't a stored document yet, its revision is 0
+											 */
+											node_p -> tsn_revision = 0;
+
+											json_array_foreach (results_p, i, doc_p)
+												{
+													const char *doc_id_s = GetJSONString (doc_p, MONGO_ID_S);
+
+													if ((doc_id_s) && (strcmp (doc_id_s, id_s) == 0))
+														{
+															const json_t *revision_p = json_object_get (doc_p, TS_REVISION_S);
+
+															node_p -> tsn_revision = json_is_integer (revision_p) ? (int64) json_integer_value (revision_p) : -1;
+														}
+												}
+
+											FreeCopiedString (id_s);
+										}
+
+									if (node_p -> tsn_revision < 0)
+										{
+											success_flag = false;
+										}
+
+									node_p = (TraitStatisticsNode *) (node_p -> tsn_node.ln_next_p);
+								}
+
+							json_decref (results_p);
+						}		/* if (results_p) */
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, TS_COLLECTION_S)) */
+
+	if (!success_flag)
+		{
+			char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+			bson_oid_to_string (study_id_p, id_s);
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get all of the trait statistics revisions for study \"%s\", they will be rebuilt", id_s);
+		}
+
+	return success_flag;
+}
+
+
+bool SaveStudyTraitStatistics (const bson_oid_t *study_id_p, LinkedList *stats_p, const bool recompute_flag, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = true;
+	const size_t num_updates = stats_p -> ll_size;
+
+	if (num_updates > 0)
+		{
+			TraitStatisticsUpdate *updates_p = (TraitStatisticsUpdate *) AllocMemoryArray (num_updates, sizeof (TraitStatisticsUpdate));
+
+			success_flag = false;
+
+			if (updates_p)
+				{
+					const TraitStatisticsNode *node_p = (const TraitStatisticsNode *) (stats_p -> ll_head_p);
+					TraitStatisticsUpdate *update_p = updates_p;
+					size_t num_left = num_updates;
+					size_t i;
+					int j;
+
+					for (i = 0; i < num_updates; ++ i, ++ update_p)
+						{
+							update_p -> tsu_node_p = node_p;
+							update_p -> tsu_id_s = GetTraitStatisticsId (study_id_p, & (node_p -> tsn_variable_id));
+							update_p -> tsu_status = (update_p -> tsu_id_s) ? TSS_CONFLICT : TSS_FAILED;
+
+							node_p = (const TraitStatisticsNode *) (node_p -> tsn_node.ln_next_p);
+						}
+
+					/*
+					 * If another upload changes any of the documents between them
+					 * being read and written, then start again with the new versions.
+					 */
+					for (j = 0; (j < S_MAX_NUM_SAVE_ATTEMPTS) && (num_left > 0); ++ j)
+						{
+							num_left = SaveTraitStatisticsUpdates (study_id_p, updates_p, num_updates, recompute_flag, data_p);
+						}
+
+					success_flag = true;
+
+					for (i = 0, update_p = updates_p; i < num_updates; ++ i, ++ update_p)
+						{
+							if (update_p -> tsu_status != TSS_SAVED)
+								{
+									char variable_id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+									bson_oid_to_string (& (update_p -> tsu_node_p -> tsn_variable_id), variable_id_s);
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to save trait statistics for variable \"%s\"", update_p -> tsu_node_p -> tsn_variable_name_s ? update_p -> tsu_node_p -> tsn_variable_name_s : variable_id_s);
+
+									success_flag = false;
+								}
+
+							if (update_p -> tsu_id_s)
+								{
+									FreeCopiedString (update_p -> tsu_id_s);
+								}
+						}
+
+					FreeMemory (updates_p);
+				}		/* if (updates_p) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " trait statistics updates", num_updates);
+				}
+
+		}		/* if (num_updates > 0) */
+
+	return success_flag;
+}
+
+
+bool RemoveStudyTraitStatistics (const bson_oid_t *study_id_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, TS_COLLECTION_S))
+		{
+			bson_t *query_p = BCON_NEW (RO_STUDY_ID_S, BCON_OID (study_id_p));
+
+			if (query_p)
+				{
+					success_flag = RemoveMongoDocumentsByBSON (data_p -> dftsd_mongo_p, query_p, false);
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+		}
+
+	if (!success_flag)
+		{
+			char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+			bson_oid_to_string (study_id_p, id_s);
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to remove study \"%s\" from \"%s\"", id_s, TS_COLLECTION_S);
+		}
+
+	return success_flag;
+}
+
+
+json_t *GetStudyTraitStatisticsAsJSON (const bson_oid_t *study_id_p, const FieldTrialServiceData *data_p)
+{
+	json_t *summaries_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, TS_COLLECTION_S))
+		{
+			bson_t *query_p = BCON_NEW (RO_STUDY_ID_S, BCON_OID (study_id_p));
+
+			if (query_p)
+				{
+					bson_t *opts_p = BCON_NEW ("sort", "{", TS_NAME_S, BCON_INT32 (1), "}");
+
+					if (opts_p)
+						{
+							json_t *results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, opts_p);
+
+							if (results_p)
+								{
+									summaries_p = json_array ();
+
+									if (summaries_p)
+										{
+											const size_t num_results = json_array_size (results_p);
+											size_t i;
+
+											for (i = 0; i < num_results; ++ i)
+												{
+													const json_t *doc_p = json_array_get (results_p, i);
+													json_t *summary_p = GetTraitStatisticsSummaryAsJSON (doc_p);
+
+													if (summary_p)
+														{
+															if (json_array_append_new (summaries_p, summary_p) != 0)
+																{
+																	PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Failed to add trait statistics summary");
+																}
+														}
+												}
+
+										}		/* if (summaries_p) */
+
+									json_decref (results_p);
+								}		/* if (results_p) */
+							else
+								{
+									PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, query_p, "Failed to get results from \"%s\"", TS_COLLECTION_S);
+								}
+
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, TS_COLLECTION_S)) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set collection to \"%s\"", TS_COLLECTION_S);
+		}
+
+	return summaries_p;
+}
+
+
+bool AddStudyTraitStatisticsToServiceJob (const char *id_s, ServiceJob *job_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	bson_oid_t *id_p = GetBSONOidFromString (id_s);
+
+	if (id_p)
+		{
+			json_t *summaries_p = GetStudyTraitStatisticsAsJSON (id_p, data_p);
+
+			if (summaries_p)
+				{
+					json_t *dest_record_p = GetResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, id_s, summaries_p);
+
+					if (dest_record_p)
+						{
+							if (AddResultToServiceJob (job_p, dest_record_p))
+								{
+									success_flag = true;
+								}
+							else
+								{
+									json_decref (dest_record_p);
+								}
+						}
+
+					json_decref (summaries_p);
+				}		/* if (summaries_p) */
+
+			FreeBSONOid (id_p);
+		}		/* if (id_p) */
+
+	if (!success_flag)
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, "Failed to get the trait statistics for the Study");
+		}
+
+	SetServiceJobStatus (job_p, success_flag ? OS_SUCCEEDED : OS_FAILED);
+
+	return success_flag;
+}
+
+
+
+/*
+ * static definitions
+ */
+
+
+static void FreeTraitStatisticsNode (ListItem *node_p)
+{
+	TraitStatisticsNode *ts_node_p = (TraitStatisticsNode *) node_p;
+
+	if (ts_node_p -> tsn_variable_name_s)
+		{
+			FreeCopiedString (ts_node_p -> tsn_variable_name_s);
+		}
+
+	FreeMemory (ts_node_p);
+}
+
+
+static TraitStatisticsNode *GetTraitStatisticsNode (LinkedList *stats_p, const MeasuredVariable *variable_p)
+{
+	TraitStatisticsNode *node_p = NULL;
+
+	if (variable_p && (variable_p -> mv_id_p))
+		{
+			node_p = (TraitStatisticsNode *) (stats_p -> ll_head_p);
+
+			while (node_p)
+				{
+					if (bson_oid_equal (& (node_p -> tsn_variable_id), variable_p -> mv_id_p))
+						{
+							return node_p;
+						}
+
+					node_p = (TraitStatisticsNode *) (node_p -> tsn_node.ln_next_p);
+				}
+
+			node_p = (TraitStatisticsNode *) AllocMemory (sizeof (TraitStatisticsNode));
+
+			if (node_p)
+				{
+					const char *name_s = GetMeasuredVariableName (variable_p);
+
+					node_p -> tsn_node.ln_prev_p = NULL;
+					node_p -> tsn_node.ln_next_p = NULL;
+
+					bson_oid_copy (variable_p -> mv_id_p, & (node_p -> tsn_variable_id));
+					ClearTraitStatistics (& (node_p -> tsn_added));
+					ClearTraitStatistics (& (node_p -> tsn_removed));
+
+					/* Until it has been read, the stored revision is unknown */
+					node_p -> tsn_revision = -1;
+
+					node_p -> tsn_variable_name_s = NULL;
+
+					if ((!name_s) || ((node_p -> tsn_variable_name_s = EasyCopyToNewString (name_s)) != NULL))
+						{
+							LinkedListAddTail (stats_p, & (node_p -> tsn_node));
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to copy variable name \"%s\"", name_s);
+							FreeMemory (node_p);
+							node_p = NULL;
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate TraitStatisticsNode");
+				}
+
+		}		/* if (variable_p && (variable_p -> mv_id_p)) */
+
+	return node_p;
+}
+
+
+static void ClearTraitStatistics (TraitStatistics *ts_p)
+{
+	memset (ts_p, 0, sizeof (TraitStatistics));
+}
+
+
+static void AddValueToTraitStatistics (TraitStatistics *ts_p, const double64 value)
+{
+	double64 delta;
+
+	if (ts_p -> ts_count == 0)
+		{
+			/*
+			 * Start with bins that are roughly a sixteenth of the
+			 * value's magnitude wide and centre them on it.
+			 */
+			ClearTraitStatistics (ts_p);
+
+			ts_p -> ts_min = value;
+			ts_p -> ts_max = value;
+			ts_p -> ts_bin_exponent = (value != 0.0) ? (ilogb (value) - 4) : 0;
+			ts_p -> ts_first_bin = GetHistogramBinIndex (value, ts_p -> ts_bin_exponent) - (TS_NUM_HISTOGRAM_BINS / 2);
+		}
+	else
+		{
+			if (value < ts_p -> ts_min)
+				{
+					ts_p -> ts_min = value;
+				}
+
+			if (value > ts_p -> ts_max)
+				{
+					ts_p -> ts_max = value;
+				}
+		}
+
+	++ (ts_p -> ts_count);
+
+	delta = value - (ts_p -> ts_mean);
+	ts_p -> ts_mean += delta / (double64) (ts_p -> ts_count);
+	ts_p -> ts_m2 += delta * (value - (ts_p -> ts_mean));
+
+	FitHistogram (ts_p, GetHistogramBinIndex (value, ts_p -> ts_bin_exponent), GetHistogramBinIndex (value, ts_p -> ts_bin_exponent));
+	++ (ts_p -> ts_bins [GetHistogramBinIndex (value, ts_p -> ts_bin_exponent) - (ts_p -> ts_first_bin)]);
+}
+
+
+/*
+ * Chan et al.'s parallel form of Welford's method.
+ */
+static void MergeTraitStatistics (TraitStatistics *ts_p, const TraitStatistics *other_p)
+{
+	if (other_p -> ts_count > 0)
+		{
+			if (ts_p -> ts_count > 0)
+				{
+					const double64 count = (double64) (ts_p -> ts_count + other_p -> ts_count);
+					const double64 delta = (other_p -> ts_mean) - (ts_p -> ts_mean);
+
+					ts_p -> ts_mean += delta * ((double64) (other_p -> ts_count)) / count;
+					ts_p -> ts_m2 += (other_p -> ts_m2) + (delta * delta * ((double64) (ts_p -> ts_count)) * ((double64) (other_p -> ts_count)) / count);
+					ts_p -> ts_count += other_p -> ts_count;
+
+					if (other_p -> ts_min < ts_p -> ts_min)
+						{
+							ts_p -> ts_min = other_p -> ts_min;
+						}
+
+					if (other_p -> ts_max > ts_p -> ts_max)
+						{
+							ts_p -> ts_max = other_p -> ts_max;
+						}
+
+					AddHistogram (ts_p, other_p, 1);
+				}
+			else
+				{
+					*ts_p = *other_p;
+				}
+		}
+}
+
+
+/*
+ * The inverse of MergeTraitStatistics (), taking the values in other_p
+ * back out of ts_p. The smallest and largest values can't be recovered
+ * so they are left as they are.
+ *
+ * Returns false if other_p has more values than ts_p or values in bins
+ * that ts_p doesn't have, as they can't all have been merged into it.
+ */
+static bool UnmergeTraitStatistics (TraitStatistics *ts_p, const TraitStatistics *other_p)
+{
+	bool success_flag = true;
+
+	if (other_p -> ts_count > 0)
+		{
+			const int64 count = (ts_p -> ts_count) - (other_p -> ts_count);
+
+			if (count > 0)
+				{
+					const double64 mean = (((double64) (ts_p -> ts_count)) * (ts_p -> ts_mean) - ((double64) (other_p -> ts_count)) * (other_p -> ts_mean)) / (double64) count;
+					const double64 delta = (other_p -> ts_mean) - mean;
+
+					ts_p -> ts_m2 -= (other_p -> ts_m2) + (delta * delta * ((double64) count) * ((double64) (other_p -> ts_count)) / (double64) (ts_p -> ts_count));
+
+					/* Guard against rounding errors */
+					if (ts_p -> ts_m2 < 0.0)
+						{
+							ts_p -> ts_m2 = 0.0;
+						}
+
+					ts_p -> ts_mean = mean;
+					ts_p -> ts_count = count;
+
+					success_flag = AddHistogram (ts_p, other_p, -1);
+				}
+			else if (count == 0)
+				{
+					success_flag = AddHistogram (ts_p, other_p, -1);
+					ClearTraitStatistics (ts_p);
+				}
+			else
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+static int64 GetHistogramBinIndex (const double64 value, const int32 exponent)
+{
+	return (int64) floor (ldexp (value, -exponent));
+}
+
+
+/*
+ * Get the index of the bin that a bin falls into when the
+ * width doubles, rounding towards minus infinity.
+ */
+static int64 HalveBinIndex (const int64 index)
+{
+	return (index >= 0) ? (index / 2) : -((1 - index) / 2);
+}
+
+
+/*
+ * Double the width of the bins, merging each pair of adjacent bins.
+ */
+static void CoarsenHistogram (TraitStatistics *ts_p)
+{
+	int64 bins [TS_NUM_HISTOGRAM_BINS];
+	const int64 first_bin = HalveBinIndex (ts_p -> ts_first_bin);
+	int i;
+
+	memset (bins, 0, sizeof (bins));
+
+	for (i = 0; i < TS_NUM_HISTOGRAM_BINS; ++ i)
+		{
+			bins [HalveBinIndex ((ts_p -> ts_first_bin) + i) - first_bin] += ts_p -> ts_bins [i];
+		}
+
+	memcpy (ts_p -> ts_bins, bins, sizeof (bins));
+	ts_p -> ts_first_bin = first_bin;
+	++ (ts_p -> ts_bin_exponent);
+}
+
+
+/*
+ * Get the indexes of the first and last non-empty bins.
+ */
+static bool GetHistogramRange (const TraitStatistics *ts_p, int64 *first_p, int64 *last_p)
+{
+	bool found_flag = false;
+	int i;
+
+	for (i = 0; i < TS_NUM_HISTOGRAM_BINS; ++ i)
+		{
+			if (ts_p -> ts_bins [i] != 0)
+				{
+					if (!found_flag)
+						{
+							*first_p = (ts_p -> ts_first_bin) + i;
+							found_flag = true;
+						}
+
+					*last_p = (ts_p -> ts_first_bin) + i;
+				}
+		}
+
+	return found_flag;
+}
+
+
+/*
+ * Make the histogram cover the bins from first to last, at its current
+ * width, as well as all of its non-empty bins. The bins are widened until
+ * they fit and then the occupied bins are centred.
+ */
+static void FitHistogram (TraitStatistics *ts_p, int64 first, int64 last)
+{
+	int64 used_first;
+	int64 used_last;
+
+	if (GetHistogramRange (ts_p, &used_first, &used_last))
+		{
+			if (used_first < first)
+				{
+					first = used_first;
+				}
+
+			if (used_last > last)
+				{
+					last = used_last;
+				}
+		}
+
+	if ((first < ts_p -> ts_first_bin) || (last >= (ts_p -> ts_first_bin) + TS_NUM_HISTOGRAM_BINS))
+		{
+			int64 bins [TS_NUM_HISTOGRAM_BINS];
+			int64 first_bin;
+			int i;
+
+			while (last - first >= TS_NUM_HISTOGRAM_BINS)
+				{
+					CoarsenHistogram (ts_p);
+					first = HalveBinIndex (first);
+					last = HalveBinIndex (last);
+				}
+
+			first_bin = first - ((TS_NUM_HISTOGRAM_BINS - (last - first + 1)) / 2);
+			memset (bins, 0, sizeof (bins));
+
+			for (i = 0; i < TS_NUM_HISTOGRAM_BINS; ++ i)
+				{
+					if (ts_p -> ts_bins [i] != 0)
+						{
+							bins [(ts_p -> ts_first_bin) + i - first_bin] = ts_p -> ts_bins [i];
+						}
+				}
+
+			memcpy (ts_p -> ts_bins, bins, sizeof (bins));
+			ts_p -> ts_first_bin = first_bin;
+		}
+}
+
+
+/*
+ * Add, or subtract if sign is -1, the bins of one histogram to
+ * another, first bringing them to the same width.
+ *
+ * Returns false if subtracting would leave any bin below zero.
+ */
+static bool AddHistogram (TraitStatistics *ts_p, const TraitStatistics *other_p, const int64 sign)
+{
+	bool success_flag = true;
+	TraitStatistics other = *other_p;
+	int64 other_first;
+	int64 other_last;
+	int i;
+
+	while (ts_p -> ts_bin_exponent < other.ts_bin_exponent)
+		{
+			CoarsenHistogram (ts_p);
+		}
+
+	while (GetHistogramRange (&other, &other_first, &other_last))
+		{
+			while (other.ts_bin_exponent < ts_p -> ts_bin_exponent)
+				{
+					CoarsenHistogram (&other);
+				}
+
+			GetHistogramRange (&other, &other_first, &other_last);
+
+			if ((other_first >= ts_p -> ts_first_bin) && (other_last < (ts_p -> ts_first_bin) + TS_NUM_HISTOGRAM_BINS))
+				{
+					for (i = 0; i < TS_NUM_HISTOGRAM_BINS; ++ i)
+						{
+							if (other.ts_bins [i] != 0)
+								{
+									int64 *bin_p = ts_p -> ts_bins + (other.ts_first_bin + i - (ts_p -> ts_first_bin));
+
+									*bin_p += sign * other.ts_bins [i];
+
+									if (*bin_p < 0)
+										{
+											*bin_p = 0;
+											success_flag = false;
+										}
+								}
+						}
+
+					return success_flag;
+				}
+
+			FitHistogram (ts_p, other_first, other_last);
+		}
+
+	return success_flag;
+}
+
+
+static char *GetTraitStatisticsId (const bson_oid_t *study_id_p, const bson_oid_t *variable_id_p)
+{
+	char study_id_s [MONGO_OID_STRING_BUFFER_SIZE];
+	char variable_id_s [MONGO_OID_STRING_BUFFER_SIZE];
+	char *id_s = NULL;
+
+	bson_oid_to_string (study_id_p, study_id_s);
+	bson_oid_to_string (variable_id_p, variable_id_s);
+
+	id_s = ConcatenateVarargsStrings (study_id_s, "_", variable_id_s, NULL);
+
+	if (!id_s)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to make trait statistics id for study \"%s\" and variable \"%s\"", study_id_s, variable_id_s);
+		}
+
+	return id_s;
+}
+
+
+/*
+ * Make one attempt at saving each of the updates that another upload
+ * got in the way of last time, returning how many of them still need
+ * another attempt.
+ *
+ * An upload's changes are only merged into a stored document that is
+ * still at the revision it had before the upload's values were saved.
+ * Otherwise another upload may have rebuilt it from Plots that already
+ * include them, so it is rebuilt again instead. The same happens if
+ * the replaced values can't be taken back out of it or not all of the
+ * changes were saved.
+ *
+ * All of the documents are read before the Study's Plots so that a
+ * rebuild can't miss any values that a document already includes.
+ */
+static size_t SaveTraitStatisticsUpdates (const bson_oid_t *study_id_p, TraitStatisticsUpdate *updates_p, const size_t num_updates, const bool recompute_flag, const FieldTrialServiceData *data_p)
+{
+	size_t num_left = 0;
+	size_t num_to_rebuild = 0;
+	TraitStatisticsUpdate *update_p = updates_p;
+	size_t i;
+
+	for (i = 0; i < num_updates; ++ i, ++ update_p)
+		{
+			if (update_p -> tsu_status == TSS_CONFLICT)
+				{
+					const TraitStatisticsNode *node_p = update_p -> tsu_node_p;
+
+					update_p -> tsu_status = TSS_FAILED;
+					update_p -> tsu_rebuild_flag = true;
+
+					if (GetStoredTraitStatistics (update_p -> tsu_id_s, & (update_p -> tsu_stats), & (update_p -> tsu_revision), data_p))
+						{
+							if ((!recompute_flag) && (update_p -> tsu_revision > 0) && (update_p -> tsu_revision == node_p -> tsn_revision))
+								{
+									MergeTraitStatistics (& (update_p -> tsu_stats), & (node_p -> tsn_added));
+
+									if (UnmergeTraitStatistics (& (update_p -> tsu_stats), & (node_p -> tsn_removed)))
+										{
+											update_p -> tsu_rebuild_flag = false;
+											update_p -> tsu_status = UpdateStoredTraitStatistics (update_p -> tsu_id_s, study_id_p, node_p, & (update_p -> tsu_stats), update_p -> tsu_revision, data_p);
+										}
+								}
+
+							if (update_p -> tsu_rebuild_flag)
+								{
+									++ num_to_rebuild;
+								}
+						}
+
+				}		/* if (update_p -> tsu_status == TSS_CONFLICT) */
+
+		}		/* for (i = 0; i < num_updates; ++ i, ++ update_p) */
+
+
+	if (num_to_rebuild > 0)
+		{
+			LinkedList *recomputed_stats_p = RecomputeStudyTraitStatistics (study_id_p, data_p);
+
+			if (recomputed_stats_p)
+				{
+					for (i = 0, update_p = updates_p; i < num_updates; ++ i, ++ update_p)
+						{
+							if ((update_p -> tsu_status == TSS_FAILED) && (update_p -> tsu_rebuild_flag))
+								{
+									GetRecomputedTraitStatistics (recomputed_stats_p, & (update_p -> tsu_node_p -> tsn_variable_id), & (update_p -> tsu_stats));
+									update_p -> tsu_status = UpdateStoredTraitStatistics (update_p -> tsu_id_s, study_id_p, update_p -> tsu_node_p, & (update_p -> tsu_stats), update_p -> tsu_revision, data_p);
+								}
+						}
+
+					FreeLinkedList (recomputed_stats_p);
+				}
+
+		}		/* if (num_to_rebuild > 0) */
+
+
+	for (i = 0, update_p = updates_p; i < num_updates; ++ i, ++ update_p)
+		{
+			if (update_p -> tsu_status == TSS_CONFLICT)
+				{
+					++ num_left;
+				}
+		}
+
+	return num_left;
+}
+
+
+/*
+ * Get the statistics for a MeasuredVariable from those rebuilt from
+ * the Study's stored Plots. If none of the Study's values are for the
+ * variable, its statistics are empty.
+ */
+static void GetRecomputedTraitStatistics (const LinkedList *recomputed_stats_p, const bson_oid_t *variable_id_p, TraitStatistics *ts_p)
+{
+	const TraitStatisticsNode *node_p = (const TraitStatisticsNode *) (recomputed_stats_p -> ll_head_p);
+
+	ClearTraitStatistics (ts_p);
+
+	while (node_p)
+		{
+			if (bson_oid_equal (& (node_p -> tsn_variable_id), variable_id_p))
+				{
+					*ts_p = node_p -> tsn_added;
+					node_p = NULL;
+				}
+			else
+				{
+					node_p = (const TraitStatisticsNode *) (node_p -> tsn_node.ln_next_p);
+				}
+		}
+}
+
+
+/*
+ * Add the values of all of the Observations in a Study's stored Plots
+ * to a new list of TraitStatisticsNodes.
+ */
+static LinkedList *RecomputeStudyTraitStatistics (const bson_oid_t *study_id_p, const FieldTrialServiceData *data_p)
+{
+	LinkedList *stats_p = NULL;
+	bson_oid_t id;
+	Study *study_p = NULL;
+
+	bson_oid_copy (study_id_p, &id);
+	study_p = GetStudyById (&id, VF_STORAGE, data_p);
+
+	if (study_p)
+		{
+			if (GetStudyPlots (study_p, data_p))
+				{
+					stats_p = AllocateTraitStatisticsList ();
+
+					if (stats_p)
+						{
+							bool success_flag = true;
+							PlotNode *plot_node_p = (PlotNode *) (study_p -> st_plots_p -> ll_head_p);
+
+							while (plot_node_p && success_flag)
+								{
+									RowNode *row_node_p = (RowNode *) (plot_node_p -> pn_plot_p -> pl_rows_p -> ll_head_p);
+
+									while (row_node_p && success_flag)
+										{
+											Row *row_p = row_node_p -> rn_row_p;
+
+											if (row_p -> ro_observations_p)
+												{
+													ObservationNode *observation_node_p = (ObservationNode *) (row_p -> ro_observations_p -> ll_head_p);
+
+													while (observation_node_p && success_flag)
+														{
+															success_flag = AddObservationToTraitStatistics (stats_p, observation_node_p -> on_observation_p);
+															observation_node_p = (ObservationNode *) (observation_node_p -> on_node.ln_next_p);
+														}
+												}
+
+											row_node_p = (RowNode *) (row_node_p -> rn_node.ln_next_p);
+										}
+
+									plot_node_p = (PlotNode *) (plot_node_p -> pn_node.ln_next_p);
+								}
+
+							if (!success_flag)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to recompute trait statistics for study \"%s\"", study_p -> st_name_s);
+									FreeLinkedList (stats_p);
+									stats_p = NULL;
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate trait statistics list for study \"%s\"", study_p -> st_name_s);
+						}
+
+				}		/* if (GetStudyPlots (study_p, data_p)) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get plots for study \"%s\"", study_p -> st_name_s);
+				}
+
+			FreeStudy (study_p);
+		}		/* if (study_p) */
+	else
+		{
+			char id_s [MONGO_OID_STRING_BUFFER_SIZE];
+
+			bson_oid_to_string (study_id_p, id_s);
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get study \"%s\"", id_s);
+		}
+
+	return stats_p;
+}
+
+
+/*
+ * Get the stored statistics, or empty ones with a revision of 0 if
+ * there aren't any yet.
+ */
+static bool GetStoredTraitStatistics (const char *id_s, TraitStatistics *ts_p, int64 *revision_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+
+	ClearTraitStatistics (ts_p);
+	*revision_p = 0;
+
+	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, TS_COLLECTION_S))
+		{
+			bson_t *query_p = BCON_NEW (MONGO_ID_S, BCON_UTF8 (id_s));
+
+			if (query_p)
+				{
+					json_t *results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, NULL);
+
+					if (results_p)
+						{
+							const size_t num_results = json_array_size (results_p);
+
+							if (num_results == 0)
+								{
+									success_flag = true;
+								}
+							else if (num_results == 1)
+								{
+									success_flag = GetTraitStatisticsFromJSON (json_array_get (results_p, 0), ts_p, revision_p);
+								}
+							else
+								{
+									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, results_p, "Multiple trait statistics for \"%s\"", id_s);
+								}
+
+							json_decref (results_p);
+						}		/* if (results_p) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get trait statistics for \"%s\"", id_s);
+						}
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, TS_COLLECTION_S)) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set collection to \"%s\"", TS_COLLECTION_S);
+		}
+
+	return success_flag;
+}
+
+
+static bool GetTraitStatisticsFromJSON (const json_t *doc_p, TraitStatistics *ts_p, int64 *revision_p)
+{
+	const json_t *histogram_p = json_object_get (doc_p, TS_HISTOGRAM_S);
+	const json_t *bins_p = json_object_get (histogram_p, TS_BINS_S);
+
+	if ((json_array_size (bins_p) == TS_NUM_HISTOGRAM_BINS) && (json_is_integer (json_object_get (doc_p, TS_REVISION_S))) && (json_is_integer (json_object_get (doc_p, TS_COUNT_S))))
+		{
+			size_t i;
+
+			*revision_p = (int64) json_integer_value (json_object_get (doc_p, TS_REVISION_S));
+
+			ts_p -> ts_count = (int64) json_integer_value (json_object_get (doc_p, TS_COUNT_S));
+			ts_p -> ts_mean = json_number_value (json_object_get (doc_p, TS_MEAN_S));
+			ts_p -> ts_m2 = json_number_value (json_object_get (doc_p, TS_M2_S));
+			ts_p -> ts_min = json_number_value (json_object_get (doc_p, TS_MIN_S));
+			ts_p -> ts_max = json_number_value (json_object_get (doc_p, TS_MAX_S));
+			ts_p -> ts_bin_exponent = (int32) json_integer_value (json_object_get (histogram_p, TS_BIN_EXPONENT_S));
+			ts_p -> ts_first_bin = (int64) json_integer_value (json_object_get (histogram_p, TS_FIRST_BIN_S));
+
+			for (i = 0; i < TS_NUM_HISTOGRAM_BINS; ++ i)
+				{
+					ts_p -> ts_bins [i] = (int64) json_integer_value (json_array_get (bins_p, i));
+				}
+
+			return true;
+		}
+
+	PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Invalid trait statistics");
+
+	return false;
+}
+
+
+/*
+ * Replace the stored document as long as it is still at the given
+ * revision. A new document is only inserted if there wasn't one before.
+ */
+static TraitStatisticsSaveStatus UpdateStoredTraitStatistics (const char *id_s, const bson_oid_t *study_id_p, const TraitStatisticsNode *node_p, const TraitStatistics *ts_p, const int64 revision, const FieldTrialServiceData *data_p)
+{
+	TraitStatisticsSaveStatus status = TSS_FAILED;
+	bson_t *doc_p = BCON_NEW (MONGO_ID_S, BCON_UTF8 (id_s),
+														RO_STUDY_ID_S, BCON_OID (study_id_p),
+														OB_PHENOTYPE_ID_S, BCON_OID (& (node_p -> tsn_variable_id)),
+														TS_REVISION_S, BCON_INT64 (revision + 1));
+
+	if (doc_p)
+		{
+			if (((! (node_p -> tsn_variable_name_s)) || (BSON_APPEND_UTF8 (doc_p, TS_NAME_S, node_p -> tsn_variable_name_s))) && (AppendTraitStatisticsToBSON (doc_p, ts_p)))
+				{
+					bson_t *command_p = BCON_NEW ("update", BCON_UTF8 (TS_COLLECTION_S),
+																				"updates", "[",
+																					"{",
+																						"q", "{", MONGO_ID_S, BCON_UTF8 (id_s), TS_REVISION_S, BCON_INT64 (revision), "}",
+																						"u", BCON_DOCUMENT (doc_p),
+																						"upsert", BCON_BOOL (revision == 0),
+																					"}",
+																				"]");
+
+					if (command_p)
+						{
+							bson_t *reply_p = NULL;
+
+							if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p))
+								{
+									if (reply_p)
+										{
+											json_t *reply_json_p = ConvertBSONToJSON (reply_p);
+
+											if (reply_json_p)
+												{
+													const json_t *write_errors_p = json_object_get (reply_json_p, "writeErrors");
+
+													if (json_array_size (write_errors_p) > 0)
+														{
+															const json_t *code_p = json_object_get (json_array_get (write_errors_p, 0), "code");
+
+															/*
+															 * Another upload inserted the document first
+															 */
+															if (json_integer_value (code_p) == S_DUPLICATE_KEY_ERROR)
+																{
+																	status = TSS_CONFLICT;
+																}
+															else
+																{
+																	PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, write_errors_p, "Failed to save trait statistics \"%s\"", id_s);
+																}
+														}
+													else if (json_integer_value (json_object_get (reply_json_p, "n")) == 1)
+														{
+															status = TSS_SAVED;
+														}
+													else
+														{
+															/*
+															 * Another upload changed the document first
+															 */
+															status = TSS_CONFLICT;
+														}
+
+													json_decref (reply_json_p);
+												}		/* if (reply_json_p) */
+
+											bson_destroy (reply_p);
+										}		/* if (reply_p) */
+
+								}		/* if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p)) */
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to run update for trait statistics \"%s\"", id_s);
+								}
+
+							bson_destroy (command_p);
+						}		/* if (command_p) */
+
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to build trait statistics document \"%s\"", id_s);
+				}
+
+			bson_destroy (doc_p);
+		}		/* if (doc_p) */
+
+	return status;
+}
+
+
+static bool AppendTraitStatisticsToBSON (bson_t *doc_p, const TraitStatistics *ts_p)
+{
+	bool success_flag = false;
+
+	if ((BSON_APPEND_INT64 (doc_p, TS_COUNT_S, ts_p -> ts_count)) &&
+			(BSON_APPEND_DOUBLE (doc_p, TS_MEAN_S, ts_p -> ts_mean)) &&
+			(BSON_APPEND_DOUBLE (doc_p, TS_M2_S, ts_p -> ts_m2)) &&
+			(BSON_APPEND_DOUBLE (doc_p, TS_MIN_S, ts_p -> ts_min)) &&
+			(BSON_APPEND_DOUBLE (doc_p, TS_MAX_S, ts_p -> ts_max)))
+		{
+			bson_t histogram;
+
+			if (BSON_APPEND_DOCUMENT_BEGIN (doc_p, TS_HISTOGRAM_S, &histogram))
+				{
+					if ((BSON_APPEND_INT32 (&histogram, TS_BIN_EXPONENT_S, ts_p -> ts_bin_exponent)) && (BSON_APPEND_INT64 (&histogram, TS_FIRST_BIN_S, ts_p -> ts_first_bin)))
+						{
+							bson_t bins;
+
+							if (BSON_APPEND_ARRAY_BEGIN (&histogram, TS_BINS_S, &bins))
+								{
+									uint32 i;
+
+									success_flag = true;
+
+									for (i = 0; (i < TS_NUM_HISTOGRAM_BINS) && success_flag; ++ i)
+										{
+											const char *key_s;
+											char buffer_s [16];
+
+											bson_uint32_to_string (i, &key_s, buffer_s, sizeof (buffer_s));
+
+											if (!BSON_APPEND_INT64 (&bins, key_s, ts_p -> ts_bins [i]))
+												{
+													success_flag = false;
+												}
+										}
+
+									if (!bson_append_array_end (&histogram, &bins))
+										{
+											success_flag = false;
+										}
+								}
+						}
+
+					if (!bson_append_document_end (doc_p, &histogram))
+						{
+							success_flag = false;
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * The stored document with its sample standard deviation and with
+ * the histogram trimmed to the bins between its first and last values.
+ */
+static json_t *GetTraitStatisticsSummaryAsJSON (const json_t *doc_p)
+{
+	TraitStatistics stats;
+	int64 revision;
+
+	if (GetTraitStatisticsFromJSON (doc_p, &stats, &revision))
+		{
+			json_t *summary_p = json_object ();
+
+			if (summary_p)
+				{
+					bool success_flag = false;
+					json_t *variable_id_p = json_object_get (doc_p, OB_PHENOTYPE_ID_S);
+					json_t *name_p = json_object_get (doc_p, TS_NAME_S);
+
+					if (((!variable_id_p) || (json_object_set (summary_p, OB_PHENOTYPE_ID_S, variable_id_p) == 0)) &&
+							((!name_p) || (json_object_set (summary_p, TS_NAME_S, name_p) == 0)) &&
+							(SetJSONInteger (summary_p, TS_COUNT_S, stats.ts_count)))
+						{
+							int64 first;
+							int64 last;
+
+							success_flag = true;
+
+							if ((stats.ts_count > 0) && (GetHistogramRange (&stats, &first, &last)))
+								{
+									json_t *bins_p = json_array ();
+
+									success_flag = false;
+
+									if (bins_p)
+										{
+											json_t *histogram_p = NULL;
+											int64 i;
+
+											for (i = first; i <= last; ++ i)
+												{
+													if (json_array_append_new (bins_p, json_integer ((json_int_t) (stats.ts_bins [i - stats.ts_first_bin]))) != 0)
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add histogram bin " INT64_FMT, i);
+															json_decref (bins_p);
+															bins_p = NULL;
+															i = last;
+														}
+												}
+
+											/* The bins are stolen even if this fails */
+											if (bins_p)
+												{
+													histogram_p = json_pack ("{s:f,s:f,s:o}", TS_START_S, ldexp ((double64) first, stats.ts_bin_exponent), TS_BIN_WIDTH_S, ldexp (1.0, stats.ts_bin_exponent), TS_BINS_S, bins_p);
+												}
+
+											if (histogram_p)
+												{
+													if (json_object_set_new (summary_p, TS_HISTOGRAM_S, histogram_p) == 0)
+														{
+															if ((SetJSONReal (summary_p, TS_MEAN_S, stats.ts_mean)) && (SetJSONReal (summary_p, TS_MIN_S, stats.ts_min)) && (SetJSONReal (summary_p, TS_MAX_S, stats.ts_max)))
+																{
+																	if (stats.ts_count > 1)
+																		{
+																			success_flag = SetJSONReal (summary_p, TS_SD_S, sqrt (stats.ts_m2 / (double64) (stats.ts_count - 1)));
+																		}
+																	else
+																		{
+																			success_flag = true;
+																		}
+																}
+														}
+												}		/* if (histogram_p) */
+
+										}		/* if (bins_p) */
+
+								}		/* if ((stats.ts_count > 0) && (GetHistogramRange (&stats, &first, &last))) */
+
+						}
+
+					if (success_flag)
+						{
+							return summary_p;
+						}
+
+					json_decref (summary_p);
+				}		/* if (summary_p) */
+
+		}		/* if (GetTraitStatisticsFromJSON (doc_p, &stats, &revision)) */
+
+	PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Failed to get trait statistics summary");
+
+	return NULL;
+}
@@ -22,6 +22,7 @@
 
 
 #include "treatment_factor_value.h"
+#include "list_index.h"
 #include "memory_allocations.h"
 #include "string_utils.h"
 
@@ -115,6 +116,20 @@ bool AreTreatmentFactorValuesMatching (const TreatmentFactorValue *tfv_0_p, cons
 }
 
 
+bool GetTreatmentFactorValueMatchHash (const TreatmentFactorValue *tfv_p, uint32 *hash_p)
+{
+	const bson_oid_t *id_p = GetTreatmentIdForTreatmentFactorValue (tfv_p);
+
+	if (id_p)
+		{
+			*hash_p = HashListIndexBytes (LI_HASH_SEED, id_p -> bytes, sizeof (id_p -> bytes));
+			return true;
+		}
+
+	return false;
+}
+
+
 const bson_oid_t *GetTreatmentIdForTreatmentFactorValue (const TreatmentFactorValue *tfv_p)
 {
 	const TreatmentFactor *tf_p = tfv_p -> tfv_factor_p;
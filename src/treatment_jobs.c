@@ -114,36 +114,46 @@ json_t *GetAllTreatmentsAsJSON (const FieldTrialServiceData *data_p, bson_t *opt
 json_t *GetTreatmentIndexingData (Service *service_p)
 {
 	FieldTrialServiceData *data_p = (FieldTrialServiceData *) (service_p -> se_data_p);
-	json_t *src_treatments_p = GetAllTreatmentsAsJSON (data_p, NULL);
+	json_t *treatments_p = GetAllTreatmentsAsJSON (data_p, NULL);
 
-	if (src_treatments_p)
+	if (treatments_p)
 		{
-			if (json_is_array (src_treatments_p))
-				{
-					size_t i;
-					json_t *src_treatment_p;
-					size_t num_added = 0;
-
-					json_array_foreach (src_treatments_p, i, src_treatment_p)
-						{
-							if (AddDatatype (src_treatment_p, DFTD_TREATMENT))
-								{
+			PrepareTreatmentsForIndexing (treatments_p, data_p);
 
-								}
+			return treatments_p;
+		}		/* if (treatments_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "No treatments for \"%s\"", GetServiceName (service_p));
+		}
 
+	return NULL;
+}
 
-						}		/* json_array_foreach (src_treatments_p, i, src_study_p) */
 
-				}		/* if (json_is_array (src_treatments_p)) */
+bool PrepareTreatmentsForIndexing (json_t *treatments_p, const FieldTrialServiceData * UNUSED_PARAM (data_p))
+{
+	bool success_flag = false;
 
-			return src_treatments_p;
-		}		/* if (src_treatments_p) */
-	else
+	if (json_is_array (treatments_p))
 		{
-			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "No programs for \"%s\"", GetServiceName (service_p));
-		}
+			size_t i;
+			json_t *treatment_p;
+			size_t num_added = 0;
 
-	return NULL;
+			json_array_foreach (treatments_p, i, treatment_p)
+				{
+					if (AddDatatype (treatment_p, DFTD_TREATMENT))
+						{
+							++ num_added;
+						}
+
+				}		/* json_array_foreach (treatments_p, i, treatment_p) */
+
+			success_flag = (num_added == json_array_size (treatments_p));
+		}		/* if (json_is_array (treatments_p)) */
+
+	return success_flag;
 }
 
 
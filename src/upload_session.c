@@ -0,0 +1,467 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * upload_session.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <string.h>
+#include <time.h>
+
+#define ALLOCATE_UPLOAD_SESSION_TAGS (1)
+#include "upload_session.h"
+
+#include "json_util.h"
+#include "memory_allocations.h"
+#include "mongodb_tool.h"
+#include "mongodb_util.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+static const char * const S_TYPE_S = "type";
+
+static const char * const S_STUDY_ID_S = "study_id";
+
+static const char * const S_UPLOAD_SESSION_S = "upload_session";
+
+
+static bool GetUploadSessionDocument (const char *session_id_s, json_t **doc_pp, const FieldTrialServiceData *data_p);
+
+static void AddUploadSessionError (ServiceJob *job_p, const NamedParameterType *session_param_p, const char *message_s);
+
+static bool ClaimUploadChunk (UploadChunk *chunk_p, const char *type_s, const char *study_id_s, const FieldTrialServiceData *data_p);
+
+static bool RunUploadSessionUpdate (bson_t *command_p, const UploadChunk *chunk_p, const FieldTrialServiceData *data_p);
+
+
+
+bool BeginUploadChunk (UploadChunk *chunk_p, const char *session_id_s, const char *type_s, const char *study_id_s, const int64 start_row, const size_t num_rows, ServiceJob *job_p, const NamedParameterType *session_param_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	json_t *session_p = NULL;
+
+	chunk_p -> uc_session_id_s = session_id_s;
+	chunk_p -> uc_start_row = start_row;
+	chunk_p -> uc_committed_rows = 0;
+	chunk_p -> uc_end_row = start_row + (int64) num_rows;
+	chunk_p -> uc_claimed_flag = false;
+
+	if (start_row >= 0)
+		{
+			if (GetUploadSessionDocument (session_id_s, &session_p, data_p))
+				{
+					if (session_p)
+						{
+							const char *session_type_s = GetJSONString (session_p, S_TYPE_S);
+							const char *session_study_id_s = GetJSONString (session_p, S_STUDY_ID_S);
+							const json_t *committed_rows_p = json_object_get (session_p, US_COMMITTED_ROWS_S);
+
+							/*
+							 * A session id can't be reused for a different table
+							 */
+							if ((session_type_s) && (strcmp (session_type_s, type_s) == 0) && (session_study_id_s) && (strcmp (session_study_id_s, study_id_s) == 0) && (json_is_integer (committed_rows_p)))
+								{
+									chunk_p -> uc_committed_rows = json_integer_value (committed_rows_p);
+									success_flag = true;
+								}
+							else
+								{
+									PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, session_p, "Upload session \"%s\" doesn't match type \"%s\" and study \"%s\"", session_id_s, type_s, study_id_s);
+									AddUploadSessionError (job_p, session_param_p, "The upload session belongs to a different table");
+								}
+
+							json_decref (session_p);
+						}
+					else
+						{
+							/* This is the first chunk of the session */
+							success_flag = true;
+						}
+
+					/*
+					 * A chunk after the checkpoint would leave rows missing
+					 */
+					if (success_flag && (start_row > chunk_p -> uc_committed_rows))
+						{
+							char *start_s = ConvertLongToString (start_row);
+							char *committed_s = ConvertLongToString (chunk_p -> uc_committed_rows);
+
+							if (start_s && committed_s)
+								{
+									char *error_s = ConcatenateVarargsStrings ("The chunk starts at row ", start_s, " but the upload session has only committed ", committed_s, " rows", NULL);
+
+									if (error_s)
+										{
+											AddUploadSessionError (job_p, session_param_p, error_s);
+											FreeCopiedString (error_s);
+										}
+								}
+
+							if (start_s)
+								{
+									FreeCopiedString (start_s);
+								}
+
+							if (committed_s)
+								{
+									FreeCopiedString (committed_s);
+								}
+
+							success_flag = false;
+						}		/* if (success_flag && (start_row > chunk_p -> uc_committed_rows)) */
+
+					/*
+					 * Claim any rows that still need applying before writing them
+					 */
+					if (success_flag && (chunk_p -> uc_end_row > chunk_p -> uc_committed_rows))
+						{
+							if (!ClaimUploadChunk (chunk_p, type_s, study_id_s, data_p))
+								{
+									AddUploadSessionError (job_p, session_param_p, "Another request is applying the rows of this upload session");
+									success_flag = false;
+								}
+						}
+
+				}		/* if (GetUploadSessionDocument (session_id_s, &session_p, data_p)) */
+			else
+				{
+					AddUploadSessionError (job_p, session_param_p, "Failed to get the upload session");
+				}
+
+		}		/* if (start_row >= 0) */
+	else
+		{
+			AddUploadSessionError (job_p, session_param_p, "The chunk can't start before the first row");
+		}
+
+	return success_flag;
+}
+
+
+json_t *GetUploadChunkRowsToApply (const UploadChunk *chunk_p, const json_t *rows_p)
+{
+	json_t *rows_to_apply_p = json_array ();
+
+	if (rows_to_apply_p)
+		{
+			const size_t num_rows = json_array_size (rows_p);
+			size_t i = 0;
+
+			if (chunk_p -> uc_committed_rows > chunk_p -> uc_start_row)
+				{
+					i = (size_t) (chunk_p -> uc_committed_rows - chunk_p -> uc_start_row);
+				}
+
+			while (i < num_rows)
+				{
+					if (json_array_append (rows_to_apply_p, json_array_get (rows_p, i)) == 0)
+						{
+							++ i;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add row " SIZET_FMT " of upload session \"%s\"", i, chunk_p -> uc_session_id_s);
+
+							json_decref (rows_to_apply_p);
+							rows_to_apply_p = NULL;
+							i = num_rows;
+						}
+				}
+
+		}		/* if (rows_to_apply_p) */
+
+	return rows_to_apply_p;
+}
+
+
+int64 GetUploadChunkFirstRowToApply (const UploadChunk *chunk_p)
+{
+	return (chunk_p -> uc_committed_rows > chunk_p -> uc_start_row) ? chunk_p -> uc_committed_rows : chunk_p -> uc_start_row;
+}
+
+
+bool CommitUploadChunk (UploadChunk *chunk_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (chunk_p -> uc_claimed_flag)
+		{
+			/*
+			 * Only the holder of the claim can move the checkpoint on
+			 */
+			bson_t *command_p = BCON_NEW ("update", BCON_UTF8 (US_UPLOAD_SESSIONS_S),
+																		"updates", "[",
+																			"{",
+																				"q", "{", MONGO_ID_S, BCON_UTF8 (chunk_p -> uc_session_id_s), US_COMMITTED_ROWS_S, BCON_INT64 (chunk_p -> uc_committed_rows), US_PENDING_ID_S, BCON_OID (& (chunk_p -> uc_claim_id)), "}",
+																				"u", "{",
+																					"$set", "{", US_COMMITTED_ROWS_S, BCON_INT64 (chunk_p -> uc_end_row), "}",
+																					"$unset", "{", US_PENDING_ID_S, BCON_UTF8 (""), US_PENDING_SINCE_S, BCON_UTF8 (""), "}",
+																				"}",
+																			"}",
+																		"]");
+
+			if (command_p)
+				{
+					if (RunUploadSessionUpdate (command_p, chunk_p, data_p))
+						{
+							chunk_p -> uc_committed_rows = chunk_p -> uc_end_row;
+							chunk_p -> uc_claimed_flag = false;
+							success_flag = true;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Upload session \"%s\" is no longer claimed by this request", chunk_p -> uc_session_id_s);
+						}
+
+					bson_destroy (command_p);
+				}		/* if (command_p) */
+
+		}		/* if (chunk_p -> uc_claimed_flag) */
+	else if (chunk_p -> uc_end_row <= chunk_p -> uc_committed_rows)
+		{
+			/* Every row had already been committed */
+			success_flag = true;
+		}
+
+	return success_flag;
+}
+
+
+void ReleaseUploadChunk (UploadChunk *chunk_p, const FieldTrialServiceData *data_p)
+{
+	if (chunk_p -> uc_claimed_flag)
+		{
+			bson_t *command_p = BCON_NEW ("update", BCON_UTF8 (US_UPLOAD_SESSIONS_S),
+																		"updates", "[",
+																			"{",
+																				"q", "{", MONGO_ID_S, BCON_UTF8 (chunk_p -> uc_session_id_s), US_PENDING_ID_S, BCON_OID (& (chunk_p -> uc_claim_id)), "}",
+																				"u", "{", "$unset", "{", US_PENDING_ID_S, BCON_UTF8 (""), US_PENDING_SINCE_S, BCON_UTF8 (""), "}", "}",
+																			"}",
+																		"]");
+
+			if (command_p)
+				{
+					if (!RunUploadSessionUpdate (command_p, chunk_p, data_p))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to release the claim on upload session \"%s\", it will expire instead", chunk_p -> uc_session_id_s);
+						}
+
+					bson_destroy (command_p);
+				}
+
+			chunk_p -> uc_claimed_flag = false;
+		}		/* if (chunk_p -> uc_claimed_flag) */
+}
+
+
+bool AddUploadChunkToServiceJob (const UploadChunk *chunk_p, ServiceJob *job_p)
+{
+	bool success_flag = false;
+	json_t *session_p = json_pack ("{s:s,s:I}",
+		"id", chunk_p -> uc_session_id_s,
+		US_COMMITTED_ROWS_S, (json_int_t) (chunk_p -> uc_committed_rows));
+
+	if (session_p)
+		{
+			if (! (job_p -> sj_metadata_p))
+				{
+					job_p -> sj_metadata_p = json_object ();
+				}
+
+			if (job_p -> sj_metadata_p)
+				{
+					if (json_object_set_new (job_p -> sj_metadata_p, S_UPLOAD_SESSION_S, session_p) == 0)
+						{
+							success_flag = true;
+						}
+				}
+			else
+				{
+					json_decref (session_p);
+				}
+		}		/* if (session_p) */
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add upload session \"%s\" to job metadata", chunk_p -> uc_session_id_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Claim the rows after the session's checkpoint. This only succeeds if the
+ * checkpoint hasn't moved since it was read and no other request holds an
+ * unexpired claim. For the first chunk of a session, the session doesn't
+ * exist yet and the upsert creates it. If another request created it
+ * first, the upsert fails on the duplicate id.
+ */
+static bool ClaimUploadChunk (UploadChunk *chunk_p, const char *type_s, const char *study_id_s, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	int timeout = US_DEFAULT_CLAIM_TIMEOUT;
+	time_t now = time (NULL);
+	bson_t *command_p = NULL;
+
+	if ((!GetJSONInteger (data_p -> dftsd_base_data.sd_config_p, "upload_session_claim_timeout", &timeout)) || (timeout < 0))
+		{
+			timeout = US_DEFAULT_CLAIM_TIMEOUT;
+		}
+
+	bson_oid_init (& (chunk_p -> uc_claim_id), NULL);
+
+	command_p = BCON_NEW ("update", BCON_UTF8 (US_UPLOAD_SESSIONS_S),
+												"updates", "[",
+													"{",
+														"q", "{",
+															MONGO_ID_S, BCON_UTF8 (chunk_p -> uc_session_id_s),
+															US_COMMITTED_ROWS_S, BCON_INT64 (chunk_p -> uc_committed_rows),
+															"$or", "[",
+																"{", US_PENDING_ID_S, "{", "$exists", BCON_BOOL (false), "}", "}",
+																"{", US_PENDING_SINCE_S, "{", "$lt", BCON_INT64 ((int64) (now - timeout)), "}", "}",
+															"]",
+														"}",
+														"u", "{", "$set", "{",
+															US_PENDING_ID_S, BCON_OID (& (chunk_p -> uc_claim_id)),
+															US_PENDING_SINCE_S, BCON_INT64 ((int64) now),
+															S_TYPE_S, BCON_UTF8 (type_s),
+															S_STUDY_ID_S, BCON_UTF8 (study_id_s),
+														"}", "}",
+														"upsert", BCON_BOOL (true),
+													"}",
+												"]");
+
+	if (command_p)
+		{
+			if (RunUploadSessionUpdate (command_p, chunk_p, data_p))
+				{
+					chunk_p -> uc_claimed_flag = true;
+					success_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Upload session \"%s\" is claimed by another request", chunk_p -> uc_session_id_s);
+				}
+
+			bson_destroy (command_p);
+		}		/* if (command_p) */
+
+	return success_flag;
+}
+
+
+/*
+ * Run an update of a single upload session and check that it was matched or upserted.
+ */
+static bool RunUploadSessionUpdate (bson_t *command_p, const UploadChunk *chunk_p, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+	bson_t *reply_p = NULL;
+
+	if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p))
+		{
+			if (reply_p)
+				{
+					json_t *reply_json_p = ConvertBSONToJSON (reply_p);
+
+					if (reply_json_p)
+						{
+							const json_t *num_updated_p = json_object_get (reply_json_p, "n");
+
+							if ((json_is_integer (num_updated_p)) && (json_integer_value (num_updated_p) == 1))
+								{
+									success_flag = true;
+								}
+							else
+								{
+									PrintJSONToErrors (STM_LEVEL_INFO, __FILE__, __LINE__, reply_json_p, "No match for upload session \"%s\"", chunk_p -> uc_session_id_s);
+								}
+
+							json_decref (reply_json_p);
+						}		/* if (reply_json_p) */
+
+					bson_destroy (reply_p);
+				}		/* if (reply_p) */
+
+		}		/* if (RunMongoCommand (data_p -> dftsd_mongo_p, command_p, &reply_p)) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to update upload session \"%s\"", chunk_p -> uc_session_id_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * If the session doesn't exist, *doc_pp is set to NULL.
+ */
+static bool GetUploadSessionDocument (const char *session_id_s, json_t **doc_pp, const FieldTrialServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (data_p -> dftsd_mongo_p, US_UPLOAD_SESSIONS_S))
+		{
+			bson_t *query_p = BCON_NEW (MONGO_ID_S, BCON_UTF8 (session_id_s));
+
+			if (query_p)
+				{
+					json_t *results_p = GetAllMongoResultsAsJSON (data_p -> dftsd_mongo_p, query_p, NULL);
+
+					*doc_pp = NULL;
+
+					/*
+					 * Only an empty set of results means that the session
+					 * doesn't exist yet, NULL means that the query failed.
+					 */
+					if (results_p)
+						{
+							json_t *doc_p = json_array_get (results_p, 0);
+
+							if (doc_p)
+								{
+									*doc_pp = json_incref (doc_p);
+								}
+
+							success_flag = true;
+							json_decref (results_p);
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to query upload session \"%s\"", session_id_s);
+						}
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> dftsd_mongo_p, US_UPLOAD_SESSIONS_S)) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set collection to \"%s\"", US_UPLOAD_SESSIONS_S);
+		}
+
+	return success_flag;
+}
+
+
+static void AddUploadSessionError (ServiceJob *job_p, const NamedParameterType *session_param_p, const char *message_s)
+{
+	AddParameterErrorMessageToServiceJob (job_p, session_param_p -> npt_name_s, session_param_p -> npt_type, message_s);
+}